@@ -279,6 +279,38 @@ BOOL GFX_PIPErecv(u8 *cmd, u32 *param)
 	return (TRUE);
 }
 
+// takes all the parameters of one command off the fifo at once, if they're all there.
+// nothing is taken when the next count entries aren't all for cmd.
+BOOL GFX_PIPErecvCommand(u8 cmd, u32 *params, u32 count)
+{
+	if (gxFIFO.size < count)
+		return FALSE;
+
+	u32 pos = gxFIFO.head;
+	for (u32 i = 0; i < count; i++)
+	{
+		if (gxFIFO.cmd[pos] != cmd)
+			return FALSE;
+		params[i] = gxFIFO.param[pos];
+		pos++;
+		if (pos > HACK_GXIFO_SIZE-1) pos = 0;
+	}
+
+	if(IsMatrixStackCommand(cmd))
+	{
+		gxFIFO.matrix_stack_op_size -= count;
+		if(gxFIFO.matrix_stack_op_size>0x10000000)
+			printf("bad news disaster in matrix_stack_op_size\n");
+	}
+
+	gxFIFO.head = pos;
+	gxFIFO.size -= count;
+
+	GXF_FIFO_handleEvents();
+
+	return (TRUE);
+}
+
 void GFX_FIFOcnt(u32 val)
 {
 	////INFO("gxFIFO: write cnt 0x%08X (prev 0x%08X) FIFO size %03i PIPE size %03i\n", val, gxstat, gxFIFO.size, gxPIPE.size);
@@ -73,6 +73,7 @@ void GFX_PIPEclear();
 void GFX_FIFOclear();
 void GFX_FIFOsend(u8 cmd, u32 param);
 BOOL GFX_PIPErecv(u8 *cmd, u32 *param);
+BOOL GFX_PIPErecvCommand(u8 cmd, u32 *params, u32 count);
 void GFX_FIFOcnt(u32 val);
 
 //=================================================== Display memory FIFO
@@ -34,6 +34,10 @@
 #include <tmmintrin.h>
 #endif
 
+#ifdef ENABLE_NEON
+#include <arm_neon.h>
+#endif
+
 #include "common.h"
 #include "MMU.h"
 #include "FIFO.h"
@@ -46,6 +50,8 @@
 #include "readwrite.h"
 #include "matrix.h"
 #include "emufile.h"
+#include "utils/task.h"
+#include <rthreads/rthreads.h>
 
 #ifdef FASTBUILD
 	#undef FORCEINLINE
@@ -62,6 +68,39 @@ GPUEngineBase::MosaicLookup GPUEngineBase::_mosaicLookup;
 
 GPUSubsystem *GPU = NULL;
 
+//scanlines which were handed to the render thread by GPUSubsystem::RenderLine().
+//line[next..queued) are still waiting to be rendered, and running is set while a
+//job is active on the task. all of these are guarded by lock.
+//journalEnd is how far the MMU's 2d journal went when each line was queued, and
+//journalApplied how far the render thread has applied it; only the render thread
+//touches journalApplied while a job is active.
+static struct
+{
+	Task task;
+	bool isTaskStarted;
+	slock_t *lock;
+	bool running;
+	size_t queued;
+	size_t next;
+	u16 line[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	bool skip[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	u32 journalEnd[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	u32 journalApplied;
+} _gpuDeferred;
+
+//renders the sub engine's scanline while the main engine renders its own one on the calling thread.
+static Task _gpuSubEngineTask;
+static bool _gpuSubEngineTaskStarted = false;
+
+//4bpp tiles decoded to one palette index per byte, indexed the same way as vram_tile_dirty.
+static CACHE_ALIGN u8 _gpuTileCache4bpp[VRAM_TILE_ENGINE_COUNT][64];
+
+//which of the pixels of each 32 bytes of tile data are transparent, indexed the same way as vram_tile_dirty.
+#define GPU_TILE_COVERAGE_SOLID 0x01	// some byte isn't zero
+#define GPU_TILE_COVERAGE_HOLE4 0x02	// some 4bpp pixel is zero
+#define GPU_TILE_COVERAGE_HOLE8 0x04	// some 8bpp pixel is zero
+static u8 _gpuTileCoverageCache[VRAM_TILE_ENGINE_COUNT];
+
 static size_t _gpuLargestDstLineCount = 1;
 static size_t _gpuVRAMBlockOffset = GPU_VRAM_BLOCK_LINES * GPU_FRAMEBUFFER_NATIVE_WIDTH;
 
@@ -72,6 +111,7 @@ static CACHE_ALIGN size_t _gpuDstPitchIndex[GPU_FRAMEBUFFER_NATIVE_WIDTH];	// Ke
 static CACHE_ALIGN size_t _gpuDstLineCount[GPU_FRAMEBUFFER_NATIVE_HEIGHT];	// Key: Source line index / Value: Number of destination lines for the source line
 static CACHE_ALIGN size_t _gpuDstLineIndex[GPU_FRAMEBUFFER_NATIVE_HEIGHT];	// Key: Source line index / Value: First destination line that maps to the source line
 static CACHE_ALIGN size_t _gpuCaptureLineIndex[GPU_VRAM_BLOCK_LINES + 1];	// Key: Source line index / Value: First destination line that maps to the source line
+static size_t _gpuDstPitchScale = 1;	// Number of destination pixels for every source pixel, or 0 if it varies between source pixels
 
 const CACHE_ALIGN SpriteSize GPUEngineBase::_sprSizeTab[4][4] = {
      {{8, 8}, {16, 8}, {8, 16}, {8, 8}},
@@ -115,52 +155,96 @@ const CACHE_ALIGN u8 GPUEngineBase::_winEmpty[GPU_FRAMEBUFFER_NATIVE_WIDTH] = {
 //			BACKGROUND RENDERING -ROTOSCALE-
 /*****************************************************************************/
 
-template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void rot_tiled_8bit_entry(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const int lg, const u32 map, const u32 tile, const u16 *pal, const size_t i)
-{
-	const u16 tileindex = *(u8*)MMU_gpu_map(map + ((auxX>>3) + (auxY>>3) * (lg>>3)));
-	const u16 x = auxX & 7;
-	const u16 y = auxY & 7;
-	const u8 palette_entry = *(u8*)MMU_gpu_map(tile + ((tileindex<<6)+(y<<3)+x));
-	const u16 color = LE_TO_LOCAL_16( pal[palette_entry] );
-	
-	gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
-}
-
-template<GPULayerID LAYERID, bool MOSAIC, bool extPal, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void rot_tiled_16bit_entry(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const int lg, const u32 map, const u32 tile, const u16 *pal, const size_t i)
+enum AffineMapType
 {
-	TILEENTRY tileentry;
-	tileentry.val = LE_TO_LOCAL_16( *(u16 *)MMU_gpu_map(map + (((auxX>>3) + (auxY>>3) * (lg>>3))<<1)) );
-	
-	const u16 x = ((tileentry.bits.HFlip) ? 7 - (auxX) : (auxX)) & 7;
-	const u16 y = ((tileentry.bits.VFlip) ? 7 - (auxY) : (auxY)) & 7;
-	const u8 palette_entry = *(u8*)MMU_gpu_map(tile + ((tileentry.bits.TileNum<<6)+(y<<3)+x));
-	const u16 color = LE_TO_LOCAL_16( pal[(palette_entry + (extPal ? (tileentry.bits.Palette<<8) : 0))] );
-	
-	gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
-}
+	AffineMap_Tiled8bit = 0,			// affine BG, 8-bit map entries
+	AffineMap_Tiled16bit,				// extended affine BG, 16-bit map entries
+	AffineMap_Tiled16bitExtPal,			// extended affine BG, 16-bit map entries using the extended palettes
+	AffineMap_Bitmap256,				// 256 color bitmap, also the large 8bpp BG
+	AffineMap_BitmapDirect,				// direct color bitmap
+	AffineMap_BitmapDirectCustomVRAM	// direct color bitmap showing the display capture at custom resolution
+};
 
-template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void rot_256_map(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const int lg, const u32 map, const u32 tile, const u16 *pal, const size_t i)
+// Returns the host address of the source row that holds line auxY of the BG: the
+// tile map row for tiled BGs, the bitmap row for bitmap BGs. Both are based on
+// at least 2KB aligned addresses and are never longer than 2KB, so a row never
+// straddles a 16KB VRAM page and a single lookup covers every pixel in it.
+template<AffineMapType MAPTYPE>
+FORCEINLINE const u8* rot_map_row(const s32 auxY, const s32 lg, const u32 map)
 {
-	const u8 palette_entry = *(u8*)MMU_gpu_map((map) + ((auxX + auxY * lg)));
-	const u16 color = LE_TO_LOCAL_16( pal[palette_entry] );
+	switch (MAPTYPE)
+	{
+		case AffineMap_Tiled8bit:
+			return (u8 *)MMU_gpu_map(map + ((auxY>>3) * (lg>>3)));
+			
+		case AffineMap_Tiled16bit:
+		case AffineMap_Tiled16bitExtPal:
+			return (u8 *)MMU_gpu_map(map + (((auxY>>3) * (lg>>3)) << 1));
+			
+		case AffineMap_Bitmap256:
+			return (u8 *)MMU_gpu_map(map + (auxY * lg));
+			
+		case AffineMap_BitmapDirect:
+		case AffineMap_BitmapDirectCustomVRAM:
+			return (u8 *)MMU_gpu_map(map + ((auxY * lg) << 1));
+	}
 	
-	gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
+	return NULL;
 }
 
-template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED, bool USECUSTOMVRAM>
-FORCEINLINE void rot_BMP_map(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const int lg, const u32 map, const u32 tile, const u16 *pal, const size_t i)
+template<GPULayerID LAYERID, AffineMapType MAPTYPE, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
+FORCEINLINE void rot_row_pixel(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const u8 *row, const u32 tile, const u16 *pal, const size_t i)
 {
-	const u16 color = LE_TO_LOCAL_16( *(u16 *)MMU_gpu_map((map) + ((auxX + auxY * lg) << 1)) );
-	
-	gpu->___setFinalColorBck<LAYERID, MOSAIC, false, 0, ISCUSTOMRENDERINGNEEDED, USECUSTOMVRAM>(color, i, ((color & 0x8000) != 0));
+	switch (MAPTYPE)
+	{
+		case AffineMap_Tiled8bit:
+		{
+			const u16 tileindex = row[auxX>>3];
+			const u16 x = auxX & 7;
+			const u16 y = auxY & 7;
+			const u8 palette_entry = *(u8*)MMU_gpu_map(tile + ((tileindex<<6)+(y<<3)+x));
+			const u16 color = LE_TO_LOCAL_16( pal[palette_entry] );
+			
+			gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
+			break;
+		}
+			
+		case AffineMap_Tiled16bit:
+		case AffineMap_Tiled16bitExtPal:
+		{
+			TILEENTRY tileentry;
+			tileentry.val = LE_TO_LOCAL_16( ((u16 *)row)[auxX>>3] );
+			
+			const u16 x = ((tileentry.bits.HFlip) ? 7 - (auxX) : (auxX)) & 7;
+			const u16 y = ((tileentry.bits.VFlip) ? 7 - (auxY) : (auxY)) & 7;
+			const u8 palette_entry = *(u8*)MMU_gpu_map(tile + ((tileentry.bits.TileNum<<6)+(y<<3)+x));
+			const u16 color = LE_TO_LOCAL_16( pal[(palette_entry + ((MAPTYPE == AffineMap_Tiled16bitExtPal) ? (tileentry.bits.Palette<<8) : 0))] );
+			
+			gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
+			break;
+		}
+			
+		case AffineMap_Bitmap256:
+		{
+			const u8 palette_entry = row[auxX];
+			const u16 color = LE_TO_LOCAL_16( pal[palette_entry] );
+			
+			gpu->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, i, (palette_entry != 0));
+			break;
+		}
+			
+		case AffineMap_BitmapDirect:
+		case AffineMap_BitmapDirectCustomVRAM:
+		{
+			const u16 color = LE_TO_LOCAL_16( ((u16 *)row)[auxX] );
+			
+			gpu->___setFinalColorBck<LAYERID, MOSAIC, false, 0, ISCUSTOMRENDERINGNEEDED, (MAPTYPE == AffineMap_BitmapDirectCustomVRAM)>(color, i, ((color & 0x8000) != 0));
+			break;
+		}
+	}
 }
 
-typedef void (*rot_fun)(GPUEngineBase *gpu, const s32 auxX, const s32 auxY, const int lg, const u32 map, const u32 tile, const u16 *pal, const size_t i);
-
-template<rot_fun fun, bool WRAP>
+template<GPULayerID LAYERID, AffineMapType MAPTYPE, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED, bool WRAP>
 void rot_scale_op(GPUEngineBase *gpu, const BGxPARMS &param, const u16 LG, const s32 wh, const s32 ht, const u32 map, const u32 tile, const u16 *pal)
 {
 	ROTOCOORD x, y;
@@ -170,26 +254,47 @@ void rot_scale_op(GPUEngineBase *gpu, const BGxPARMS &param, const u16 LG, const
 	const s32 dx = (s32)param.BGxPA;
 	const s32 dy = (s32)param.BGxPC;
 	
-	// as an optimization, specially handle the fairly common case of
-	// "unrotated + unscaled + no boundary checking required"
-	if (dx == GPU_FRAMEBUFFER_NATIVE_WIDTH && dy == 0)
+	// without rotation, which includes every plain or scaled full screen BG, the whole
+	// line is read from one source row, so the row only has to be looked up once
+	if (dy == 0)
 	{
-		s32 auxX = (WRAP) ? x.bits.Integer & (wh-1) : x.bits.Integer;
 		const s32 auxY = (WRAP) ? y.bits.Integer & (ht-1) : y.bits.Integer;
 		
-		if (WRAP || (auxX + LG < wh && auxX >= 0 && auxY < ht && auxY >= 0))
+		if (!WRAP && ((auxY < 0) || (auxY >= ht)))
+			return;
+		
+		const u8 *row = rot_map_row<MAPTYPE>(auxY, wh, map);
+		
+		// as an optimization, specially handle the fairly common case of
+		// "unrotated + unscaled + no boundary checking required"
+		if (dx == GPU_FRAMEBUFFER_NATIVE_WIDTH)
 		{
-			for (size_t i = 0; i < LG; i++)
+			s32 auxX = (WRAP) ? x.bits.Integer & (wh-1) : x.bits.Integer;
+			
+			if (WRAP || ((auxX >= 0) && (auxX + LG < wh)))
 			{
-				fun(gpu, auxX, auxY, wh, map, tile, pal, i);
-				auxX++;
+				for (size_t i = 0; i < LG; i++)
+				{
+					rot_row_pixel<LAYERID, MAPTYPE, MOSAIC, ISCUSTOMRENDERINGNEEDED>(gpu, auxX, auxY, row, tile, pal, i);
+					auxX++;
+					
+					if (WRAP)
+						auxX = auxX & (wh-1);
+				}
 				
-				if (WRAP)
-					auxX = auxX & (wh-1);
+				return;
 			}
+		}
+		
+		for (size_t i = 0; i < LG; i++, x.val += dx)
+		{
+			const s32 auxX = (WRAP) ? x.bits.Integer & (wh-1) : x.bits.Integer;
 			
-			return;
+			if (WRAP || ((auxX >= 0) && (auxX < wh)))
+				rot_row_pixel<LAYERID, MAPTYPE, MOSAIC, ISCUSTOMRENDERINGNEEDED>(gpu, auxX, auxY, row, tile, pal, i);
 		}
+		
+		return;
 	}
 	
 	for (size_t i = 0; i < LG; i++, x.val += dx, y.val += dy)
@@ -198,11 +303,11 @@ void rot_scale_op(GPUEngineBase *gpu, const BGxPARMS &param, const u16 LG, const
 		const s32 auxY = (WRAP) ? y.bits.Integer & (ht-1) : y.bits.Integer;
 		
 		if (WRAP || ((auxX >= 0) && (auxX < wh) && (auxY >= 0) && (auxY < ht)))
-			fun(gpu, auxX, auxY, wh, map, tile, pal, i);
+			rot_row_pixel<LAYERID, MAPTYPE, MOSAIC, ISCUSTOMRENDERINGNEEDED>(gpu, auxX, auxY, rot_map_row<MAPTYPE>(auxY, wh, map), tile, pal, i);
 	}
 }
 
-template<GPULayerID LAYERID, rot_fun fun>
+template<GPULayerID LAYERID, AffineMapType MAPTYPE, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
 void apply_rot_fun(GPUEngineBase *gpu, const BGxPARMS &param, const u16 LG, const u32 map, const u32 tile, const u16 *pal)
 {
 	struct _BGxCNT *bgCnt = &(gpu->dispx_st)->dispx_BGxCNT[LAYERID].bits;
@@ -210,9 +315,9 @@ void apply_rot_fun(GPUEngineBase *gpu, const BGxPARMS &param, const u16 LG, cons
 	s32 ht = gpu->BGSize[LAYERID][1];
 	
 	if (bgCnt->PaletteSet_Wrap)
-		rot_scale_op<fun,true>(gpu, param, LG, wh, ht, map, tile, pal);
+		rot_scale_op<LAYERID, MAPTYPE, MOSAIC, ISCUSTOMRENDERINGNEEDED, true>(gpu, param, LG, wh, ht, map, tile, pal);
 	else
-		rot_scale_op<fun,false>(gpu, param, LG, wh, ht, map, tile, pal);
+		rot_scale_op<LAYERID, MAPTYPE, MOSAIC, ISCUSTOMRENDERINGNEEDED, false>(gpu, param, LG, wh, ht, map, tile, pal);
 }
 
 void gpu_savestate(EMUFILE* os)
@@ -261,6 +366,8 @@ bool gpu_loadstate(EMUFILE* is, int size)
 	if (version > 1) return false;
 	
 	is->fread((u8 *)GPU->GetCustomFramebuffer(), GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u16) * 2);
+	mainEngine->InvalidateLineReuse();
+	subEngine->InvalidateLineReuse();
 	
 	if (version == 1)
 	{
@@ -373,6 +480,7 @@ void GPUEngineBase::_Reset_Base()
 	memset(this->_sprAlpha, 0, sizeof(this->_sprAlpha));
 	memset(this->_sprType, 0, sizeof(this->_sprType));
 	memset(this->_sprPrio, 0, sizeof(this->_sprPrio));
+	memset(this->_winMask, 0, sizeof(this->_winMask));
 	memset(this->_itemsForPriority, 0, sizeof(this->_itemsForPriority));
 	
 	this->_enableLayer[0] = false;
@@ -395,6 +503,10 @@ void GPUEngineBase::_Reset_Base()
 	this->_BGTypes[3] = BGType_Invalid;
 	
 	memset(&this->_mosaicColors, 0, sizeof(MosaicColor));
+	this->_mosaicWidthValue = 0;
+	this->_mosaicHeightValue = 0;
+	this->_mosaicWidth = &GPUEngineBase::_mosaicLookup.table[0][0];
+	this->_mosaicHeight = &GPUEngineBase::_mosaicLookup.table[0][0];
 	memset(this->_sprNum, 0, sizeof(this->_sprNum));
 	memset(this->_h_win[0], 0, sizeof(this->_h_win[0]));
 	memset(this->_h_win[1], 0, sizeof(this->_h_win[1]));
@@ -427,6 +539,14 @@ void GPUEngineBase::_Reset_Base()
 	this->_sprBMPBoundary = 0;
 	this->_sprBMPMode = 0;
 	this->_sprEnable = 0;
+	this->_sprListGeneration = 0;
+	this->_captureSpriteGeneration = 0;
+	this->_captureSpriteWriteOffset = 0;
+	this->_captureSpriteFound = false;
+	
+	this->InvalidateLineReuse();
+	this->_reusedLineCount = 0;
+	memset(this->_bgCoverage, 0, sizeof(this->_bgCoverage));
 	
 	this->_WIN0H0 = 0;
 	this->_WIN0H1 = 0;
@@ -789,65 +909,60 @@ void GPUEngineBase::SetLayerEnableState(const size_t layerIndex, bool theState)
 //		ROUTINES FOR INSIDE / OUTSIDE WINDOW CHECKS
 /*****************************************************************************/
 
-template<int WIN_NUM>
-u8 GPUEngineBase::_WithinRect(const size_t x) const
+// Resolves the windows of the current line into one byte per pixel. Each byte holds the
+// layer enable bits of the window which the pixel falls into, and the color special effect
+// enable of that window in bit 7. Win0 takes priority over win1, which takes priority over
+// the OBJ window; pixels outside of all of them use WINOUT.
+void GPUEngineBase::_RenderLine_SetupWindowMask()
 {
-	return this->_curr_win[WIN_NUM][x];
+	const u8 in0 = this->_WININ0 | ((this->_WININ0_SPECIAL) ? 0x80 : 0x00);
+	const u8 in1 = this->_WININ1 | ((this->_WININ1_SPECIAL) ? 0x80 : 0x00);
+	const u8 inObj = this->_WINOBJ | ((this->_WINOBJ_SPECIAL) ? 0x80 : 0x00);
+	const u8 out = this->_WINOUT | ((this->_WINOUT_SPECIAL) ? 0x80 : 0x00);
+	
+#ifdef ENABLE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i in0Vec = _mm_set1_epi8(in0);
+	const __m128i in1Vec = _mm_set1_epi8(in1);
+	const __m128i inObjVec = _mm_set1_epi8(inObj);
+	const __m128i outVec = _mm_set1_epi8(out);
+	const __m128i objEnabled = _mm_set1_epi8((this->_WINOBJ_ENABLED) ? 0xFF : 0x00);
+	
+	for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i += 16)
+	{
+		// each of these is 0xFF where the pixel lies outside of the window
+		const __m128i outside0 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(this->_curr_win[0] + i)), zero);
+		const __m128i outside1 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(this->_curr_win[1] + i)), zero);
+		const __m128i insideObj = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(this->_sprWin + i)), zero), objEnabled);
+		
+		__m128i mask = _mm_or_si128(_mm_and_si128(insideObj, inObjVec), _mm_andnot_si128(insideObj, outVec));
+		mask = _mm_or_si128(_mm_and_si128(outside1, mask), _mm_andnot_si128(outside1, in1Vec));
+		mask = _mm_or_si128(_mm_and_si128(outside0, mask), _mm_andnot_si128(outside0, in0Vec));
+		_mm_storeu_si128((__m128i *)(this->_winMask + i), mask);
+	}
+#else
+	for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i++)
+	{
+		if (this->_curr_win[0][i])
+			this->_winMask[i] = in0;
+		else if (this->_curr_win[1][i])
+			this->_winMask[i] = in1;
+		else if (this->_WINOBJ_ENABLED && this->_sprWin[i])
+			this->_winMask[i] = inObj;
+		else
+			this->_winMask[i] = out;
+	}
+#endif
 }
 
-//  Now assumes that *draw and *effect are different from 0 when called, so we can avoid
-// setting some values twice
+// Only called when at least one window is enabled, in which case the window mask
+// of the current line decides both values.
 template <GPULayerID LAYERID>
-void GPUEngineBase::_RenderLine_CheckWindows(const size_t srcX, bool &draw, bool &effect) const
+FORCEINLINE void GPUEngineBase::_RenderLine_CheckWindows(const size_t srcX, bool &draw, bool &effect) const
 {
-	// Check if win0 if enabled, and only check if it is
-	// howevever, this has already been taken care of by the window precalculation
-	//if (WIN0_ENABLED)
-	{
-		// it is in win0, do we display ?
-		// high priority	
-		if (this->_WithinRect<0>(srcX))
-		{
-			//INFO("bg%i passed win0 : (%i %i) was within (%i %i)(%i %i)\n", bgnum, x, gpu->currLine, gpu->WIN0H0, gpu->WIN0V0, gpu->WIN0H1, gpu->WIN0V1);
-			draw = (this->_WININ0 >> LAYERID) & 1;
-			effect = (this->_WININ0_SPECIAL);
-			return;
-		}
-	}
-
-	// Check if win1 if enabled, and only check if it is
-	//if (WIN1_ENABLED)
-	// howevever, this has already been taken care of by the window precalculation
-	{
-		// it is in win1, do we display ?
-		// mid priority
-		if (this->_WithinRect<1>(srcX))
-		{
-			//INFO("bg%i passed win1 : (%i %i) was within (%i %i)(%i %i)\n", bgnum, x, gpu->currLine, gpu->WIN1H0, gpu->WIN1V0, gpu->WIN1H1, gpu->WIN1V1);
-			draw = (this->_WININ1 >> LAYERID) & 1;
-			effect = (this->_WININ1_SPECIAL);
-			return;
-		}
-	}
-
-	//if(true) //sprwin test hack
-	if (this->_WINOBJ_ENABLED)
-	{
-		// it is in winOBJ, do we display ?
-		// low priority
-		if (this->_sprWin[srcX])
-		{
-			draw = (this->_WINOBJ >> LAYERID) & 1;
-			effect = (this->_WINOBJ_SPECIAL);
-			return;
-		}
-	}
-
-	if (this->_WINOBJ_ENABLED | this->_WIN1_ENABLED | this->_WIN0_ENABLED)
-	{
-		draw = (this->_WINOUT >> LAYERID) & 1;
-		effect = (this->_WINOUT_SPECIAL);
-	}
+	const u8 mask = this->_winMask[srcX];
+	draw = ((mask >> LAYERID) & 1) != 0;
+	effect = ((mask & 0x80) != 0);
 }
 
 /*****************************************************************************/
@@ -1155,15 +1270,15 @@ FORCEINLINE void GPUEngineBase::___setFinalColorBck(u16 color, const size_t srcX
 		if (!opaque) color = 0xFFFF;
 		else color &= 0x7FFF;
 		
-		if (GPUEngineBase::_mosaicLookup.width[srcX].begin && GPUEngineBase::_mosaicLookup.height[this->currLine].begin)
+		if (this->_mosaicWidth[srcX].begin && this->_mosaicHeight[this->currLine].begin)
 		{
 			// Do nothing.
 		}
 		else
 		{
 			//due to the early out, enabled must always be true
-			//x_int = enabled ? GPU::_mosaicLookup.width[srcX].trunc : srcX;
-			const size_t x_int = GPUEngineBase::_mosaicLookup.width[srcX].trunc;
+			//x_int = enabled ? this->_mosaicWidth[srcX].trunc : srcX;
+			const size_t x_int = this->_mosaicWidth[srcX].trunc;
 			color = this->_mosaicColors.bg[LAYERID][x_int];
 		}
 		
@@ -1182,6 +1297,84 @@ FORCEINLINE void GPUEngineBase::__setFinalColorBck(const u16 color, const size_t
 	return ___setFinalColorBck<LAYERID, MOSAIC, BACKDROP, 0, ISCUSTOMRENDERINGNEEDED, false>(color, srcX, opaque);
 }
 
+// Draws the backdrop of a line which uses windows. Only the resolution of the windows
+// and the two passes below are vectorized. The BG, 3D and OBJ pixels are still
+// blended one at a time as they are drawn, through the function-ID dispatch above,
+// since there are no per-layer line buffers to run a separate priority and blend pass
+// over.
+//
+// The backdrop is always drawn, and only brightness up/down depends on the window mask,
+// so a native line is a per-pixel select between two colors.
+template <bool ISCUSTOMRENDERINGNEEDED>
+void GPUEngineBase::_RenderLine_WindowedBackdrop(const u16 backdrop_color)
+{
+	if (ISCUSTOMRENDERINGNEEDED)
+	{
+		switch (this->_finalColorBckFuncID)
+		{
+			case 4: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,4,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+			case 5: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,5,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+			case 6: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,6,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+			case 7: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,7,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+		}
+		return;
+	}
+	
+	u16 *dstLine = this->currDst;
+	const u16 plainColor = backdrop_color | 0x8000;
+	u16 effectColor = plainColor;
+	
+	if (this->_blend1)
+	{
+		if (this->_finalColorBckFuncID == 6) effectColor = this->_currentFadeInColors[backdrop_color] | 0x8000;
+		if (this->_finalColorBckFuncID == 7) effectColor = this->_currentFadeOutColors[backdrop_color] | 0x8000;
+	}
+	
+#ifdef ENABLE_SSE2
+	const __m128i plainVec = _mm_set1_epi16(plainColor);
+	const __m128i effectVec = _mm_set1_epi16(effectColor);
+	
+	for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i += 16)
+	{
+		// 0xFF where the window allows color effects, from bit 7 of the mask
+		const __m128i effect = _mm_cmplt_epi8(_mm_loadu_si128((__m128i *)(this->_winMask + i)), _mm_setzero_si128());
+		const __m128i effectLo = _mm_unpacklo_epi8(effect, effect);
+		const __m128i effectHi = _mm_unpackhi_epi8(effect, effect);
+		
+		_mm_storeu_si128((__m128i *)(dstLine + i) + 0, _mm_or_si128(_mm_and_si128(effectLo, effectVec), _mm_andnot_si128(effectLo, plainVec)));
+		_mm_storeu_si128((__m128i *)(dstLine + i) + 1, _mm_or_si128(_mm_and_si128(effectHi, effectVec), _mm_andnot_si128(effectHi, plainVec)));
+	}
+#else
+	for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i++)
+	{
+		dstLine[i] = (this->_winMask[i] & 0x80) ? effectColor : plainColor;
+	}
+#endif
+}
+
+// Sorts the sprite pixels of the current line into the priority items, in increasing x.
+// Most of a line usually has no sprite on it, which is skipped 16 pixels at a time.
+void GPUEngineBase::_RenderLine_SortSpritePixels()
+{
+	for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i += 16)
+	{
+#ifdef ENABLE_SSE2
+		const __m128i prio = _mm_loadu_si128((__m128i *)(this->_sprPrio + i));
+		const __m128i hasSprite = _mm_cmpeq_epi8(_mm_min_epu8(prio, _mm_set1_epi8(NB_PRIORITIES - 1)), prio);
+		if (_mm_movemask_epi8(hasSprite) == 0) continue;
+#endif
+		for (size_t x = i; x < i + 16; x++)
+		{
+			const size_t prio = this->_sprPrio[x];
+			if (prio >= NB_PRIORITIES) continue;
+			
+			itemsForPriority_t *item = &(this->_itemsForPriority[prio]);
+			item->PixelsX[item->nbPixelsX] = x;
+			item->nbPixelsX++;
+		}
+	}
+}
+
 //this is fantastically inaccurate.
 //we do the early return even though it reduces the resulting accuracy
 //because we need the speed, and because it is inaccurate anyway
@@ -1198,13 +1391,13 @@ void GPUEngineBase::_MosaicSpriteLinePixel(const size_t x, u16 l, u16 *dst, u8 *
 	objColor.alpha = dst_alpha[x];
 	objColor.opaque = opaque;
 
-	const size_t x_int = (enableMosaic) ? GPUEngineBase::_mosaicLookup.width[x].trunc : x;
+	const size_t x_int = (enableMosaic) ? this->_mosaicWidth[x].trunc : x;
 
 	if (enableMosaic)
 	{
 		const size_t y = l;
 		
-		if (GPUEngineBase::_mosaicLookup.width[x].begin && GPUEngineBase::_mosaicLookup.height[y].begin)
+		if (this->_mosaicWidth[x].begin && this->_mosaicHeight[y].begin)
 		{
 			// Do nothing.
 		}
@@ -1223,7 +1416,7 @@ void GPUEngineBase::_MosaicSpriteLinePixel(const size_t x, u16 l, u16 *dst, u8 *
 void GPUEngineBase::_MosaicSpriteLine(u16 l, u16 *dst, u8 *dst_alpha, u8 *typeTab, u8 *prioTab)
 {
 	//don't even try this unless the mosaic is effective
-	if (GPUEngineBase::_mosaicLookup.widthValue != 0 || GPUEngineBase::_mosaicLookup.heightValue != 0)
+	if (this->_mosaicWidthValue != 0 || this->_mosaicHeightValue != 0)
 		for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i++)
 			this->_MosaicSpriteLinePixel(i, l, dst, dst_alpha, typeTab, prioTab);
 }
@@ -1263,6 +1456,27 @@ void GPUEngineBase::_LineLarge8bpp()
 /*****************************************************************************/
 //			BACKGROUND RENDERING -TEXT-
 /*****************************************************************************/
+// returns the 8x8 palette indices of the 4bpp tile at tileAddr, decoding it again if vram was written since
+static FORCEINLINE const u8* _gpuDecodedTile4bpp(const GPUEngineID engineID, const u32 tileAddr)
+{
+	const u8 *src = (const u8 *)MMU_gpu_map(tileAddr);
+	const u32 index = VRAM_TILE_INDEX(engineID, (u32)(src - MMU.ARM9_LCD));
+	u8 *decoded = _gpuTileCache4bpp[index];
+	
+	if (vram_tile_dirty[index] & VRAM_TILE_DIRTY_DECODED)
+	{
+		for (size_t i = 0; i < 32; i++)
+		{
+			decoded[(i << 1) + 0] = src[i] & 0x0F;
+			decoded[(i << 1) + 1] = src[i] >> 4;
+		}
+		
+		vram_tile_dirty[index] &= ~VRAM_TILE_DIRTY_DECODED;
+	}
+	
+	return decoded;
+}
+
 // render a text background to the combined pixelbuffer
 template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
 void GPUEngineBase::_RenderLine_TextBG(u16 XBG, u16 YBG, u16 LG)
@@ -1297,63 +1511,34 @@ void GPUEngineBase::_RenderLine_TextBG(u16 XBG, u16 YBG, u16 LG)
 	{
 		const u16 *pal = (u16 *)(MMU.ARM9_VMEM + this->_engineID * ADDRESS_STEP_1KB);
 		
-		yoff = ((YBG&7)<<2);
+		yoff = (YBG&7);
 		xfin = 8 - (xoff&7);
 		for (size_t x = 0; x < LG; xfin = std::min<u16>(x+8, LG))
 		{
-			u16 tilePalette = 0;
 			tmp = ((xoff&wmask)>>3);
 			mapinfo = map + (tmp&0x1F) * 2;
 			if(tmp>31) mapinfo += 32*32*2;
 			tileentry.val = LOCAL_TO_LE_16( *(u16 *)MMU_gpu_map(mapinfo) );
-
-			tilePalette = (tileentry.bits.Palette*16);
-
-			u8 *line = (u8 *)MMU_gpu_map(tile + (tileentry.bits.TileNum * 0x20) + ((tileentry.bits.VFlip) ? (7*4)-yoff : yoff));
-			u8 offset = 0;
+			
+			const u16 *tilePal = pal + (tileentry.bits.Palette*16);
+			const u8 *tileRow = _gpuDecodedTile4bpp(this->_engineID, tile + (tileentry.bits.TileNum * 0x20)) + (((tileentry.bits.VFlip) ? 7-yoff : yoff) << 3);
 			
 			if (tileentry.bits.HFlip)
 			{
-				line += ( 3 - ((xoff & 7) >> 1) );
-				for (; x < xfin; line--)
+				for (; x < xfin; x++, xoff++)
 				{
-					if (!(xoff & 1))
-					{
-						offset = *line >> 4;
-						const u16 color = LE_TO_LOCAL_16( pal[offset + tilePalette] );
-						this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
-						x++; xoff++;
-					}
-					
-					if (x < xfin)
-					{
-						offset = *line & 0xF;
-						const u16 color = LE_TO_LOCAL_16( pal[offset + tilePalette] );
-						this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
-						x++; xoff++;
-					}
+					const u8 offset = tileRow[7 - (xoff & 7)];
+					const u16 color = LE_TO_LOCAL_16(tilePal[offset]);
+					this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
 				}
 			}
 			else
 			{
-				line += ((xoff & 7) >> 1);
-				for (; x < xfin; line++)
+				for (; x < xfin; x++, xoff++)
 				{
-					if (!(xoff & 1))
-					{
-						offset = *line & 0xF;
-						const u16 color = LE_TO_LOCAL_16( pal[offset + tilePalette] );
-						this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
-						x++; xoff++;
-					}
-					
-					if (x < xfin)
-					{
-						offset = *line >> 4;
-						const u16 color = LE_TO_LOCAL_16( pal[offset + tilePalette] );
-						this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
-						x++; xoff++;
-					}
+					const u8 offset = tileRow[xoff & 7];
+					const u16 color = LE_TO_LOCAL_16(tilePal[offset]);
+					this->__setFinalColorBck<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED>(color, x, (offset != 0));
 				}
 			}
 		}
@@ -1409,7 +1594,7 @@ void GPUEngineBase::_RotBG2(const BGxPARMS &param, const u16 LG)
 {
 	const u16 *pal = (u16 *)(MMU.ARM9_VMEM + this->_engineID * ADDRESS_STEP_1KB);
 //	printf("rot mode\n");
-	apply_rot_fun< LAYERID, rot_tiled_8bit_entry<LAYERID, MOSAIC, ISCUSTOMRENDERINGNEEDED> >(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
+	apply_rot_fun<LAYERID, AffineMap_Tiled8bit, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
 }
 
 template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED>
@@ -1426,32 +1611,32 @@ void GPUEngineBase::_ExtRotBG2(const BGxPARMS &param, const u16 LG)
 			if (pal == NULL) return;
 			
 			if(dispCnt->ExBGxPalette_Enable)
-				apply_rot_fun< LAYERID, rot_tiled_16bit_entry<LAYERID, MOSAIC, true, ISCUSTOMRENDERINGNEEDED> >(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
+				apply_rot_fun<LAYERID, AffineMap_Tiled16bitExtPal, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
 			else
-				apply_rot_fun< LAYERID, rot_tiled_16bit_entry<LAYERID, MOSAIC, false, ISCUSTOMRENDERINGNEEDED> >(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
+				apply_rot_fun<LAYERID, AffineMap_Tiled16bit, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_map_ram[LAYERID], this->_BG_tile_ram[LAYERID], pal);
 			break;
 			
 		case BGType_AffineExt_256x1: // 256 colors
 			pal = (u16 *)(MMU.ARM9_VMEM + this->_engineID * ADDRESS_STEP_1KB);
-			apply_rot_fun< LAYERID, rot_256_map<LAYERID, MOSAIC, ISCUSTOMRENDERINGNEEDED> >(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, pal);
+			apply_rot_fun<LAYERID, AffineMap_Bitmap256, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, pal);
 			break;
 			
 		case BGType_AffineExt_Direct: // direct colors / BMP
 		{
 			if (ISCUSTOMRENDERINGNEEDED && (LAYERID == this->vramBGLayer))
 			{
-				apply_rot_fun< LAYERID, rot_BMP_map<LAYERID, MOSAIC, ISCUSTOMRENDERINGNEEDED, true> >(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, NULL);
+				apply_rot_fun<LAYERID, AffineMap_BitmapDirectCustomVRAM, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, NULL);
 			}
 			else
 			{
-				apply_rot_fun< LAYERID, rot_BMP_map<LAYERID, MOSAIC, ISCUSTOMRENDERINGNEEDED, false> >(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, NULL);
+				apply_rot_fun<LAYERID, AffineMap_BitmapDirect, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_bmp_ram[LAYERID], 0, NULL);
 			}
 			break;
 		}
 			
 		case BGType_Large8bpp: // large screen 256 colors
 			pal = (u16 *)(MMU.ARM9_VMEM + this->_engineID * ADDRESS_STEP_1KB);
-			apply_rot_fun< LAYERID, rot_256_map<LAYERID, MOSAIC, ISCUSTOMRENDERINGNEEDED> >(this, param, LG, this->_BG_bmp_large_ram[LAYERID], 0, pal);
+			apply_rot_fun<LAYERID, AffineMap_Bitmap256, MOSAIC, ISCUSTOMRENDERINGNEEDED>(this, param, LG, this->_BG_bmp_large_ram[LAYERID], 0, pal);
 			break;
 			
 		default:
@@ -1705,6 +1890,35 @@ void GPUEngineBase::SpriteRender(u16 *dst, u8 *dst_alpha, u8 *typeTab, u8 *prioT
 		this->_SpriteRenderPerform<SpriteRenderMode_Sprite2D>(dst, dst_alpha, typeTab, prioTab);
 }
 
+void GPUEngineBase::_SpriteBuildLineLists()
+{
+	this->_sprListGeneration = videoWriteTracking.look();
+	memset(this->_sprLineCount, 0, sizeof(this->_sprLineCount));
+	
+	for (size_t i = 0; i < 128; i++)
+	{
+		const OAMAttributes &spriteInfo = this->_oamList[i];
+		
+		if (spriteInfo.RotScale == 2)
+			continue;
+		
+		// same y visibility test as the renderers, which still do the x clipping themselves
+		s32 sprY = spriteInfo.Y;
+		if (sprY >= GPU_FRAMEBUFFER_NATIVE_HEIGHT)
+			sprY = (s32)((s8)(spriteInfo.Y));
+		
+		s32 fieldY = GPUEngineBase::_sprSizeTab[spriteInfo.Size][spriteInfo.Shape].y;
+		if (spriteInfo.RotScale == 3)
+			fieldY <<= 1;
+		
+		for (size_t l = 0; l < GPU_FRAMEBUFFER_NATIVE_HEIGHT; l++)
+		{
+			if ((s32)((l - sprY) & 0xFF) < fieldY)
+				this->_sprLineList[l][this->_sprLineCount[l]++] = i;
+		}
+	}
+}
+
 template<SpriteRenderMode MODE>
 void GPUEngineBase::_SpriteRenderPerform(u16 *dst, u8 *dst_alpha, u8 *typeTab, u8 *prioTab)
 {
@@ -1713,9 +1927,16 @@ void GPUEngineBase::_SpriteRenderPerform(u16 *dst, u8 *dst_alpha, u8 *typeTab, u
 
 	struct _DISPCNT *dispCnt = &(this->dispx_st)->dispx_DISPCNT.bits;
 	u8 block = this->_sprBoundary;
+	
+	if (videoWriteTracking.oamChangedSince(this->_engineID, this->_sprListGeneration))
+		this->_SpriteBuildLineLists();
+	
+	const size_t sprCount = this->_sprLineCount[l];
+	const u8 *sprList = this->_sprLineList[l];
 
-	for (size_t i = 0; i < 128; i++)
+	for (size_t n = 0; n < sprCount; n++)
 	{
+		const size_t i = sprList[n];
 		const OAMAttributes &spriteInfo = this->_oamList[i];
 
 		//for each sprite:
@@ -2028,77 +2249,381 @@ void GPUEngineBase::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t ds
 	
 }
 
-template<bool ISCUSTOMRENDERINGNEEDED>
-void GPUEngineBase::_RenderLine_MasterBrightness(u16 *dstLine, const size_t dstLineWidth, const size_t dstLineCount)
+#ifdef ENABLE_SSE2
+// Converts 8 RGB555 colors to XRGB8888 the same way as RGB15TO24_REVERSE(), widening each
+// component by repeating its upper bits.
+static FORCEINLINE void _gpuColor555To8888_SSE2(const __m128i &src, u32 *dst)
 {
-	const u32 factor = this->MasterBrightFactor;
+	const __m128i src_lo = _mm_unpacklo_epi16(src, _mm_setzero_si128());
+	const __m128i src_hi = _mm_unpackhi_epi16(src, _mm_setzero_si128());
+	__m128i out[2];
 	
-	//isn't it odd that we can set uselessly high factors here?
-	//factors above 16 change nothing. curious.
-	if (factor == 0) return;
+	for (size_t n = 0; n < 2; n++)
+	{
+		const __m128i c = (n == 0) ? src_lo : src_hi;
+		
+		const __m128i r = _mm_or_si128( _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x001F)), 19), _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x001C)), 14) );
+		const __m128i g = _mm_or_si128( _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x03E0)),  6), _mm_slli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x0380)),  1) );
+		const __m128i b = _mm_or_si128( _mm_srli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x7C00)),  7), _mm_srli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x7000)), 12) );
+		
+		out[n] = _mm_or_si128(_mm_or_si128(r, g), b);
+	}
 	
-	//Apply final brightness adjust (MASTER_BRIGHT)
-	//http://nocash.emubase.de/gbatek.htm#dsvideo (Under MASTER_BRIGHTNESS)
+	_mm_storeu_si128((__m128i *)dst + 0, out[0]);
+	_mm_storeu_si128((__m128i *)dst + 1, out[1]);
+}
+#endif
+
+static void _gpuLine555To8888(const u16 *src, u32 *dst, const size_t pixCount)
+{
+	size_t i = 0;
 	
-	const size_t pixCount = dstLineWidth * dstLineCount;
+#ifdef ENABLE_SSE2
+	const size_t ssePixCount = pixCount - (pixCount % 8);
+	for (; i < ssePixCount; i += 8)
+	{
+		_gpuColor555To8888_SSE2(_mm_loadu_si128((__m128i *)(src + i)), dst + i);
+	}
+#endif
 	
-	switch (this->MasterBrightMode)
+	for (; i < pixCount; i++)
 	{
-		case GPUMasterBrightMode_Disable:
-			break;
+		dst[i] = RGB15TO24_REVERSE(src[i]);
+	}
+}
+
+#if defined(ENABLE_SSE2)
+// Expands whole vectors of source pixels for the integer scales that have a kernel.
+// Returns the number of source pixels done; the rest are left to the caller.
+static size_t _gpuExpandLine_SIMD(const u16 *src, u16 *dst, const size_t srcPixCount, const size_t scale)
+{
+	const size_t vecPixCount = srcPixCount - (srcPixCount % 8);
+	
+	switch (scale)
+	{
+		case 2:
+			for (size_t x = 0; x < vecPixCount; x += 8)
+			{
+				const __m128i c = _mm_loadu_si128((__m128i *)(src + x));
+				_mm_storeu_si128((__m128i *)(dst + (x * 2)) + 0, _mm_unpacklo_epi16(c, c));
+				_mm_storeu_si128((__m128i *)(dst + (x * 2)) + 1, _mm_unpackhi_epi16(c, c));
+			}
+			return vecPixCount;
 			
-		case GPUMasterBrightMode_Up:
-		{
-			if (factor < 16)
+		case 4:
+			for (size_t x = 0; x < vecPixCount; x += 8)
 			{
-				size_t i = 0;
-				
-#ifdef ENABLE_SSE2
-				const size_t ssePixCount = pixCount - (pixCount % 8);
-				for (; i < ssePixCount; i += 8)
-				{
-					__m128i dstColor_vec128 = _mm_load_si128((__m128i *)(dstLine + i));
-					dstColor_vec128 = _mm_and_si128(dstColor_vec128, _mm_set1_epi16(0x7FFF));
-					
-					dstLine[i+7] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 7) ];
-					dstLine[i+6] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 6) ];
-					dstLine[i+5] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 5) ];
-					dstLine[i+4] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 4) ];
-					dstLine[i+3] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 3) ];
-					dstLine[i+2] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 2) ];
-					dstLine[i+1] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 1) ];
-					dstLine[i+0] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 0) ];
-				}
-#endif
-				for (; i < pixCount; i++)
-				{
-					dstLine[i] = GPUEngineBase::_fadeInColors[factor][ dstLine[i] & 0x7FFF ];
-				}
+				const __m128i c = _mm_loadu_si128((__m128i *)(src + x));
+				const __m128i lo = _mm_unpacklo_epi16(c, c);
+				const __m128i hi = _mm_unpackhi_epi16(c, c);
+				_mm_storeu_si128((__m128i *)(dst + (x * 4)) + 0, _mm_unpacklo_epi32(lo, lo));
+				_mm_storeu_si128((__m128i *)(dst + (x * 4)) + 1, _mm_unpackhi_epi32(lo, lo));
+				_mm_storeu_si128((__m128i *)(dst + (x * 4)) + 2, _mm_unpacklo_epi32(hi, hi));
+				_mm_storeu_si128((__m128i *)(dst + (x * 4)) + 3, _mm_unpackhi_epi32(hi, hi));
 			}
-			else
+			return vecPixCount;
+			
+		case 8:
+			for (size_t x = 0; x < srcPixCount; x++)
 			{
-				// all white (optimization)
-				if (ISCUSTOMRENDERINGNEEDED)
-				{
-					memset_u16(dstLine, 0x7FFF, pixCount);
-				}
-				else
-				{
-					memset_u16_fast<GPU_FRAMEBUFFER_NATIVE_WIDTH>(dstLine, 0x7FFF);
-				}
+				_mm_storeu_si128((__m128i *)(dst + (x * 8)), _mm_set1_epi16(src[x]));
 			}
+			return srcPixCount;
+			
+		default:
 			break;
-		}
+	}
+	
+	return 0;
+}
+
+static size_t _gpuExpandLine_SIMD(const u32 *src, u32 *dst, const size_t srcPixCount, const size_t scale)
+{
+	const size_t vecPixCount = srcPixCount - (srcPixCount % 4);
+	
+	switch (scale)
+	{
+		case 2:
+			for (size_t x = 0; x < vecPixCount; x += 4)
+			{
+				const __m128i c = _mm_loadu_si128((__m128i *)(src + x));
+				_mm_storeu_si128((__m128i *)(dst + (x * 2)) + 0, _mm_unpacklo_epi32(c, c));
+				_mm_storeu_si128((__m128i *)(dst + (x * 2)) + 1, _mm_unpackhi_epi32(c, c));
+			}
+			return vecPixCount;
 			
-		case GPUMasterBrightMode_Down:
-		{
-			if (factor < 16)
+		case 4:
+			for (size_t x = 0; x < srcPixCount; x++)
 			{
-				size_t i = 0;
-				
-#ifdef ENABLE_SSE2
-				const size_t ssePixCount = pixCount - (pixCount % 8);
-				for (; i < ssePixCount; i += 8)
+				_mm_storeu_si128((__m128i *)(dst + (x * 4)), _mm_set1_epi32(src[x]));
+			}
+			return srcPixCount;
+			
+		case 8:
+			for (size_t x = 0; x < srcPixCount; x++)
+			{
+				const __m128i c = _mm_set1_epi32(src[x]);
+				_mm_storeu_si128((__m128i *)(dst + (x * 8)) + 0, c);
+				_mm_storeu_si128((__m128i *)(dst + (x * 8)) + 1, c);
+			}
+			return srcPixCount;
+			
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+#elif defined(ENABLE_NEON)
+static size_t _gpuExpandLine_SIMD(const u16 *src, u16 *dst, const size_t srcPixCount, const size_t scale)
+{
+	const size_t vecPixCount = srcPixCount - (srcPixCount % 8);
+	
+	switch (scale)
+	{
+		case 2:
+			for (size_t x = 0; x < vecPixCount; x += 8)
+			{
+				uint16x8x2_t c;
+				c.val[0] = c.val[1] = vld1q_u16(src + x);
+				vst2q_u16(dst + (x * 2), c);
+			}
+			return vecPixCount;
+			
+		case 3:
+			for (size_t x = 0; x < vecPixCount; x += 8)
+			{
+				uint16x8x3_t c;
+				c.val[0] = c.val[1] = c.val[2] = vld1q_u16(src + x);
+				vst3q_u16(dst + (x * 3), c);
+			}
+			return vecPixCount;
+			
+		case 4:
+			for (size_t x = 0; x < vecPixCount; x += 8)
+			{
+				uint16x8x4_t c;
+				c.val[0] = c.val[1] = c.val[2] = c.val[3] = vld1q_u16(src + x);
+				vst4q_u16(dst + (x * 4), c);
+			}
+			return vecPixCount;
+			
+		case 8:
+			for (size_t x = 0; x < srcPixCount; x++)
+			{
+				vst1q_u16(dst + (x * 8), vdupq_n_u16(src[x]));
+			}
+			return srcPixCount;
+			
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+static size_t _gpuExpandLine_SIMD(const u32 *src, u32 *dst, const size_t srcPixCount, const size_t scale)
+{
+	const size_t vecPixCount = srcPixCount - (srcPixCount % 4);
+	
+	switch (scale)
+	{
+		case 2:
+			for (size_t x = 0; x < vecPixCount; x += 4)
+			{
+				uint32x4x2_t c;
+				c.val[0] = c.val[1] = vld1q_u32(src + x);
+				vst2q_u32(dst + (x * 2), c);
+			}
+			return vecPixCount;
+			
+		case 3:
+			for (size_t x = 0; x < vecPixCount; x += 4)
+			{
+				uint32x4x3_t c;
+				c.val[0] = c.val[1] = c.val[2] = vld1q_u32(src + x);
+				vst3q_u32(dst + (x * 3), c);
+			}
+			return vecPixCount;
+			
+		case 4:
+			for (size_t x = 0; x < srcPixCount; x++)
+			{
+				vst1q_u32(dst + (x * 4), vdupq_n_u32(src[x]));
+			}
+			return srcPixCount;
+			
+		case 8:
+			for (size_t x = 0; x < srcPixCount; x++)
+			{
+				const uint32x4_t c = vdupq_n_u32(src[x]);
+				vst1q_u32(dst + (x * 8) + 0, c);
+				vst1q_u32(dst + (x * 8) + 4, c);
+			}
+			return srcPixCount;
+			
+		default:
+			break;
+	}
+	
+	return 0;
+}
+#endif
+
+// Expands the first srcPixCount pixels of a native line to the custom width.
+template<typename T>
+static void _gpuExpandLine(const T *__restrict src, T *__restrict dst, const size_t srcPixCount)
+{
+	const size_t scale = _gpuDstPitchScale;
+	
+	if (scale == 1)
+	{
+		memcpy(dst, src, srcPixCount * sizeof(T));
+		return;
+	}
+	
+	if (scale == 0)
+	{
+		// uneven scales go by the source index of each pixel on the first custom line
+		const size_t dstPixCount = _gpuDstPitchIndex[srcPixCount - 1] + _gpuDstPitchCount[srcPixCount - 1];
+		for (size_t i = 0; i < dstPixCount; i++)
+		{
+			dst[i] = src[_gpuDstToSrcIndex[i]];
+		}
+		return;
+	}
+	
+	size_t x = 0;
+	
+#if defined(ENABLE_SSE2) || defined(ENABLE_NEON)
+	x = _gpuExpandLine_SIMD(src, dst, srcPixCount, scale);
+#endif
+	
+	for (; x < srcPixCount; x++)
+	{
+		for (size_t p = 0; p < scale; p++)
+		{
+			dst[(x * scale) + p] = src[x];
+		}
+	}
+}
+
+// Copies the first line of a block of custom lines to the others in the block. Streamed
+// copies bypass the cache, for lines nothing else reads until the frame is done.
+template<typename T>
+static void _gpuCopyLines(T *dstLine, const size_t lineWidth, const size_t lineCount, const bool stream)
+{
+#ifdef ENABLE_SSE2
+	const size_t lineSize = lineWidth * sizeof(T);
+	
+	if ( stream && (((uintptr_t)dstLine % 16) == 0) && ((lineSize % 16) == 0) )
+	{
+		const __m128i *src = (__m128i *)dstLine;
+		
+		for (size_t line = 1; line < lineCount; line++)
+		{
+			__m128i *dst = (__m128i *)(dstLine + (line * lineWidth));
+			for (size_t i = 0; i < lineSize / sizeof(__m128i); i++)
+			{
+				_mm_stream_si128(dst + i, _mm_load_si128(src + i));
+			}
+		}
+		
+		return;
+	}
+#endif
+	
+	for (size_t line = 1; line < lineCount; line++)
+	{
+		memcpy(dstLine + (line * lineWidth), dstLine, lineWidth * sizeof(T));
+	}
+}
+
+template<bool ISCUSTOMRENDERINGNEEDED>
+void GPUEngineBase::_RenderLine_MasterBrightness(u16 *dstLine, u32 *dstLine32, const size_t dstLineWidth, const size_t dstLineCount)
+{
+	const u32 factor = this->MasterBrightFactor;
+	const size_t pixCount = dstLineWidth * dstLineCount;
+	
+	// the XRGB8888 output is converted in the same pass that applies the brightness,
+	// while the line is still in the cache
+	
+	//isn't it odd that we can set uselessly high factors here?
+	//factors above 16 change nothing. curious.
+	if (factor == 0)
+	{
+		if (dstLine32 != NULL)
+			_gpuLine555To8888(dstLine, dstLine32, pixCount);
+		return;
+	}
+	
+	//Apply final brightness adjust (MASTER_BRIGHT)
+	//http://nocash.emubase.de/gbatek.htm#dsvideo (Under MASTER_BRIGHTNESS)
+	
+	switch (this->MasterBrightMode)
+	{
+		case GPUMasterBrightMode_Up:
+		{
+			if (factor < 16)
+			{
+				size_t i = 0;
+				
+#ifdef ENABLE_SSE2
+				const size_t ssePixCount = pixCount - (pixCount % 8);
+				for (; i < ssePixCount; i += 8)
+				{
+					__m128i dstColor_vec128 = _mm_load_si128((__m128i *)(dstLine + i));
+					dstColor_vec128 = _mm_and_si128(dstColor_vec128, _mm_set1_epi16(0x7FFF));
+					
+					dstLine[i+7] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 7) ];
+					dstLine[i+6] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 6) ];
+					dstLine[i+5] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 5) ];
+					dstLine[i+4] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 4) ];
+					dstLine[i+3] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 3) ];
+					dstLine[i+2] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 2) ];
+					dstLine[i+1] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 1) ];
+					dstLine[i+0] = GPUEngineBase::_fadeInColors[factor][ _mm_extract_epi16(dstColor_vec128, 0) ];
+					
+					if (dstLine32 != NULL)
+						_gpuColor555To8888_SSE2(_mm_load_si128((__m128i *)(dstLine + i)), dstLine32 + i);
+				}
+#endif
+				for (; i < pixCount; i++)
+				{
+					dstLine[i] = GPUEngineBase::_fadeInColors[factor][ dstLine[i] & 0x7FFF ];
+					
+					if (dstLine32 != NULL)
+						dstLine32[i] = RGB15TO24_REVERSE(dstLine[i]);
+				}
+			}
+			else
+			{
+				// all white (optimization)
+				if (ISCUSTOMRENDERINGNEEDED)
+				{
+					memset_u16(dstLine, 0x7FFF, pixCount);
+				}
+				else
+				{
+					memset_u16_fast<GPU_FRAMEBUFFER_NATIVE_WIDTH>(dstLine, 0x7FFF);
+				}
+				
+				if (dstLine32 != NULL)
+					memset_u32(dstLine32, RGB15TO24_REVERSE(0x7FFF), pixCount);
+			}
+			break;
+		}
+			
+		case GPUMasterBrightMode_Down:
+		{
+			if (factor < 16)
+			{
+				size_t i = 0;
+				
+#ifdef ENABLE_SSE2
+				const size_t ssePixCount = pixCount - (pixCount % 8);
+				for (; i < ssePixCount; i += 8)
 				{
 					__m128i dstColor_vec128 = _mm_load_si128((__m128i *)(dstLine + i));
 					dstColor_vec128 = _mm_and_si128(dstColor_vec128, _mm_set1_epi16(0x7FFF));
@@ -2111,22 +2636,35 @@ void GPUEngineBase::_RenderLine_MasterBrightness(u16 *dstLine, const size_t dstL
 					dstLine[i+2] = GPUEngineBase::_fadeOutColors[factor][ _mm_extract_epi16(dstColor_vec128, 2) ];
 					dstLine[i+1] = GPUEngineBase::_fadeOutColors[factor][ _mm_extract_epi16(dstColor_vec128, 1) ];
 					dstLine[i+0] = GPUEngineBase::_fadeOutColors[factor][ _mm_extract_epi16(dstColor_vec128, 0) ];
+					
+					if (dstLine32 != NULL)
+						_gpuColor555To8888_SSE2(_mm_load_si128((__m128i *)(dstLine + i)), dstLine32 + i);
 				}
 #endif
 				for (; i < pixCount; i++)
 				{
 					dstLine[i] = GPUEngineBase::_fadeOutColors[factor][ dstLine[i] & 0x7FFF ];
+					
+					if (dstLine32 != NULL)
+						dstLine32[i] = RGB15TO24_REVERSE(dstLine[i]);
 				}
 			}
 			else
 			{
 				// all black (optimization)
 				memset(dstLine, 0, pixCount * sizeof(u16));
+				
+				if (dstLine32 != NULL)
+					memset(dstLine32, 0, pixCount * sizeof(u32));
 			}
 			break;
 		}
 			
+		case GPUMasterBrightMode_Disable:
 		case GPUMasterBrightMode_Reserved:
+		default:
+			if (dstLine32 != NULL)
+				_gpuLine555To8888(dstLine, dstLine32, pixCount);
 			break;
 	}
 }
@@ -2252,24 +2790,38 @@ void GPUEngineBase::UpdateVRAM3DUsageProperties_OBJLayer(const size_t bankIndex,
 	}
 	
 	GPUEngineA *mainEngine = GPU->GetEngineMain();
+	const u32 writeOffset = mainEngine->dispCapCnt.writeOffset;
 	
-	for (size_t spriteIndex = 0; spriteIndex < 128; spriteIndex++)
+	// this runs every frame, but OAM rarely changes between frames, so only search it again when it does
+	if ( videoWriteTracking.oamChangedSince(this->_engineID, this->_captureSpriteGeneration) || (writeOffset != this->_captureSpriteWriteOffset) )
 	{
-		const OAMAttributes &spriteInfo = this->_oamList[spriteIndex];
+		this->_captureSpriteGeneration = videoWriteTracking.look();
+		this->_captureSpriteWriteOffset = writeOffset;
+		this->_captureSpriteFound = false;
 		
-		if ( (spriteInfo.RotScale != 2) && ((spriteInfo.RotScale & 1) == 0) && (spriteInfo.Mode == 3) && (spriteInfo.PaletteIndex != 0) )
+		for (size_t spriteIndex = 0; spriteIndex < 128; spriteIndex++)
 		{
-			const u32 vramAddress = ( (spriteInfo.TileIndex & 0x1F) * 0x10 ) + ( (spriteInfo.TileIndex & ~0x1F) * 0x80 );
-			const SpriteSize sprSize = GPUEngineBase::_sprSizeTab[spriteInfo.Size][spriteInfo.Shape];
+			const OAMAttributes &spriteInfo = this->_oamList[spriteIndex];
 			
-			if( (vramAddress == (mainEngine->dispCapCnt.writeOffset * ADDRESS_STEP_32KB)) && (sprSize.x == 64) && (sprSize.y == 64) )
+			if ( (spriteInfo.RotScale != 2) && ((spriteInfo.RotScale & 1) == 0) && (spriteInfo.Mode == 3) && (spriteInfo.PaletteIndex != 0) )
 			{
-				this->vramBlockOBJIndex = bankIndex;
-				this->isCustomRenderingNeeded = true;
-				return;
+				const u32 vramAddress = ( (spriteInfo.TileIndex & 0x1F) * 0x10 ) + ( (spriteInfo.TileIndex & ~0x1F) * 0x80 );
+				const SpriteSize sprSize = GPUEngineBase::_sprSizeTab[spriteInfo.Size][spriteInfo.Shape];
+				
+				if( (vramAddress == (writeOffset * ADDRESS_STEP_32KB)) && (sprSize.x == 64) && (sprSize.y == 64) )
+				{
+					this->_captureSpriteFound = true;
+					break;
+				}
 			}
 		}
 	}
+	
+	if (this->_captureSpriteFound)
+	{
+		this->vramBlockOBJIndex = bankIndex;
+		this->isCustomRenderingNeeded = true;
+	}
 }
 
 u32 GPUEngineBase::getAffineStart(const size_t layer, int xy)
@@ -2412,21 +2964,16 @@ void GPUEngineBase::HandleDisplayModeVRAM(u16 *dstLine, const size_t l, const si
 		else
 		{
 			const u16 *src = this->_VRAMaddrNative + (l * GPU_FRAMEBUFFER_NATIVE_WIDTH);
-			
+#ifndef LOCAL_LE
+			CACHE_ALIGN u16 srcLine[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 			for (size_t x = 0; x < GPU_FRAMEBUFFER_NATIVE_WIDTH; x++)
 			{
-				const u16 color = LE_TO_LOCAL_16(src[x]);
-				
-				for (size_t p = 0; p < _gpuDstPitchCount[x]; p++)
-				{
-					dstLine[_gpuDstPitchIndex[x] + p] = color;
-				}
-			}
-			
-			for (size_t line = 1; line < dstLineCount; line++)
-			{
-				memcpy(dstLine + (line * dstLineWidth), dstLine, dstLineWidth * sizeof(u16));
+				srcLine[x] = LE_TO_LOCAL_16(src[x]);
 			}
+			src = srcLine;
+#endif
+			_gpuExpandLine(src, dstLine, GPU_FRAMEBUFFER_NATIVE_WIDTH);
+			_gpuCopyLines(dstLine, dstLineWidth, dstLineCount, false);
 		}
 	}
 }
@@ -2453,18 +3000,11 @@ void GPUEngineBase::HandleDisplayModeMainMemory(u16 *dstLine, const size_t l, co
 #endif
 	if (ISCUSTOMRENDERINGNEEDED)
 	{
-		for (size_t i = GPU_FRAMEBUFFER_NATIVE_WIDTH - 1; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i--)
-		{
-			for (size_t p = _gpuDstPitchCount[i] - 1; p < _gpuDstPitchCount[i]; p--)
-			{
-				dstLine[_gpuDstPitchIndex[i] + p] = dstLine[i];
-			}
-		}
+		CACHE_ALIGN u16 srcLine[GPU_FRAMEBUFFER_NATIVE_WIDTH];
+		memcpy(srcLine, dstLine, sizeof(srcLine));
 		
-		for (size_t line = 1; line < dstLineCount; line++)
-		{
-			memcpy(dstLine + (line * dstLineWidth), dstLine, dstLineWidth * sizeof(u16));
-		}
+		_gpuExpandLine(srcLine, dstLine, GPU_FRAMEBUFFER_NATIVE_WIDTH);
+		_gpuCopyLines(dstLine, dstLineWidth, dstLineCount, false);
 	}
 }
 
@@ -2655,6 +3195,8 @@ void GPUEngineBase::SetDisplayByID(const NDSDisplayID theDisplayID)
 	this->_targetDisplayID = theDisplayID;
 	this->nativeBuffer = GPU->GetNativeFramebuffer(theDisplayID);
 	this->customBuffer = GPU->GetCustomFramebuffer(theDisplayID);
+	this->nativeBuffer32 = GPU->GetNativeFramebuffer32(theDisplayID);
+	this->customBuffer32 = GPU->GetCustomFramebuffer32(theDisplayID);
 }
 
 GPUEngineID GPUEngineBase::GetEngineID() const
@@ -2669,51 +3211,425 @@ void GPUEngineBase::SetCustomFramebufferSize(size_t w, size_t h)
 	u16 *newWorkingScanline = (u16 *)memalign_alloc_aligned(w * _gpuLargestDstLineCount * sizeof(u16));
 	u8 *newBGPixels = (u8 *)memalign_alloc_aligned(w * _gpuLargestDstLineCount * 4 * sizeof(u8)); // yes indeed, this is oversized. map debug tools try to write to it
 	
-	this->workingScanline = newWorkingScanline;
-	this->_bgPixels = newBGPixels;
-	this->_VRAMaddrCustom = GPU->GetCustomVRAMBuffer() + (this->_vramBlock * _gpuCaptureLineIndex[GPU_VRAM_BLOCK_LINES] * w);
-	this->customBuffer = GPU->GetCustomFramebuffer(this->_targetDisplayID);
+	this->workingScanline = newWorkingScanline;
+	this->_bgPixels = newBGPixels;
+	this->_VRAMaddrCustom = GPU->GetCustomVRAMBuffer() + (this->_vramBlock * _gpuCaptureLineIndex[GPU_VRAM_BLOCK_LINES] * w);
+	this->customBuffer = GPU->GetCustomFramebuffer(this->_targetDisplayID);
+	this->customBuffer32 = GPU->GetCustomFramebuffer32(this->_targetDisplayID);
+	this->InvalidateLineReuse();
+	
+	memalign_free(oldWorkingScanline);
+	memalign_free(oldBGPixels);
+}
+
+void GPUEngineBase::BlitNativeToCustomFramebuffer()
+{
+	const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
+	
+	if (dispInfo.didPerformCustomRender[this->_targetDisplayID])
+	{
+		return;
+	}
+	
+	const u16 *src = this->nativeBuffer;
+	u16 *dst = this->customBuffer;
+	
+	for (size_t y = 0; y < GPU_FRAMEBUFFER_NATIVE_HEIGHT; y++)
+	{
+		_gpuExpandLine(src, dst, GPU_FRAMEBUFFER_NATIVE_WIDTH);
+		_gpuCopyLines(dst, dispInfo.customWidth, _gpuDstLineCount[y], true);
+		
+		src += GPU_FRAMEBUFFER_NATIVE_WIDTH;
+		dst += dispInfo.customWidth * _gpuDstLineCount[y];
+	}
+	
+	if (this->nativeBuffer32 != NULL)
+	{
+		const u32 *src32 = this->nativeBuffer32;
+		u32 *dst32 = this->customBuffer32;
+		
+		for (size_t y = 0; y < GPU_FRAMEBUFFER_NATIVE_HEIGHT; y++)
+		{
+			_gpuExpandLine(src32, dst32, GPU_FRAMEBUFFER_NATIVE_WIDTH);
+			_gpuCopyLines(dst32, dispInfo.customWidth, _gpuDstLineCount[y], true);
+			
+			src32 += GPU_FRAMEBUFFER_NATIVE_WIDTH;
+			dst32 += dispInfo.customWidth * _gpuDstLineCount[y];
+		}
+	}
+	
+#ifdef ENABLE_SSE2
+	_mm_sfence();
+#endif
+	
+	GPU->SetDisplayDidCustomRender(this->_targetDisplayID, true);
+}
+
+void GPUEngineBase::InvalidateLineReuse()
+{
+	for (size_t l = 0; l < GPU_FRAMEBUFFER_NATIVE_HEIGHT; l++)
+	{
+		this->_lineInputs[l].isValid = 0;
+	}
+}
+
+size_t GPUEngineBase::TakeReusedLineCount()
+{
+	const size_t count = this->_reusedLineCount;
+	this->_reusedLineCount = 0;
+	return count;
+}
+
+static FORCEINLINE bool _gpuVRAMChangedAt(const u8 *ptr, const u64 generation)
+{
+	// extended palettes point at blank_memory when nothing is mapped for them
+	if ( (ptr < MMU.ARM9_LCD) || (ptr >= MMU.ARM9_LCD + sizeof(MMU.ARM9_LCD)) )
+	{
+		return false;
+	}
+	
+	return videoWriteTracking.vramPageChangedSince((ptr - MMU.ARM9_LCD) >> 14, generation);
+}
+
+bool GPUEngineBase::_RenderLine_VideoMemoryChangedSince(const u64 generation) const
+{
+	if ( videoWriteTracking.vramRemappedSince(generation) ||
+	     videoWriteTracking.vmemChangedSince(this->_engineID, generation) ||
+	     videoWriteTracking.oamChangedSince(this->_engineID, generation) )
+	{
+		return true;
+	}
+	
+	// mirrored pages repeat the first ones, so those are all the engine can reach
+	const bool isMain = (this->_engineID == GPUEngineID_Main);
+	const u8 *bgMap = vram_arm9_map + ((isMain) ? VRAM_PAGE_ABG : VRAM_PAGE_BBG);
+	const u8 *objMap = vram_arm9_map + ((isMain) ? VRAM_PAGE_AOBJ : VRAM_PAGE_BOBJ);
+	const size_t bgPageCount = (isMain) ? 32 : 8;
+	const size_t objPageCount = (isMain) ? 16 : 8;
+	
+	for (size_t i = 0; i < bgPageCount; i++)
+	{
+		if (videoWriteTracking.vramPageChangedSince(bgMap[i], generation))
+			return true;
+	}
+	
+	for (size_t i = 0; i < objPageCount; i++)
+	{
+		if (videoWriteTracking.vramPageChangedSince(objMap[i], generation))
+			return true;
+	}
+	
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (_gpuVRAMChangedAt(MMU.ExtPal[this->_engineID][i], generation))
+			return true;
+	}
+	
+	if (_gpuVRAMChangedAt(MMU.ObjExtPal[this->_engineID][0], generation) || _gpuVRAMChangedAt(MMU.ObjExtPal[this->_engineID][1], generation))
+	{
+		return true;
+	}
+	
+	if (this->_dispMode == GPUDisplayMode_VRAM)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			if (videoWriteTracking.vramPageChangedSince((this->_vramBlock * 8) + i, generation))
+				return true;
+		}
+	}
+	
+	return false;
+}
+
+bool GPUEngineBase::_RenderLine_CanReuse(const u16 l, const bool isCustomRenderingNeeded, GPULineInputs &inputs)
+{
+	inputs.isValid = 0;
+	
+	// vertical mosaic takes its colors from earlier lines, which don't get rendered when reused
+	if (!CommonSettings.reuse_2d_lines || (this->dispx_st->dispx_MISC.MOSAIC != 0))
+	{
+		return false;
+	}
+	
+	memset(&inputs, 0, sizeof(GPULineInputs));
+	
+	// DISPSTAT, VCOUNT and the main memory FIFO change on their own and aren't rendered from
+	memcpy(inputs.regs, this->dispx_st, sizeof(inputs.regs));
+	memset(inputs.regs + 0x04, 0, 4);
+	memset(inputs.regs + 0x68, 0, 4);
+	
+	inputs.generation = videoWriteTracking.look();
+	
+	for (size_t i = 0; i < 5; i++)
+	{
+		inputs.enableLayer[i] = (this->_enableLayer[i]) ? 1 : 0;
+	}
+	
+	inputs.isCustomRenderingNeeded = (isCustomRenderingNeeded) ? 1 : 0;
+	inputs.targetDisplayID = this->_targetDisplayID;
+	inputs.isValid = 1;
+	
+	const GPULineInputs &lastInputs = this->_lineInputs[l];
+	if ( (memcmp(&inputs, &lastInputs, offsetof(GPULineInputs, affineAfter)) != 0) || this->_RenderLine_VideoMemoryChangedSince(lastInputs.generation) )
+	{
+		return false;
+	}
+	
+	// the pixels stay as they are, but the affine positions still move on as if the line was rendered
+	this->dispx_st->dispx_BG2PARMS.BGxX = lastInputs.affineAfter[0];
+	this->dispx_st->dispx_BG2PARMS.BGxY = lastInputs.affineAfter[1];
+	this->dispx_st->dispx_BG3PARMS.BGxX = lastInputs.affineAfter[2];
+	this->dispx_st->dispx_BG3PARMS.BGxY = lastInputs.affineAfter[3];
+	
+	this->_reusedLineCount++;
+	return true;
+}
+
+void GPUEngineBase::_RenderLine_KeepInputs(const u16 l, const GPULineInputs &inputs)
+{
+	GPULineInputs &lastInputs = this->_lineInputs[l];
+	
+	lastInputs = inputs;
+	lastInputs.affineAfter[0] = this->dispx_st->dispx_BG2PARMS.BGxX;
+	lastInputs.affineAfter[1] = this->dispx_st->dispx_BG2PARMS.BGxY;
+	lastInputs.affineAfter[2] = this->dispx_st->dispx_BG3PARMS.BGxX;
+	lastInputs.affineAfter[3] = this->dispx_st->dispx_BG3PARMS.BGxY;
+}
+
+static bool _gpuBGRangeChangedSince(const u32 address, const u32 size, const u64 generation)
+{
+	for (u32 page = (address >> 14); page <= ((address + size - 1) >> 14); page++)
+	{
+		if (videoWriteTracking.vramPageChangedSince(vram_arm9_map[page & (VRAM_ARM9_PAGES - 1)], generation))
+			return true;
+	}
+	
+	return false;
+}
+
+static bool _gpuBGBlockChangedSince(const u32 address, const u64 generation)
+{
+	const u32 ofs = ((u32)vram_arm9_map[(address >> 14) & (VRAM_ARM9_PAGES - 1)] << 14) + (address & 0x3FFF);
+	return videoWriteTracking.vramChangedSince(ofs, ADDRESS_STEP_1KB, generation);
+}
+
+// returns the GPU_TILE_COVERAGE bits of the 32 bytes of tile data at tileAddr, looking at them again if vram was written since
+static FORCEINLINE u8 _gpuTileCoverage(const GPUEngineID engineID, const u32 tileAddr)
+{
+	const u8 *src = (const u8 *)MMU_gpu_map(tileAddr);
+	const u32 index = VRAM_TILE_INDEX(engineID, (u32)(src - MMU.ARM9_LCD));
+	
+	if (vram_tile_dirty[index] & VRAM_TILE_DIRTY_COVERAGE)
+	{
+		u8 coverage = 0;
+		
+		for (size_t i = 0; i < 32; i++)
+		{
+			if (src[i] != 0)
+				coverage |= GPU_TILE_COVERAGE_SOLID;
+			if (src[i] == 0)
+				coverage |= GPU_TILE_COVERAGE_HOLE8;
+			if ( ((src[i] & 0x0F) == 0) || ((src[i] & 0xF0) == 0) )
+				coverage |= GPU_TILE_COVERAGE_HOLE4;
+		}
+		
+		_gpuTileCoverageCache[index] = coverage;
+		vram_tile_dirty[index] &= ~VRAM_TILE_DIRTY_COVERAGE;
+	}
+	
+	return _gpuTileCoverageCache[index];
+}
+
+const GPUBGLayerCoverage& GPUEngineBase::_RenderLine_BGLayerCoverage(const GPULayerID layerID)
+{
+	GPUBGLayerCoverage &coverage = this->_bgCoverage[layerID];
+	const u16 bgCnt = this->dispx_st->dispx_BGxCNT[layerID].val;
+	const BGType type = this->_BGTypes[layerID];
+	const u32 mapAddress = this->_BG_map_ram[layerID];
+	const u32 tileAddress = this->_BG_tile_ram[layerID];
+	const u32 mapEntryCount = (this->BGSize[layerID][0] / 8) * (this->BGSize[layerID][1] / 8);
+	
+	// only the tiled BG types are looked at, bitmaps always get rendered
+	bool is4bpp = false;
+	u32 mapEntrySize = 2;
+	u32 tileCount = 1024;
+	
+	switch (type)
+	{
+		case BGType_Text:
+			is4bpp = (this->dispx_st->dispx_BGxCNT[layerID].bits.Palette_256 == 0);
+			break;
+			
+		case BGType_Affine:
+			mapEntrySize = 1;
+			tileCount = 256;
+			break;
+			
+		case BGType_AffineExt_256x16:
+			break;
+			
+		default:
+			coverage.isValid = 0;
+			coverage.isEmpty = 0;
+			coverage.isOpaque = 0;
+			return coverage;
+	}
+	
+	const u32 tileSize = (is4bpp) ? 32 : 64;
+	const u8 holeBit = (is4bpp) ? GPU_TILE_COVERAGE_HOLE4 : GPU_TILE_COVERAGE_HOLE8;
+	const u32 mapSize = mapEntryCount * mapEntrySize;
+	const u32 mapBlockCount = (mapSize + ADDRESS_STEP_1KB - 1) / ADDRESS_STEP_1KB;
+	
+	// a different layout, or different tiles, mean looking at every map block again;
+	// otherwise only the blocks of the map which were written to are
+	const bool isSameLayout = coverage.isValid &&
+	                          (coverage.BGxCNT == bgCnt) &&
+	                          (coverage.type == type) &&
+	                          (coverage.mapAddress == mapAddress) &&
+	                          (coverage.tileAddress == tileAddress) &&
+	                          !videoWriteTracking.vramRemappedSince(coverage.generation);
+	const bool haveTilesChanged = !isSameLayout || _gpuBGRangeChangedSince(tileAddress, tileCount * tileSize, coverage.generation);
+	const bool hasMapChanged = haveTilesChanged || _gpuBGRangeChangedSince(mapAddress, mapSize, coverage.generation);
+	
+	if (!hasMapChanged)
+	{
+		return coverage;
+	}
+	
+	const u64 lastGeneration = coverage.generation;
+	coverage.BGxCNT = bgCnt;
+	coverage.type = type;
+	coverage.isValid = 1;
+	coverage.mapAddress = mapAddress;
+	coverage.tileAddress = tileAddress;
+	coverage.generation = videoWriteTracking.look();
+	
+	bool isEmpty = true;
+	bool isOpaque = true;
+	
+	// the map is looked at in 1KB blocks, which never cross a VRAM page
+	for (u32 block = 0; block < mapBlockCount; block++)
+	{
+		const u32 mapOffset = block * ADDRESS_STEP_1KB;
+		
+		if (haveTilesChanged || _gpuBGBlockChangedSince(mapAddress + mapOffset, lastGeneration))
+		{
+			const u8 *mapChunk = (u8 *)MMU_gpu_map(mapAddress + mapOffset);
+			const u32 chunkEntryCount = std::min<u32>(ADDRESS_STEP_1KB, mapSize - mapOffset) / mapEntrySize;
+			bool isBlockEmpty = true;
+			bool isBlockOpaque = true;
+			
+			for (u32 i = 0; (i < chunkEntryCount) && (isBlockEmpty || isBlockOpaque); i++)
+			{
+				const u32 tileNum = (mapEntrySize == 1) ? mapChunk[i] : (LE_TO_LOCAL_16(((u16 *)mapChunk)[i]) & 0x03FF);
+				const u32 tileAddr = tileAddress + (tileNum * tileSize);
+				u8 tileCoverage = _gpuTileCoverage(this->_engineID, tileAddr);
+				if (!is4bpp)
+					tileCoverage |= _gpuTileCoverage(this->_engineID, tileAddr + 32);
+				
+				if (tileCoverage & GPU_TILE_COVERAGE_SOLID)
+					isBlockEmpty = false;
+				
+				if (tileCoverage & holeBit)
+					isBlockOpaque = false;
+			}
+			
+			coverage.isBlockEmpty[block] = (isBlockEmpty) ? 1 : 0;
+			coverage.isBlockOpaque[block] = (isBlockOpaque) ? 1 : 0;
+		}
+		
+		isEmpty = isEmpty && coverage.isBlockEmpty[block];
+		isOpaque = isOpaque && coverage.isBlockOpaque[block];
+	}
+	
+	coverage.isEmpty = (isEmpty) ? 1 : 0;
+	coverage.isOpaque = (isOpaque) ? 1 : 0;
 	
-	memalign_free(oldWorkingScanline);
-	memalign_free(oldBGPixels);
+	return coverage;
 }
 
-void GPUEngineBase::BlitNativeToCustomFramebuffer()
+// Finds the BG layers that can't show anything on this line, either because their map only
+// refers to transparent tiles, or because an opaque text BG is drawn over them. Layers drawn
+// under another one only get skipped when nothing blends with or windows what's below.
+void GPUEngineBase::_RenderLine_FindSkippedBGLayers(bool *isSkipped)
 {
-	const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
+	isSkipped[0] = isSkipped[1] = isSkipped[2] = isSkipped[3] = false;
 	
-	if (dispInfo.didPerformCustomRender[this->_targetDisplayID])
+	if (this->debug || !CommonSettings.skip_hidden_bg)
 	{
 		return;
 	}
 	
-	u16 *src = this->nativeBuffer;
-	u16 *dst = this->customBuffer;
-	u16 *dstLine = this->customBuffer;
+	GPULayerID drawOrder[NB_BG];
+	size_t drawCount = 0;
 	
-	for (size_t y = 0; y < GPU_FRAMEBUFFER_NATIVE_HEIGHT; y++)
+	for (size_t prio = NB_PRIORITIES; prio > 0; )
 	{
-		for (size_t x = 0; x < GPU_FRAMEBUFFER_NATIVE_WIDTH; x++)
+		prio--;
+		const itemsForPriority_t &item = this->_itemsForPriority[prio];
+		
+		for (size_t i = 0; i < item.nbBGs; i++)
 		{
-			for (size_t p = 0; p < _gpuDstPitchCount[x]; p++)
+			const GPULayerID layerID = (GPULayerID)item.BGs[i];
+			if (this->_enableLayer[layerID])
 			{
-				dst[_gpuDstPitchIndex[x] + p] = src[x];
+				drawOrder[drawCount++] = layerID;
 			}
 		}
+	}
+	
+	const bool canOcclude = (this->_finalColorBckFuncID != 1) && (this->_finalColorBckFuncID < 4);
+	size_t firstShown = 0;
+	
+	for (size_t i = drawCount; canOcclude && (i > 0); )
+	{
+		i--;
+		const GPULayerID layerID = drawOrder[i];
+		if ( (layerID == GPULayerID_BG0) && this->is3DEnabled )
+			continue;
 		
-		dstLine = dst + dispInfo.customWidth;
-		
-		for (size_t line = 1; line < _gpuDstLineCount[y]; line++)
+		if ( (this->_BGTypes[layerID] == BGType_Text) && this->_RenderLine_BGLayerCoverage(layerID).isOpaque )
 		{
-			memcpy(dstLine, dst, dispInfo.customWidth * sizeof(u16));
-			dstLine += dispInfo.customWidth;
+			firstShown = i;
+			break;
 		}
-		
-		src += GPU_FRAMEBUFFER_NATIVE_WIDTH;
-		dst = dstLine;
 	}
 	
-	GPU->SetDisplayDidCustomRender(this->_targetDisplayID, true);
+	for (size_t i = 0; i < drawCount; i++)
+	{
+		const GPULayerID layerID = drawOrder[i];
+		
+		// a mosaic layer keeps colors from earlier lines, so it has to be drawn on every line
+		if ( ((layerID == GPULayerID_BG0) && this->is3DEnabled) || this->dispx_st->dispx_BGxCNT[layerID].bits.Mosaic_Enable )
+			continue;
+		
+		isSkipped[layerID] = (i < firstShown) || this->_RenderLine_BGLayerCoverage(layerID).isEmpty;
+	}
+}
+
+void GPUEngineBase::_RenderLine_SkipBGLayer(const GPULayerID layerID)
+{
+	// affine layers still move on to the next line, just like when they're drawn
+	const BGType type = this->_BGTypes[layerID];
+	if ( (layerID == GPULayerID_BG2 || layerID == GPULayerID_BG3) && (type != BGType_Text) && (type != BGType_Invalid) )
+	{
+		BGxPARMS &params = (layerID == GPULayerID_BG2) ? (this->dispx_st)->dispx_BG2PARMS : (this->dispx_st)->dispx_BG3PARMS;
+		params.BGxX += params.BGxPB;
+		params.BGxY += params.BGxPD;
+	}
+}
+
+// Moves the layers on to the next line without drawing them, for display modes that don't show them
+void GPUEngineBase::_RenderLine_SkipLayers()
+{
+	for (size_t i = 0; i < NB_BG; i++)
+	{
+		if (this->_enableLayer[i])
+		{
+			this->_RenderLine_SkipBGLayer((GPULayerID)i);
+		}
+	}
 }
 
 // normally should have same addresses
@@ -2760,6 +3676,11 @@ void GPUEngineA::Reset()
 	
 	memset(&this->dispCapCnt, 0, sizeof(DISPCAPCNT));
 	
+	this->_isDisplayVRAMFrameConverted = false;
+	this->_displayVRAMFrameBlock = 0;
+	this->_displayVRAMFrameBuffer = NULL;
+	this->_displayVRAMFrameGeneration = 0;
+	
 	this->_BG_tile_ram[0] = MMU_ABG;
 	this->_BG_tile_ram[1] = MMU_ABG;
 	this->_BG_tile_ram[2] = MMU_ABG;
@@ -2871,6 +3792,60 @@ void GPUEngineA::SetCustomFramebufferSize(size_t w, size_t h)
 	memalign_free(oldColorRGBA5551Buffer);
 }
 
+// Converts the whole frame of the displayed VRAM block at line 0, which the following
+// scanlines are then taken from for as long as that VRAM isn't written to.
+template<bool ISCUSTOMRENDERINGNEEDED>
+void GPUEngineA::_RenderLine_ConvertDisplayVRAMFrame(u16 *frameBuffer, const size_t dstLineWidth)
+{
+	this->_isDisplayVRAMFrameConverted = true;
+	this->_displayVRAMFrameBlock = this->_vramBlock;
+	this->_displayVRAMFrameBuffer = frameBuffer;
+	this->_displayVRAMFrameGeneration = videoWriteTracking.look();
+	
+#ifdef LOCAL_LE
+	if (!ISCUSTOMRENDERINGNEEDED)
+	{
+		memcpy(frameBuffer, this->_VRAMaddrNative, GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u16));
+		return;
+	}
+#endif
+	
+	for (size_t l = 0; l < GPU_FRAMEBUFFER_NATIVE_HEIGHT; l++)
+	{
+		const size_t dstLineCount = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineCount[l] : 1;
+		const size_t dstLineIndex = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineIndex[l] : l;
+		
+		this->HandleDisplayModeVRAM<ISCUSTOMRENDERINGNEEDED>(frameBuffer + (dstLineIndex * dstLineWidth), l, dstLineWidth, dstLineCount);
+	}
+}
+
+bool GPUEngineA::_RenderLine_IsDisplayVRAMFrameConverted(const u16 *frameBuffer) const
+{
+	if ( !this->_isDisplayVRAMFrameConverted ||
+	     (this->_displayVRAMFrameBlock != this->_vramBlock) ||
+	     (this->_displayVRAMFrameBuffer != frameBuffer) ||
+	     videoWriteTracking.vramRemappedSince(this->_displayVRAMFrameGeneration) )
+	{
+		return false;
+	}
+	
+	for (size_t i = 0; i < 8; i++)
+	{
+		if (videoWriteTracking.vramPageChangedSince((this->_vramBlock * 8) + i, this->_displayVRAMFrameGeneration))
+			return false;
+	}
+	
+	return true;
+}
+
+// Returns whether the current scanline can be rendered on the render thread. Display
+// capture writes to VRAM and the display FIFO is fed by the emulation, so while either
+// is in use the scanlines have to be rendered in step with the emulation.
+bool GPUEngineA::CanDeferLine() const
+{
+	return !this->dispCapCnt.enabled && (this->_dispMode != GPUDisplayMode_MainMemory);
+}
+
 template<bool ISCUSTOMRENDERINGNEEDED>
 void GPUEngineA::RenderLine(const u16 l, bool skip)
 {
@@ -2889,6 +3864,7 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 		//NOTE:
 		//I am REALLY unsatisfied with this logic now. But it seems to be working..
 		this->refreshAffineStartRegs(-1,-1);
+		this->_isDisplayVRAMFrameConverted = false;
 	}
 	
 	if (skip)
@@ -2907,11 +3883,14 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 	const size_t dstLineCount = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineCount[l] : 1;
 	const size_t dstLineIndex = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineIndex[l] : l;
 	u16 *dstLine = (ISCUSTOMRENDERINGNEEDED) ? this->customBuffer + (dstLineIndex * dstLineWidth) : this->nativeBuffer + (dstLineIndex * dstLineWidth);
+	u32 *dstLine32 = (this->nativeBuffer32 == NULL) ? NULL : (ISCUSTOMRENDERINGNEEDED) ? this->customBuffer32 + (dstLineIndex * dstLineWidth) : this->nativeBuffer32 + (dstLineIndex * dstLineWidth);
 	
 	//blacken the screen if it is turned off by the user
 	if (!CommonSettings.showGpu.main)
 	{
+		this->_lineInputs[l].isValid = 0;
 		memset(dstLine, 0, dstLineWidth * dstLineCount * sizeof(u16));
+		if (dstLine32 != NULL) memset(dstLine32, 0, dstLineWidth * dstLineCount * sizeof(u32));
 		return;
 	}
 	
@@ -2922,11 +3901,60 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 		if ( !this->dispCapCnt.enabled && (l != 0) && (l != 191) )
 		{
 			this->currLine = l;
-			this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLineWidth, dstLineCount);
+			this->_lineInputs[l].isValid = 0;
+			this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLine32, dstLineWidth, dstLineCount);
+			return;
+		}
+	}
+	
+	// a frame shown straight from VRAM gets converted in one go, as long as the lines
+	// after the first would still read what was converted
+	const bool isCapturePending = this->dispCapCnt.enabled || (this->dispCapCnt.val & 0x80000000);
+	u16 *frameBuffer = dstLine - (dstLineIndex * dstLineWidth);
+	
+	if ( (this->_dispMode == GPUDisplayMode_VRAM) && !isCapturePending )
+	{
+		if (l == 0)
+		{
+			this->_RenderLine_ConvertDisplayVRAMFrame<ISCUSTOMRENDERINGNEEDED>(frameBuffer, dstLineWidth);
+		}
+		
+		if (this->_RenderLine_IsDisplayVRAMFrameConverted(frameBuffer))
+		{
+			this->currLine = l;
+			this->_lineInputs[l].isValid = 0;
+			this->_RenderLine_SkipLayers();
+			
+			if (l == 191)
+			{
+				DISP_FIFOreset();
+			}
+			
+			this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLine32, dstLineWidth, dstLineCount);
 			return;
 		}
 	}
 	
+	this->_isDisplayVRAMFrameConverted = false;
+	
+	// display capture writes vram, the FIFO and 3D change without notice, so those lines always get rendered
+	GPULineInputs lineInputs;
+	lineInputs.isValid = 0;
+	
+	const bool canReuseLine = !this->dispCapCnt.enabled && !(this->dispCapCnt.val & 0x80000000) &&
+	                          (this->_dispMode != GPUDisplayMode_MainMemory) &&
+	                          !(this->_enableLayer[0] && this->dispCnt().BG0_3D);
+	
+	if (canReuseLine && this->_RenderLine_CanReuse(l, ISCUSTOMRENDERINGNEEDED, lineInputs))
+	{
+		this->currLine = l;
+		if (l == 191)
+		{
+			DISP_FIFOreset();
+		}
+		return;
+	}
+	
 	//cache some parameters which are assumed to be stable throughout the rendering of the entire line
 	this->currLine = l;
 	const u16 mosaic_control = LE_TO_LOCAL_16(this->dispx_st->dispx_MISC.MOSAIC);
@@ -2936,10 +3964,10 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 	//mosaic test hacks
 	//mosaic_width = mosaic_height = 3;
 	
-	GPUEngineBase::_mosaicLookup.widthValue = mosaic_width;
-	GPUEngineBase::_mosaicLookup.heightValue = mosaic_height;
-	GPUEngineBase::_mosaicLookup.width = &GPUEngineBase::_mosaicLookup.table[mosaic_width][0];
-	GPUEngineBase::_mosaicLookup.height = &GPUEngineBase::_mosaicLookup.table[mosaic_height][0];
+	this->_mosaicWidthValue = mosaic_width;
+	this->_mosaicHeightValue = mosaic_height;
+	this->_mosaicWidth = &GPUEngineBase::_mosaicLookup.table[mosaic_width][0];
+	this->_mosaicHeight = &GPUEngineBase::_mosaicLookup.table[mosaic_height][0];
 	
 	if (this->need_update_winh[0]) this->_UpdateWINH<0>();
 	if (this->need_update_winh[1]) this->_UpdateWINH<1>();
@@ -2959,7 +3987,15 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 		this->currDst = this->workingScanline;
 	}
 	
-	this->_RenderLine_Layer<ISCUSTOMRENDERINGNEEDED>(l, this->currDst, dstLineWidth, dstLineCount);
+	// only the normal display mode and display capture look at what the layers draw
+	if ( (this->_dispMode == GPUDisplayMode_Normal) || isCapturePending )
+	{
+		this->_RenderLine_Layer<ISCUSTOMRENDERINGNEEDED>(l, this->currDst, dstLineWidth, dstLineCount);
+	}
+	else
+	{
+		this->_RenderLine_SkipLayers();
+	}
 	
 	switch (this->_dispMode)
 	{
@@ -3006,7 +4042,8 @@ void GPUEngineA::RenderLine(const u16 l, bool skip)
 		DISP_FIFOreset();
 	}
 	
-	this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLineWidth, dstLineCount);
+	this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLine32, dstLineWidth, dstLineCount);
+	this->_RenderLine_KeepInputs(l, lineInputs);
 }
 
 template <bool ISCUSTOMRENDERINGNEEDED>
@@ -3021,6 +4058,12 @@ void GPUEngineA::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 	
 	const u16 backdrop_color = T1ReadWord(MMU.ARM9_VMEM, 0) & 0x7FFF;
 	
+	const bool isWindowUsed = (this->_finalColorBckFuncID >= 4);
+	if (isWindowUsed)
+	{
+		this->_RenderLine_SetupWindowMask();
+	}
+	
 	//we need to write backdrop colors in the same way as we do BG pixels in order to do correct window processing
 	//this is currently eating up 2fps or so. it is a reasonable candidate for optimization.
 	switch (this->_finalColorBckFuncID)
@@ -3045,10 +4088,12 @@ void GPUEngineA::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 			break;
 			
 			//windowed cases apparently need special treatment? why? can we not render the backdrop? how would that even work?
-		case 4: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,4,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 5: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,5,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 6: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,6,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 7: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,7,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+			this->_RenderLine_WindowedBackdrop<ISCUSTOMRENDERINGNEEDED>(backdrop_color);
+			break;
 	}
 	
 	memset(this->_bgPixels, GPULayerID_None, pixCount);
@@ -3078,16 +4123,13 @@ void GPUEngineA::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 		this->SpriteRender(this->_sprColor, this->_sprAlpha, this->_sprType, this->_sprPrio);
 		this->_MosaicSpriteLine(l, this->_sprColor, this->_sprAlpha, this->_sprType, this->_sprPrio);
 		
-		for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i++)
-		{
-			// assign them to the good priority item
-			const size_t prio = this->_sprPrio[i];
-			if (prio >= 4) continue;
-			
-			item = &(this->_itemsForPriority[prio]);
-			item->PixelsX[item->nbPixelsX] = i;
-			item->nbPixelsX++;
-		}
+		this->_RenderLine_SortSpritePixels();
+	}
+	
+	// the OBJ window was only just rendered for this line
+	if (isWindowUsed && this->_WINOBJ_ENABLED)
+	{
+		this->_RenderLine_SetupWindowMask();
 	}
 	
 	for (size_t j = 0; j < 8; j++)
@@ -3095,6 +4137,9 @@ void GPUEngineA::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 	
 	const bool BG_enabled = this->_enableLayer[0] || this->_enableLayer[1] || this->_enableLayer[2] || this->_enableLayer[3];
 	
+	bool isBGLayerSkipped[NB_BG];
+	this->_RenderLine_FindSkippedBGLayers(isBGLayerSkipped);
+	
 	// paint lower priorities first
 	// then higher priorities on top
 	for (size_t prio = NB_PRIORITIES; prio > 0; )
@@ -3109,6 +4154,12 @@ void GPUEngineA::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 				const GPULayerID layerID = (GPULayerID)item->BGs[i];
 				if (this->_enableLayer[layerID])
 				{
+					if (isBGLayerSkipped[layerID])
+					{
+						this->_RenderLine_SkipBGLayer(layerID);
+						continue;
+					}
+					
 					this->_blend1 = (this->_BLDCNT & (1 << layerID)) != 0;
 					
 					struct _BGxCNT *bgCnt = &(this->dispx_st)->dispx_BGxCNT[layerID].bits;
@@ -3261,6 +4312,12 @@ void GPUEngineA::_RenderLine_DisplayCapture(const u16 l)
 	
 	if (CAPTURELENGTH != 0)
 	{
+		// Capturing the 3D layer needs the 3D render to be done, even if BG0 isn't displaying it.
+		if ( (this->dispCapCnt.srcA != 0) && (this->dispCapCnt.capSrc != 1) )
+		{
+			CurrentRenderer->RenderFinish();
+		}
+		
 		const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
 		VRAM3DUsageProperties &vramUsageProperty = GPU->GetVRAM3DUsageProperties();
 		const u8 vramWriteBlock = this->dispCapCnt.writeBlock;
@@ -3376,6 +4433,8 @@ void GPUEngineA::_RenderLine_DisplayCapture(const u16 l)
 			}
 		}
 		
+		videoWriteTracking.vramWritten(cap_dst_adr, CAPTURELENGTH * sizeof(u16));
+		
 		if (ISCUSTOMRENDERINGNEEDED)
 		{
 			const size_t captureLengthExt = (CAPTURELENGTH) ? dispInfo.customWidth : dispInfo.customWidth / 2;
@@ -3529,14 +4588,14 @@ void GPUEngineA::_RenderLine_DispCapture_Copy(const u16 *__restrict src, u16 *__
 		
 		if (CAPTUREFROMNATIVESRC)
 		{
+			CACHE_ALIGN u16 srcLine[CAPTURELENGTH];
 			for (size_t i = 0; i < CAPTURELENGTH; i++)
 			{
-				for (size_t p = 0; p < _gpuDstPitchCount[i]; p++)
-				{
-					dst[_gpuDstPitchIndex[i] + p] = LE_TO_LOCAL_16(src[i]) | alphaBit;
-				}
+				srcLine[i] = LE_TO_LOCAL_16(src[i]) | alphaBit;
 			}
 			
+			_gpuExpandLine(srcLine, dst, CAPTURELENGTH);
+			
 			for (size_t line = 1; line < captureLineCount; line++)
 			{
 				memcpy(dst + (line * dispInfo.customWidth), dst, captureLengthExt * sizeof(u16));
@@ -3851,11 +4910,14 @@ void GPUEngineB::RenderLine(const u16 l, bool skip)
 	const size_t dstLineCount = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineCount[l] : 1;
 	const size_t dstLineIndex = (ISCUSTOMRENDERINGNEEDED) ? _gpuDstLineIndex[l] : l;
 	u16 *dstLine = (ISCUSTOMRENDERINGNEEDED) ? this->customBuffer + (dstLineIndex * dstLineWidth) : this->nativeBuffer + (dstLineIndex * dstLineWidth);
+	u32 *dstLine32 = (this->nativeBuffer32 == NULL) ? NULL : (ISCUSTOMRENDERINGNEEDED) ? this->customBuffer32 + (dstLineIndex * dstLineWidth) : this->nativeBuffer32 + (dstLineIndex * dstLineWidth);
 	
 	//blacken the screen if it is turned off by the user
 	if (!CommonSettings.showGpu.sub)
 	{
+		this->_lineInputs[l].isValid = 0;
 		memset(dstLine, 0, dstLineWidth * dstLineCount * sizeof(u16));
+		if (dstLine32 != NULL) memset(dstLine32, 0, dstLineWidth * dstLineCount * sizeof(u32));
 		return;
 	}
 	
@@ -3864,7 +4926,15 @@ void GPUEngineB::RenderLine(const u16 l, bool skip)
 	{
 		// except if it could cause any side effects (for example if we're capturing), then don't skip anything
 		this->currLine = l;
-		this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLineWidth, dstLineCount);
+		this->_lineInputs[l].isValid = 0;
+		this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLine32, dstLineWidth, dstLineCount);
+		return;
+	}
+	
+	GPULineInputs lineInputs;
+	if (this->_RenderLine_CanReuse(l, ISCUSTOMRENDERINGNEEDED, lineInputs))
+	{
+		this->currLine = l;
 		return;
 	}
 	
@@ -3877,10 +4947,10 @@ void GPUEngineB::RenderLine(const u16 l, bool skip)
 	//mosaic test hacks
 	//mosaic_width = mosaic_height = 3;
 	
-	GPUEngineBase::_mosaicLookup.widthValue = mosaic_width;
-	GPUEngineBase::_mosaicLookup.heightValue = mosaic_height;
-	GPUEngineBase::_mosaicLookup.width = &GPUEngineBase::_mosaicLookup.table[mosaic_width][0];
-	GPUEngineBase::_mosaicLookup.height = &GPUEngineBase::_mosaicLookup.table[mosaic_height][0];
+	this->_mosaicWidthValue = mosaic_width;
+	this->_mosaicHeightValue = mosaic_height;
+	this->_mosaicWidth = &GPUEngineBase::_mosaicLookup.table[mosaic_width][0];
+	this->_mosaicHeight = &GPUEngineBase::_mosaicLookup.table[mosaic_height][0];
 	
 	if (this->need_update_winh[0]) this->_UpdateWINH<0>();
 	if (this->need_update_winh[1]) this->_UpdateWINH<1>();
@@ -3921,7 +4991,8 @@ void GPUEngineB::RenderLine(const u16 l, bool skip)
 			break;
 	}
 	
-	this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLineWidth, dstLineCount);
+	this->_RenderLine_MasterBrightness<ISCUSTOMRENDERINGNEEDED>(dstLine, dstLine32, dstLineWidth, dstLineCount);
+	this->_RenderLine_KeepInputs(l, lineInputs);
 }
 
 template <bool ISCUSTOMRENDERINGNEEDED>
@@ -3936,6 +5007,12 @@ void GPUEngineB::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 	
 	const u16 backdrop_color = T1ReadWord(MMU.ARM9_VMEM, ADDRESS_STEP_1KB) & 0x7FFF;
 	
+	const bool isWindowUsed = (this->_finalColorBckFuncID >= 4);
+	if (isWindowUsed)
+	{
+		this->_RenderLine_SetupWindowMask();
+	}
+	
 	//we need to write backdrop colors in the same way as we do BG pixels in order to do correct window processing
 	//this is currently eating up 2fps or so. it is a reasonable candidate for optimization.
 	switch (this->_finalColorBckFuncID)
@@ -3960,10 +5037,12 @@ void GPUEngineB::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 			break;
 			
 			//windowed cases apparently need special treatment? why? can we not render the backdrop? how would that even work?
-		case 4: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,4,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 5: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,5,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 6: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,6,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
-		case 7: for(size_t x=0;x<GPU_FRAMEBUFFER_NATIVE_WIDTH;x++) this->___setFinalColorBck<GPULayerID_None,false,true,7,ISCUSTOMRENDERINGNEEDED,false>(backdrop_color,x,true); break;
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+			this->_RenderLine_WindowedBackdrop<ISCUSTOMRENDERINGNEEDED>(backdrop_color);
+			break;
 	}
 	
 	memset(this->_bgPixels, 5, pixCount);
@@ -3993,16 +5072,13 @@ void GPUEngineB::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 		this->SpriteRender(this->_sprColor, this->_sprAlpha, this->_sprType, this->_sprPrio);
 		this->_MosaicSpriteLine(l, this->_sprColor, this->_sprAlpha, this->_sprType, this->_sprPrio);
 		
-		for (size_t i = 0; i < GPU_FRAMEBUFFER_NATIVE_WIDTH; i++)
-		{
-			// assign them to the good priority item
-			const size_t prio = this->_sprPrio[i];
-			if (prio >= 4) continue;
-			
-			item = &(this->_itemsForPriority[prio]);
-			item->PixelsX[item->nbPixelsX] = i;
-			item->nbPixelsX++;
-		}
+		this->_RenderLine_SortSpritePixels();
+	}
+	
+	// the OBJ window was only just rendered for this line
+	if (isWindowUsed && this->_WINOBJ_ENABLED)
+	{
+		this->_RenderLine_SetupWindowMask();
 	}
 	
 	for (size_t j = 0; j < 8; j++)
@@ -4010,6 +5086,9 @@ void GPUEngineB::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 	
 	const bool BG_enabled = this->_enableLayer[0] || this->_enableLayer[1] || this->_enableLayer[2] || this->_enableLayer[3];
 	
+	bool isBGLayerSkipped[NB_BG];
+	this->_RenderLine_FindSkippedBGLayers(isBGLayerSkipped);
+	
 	// paint lower priorities first
 	// then higher priorities on top
 	for (size_t prio = NB_PRIORITIES; prio > 0; )
@@ -4024,6 +5103,12 @@ void GPUEngineB::_RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLi
 				const GPULayerID layerID = (GPULayerID)item->BGs[i];
 				if (this->_enableLayer[layerID])
 				{
+					if (isBGLayerSkipped[layerID])
+					{
+						this->_RenderLine_SkipBGLayer(layerID);
+						continue;
+					}
+					
 					this->_blend1 = (this->_BLDCNT & (1 << layerID)) != 0;
 					
 					struct _BGxCNT *bgCnt = &(this->dispx_st)->dispx_BGxCNT[layerID].bits;
@@ -4141,6 +5226,14 @@ GPUSubsystem::GPUSubsystem()
 	_customVRAM = NULL;
 	_customVRAMBlank = NULL;
 	_customFramebuffer = (u16 *)memalign_alloc_aligned(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u16) * 2);
+	_nativeFramebuffer32 = NULL;
+	_customFramebuffer32 = NULL;
+	
+	if (CommonSettings.output_xrgb8888)
+	{
+		_nativeFramebuffer32 = (u32 *)memalign_alloc_aligned(GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u32) * 2);
+		_customFramebuffer32 = (u32 *)memalign_alloc_aligned(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT * sizeof(u32) * 2);
+	}
    _displayInfo.customWidth = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
 	_displayInfo.customHeight = GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
 	
@@ -4162,11 +5255,33 @@ GPUSubsystem::GPUSubsystem()
 	_displayInfo.renderedHeight[1] = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
 	_displayInfo.renderedBuffer[0] = _displayInfo.nativeBuffer[0];
 	_displayInfo.renderedBuffer[1] = _displayInfo.nativeBuffer[1];
+	_displayInfo.reusedLineCount[0] = 0;
+	_displayInfo.reusedLineCount[1] = 0;
+	
+	_isRenderPending = false;
 }
 
 GPUSubsystem::~GPUSubsystem()
 {
+	this->FinishDeferredRender();
+	
+	if (_gpuSubEngineTaskStarted)
+	{
+		_gpuSubEngineTask.shutdown();
+		_gpuSubEngineTaskStarted = false;
+	}
+	
+	if (_gpuDeferred.isTaskStarted)
+	{
+		_gpuDeferred.task.shutdown();
+		slock_free(_gpuDeferred.lock);
+		_gpuDeferred.lock = NULL;
+		_gpuDeferred.isTaskStarted = false;
+	}
+	
 	memalign_free(this->_customFramebuffer);
+	memalign_free(this->_nativeFramebuffer32);
+	memalign_free(this->_customFramebuffer32);
 	memalign_free(this->_customVRAM);
 	memalign_free(_gpuDstToSrcIndex);
 
@@ -4182,6 +5297,8 @@ GPUSubsystem::~GPUSubsystem()
 
 void GPUSubsystem::Reset()
 {
+	this->FinishDeferredRender();
+	
 	if (this->_customVRAM == NULL || this->_customVRAM == NULL || this->_customFramebuffer == NULL)
 	{
 		this->SetCustomFramebufferSize(this->_displayInfo.customWidth, this->_displayInfo.customHeight);
@@ -4355,6 +5472,31 @@ u16* GPUSubsystem::GetNativeFramebuffer(const NDSDisplayID theDisplayID)
 	return (theDisplayID == NDSDisplayID_Main) ? this->_nativeFramebuffer : this->_nativeFramebuffer + (GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT);
 }
 
+u32* GPUSubsystem::GetNativeFramebuffer32(const NDSDisplayID theDisplayID)
+{
+	if (this->_nativeFramebuffer32 == NULL)
+	{
+		return NULL;
+	}
+	
+	return (theDisplayID == NDSDisplayID_Main) ? this->_nativeFramebuffer32 : this->_nativeFramebuffer32 + (GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT);
+}
+
+u32* GPUSubsystem::GetCustomFramebuffer32()
+{
+	return this->_customFramebuffer32;
+}
+
+u32* GPUSubsystem::GetCustomFramebuffer32(const NDSDisplayID theDisplayID)
+{
+	if (this->_customFramebuffer32 == NULL)
+	{
+		return NULL;
+	}
+	
+	return (theDisplayID == NDSDisplayID_Main) ? this->_customFramebuffer32 : this->_customFramebuffer32 + (this->_displayInfo.customWidth * this->_displayInfo.customHeight);
+}
+
 u16* GPUSubsystem::GetCustomFramebuffer()
 {
 	return this->_customFramebuffer;
@@ -4382,6 +5524,7 @@ void GPUSubsystem::SetCustomFramebufferSize(size_t w, size_t h)
 		return;
 	}
 	
+	this->FinishDeferredRender();
 	CurrentRenderer->RenderFinish();
 	
 	const float customWidthScale = (float)w / (float)GPU_FRAMEBUFFER_NATIVE_WIDTH;
@@ -4408,6 +5551,8 @@ void GPUSubsystem::SetCustomFramebufferSize(size_t w, size_t h)
 		currentLineCount += lineCount;
 	}
 	
+	_gpuDstPitchScale = ((w % GPU_FRAMEBUFFER_NATIVE_WIDTH) == 0) ? w / GPU_FRAMEBUFFER_NATIVE_WIDTH : 0;
+	
 	for (size_t srcY = 0, currentLineCount = 0; srcY < GPU_VRAM_BLOCK_LINES + 1; srcY++)
 	{
 		const size_t lineCount = (size_t)ceilf((srcY+1) * customHeightScale) - currentLineCount;
@@ -4433,6 +5578,14 @@ void GPUSubsystem::SetCustomFramebufferSize(size_t w, size_t h)
 	u16 *newCustomFramebuffer = (u16 *)memalign_alloc_aligned(w * h * sizeof(u16) * 2);
 	memset_u16(newCustomFramebuffer, 0x8000, w * h * 2);
 	
+	u32 *oldCustomFramebuffer32 = this->_customFramebuffer32;
+	u32 *newCustomFramebuffer32 = NULL;
+	if (oldCustomFramebuffer32 != NULL)
+	{
+		newCustomFramebuffer32 = (u32 *)memalign_alloc_aligned(w * h * sizeof(u32) * 2);
+		memset(newCustomFramebuffer32, 0, w * h * sizeof(u32) * 2);
+	}
+	
 	const size_t newCustomVRAMBlockSize = _gpuCaptureLineIndex[GPU_VRAM_BLOCK_LINES] * w;
 	const size_t newCustomVRAMBlankSize = newGpuLargestDstLineCount * w;
 	u16 *newCustomVRAM = (u16 *)memalign_alloc_aligned(((newCustomVRAMBlockSize * 4) + newCustomVRAMBlankSize) * sizeof(u16));
@@ -4445,6 +5598,7 @@ void GPUSubsystem::SetCustomFramebufferSize(size_t w, size_t h)
 	this->_customVRAMBlank = newCustomVRAM + (newCustomVRAMBlockSize * 4);
 	
 	this->_customFramebuffer = newCustomFramebuffer;
+	this->_customFramebuffer32 = newCustomFramebuffer32;
 	
 	this->_displayInfo.isCustomSizeRequested = ( (w != GPU_FRAMEBUFFER_NATIVE_WIDTH) || (h != GPU_FRAMEBUFFER_NATIVE_HEIGHT) );
 	this->_displayInfo.masterCustomBuffer = this->_customFramebuffer;
@@ -4472,6 +5626,7 @@ void GPUSubsystem::SetCustomFramebufferSize(size_t w, size_t h)
 	}
 	
 	memalign_free(oldCustomFramebuffer);
+	memalign_free(oldCustomFramebuffer32);
 	memalign_free(oldGpuDstToSrcIndexPtr);
 	memalign_free(oldCustomVRAM);
 }
@@ -4502,12 +5657,149 @@ void GPUSubsystem::SetWillAutoBlitNativeToCustomBuffer(const bool willAutoBlit)
 }
 
 void GPUSubsystem::RenderLine(const u16 l, bool skip)
+{
+	if (!CommonSettings.deferred_2d || CommonSettings.single_core())
+	{
+		this->_RenderLine(l, skip);
+		return;
+	}
+	
+	// Writes the ARM9 made to 2D state since the last scanline was queued are
+	// still held back in the MMU's journal. The render thread applies engine
+	// register writes itself, right before the line they belong to. Anything
+	// else (VRAM, palette, OAM, or the state CanDeferLine() looks at) has to
+	// land here first.
+	if (MMU_pending2DWritesNeedSync())
+	{
+		this->FinishDeferredRender();
+	}
+	
+	// The first and last scanlines do the per-frame setup and teardown, and some
+	// scanlines have side effects that the emulation can see. Those are rendered
+	// right here, once the render thread has caught up.
+	if ( (l == 0) || (l == GPU_FRAMEBUFFER_NATIVE_HEIGHT - 1) || !this->_engineMain->CanDeferLine() )
+	{
+		this->FinishDeferredRender();
+		this->_RenderLine(l, skip);
+		return;
+	}
+	
+	if (!_gpuDeferred.isTaskStarted)
+	{
+		_gpuDeferred.lock = slock_new();
+		_gpuDeferred.running = false;
+		_gpuDeferred.queued = 0;
+		_gpuDeferred.next = 0;
+		_gpuDeferred.journalApplied = 0;
+		_gpuDeferred.task.start();
+		_gpuDeferred.isTaskStarted = true;
+	}
+	
+	slock_lock(_gpuDeferred.lock);
+	_gpuDeferred.line[_gpuDeferred.queued] = l;
+	_gpuDeferred.skip[_gpuDeferred.queued] = skip;
+	_gpuDeferred.journalEnd[_gpuDeferred.queued] = MMU_2DJournalPosition();
+	_gpuDeferred.queued++;
+	const bool willStartJob = !_gpuDeferred.running;
+	_gpuDeferred.running = true;
+	slock_unlock(_gpuDeferred.lock);
+	
+	this->_isRenderPending = true;
+	
+	if (willStartJob)
+	{
+		_gpuDeferred.task.execute(&GPUSubsystem::_DeferredRenderProc, this);
+	}
+}
+
+void* GPUSubsystem::_DeferredRenderProc(void *arg)
+{
+	GPUSubsystem *gpu = (GPUSubsystem *)arg;
+	
+	for (;;)
+	{
+		slock_lock(_gpuDeferred.lock);
+		
+		if (_gpuDeferred.next == _gpuDeferred.queued)
+		{
+			_gpuDeferred.running = false;
+			slock_unlock(_gpuDeferred.lock);
+			return NULL;
+		}
+		
+		const size_t i = _gpuDeferred.next++;
+		slock_unlock(_gpuDeferred.lock);
+		
+		// the register writes made before this line was queued, in order
+		MMU_apply2DWrites(_gpuDeferred.journalApplied, _gpuDeferred.journalEnd[i]);
+		_gpuDeferred.journalApplied = _gpuDeferred.journalEnd[i];
+		
+		gpu->_RenderLine(_gpuDeferred.line[i], _gpuDeferred.skip[i]);
+	}
+}
+
+void GPUSubsystem::FinishDeferredRender()
+{
+	if (!this->_isRenderPending)
+	{
+		return;
+	}
+	
+	_gpuDeferred.task.finish();
+	
+	// The job only returns once the queue is empty, so nothing can be running now.
+	_gpuDeferred.queued = 0;
+	_gpuDeferred.next = 0;
+	this->_isRenderPending = false;
+	
+	// Now the writes the ARM9 made after the last queued line can go through.
+	const u32 journalApplied = _gpuDeferred.journalApplied;
+	_gpuDeferred.journalApplied = 0;
+	MMU_replay2DWrites(journalApplied);
+}
+
+void* GPUSubsystem::_RenderSubEngineProc(void *arg)
+{
+	GPUSubsystem *gpu = (GPUSubsystem *)arg;
+	
+	if (gpu->_engineSub->isCustomRenderingNeeded)
+	{
+		gpu->_engineSub->RenderLine<true>(gpu->_subEngineLine, gpu->_subEngineSkip);
+	}
+	else
+	{
+		gpu->_engineSub->RenderLine<false>(gpu->_subEngineLine, gpu->_subEngineSkip);
+	}
+	
+	return NULL;
+}
+
+void GPUSubsystem::_RenderLine(const u16 l, bool skip)
 {
 	if (l == 0)
 	{
 		GPU->UpdateVRAM3DUsageProperties();
 	}
 	
+	// The sub engine only reads its own registers, VRAM banks, palette and OAM, so it
+	// can render its line on another thread while the main engine renders here. Both
+	// lines are finished before returning, so VRAM bank changes between lines are seen
+	// by both engines at the same point as when rendering them one after the other.
+	const bool willRenderSubEngineInParallel = !skip && CommonSettings.parallel_2d && !CommonSettings.single_core();
+	this->_subEngineLine = l;
+	this->_subEngineSkip = skip;
+	
+	if (willRenderSubEngineInParallel)
+	{
+		if (!_gpuSubEngineTaskStarted)
+		{
+			_gpuSubEngineTask.start();
+			_gpuSubEngineTaskStarted = true;
+		}
+		
+		_gpuSubEngineTask.execute(&GPUSubsystem::_RenderSubEngineProc, this);
+	}
+	
 	if (this->_engineMain->isCustomRenderingNeeded)
 	{
 		this->_engineMain->RenderLine<true>(l, skip);
@@ -4517,25 +5809,35 @@ void GPUSubsystem::RenderLine(const u16 l, bool skip)
 		this->_engineMain->RenderLine<false>(l, skip);
 	}
 	
-	if (this->_engineSub->isCustomRenderingNeeded)
+	if (willRenderSubEngineInParallel)
 	{
-		this->_engineSub->RenderLine<true>(l, skip);
+		_gpuSubEngineTask.finish();
 	}
 	else
 	{
-		this->_engineSub->RenderLine<false>(l, skip);
+		GPUSubsystem::_RenderSubEngineProc(this);
 	}
 	
 	if (l == 191)
 	{
-		
+		this->_displayInfo.reusedLineCount[this->_engineMain->GetDisplayByID()] = this->_engineMain->TakeReusedLineCount();
+		this->_displayInfo.reusedLineCount[this->_engineSub->GetDisplayByID()] = this->_engineSub->TakeReusedLineCount();
 	}
 }
 
 void GPUSubsystem::ClearWithColor(const u16 colorBGRA5551)
 {
+	this->_engineMain->InvalidateLineReuse();
+	this->_engineSub->InvalidateLineReuse();
+	
 	memset_u16(this->_nativeFramebuffer, colorBGRA5551, GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * 2);
 	memset_u16(this->_customFramebuffer, colorBGRA5551, this->_displayInfo.customWidth * this->_displayInfo.customHeight * 2);
+	
+	if (this->_nativeFramebuffer32 != NULL)
+	{
+		memset_u32(this->_nativeFramebuffer32, RGB15TO24_REVERSE(colorBGRA5551), GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * 2);
+		memset_u32(this->_customFramebuffer32, RGB15TO24_REVERSE(colorBGRA5551), this->_displayInfo.customWidth * this->_displayInfo.customHeight * 2);
+	}
 }
 
 NDSDisplay::NDSDisplay()
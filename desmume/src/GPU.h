@@ -695,8 +695,48 @@ typedef struct
 	size_t renderedWidth[2];			// The display rendered at this width, measured in pixels
 	size_t renderedHeight[2];			// The display rendered at this height, measured in pixels
 	u16 *renderedBuffer[2];				// The display rendered to this buffer
+	
+	size_t reusedLineCount[2];			// Number of lines of the last frame that were left as they were in the frame before
 } NDSDisplayInfo;
 
+// Everything a 2D engine's scanline is rendered from, except for the 3D layer and video
+// memory. If the inputs of a line are the same as when the line was last rendered, and
+// none of the video memory the engine reads was written since, then rendering it again
+// would just produce the same pixels.
+typedef struct
+{
+	u8 regs[0x70];						// The engine's registers, including the running affine positions
+	u8 enableLayer[5];
+	u8 isCustomRenderingNeeded;
+	u8 targetDisplayID;
+	u8 isValid;
+	
+	s32 affineAfter[4];					// BG2X, BG2Y, BG3X and BG3Y after rendering the line; not compared
+	u64 generation;						// Video write generation taken when the line was rendered; not compared
+} GPULineInputs;
+
+#define GPU_BG_MAP_BLOCK_COUNT 32			// 1KB blocks in the largest BG map (128x128 16-bit entries)
+
+// What a tiled BG layer's map and tiles can show, looked at over the whole map. Kept
+// until the BG's control bits or the video memory it reads change. It is also kept for
+// each 1KB block of the map, so that a write to the map only has the written blocks
+// looked at again.
+typedef struct
+{
+	u16 BGxCNT;
+	u8 type;
+	u8 isValid;
+	u32 mapAddress;
+	u32 tileAddress;
+	
+	u8 isEmpty;							// Every tile the map refers to is fully transparent
+	u8 isOpaque;						// No tile the map refers to has a transparent pixel
+	u64 generation;						// Video write generation taken when the layer was looked at
+	
+	u8 isBlockEmpty[GPU_BG_MAP_BLOCK_COUNT];
+	u8 isBlockOpaque[GPU_BG_MAP_BLOCK_COUNT];
+} GPUBGLayerCoverage;
+
 #define VRAM_NO_3D_USAGE 0xFF
 
 class GPUEngineBase
@@ -727,16 +767,21 @@ protected:
 				}
 		}
 		
-		TableEntry *width, *height;
-		int widthValue, heightValue;
-		
 	} _mosaicLookup;
 	
+	// The mosaic sizes of the current line. These are per engine, since both engines
+	// can be rendering a line at the same time.
+	MosaicLookup::TableEntry *_mosaicWidth;
+	MosaicLookup::TableEntry *_mosaicHeight;
+	int _mosaicWidthValue;
+	int _mosaicHeightValue;
+	
 	CACHE_ALIGN u16 _sprColor[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	CACHE_ALIGN u8 _sprAlpha[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	CACHE_ALIGN u8 _sprType[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	CACHE_ALIGN u8 _sprPrio[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	CACHE_ALIGN u8 _sprWin[GPU_FRAMEBUFFER_NATIVE_WIDTH];
+	CACHE_ALIGN u8 _winMask[GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	
 	bool _enableLayer[5];
 	itemsForPriority_t _itemsForPriority[NB_PRIORITIES];
@@ -762,6 +807,16 @@ protected:
 	u8 _sprBMPMode;
 	u32 _sprEnable;
 	
+	// OAM indexes of the sprites that intersect each line, in OAM order. Rebuilt whenever OAM is written.
+	u8 _sprLineCount[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	u8 _sprLineList[GPU_FRAMEBUFFER_NATIVE_HEIGHT][128];
+	u64 _sprListGeneration;
+	
+	// Result of the last search of OAM for a 64x64 bitmap sprite showing the display capture
+	u64 _captureSpriteGeneration;
+	u32 _captureSpriteWriteOffset;
+	bool _captureSpriteFound;
+	
 	u16 *_currentFadeInColors;
 	u16 *_currentFadeOutColors;
 	
@@ -780,6 +835,11 @@ protected:
 	GPUDisplayMode _dispMode;
 	u8 _vramBlock;
 	
+	GPULineInputs _lineInputs[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	size_t _reusedLineCount;
+	
+	GPUBGLayerCoverage _bgCoverage[4];
+	
 	CACHE_ALIGN u8 _sprNum[256];
 	CACHE_ALIGN u8 _h_win[2][GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	const u8 *_curr_win[2];
@@ -843,12 +903,13 @@ protected:
 	template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED> void _LineRot();
 	template<GPULayerID LAYERID, bool MOSAIC, bool ISCUSTOMRENDERINGNEEDED> void _LineExtRot();
 	
-	// check whether (x,y) is within the rectangle (including wraparounds)
-	template<int WIN_NUM> u8 _WithinRect(const size_t x) const;
+	void _RenderLine_SetupWindowMask();
 	template <GPULayerID LAYERID> void _RenderLine_CheckWindows(const size_t srcX, bool &draw, bool &effect) const;
+	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_WindowedBackdrop(const u16 backdrop_color);
+	void _RenderLine_SortSpritePixels();
 	
 	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLineWidth, const size_t dstLineCount);
-	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_MasterBrightness(u16 *dstLine, const size_t dstLineWidth, const size_t dstLineCount);
+	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_MasterBrightness(u16 *dstLine, u32 *dstLine32, const size_t dstLineWidth, const size_t dstLineCount);
 	
 	template<size_t WIN_NUM> void _UpdateWINH();
 	template<size_t WIN_NUM> void _SetupWindows();
@@ -877,9 +938,19 @@ protected:
 	bool _ComputeSpriteVars(const OAMAttributes &spriteInfo, const u16 l, SpriteSize &sprSize, s32 &sprX, s32 &sprY, s32 &x, s32 &y, s32 &lg, s32 &xdir);
 	
 	u32 _SpriteAddressBMP(const OAMAttributes &spriteInfo, const SpriteSize sprSize, const s32 y);
+	void _SpriteBuildLineLists();
 	
 	template<SpriteRenderMode MODE> void _SpriteRenderPerform(u16 *dst, u8 *dst_alpha, u8 *typeTab, u8 *prioTab);
 	
+	bool _RenderLine_VideoMemoryChangedSince(const u64 generation) const;
+	bool _RenderLine_CanReuse(const u16 l, const bool isCustomRenderingNeeded, GPULineInputs &inputs);
+	void _RenderLine_KeepInputs(const u16 l, const GPULineInputs &inputs);
+	
+	const GPUBGLayerCoverage& _RenderLine_BGLayerCoverage(const GPULayerID layerID);
+	void _RenderLine_FindSkippedBGLayers(bool *isSkipped);
+	void _RenderLine_SkipBGLayer(const GPULayerID layerID);
+	void _RenderLine_SkipLayers();
+	
 public:
 	GPUEngineBase();
 	virtual ~GPUEngineBase();
@@ -915,6 +986,8 @@ public:
 	
 	u16 *customBuffer;
 	u16 *nativeBuffer;
+	u32 *customBuffer32;				// XRGB8888 output, NULL unless CommonSettings.output_xrgb8888
+	u32 *nativeBuffer32;
 	size_t renderedWidth;
 	size_t renderedHeight;
 	u16 *renderedBuffer;
@@ -1007,6 +1080,11 @@ public:
 	virtual void SetCustomFramebufferSize(size_t w, size_t h);
 	void BlitNativeToCustomFramebuffer();
 	
+	// Forgets the inputs of all lines, so that none of them gets reused. Needed whenever the
+	// framebuffer is written by anything other than the engine's own line rendering.
+	void InvalidateLineReuse();
+	size_t TakeReusedLineCount();
+	
 	void REG_DISPx_pack_test();
 };
 
@@ -1016,6 +1094,16 @@ protected:
 	FragmentColor *_3DFramebufferRGBA6665;
 	u16 *_3DFramebufferRGBA5551;
 	
+	// The display VRAM block is converted for the whole frame on line 0. The lines after that
+	// are left as they are for as long as nothing could have changed what they show.
+	bool _isDisplayVRAMFrameConverted;
+	u8 _displayVRAMFrameBlock;
+	u16 *_displayVRAMFrameBuffer;
+	u64 _displayVRAMFrameGeneration;
+	
+	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_ConvertDisplayVRAMFrame(u16 *frameBuffer, const size_t dstLineWidth);
+	bool _RenderLine_IsDisplayVRAMFrameConverted(const u16 *frameBuffer) const;
+	
 	template<bool ISCUSTOMRENDERINGNEEDED> void _RenderLine_Layer(const u16 l, u16 *dstLine, const size_t dstLineWidth, const size_t dstLineCount);
 	template<bool ISCUSTOMRENDERINGNEEDED, size_t CAPTURELENGTH> void _RenderLine_DisplayCapture(const u16 l);
 	void _RenderLine_DispCapture_FIFOToBuffer(u16 *fifoLineBuffer);
@@ -1048,6 +1136,7 @@ public:
 	FragmentColor* Get3DFramebufferRGBA6665() const;
 	u16* Get3DFramebufferRGBA5551() const;
 	virtual void SetCustomFramebufferSize(size_t w, size_t h);
+	bool CanDeferLine() const;
 		
 	template<bool ISCUSTOMRENDERINGNEEDED> void RenderLine(const u16 l, bool skip);
 };
@@ -1097,9 +1186,19 @@ private:
 	
 	CACHE_ALIGN u16 _nativeFramebuffer[GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT * 2];
 	u16 *_customFramebuffer;
+	u32 *_nativeFramebuffer32;
+	u32 *_customFramebuffer32;
 	
 	NDSDisplayInfo _displayInfo;
 	
+	bool _isRenderPending;
+	u16 _subEngineLine;
+	bool _subEngineSkip;
+	
+	void _RenderLine(const u16 l, bool skip);
+	static void* _DeferredRenderProc(void *arg);
+	static void* _RenderSubEngineProc(void *arg);
+	
 public:
 	GPUSubsystem();
 	~GPUSubsystem();
@@ -1119,6 +1218,13 @@ public:
 	u16* GetCustomFramebuffer();
 	u16* GetCustomFramebuffer(const NDSDisplayID theDisplayID);
 	
+	// With CommonSettings.output_xrgb8888, the displays are also output as XRGB8888,
+	// converted from RGB555 while the master brightness is applied. These buffers
+	// are laid out like the ones above, and are NULL when the setting is off.
+	u32* GetNativeFramebuffer32(const NDSDisplayID theDisplayID);
+	u32* GetCustomFramebuffer32();
+	u32* GetCustomFramebuffer32(const NDSDisplayID theDisplayID);
+	
 	u16* GetCustomVRAMBuffer();
 	u16* GetCustomVRAMBlankBuffer();
 	
@@ -1144,7 +1250,16 @@ public:
 	bool GetWillAutoBlitNativeToCustomBuffer() const;
 	void SetWillAutoBlitNativeToCustomBuffer(const bool willAutoBlit);
 	
+	// With CommonSettings.deferred_2d, RenderLine() may only queue the scanline for
+	// the render thread. IsRenderPending() tells whether any queued scanlines may
+	// still be unfinished, and FinishDeferredRender() waits for all of them. This
+	// must be done before changing any state that the 2D engines read, such as
+	// their registers, VRAM, palette or OAM. The ARM9's writes to that state are
+	// journaled by the MMU meanwhile. The render thread applies the register writes
+	// ahead of the line they were made for, and FinishDeferredRender() replays the rest.
 	void RenderLine(const u16 l, bool skip = false);
+	bool IsRenderPending() const { return this->_isRenderPending; }
+	void FinishDeferredRender();
 	void ClearWithColor(const u16 colorBGRA5551);
 };
 
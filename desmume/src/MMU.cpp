@@ -24,6 +24,7 @@
 #include <sstream>
 
 #include <retro_assert.h>
+#include <rthreads/rthreads.h>
 
 #include "utils/bits.h"
 #include "armcpu.h"
@@ -158,6 +159,18 @@ MMU_struct MMU;
 MMU_struct_new MMU_new;
 MMU_struct_timing MMU_timing;
 
+//the ARM9's journaled writes to 2d engine state, see MMU_journal2D
+struct MMU_2DWrite
+{
+	u32 adr;
+	u32 val;
+	u32 size;
+};
+
+static MMU_2DWrite MMU_2DJournal[2048];
+static u32 MMU_2DJournalCount = 0;
+static bool MMU_2DJournalNeedsSync = false;
+
 u8 * MMU_struct::MMU_MEM[2][256] = {
 	//arm9
 	{
@@ -275,6 +288,8 @@ u8 vram_lcdc_map[VRAM_LCDC_PAGES];
 //in the range of 0x06000000 - 0x06800000 in 16KB pages (the ARM9 vram mappable area)
 //this maps to 16KB pages in the LCDC buffer which is what will actually contain the data
 u8 vram_arm9_map[VRAM_ARM9_PAGES];
+u8 vram_tile_dirty[VRAM_TILE_ENGINE_COUNT];
+VideoWriteTracking videoWriteTracking;
 
 //this chooses which banks are mapped in the 128K banks starting at 0x06000000 in ARM7
 u8 vram_arm7_map[2];
@@ -452,6 +467,92 @@ static FORCEINLINE u32 MMU_LCDmap(u32 addr, bool& unmapped, bool& restricted)
    return LCDC_HACKY_LOCATION + (vram_page<<14) + ofs;
 }
 
+template<int PROCNUM>
+u8* MMU_hostRange(u32 addr, u32& size, bool write, bool byteWrites)
+{
+	addr &= 0x0FFFFFFF;
+	size = std::min(size, 0x10000000 - addr);
+	if(size == 0) return NULL;
+
+	if(PROCNUM==ARMCPU_ARM9)
+	{
+		if(addr < 0x02000000) return NULL; //itcm
+		if((addr&(~0x3FFF)) == MMU.DTCMRegion) return NULL;
+		if(addr < MMU.DTCMRegion && addr + size > MMU.DTCMRegion)
+			size = MMU.DTCMRegion - addr;
+	}
+
+	if((addr & 0x0F000000) == 0x02000000)
+	{
+		const u32 ofs = addr & _MMU_MAIN_MEM_MASK;
+		size = std::min(size, _MMU_MAIN_MEM_MASK + 1 - ofs);
+#ifdef HAVE_JIT
+		if(write)
+			for(u32 i = 0; i < size; i += 2)
+				JIT_COMPILED_FUNC_KNOWNBANK(addr+i, MAIN_MEM, _MMU_MAIN_MEM_MASK, 0) = 0;
+#endif
+		return MMU.MAIN_MEM + ofs;
+	}
+
+	//besides main memory, only wram, palette, vram and oam are plain memory.
+	//the io registers have side effects on every access, so they never are.
+	const u32 region = addr >> 24;
+	if(region < 3 || region > 7 || region == 4) return NULL;
+
+	if(region == 5 || region == 7)
+	{
+		//palette and oam only exist for the arm9, and ignore 8bit writes
+		if(PROCNUM==ARMCPU_ARM7 || byteWrites) return NULL;
+		if(GPU->IsRenderPending())
+			GPU->FinishDeferredRender();
+		const u32 ofs = addr & 0x7FF;
+		size = std::min(size, 0x800 - ofs);
+		if(write)
+			for(u32 i = ofs >> VMEM_BLOCK_SHIFT; i <= ((ofs + size - 1) >> VMEM_BLOCK_SHIFT); i++)
+			{
+				if(region == 5) videoWriteTracking.vmemWritten(i << VMEM_BLOCK_SHIFT);
+				else videoWriteTracking.oamWritten(i << VMEM_BLOCK_SHIFT);
+			}
+		return (region == 5 ? MMU.ARM9_VMEM : MMU.ARM9_OAM) + ofs;
+	}
+
+	if(PROCNUM==ARMCPU_ARM9 && region == 6 && GPU->IsRenderPending())
+		GPU->FinishDeferredRender();
+	size = std::min(size, ((region + 1) << 24) - addr);
+
+	//walk the range page by page, and stop at the first page which isn't
+	//mapped right behind the previous one on the host side
+	u8 *host = NULL;
+	u32 done = 0;
+	while(done < size)
+	{
+		const u32 page = addr + done;
+		const u32 pageSize = std::min(0x4000 - (page & 0x3FFF), size - done);
+		bool unmapped, restricted;
+		const u32 mapped = MMU_LCDmap<PROCNUM>(page, unmapped, restricted);
+		if(unmapped || (restricted && byteWrites)) break;
+
+		u8 *pageHost = &MMU.MMU_MEM[PROCNUM][mapped>>20][mapped & MMU.MMU_MASK[PROCNUM][mapped>>20]];
+		if(!host) host = pageHost;
+		else if(pageHost != host + done) break;
+
+#ifdef HAVE_JIT
+		if(write && JIT_MAPPED(mapped & ~0x3FFF, PROCNUM))
+			for(u32 i = 0; i < pageSize; i += 2)
+				JIT_COMPILED_FUNC_PREMASKED(mapped+i, PROCNUM, 0) = 0;
+#endif
+		if(write && (mapped >> 24) == 6)
+			videoWriteTracking.vramWritten(mapped - LCDC_HACKY_LOCATION, pageSize);
+		done += pageSize;
+	}
+
+	size = done;
+	return size ? host : NULL;
+}
+
+template u8* MMU_hostRange<ARMCPU_ARM9>(u32 addr, u32& size, bool write, bool byteWrites);
+template u8* MMU_hostRange<ARMCPU_ARM7>(u32 addr, u32& size, bool write, bool byteWrites);
+
 
 #define LOG_VRAM_ERROR() LOG("No data for block %i MST %i\n", block, VRAMBankCnt & 0x07);
 
@@ -778,6 +879,7 @@ unsupported_mst:
 void MMU_VRAM_unmap_all()
 {
 	vramConfiguration.clear();
+	videoWriteTracking.vramRemapped();
 
 	vram_arm7_map[0] = VRAM_PAGE_UNMAPPED;
 	vram_arm7_map[1] = VRAM_PAGE_UNMAPPED;
@@ -811,6 +913,8 @@ static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 	if(block == 7)
 	{
 		MMU.WRAMCNT = VRAMBankCnt & 3;
+		//the shared wram changed hands; let a threaded ARM7 catch up with it
+		NDS_Reschedule();
 		return;
 	}
 
@@ -921,6 +1025,9 @@ static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 
 
 
+static slock_t *MMU_shared_lock = NULL;
+static int MMU_shared_lock_depth[2] = { 0, 0 };
+
 void MMU_Init(void)
 {
 	LOG("MMU init\n");
@@ -949,6 +1056,9 @@ void MMU_Init(void)
 	slot2_Init();
 	
 	Mic_Init();
+
+	if(!MMU_shared_lock)
+		MMU_shared_lock = slock_new();
 } 
 
 void MMU_DeInit(void) {
@@ -960,16 +1070,36 @@ void MMU_DeInit(void) {
 	slot1_Shutdown();
 	slot2_Shutdown();
 	Mic_DeInit();
+
+	if(MMU_shared_lock)
+		slock_free(MMU_shared_lock);
+	MMU_shared_lock = NULL;
+}
+
+bool MMU_arm7Threaded = false;
+
+void MMU_sharedLock(int PROCNUM)
+{
+	if(MMU_shared_lock_depth[PROCNUM]++ == 0)
+		slock_lock(MMU_shared_lock);
+}
+
+void MMU_sharedUnlock(int PROCNUM)
+{
+	if(--MMU_shared_lock_depth[PROCNUM] == 0)
+		slock_unlock(MMU_shared_lock);
 }
 
 void MMU_Reset()
 {
+	MMU_2DJournalCount = 0;
 	memset(MMU.ARM9_DTCM, 0, sizeof(MMU.ARM9_DTCM));
 	memset(MMU.ARM9_ITCM, 0, sizeof(MMU.ARM9_ITCM));
 	memset(MMU.ARM9_LCD,  0, sizeof(MMU.ARM9_LCD));
 	memset(MMU.ARM9_OAM,  0, sizeof(MMU.ARM9_OAM));
 	memset(MMU.ARM9_REG,  0, sizeof(MMU.ARM9_REG));
 	memset(MMU.ARM9_VMEM, 0, sizeof(MMU.ARM9_VMEM));
+	videoWriteTracking.touchAll();
 	memset(MMU.MAIN_MEM,  0, sizeof(MMU.MAIN_MEM));
 
 	memset(MMU.blank_memory,  0, sizeof(MMU.blank_memory));
@@ -2269,7 +2399,7 @@ void DmaController::exec()
 
 	//printf("ARM%c DMA%d execute, count %08X, mode %d%s\n", procnum?'7':'9', chan, wordcount, startmode, running?" - RUNNING":"");
 	//we'll need to unfreeze the arm9 bus now
-	if(procnum==ARMCPU_ARM9) nds.freezeBus &= ~(1<<(chan+1));
+	if(procnum==ARMCPU_ARM9) atomic_store(&nds.freezeBus, nds.freezeBus & ~(1<<(chan+1)));
 
 	dmaCheck = FALSE;
 
@@ -2418,7 +2548,7 @@ void DmaController::doCopy()
 	//freeze the ARM9 bus for the duration of this DMA
 	//thats not entirely accurate
 	if(procnum==ARMCPU_ARM9) 
-		nds.freezeBus |= (1<<(chan+1));
+		atomic_store(&nds.freezeBus, nds.freezeBus | (1<<(chan+1)));
 		
 	//write back the addresses
 	saddr = src;
@@ -2929,7 +3059,161 @@ bool validateIORegsWrite(u32 addr, u8 size, u32 val)
 //=========================================================================================================
 //=========================================================================================================
 //================================================= MMU write 08
-void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
+//with deferred 2d rendering, the render thread may still be working on earlier scanlines
+//while the ARM9 runs ahead. the ARM9's writes to state the 2d engines read are held back in
+//a journal meanwhile. each queued scanline remembers how far the journal went, and the
+//render thread applies the engine register writes up to there right before rendering it,
+//so per-line register changes (scrolling, windows, blending) are seen on the right line
+//without waiting (see GPUSubsystem::_DeferredRenderProc). writes to vram, palette and oam,
+//and to the registers the emulation thread looks at to decide whether a line can be
+//deferred, make the next scanline wait for the render thread and replay the journal there
+//instead (see GPUSubsystem::FinishDeferredRender).
+//any read of 2d state waits for the render thread, so the ARM9 sees its own writes and
+//never a line half done. the registers which matter beyond the 2d engines (vram mapping,
+//power, 3d) catch up instead of waiting.
+enum MMU_2DAccess
+{
+	MMU_2D_NONE,
+	MMU_2D_JOURNAL,
+	MMU_2D_SYNC
+};
+
+static FORCEINLINE MMU_2DAccess MMU_classify2D(u32 adr)
+{
+	switch(adr >> 24)
+	{
+		case 4:
+			if(adr >= REG_DISPA_DISPSTAT && adr < REG_DISPA_BG0CNT) return MMU_2D_NONE;			//dispstat, vcount
+			if(adr >= REG_DISPA_DISP3DCNT && adr < REG_DISPA_DISPCAPCNT) return MMU_2D_SYNC;
+			if(adr < 0x04000070) return MMU_2D_JOURNAL;											//engine A, capture, display fifo, master brightness
+			if(adr >= 0x04001000 && adr < 0x04001070) return MMU_2D_JOURNAL;						//engine B
+			if(adr >= REG_VRAMCNTA && adr <= REG_VRAMCNTI) return MMU_2D_SYNC;
+			if(adr >= REG_POWCNT1 && adr < REG_POWCNT1 + 4) return MMU_2D_SYNC;
+			return MMU_2D_NONE;
+		case 5: case 6: case 7:
+			return MMU_2D_JOURNAL;
+		default:
+			return MMU_2D_NONE;
+	}
+}
+
+//engine register writes which the render thread may apply itself: everything but
+//engine A's DISPCNT, DISPCAPCNT and the main memory display fifo, which
+//GPUEngineA::CanDeferLine() depends on, and vram, palette and oam
+static FORCEINLINE bool MMU_lineDeferrable2D(u32 adr)
+{
+	if((adr >> 24) != 4) return false;
+	if(adr < REG_DISPA_DISPSTAT) return false;
+	if(adr >= REG_DISPA_DISPCAPCNT && adr < REG_DISPA_DISPMMEMFIFO + 4) return false;
+	return true;
+}
+
+//returns true if the write was held back
+static FORCEINLINE bool MMU_journal2D(u32 adr, u32 val, u32 size)
+{
+	if(!GPU->IsRenderPending()) return false;
+
+	switch(MMU_classify2D(adr))
+	{
+		case MMU_2D_NONE:
+			return false;
+		case MMU_2D_SYNC:
+			GPU->FinishDeferredRender();
+			return false;
+		default:
+			break;
+	}
+
+	if(MMU_2DJournalCount == ARRAY_SIZE(MMU_2DJournal))
+	{
+		GPU->FinishDeferredRender();
+		return false;
+	}
+
+#ifdef HAVE_JIT
+	//code may run from vram, so its blocks can't wait for the replay to be invalidated
+	if((adr >> 24) == 6)
+	{
+		bool unmapped, restricted;
+		const u32 mapped = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted) & ~1;
+		if(!unmapped && JIT_MAPPED(mapped, ARMCPU_ARM9))
+			for(u32 i = 0; i < size; i += 2)
+				JIT_COMPILED_FUNC_PREMASKED(mapped, ARMCPU_ARM9, i >> 1) = 0;
+	}
+#endif
+
+	if(!MMU_lineDeferrable2D(adr))
+		MMU_2DJournalNeedsSync = true;
+
+	MMU_2DWrite &write = MMU_2DJournal[MMU_2DJournalCount++];
+	write.adr = adr;
+	write.val = val;
+	write.size = size;
+	return true;
+}
+
+static FORCEINLINE void MMU_catchUp2D(u32 adr)
+{
+	if(GPU->IsRenderPending() && MMU_classify2D(adr) != MMU_2D_NONE)
+		GPU->FinishDeferredRender();
+}
+
+bool MMU_pending2DWrites()
+{
+	return MMU_2DJournalCount != 0;
+}
+
+bool MMU_pending2DWritesNeedSync()
+{
+	return MMU_2DJournalNeedsSync;
+}
+
+u32 MMU_2DJournalPosition()
+{
+	return MMU_2DJournalCount;
+}
+
+static void FASTCALL _MMU_ARM9_write08_unshared(u32 adr, u8 val);
+static void FASTCALL _MMU_ARM9_write16_unshared(u32 adr, u16 val);
+static void FASTCALL _MMU_ARM9_write32_unshared(u32 adr, u32 val);
+
+void MMU_apply2DWrites(u32 begin, u32 end)
+{
+	//called on the render thread, which owns the engines' state while lines are pending.
+	//only engine registers get here (see MMU_lineDeferrable2D), and they skip the journal
+	//and the shared lock, which the ARM7 never takes for them
+	for(u32 i = begin; i < end; i++)
+	{
+		const MMU_2DWrite &write = MMU_2DJournal[i];
+		switch(write.size)
+		{
+			case 1: _MMU_ARM9_write08_unshared(write.adr, (u8)write.val); break;
+			case 2: _MMU_ARM9_write16_unshared(write.adr, (u16)write.val); break;
+			default: _MMU_ARM9_write32_unshared(write.adr, write.val); break;
+		}
+	}
+}
+
+void MMU_replay2DWrites(u32 begin)
+{
+	//the render thread has caught up, so these go straight through
+	const u32 count = MMU_2DJournalCount;
+	MMU_2DJournalCount = 0;
+	MMU_2DJournalNeedsSync = false;
+
+	for(u32 i = begin; i < count; i++)
+	{
+		const MMU_2DWrite &write = MMU_2DJournal[i];
+		switch(write.size)
+		{
+			case 1: _MMU_ARM9_write08(write.adr, (u8)write.val); break;
+			case 2: _MMU_ARM9_write16(write.adr, (u16)write.val); break;
+			default: _MMU_ARM9_write32(write.adr, write.val); break;
+		}
+	}
+}
+
+static void FASTCALL _MMU_ARM9_write08_unshared(u32 adr, u8 val)
 {
 	adr &= 0x0FFFFFFF;
 
@@ -3222,6 +3506,7 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
 	if(restricted) return; //block 8bit vram writes
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -3232,8 +3517,16 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 	MMU.MMU_MEM[ARMCPU_ARM9][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]]=val;
 }
 
+void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
+{
+	if(MMU_journal2D(adr & 0x0FFFFFFF, val, 1)) return;
+	if(!MMU_arm7Threaded) return _MMU_ARM9_write08_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM9_write08_unshared(adr, val);
+}
+
 //================================================= MMU ARM9 write 16
-void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
+static void FASTCALL _MMU_ARM9_write16_unshared(u32 adr, u16 val)
 {
 	adr &= 0x0FFFFFFE;
 
@@ -3683,6 +3976,9 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
+	if((adr >> 24) == 5) videoWriteTracking.vmemWritten(adr);
+	if((adr >> 24) == 7) videoWriteTracking.oamWritten(adr);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -3693,8 +3989,16 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
 } 
 
+void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
+{
+	if(MMU_journal2D(adr & 0x0FFFFFFE, val, 2)) return;
+	if(!MMU_arm7Threaded) return _MMU_ARM9_write16_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM9_write16_unshared(adr, val);
+}
+
 //================================================= MMU ARM9 write 32
-void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
+static void FASTCALL _MMU_ARM9_write32_unshared(u32 adr, u32 val)
 {
 	adr &= 0x0FFFFFFC;
 	
@@ -3790,7 +4094,7 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 			case 0x40005B:
 			case 0x40005C:		// Individual Commands
 				if (gxFIFO.size > 254)
-					nds.freezeBus |= 1;
+					atomic_store(&nds.freezeBus, nds.freezeBus | 1);
 
 				((u32 *)(MMU.MMU_MEM[ARMCPU_ARM9][0x40]))[(adr & 0xFFF) >> 2] = val;
 				gfx3d_sendCommand(adr, val);
@@ -4123,6 +4427,9 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
+	if((adr >> 24) == 5) videoWriteTracking.vmemWritten(adr);
+	if((adr >> 24) == 7) videoWriteTracking.oamWritten(adr);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -4136,10 +4443,19 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM9][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM9][adr>>20], val);
 }
 
+void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
+{
+	if(MMU_journal2D(adr & 0x0FFFFFFC, val, 4)) return;
+	if(!MMU_arm7Threaded) return _MMU_ARM9_write32_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM9_write32_unshared(adr, val);
+}
+
 //================================================= MMU ARM9 read 08
-u8 FASTCALL _MMU_ARM9_read08(u32 adr)
+static u8 FASTCALL _MMU_ARM9_read08_unshared(u32 adr)
 {
 	adr &= 0x0FFFFFFF;
+	MMU_catchUp2D(adr);
 	 
 #ifdef _MMU_DEBUG
 	mmu_log_debug_ARM9(adr, "(read08) 0x%02X", MMU.MMU_MEM[ARMCPU_ARM9][(adr>>20)&0xFF][adr&MMU.MMU_MASK[ARMCPU_ARM9][(adr>>20)&0xFF]]);
@@ -4299,10 +4615,18 @@ u8 FASTCALL _MMU_ARM9_read08(u32 adr)
 	return MMU.MMU_MEM[ARMCPU_ARM9][(adr>>20)&0xFF][adr&MMU.MMU_MASK[ARMCPU_ARM9][(adr>>20)&0xFF]];
 }
 
+u8 FASTCALL _MMU_ARM9_read08(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM9_read08_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM9_read08_unshared(adr);
+}
+
 //================================================= MMU ARM9 read 16
-u16 FASTCALL _MMU_ARM9_read16(u32 adr)
+static u16 FASTCALL _MMU_ARM9_read16_unshared(u32 adr)
 {    
 	adr &= 0x0FFFFFFE;
+	MMU_catchUp2D(adr);
 
 #ifdef _MMU_DEBUG
 	mmu_log_debug_ARM9(adr, "(read16) 0x%04X", T1ReadWord_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]));
@@ -4413,10 +4737,18 @@ u16 FASTCALL _MMU_ARM9_read16(u32 adr)
 	return T1ReadWord_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr >> 20]); 
 }
 
+u16 FASTCALL _MMU_ARM9_read16(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM9_read16_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM9_read16_unshared(adr);
+}
+
 //================================================= MMU ARM9 read 32
-u32 FASTCALL _MMU_ARM9_read32(u32 adr)
+static u32 FASTCALL _MMU_ARM9_read32_unshared(u32 adr)
 {
 	adr &= 0x0FFFFFFC;
+	MMU_catchUp2D(adr);
 
 #ifdef _MMU_DEBUG
 	mmu_log_debug_ARM9(adr, "(read32) 0x%08X", T1ReadLong_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]));
@@ -4557,11 +4889,18 @@ u32 FASTCALL _MMU_ARM9_read32(u32 adr)
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [zeromus, inspired by shash]
 	return T1ReadLong_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM9][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM9][adr>>20]);
 }
+
+u32 FASTCALL _MMU_ARM9_read32(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM9_read32_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM9> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM9_read32_unshared(adr);
+}
 //================================================================================================== ARM7 *
 //=========================================================================================================
 //=========================================================================================================
 //================================================= MMU ARM7 write 08
-void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
+static void FASTCALL _MMU_ARM7_write08_unshared(u32 adr, u8 val)
 {
 	adr &= 0x0FFFFFFF;
 
@@ -4665,6 +5004,7 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM7>(adr,unmapped, restricted);
 	if(unmapped) return;
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
@@ -4675,8 +5015,15 @@ void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
 	MMU.MMU_MEM[ARMCPU_ARM7][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]]=val;
 }
 
+void FASTCALL _MMU_ARM7_write08(u32 adr, u8 val)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_write08_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM7_write08_unshared(adr, val);
+}
+
 //================================================= MMU ARM7 write 16
-void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
+static void FASTCALL _MMU_ARM7_write16_unshared(u32 adr, u16 val)
 {
 	adr &= 0x0FFFFFFE;
 
@@ -4843,6 +5190,7 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM7>(adr,unmapped, restricted);
 	if(unmapped) return;
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
@@ -4852,8 +5200,15 @@ void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
 	// Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF [shash]
 	T1WriteWord(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
 }
+
+void FASTCALL _MMU_ARM7_write16(u32 adr, u16 val)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_write16_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM7_write16_unshared(adr, val);
+}
 //================================================= MMU ARM7 write 32
-void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
+static void FASTCALL _MMU_ARM7_write32_unshared(u32 adr, u32 val)
 {
 	adr &= 0x0FFFFFFC;
 
@@ -4944,6 +5299,7 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM7>(adr,unmapped, restricted);
 	if(unmapped) return;
+	if((adr >> 24) == 6) videoWriteTracking.vramWritten(adr - LCDC_HACKY_LOCATION);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM7))
@@ -4957,8 +5313,15 @@ void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
 	T1WriteLong(MMU.MMU_MEM[ARMCPU_ARM7][adr>>20], adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20], val);
 }
 
+void FASTCALL _MMU_ARM7_write32(u32 adr, u32 val)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_write32_unshared(adr, val);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	_MMU_ARM7_write32_unshared(adr, val);
+}
+
 //================================================= MMU ARM7 read 08
-u8 FASTCALL _MMU_ARM7_read08(u32 adr)
+static u8 FASTCALL _MMU_ARM7_read08_unshared(u32 adr)
 {
 	adr &= 0x0FFFFFFF;
 
@@ -5028,8 +5391,15 @@ u8 FASTCALL _MMU_ARM7_read08(u32 adr)
 
 	return MMU.MMU_MEM[ARMCPU_ARM7][adr>>20][adr&MMU.MMU_MASK[ARMCPU_ARM7][adr>>20]];
 }
+
+u8 FASTCALL _MMU_ARM7_read08(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_read08_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM7_read08_unshared(adr);
+}
 //================================================= MMU ARM7 read 16
-u16 FASTCALL _MMU_ARM7_read16(u32 adr)
+static u16 FASTCALL _MMU_ARM7_read16_unshared(u32 adr)
 {
 	adr &= 0x0FFFFFFE;
 
@@ -5125,8 +5495,15 @@ u16 FASTCALL _MMU_ARM7_read16(u32 adr)
 	/* Removed the &0xFF as they are implicit with the adr&0x0FFFFFFF */
 	return T1ReadWord_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20]); 
 }
+
+u16 FASTCALL _MMU_ARM7_read16(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_read16_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM7_read16_unshared(adr);
+}
 //================================================= MMU ARM7 read 32
-u32 FASTCALL _MMU_ARM7_read32(u32 adr)
+static u32 FASTCALL _MMU_ARM7_read32_unshared(u32 adr)
 {
 	adr &= 0x0FFFFFFC;
 
@@ -5211,6 +5588,13 @@ u32 FASTCALL _MMU_ARM7_read32(u32 adr)
 	return T1ReadLong_guaranteedAligned(MMU.MMU_MEM[ARMCPU_ARM7][adr >> 20], adr & MMU.MMU_MASK[ARMCPU_ARM7][adr >> 20]);
 }
 
+u32 FASTCALL _MMU_ARM7_read32(u32 adr)
+{
+	if(!MMU_arm7Threaded) return _MMU_ARM7_read32_unshared(adr);
+	MMU_SharedAccess<ARMCPU_ARM7> shared(((adr & 0x0FFFFFFF) >> 24) == 4);
+	return _MMU_ARM7_read32_unshared(adr);
+}
+
 //=========================================================================================================
 
 u32 FASTCALL MMU_read32(u32 proc, u32 adr) 
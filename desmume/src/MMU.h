@@ -20,10 +20,14 @@
 #ifndef MMU_H
 #define MMU_H
 
+#include <string.h>
+#include <algorithm>
+
 #include "debug.h"
 #include "firmware.h"
 #include "mc.h"
 #include "mem.h"
+#include "utils/atomic.h"
 
 #ifdef HAVE_JIT
 #include "arm_jit.h"
@@ -500,6 +504,50 @@ void MMU_Reset( void);
 
 void print_memory_profiling( void);
 
+//resolves the guest range [addr,addr+size) to host memory, for hle routines which access
+//memory in bulk. size is shrunk to the longest prefix of the range which is plain ram
+//(main memory, wram, palette, vram, oam) laid out contiguously on the host; returns NULL
+//if there is none. the io registers are never plain ram. byteWrites rejects palette, vram
+//and oam, which ignore 8bit writes. if write is set, jit blocks compiled from the returned
+//range are invalidated.
+template<int PROCNUM> u8* MMU_hostRange(u32 addr, u32& size, bool write, bool byteWrites);
+
+//the ARM9's writes to 2d engine state made while deferred 2d rendering is behind are
+//journaled. the render thread applies the engine register writes queued ahead of each line
+//with MMU_apply2DWrites; GPUSubsystem::FinishDeferredRender replays the rest once it has
+//caught up. MMU_pending2DWritesNeedSync tells whether the journal holds anything the render
+//thread can't apply itself.
+bool MMU_pending2DWrites();
+bool MMU_pending2DWritesNeedSync();
+u32 MMU_2DJournalPosition();
+void MMU_apply2DWrites(u32 begin, u32 end);
+void MMU_replay2DWrites(u32 begin);
+
+//while the ARM7 runs on its own host thread (CommonSettings.arm7_thread), accesses to
+//state shared by both cores (the IO registers) are serialized by a lock.
+//the lock nests per core, which is safe since each core only ever runs on one host thread.
+//the _MMU_ARMx_readxx/writexx entry points test MMU_arm7Threaded once and otherwise go
+//straight to the unlocked access, so nothing is constructed while the mode is off.
+extern bool MMU_arm7Threaded;
+void MMU_sharedLock(int PROCNUM);
+void MMU_sharedUnlock(int PROCNUM);
+
+template<int PROCNUM>
+class MMU_SharedAccess
+{
+public:
+	MMU_SharedAccess(bool shared) : locked(shared)
+	{
+		if(locked) MMU_sharedLock(PROCNUM);
+	}
+	~MMU_SharedAccess()
+	{
+		if(locked) MMU_sharedUnlock(PROCNUM);
+	}
+private:
+	const bool locked;
+};
+
 // Memory reading/writing (old)
 u8 FASTCALL MMU_read8(u32 proc, u32 adr);
 u16 FASTCALL MMU_read16(u32 proc, u32 adr);
@@ -558,6 +606,138 @@ extern VramConfiguration vramConfiguration;
 
 #define VRAM_ARM9_PAGES 512
 extern u8 vram_arm9_map[VRAM_ARM9_PAGES];
+
+//one byte per 32 bytes of vram (and of the blank page behind it), which every write to vram sets to
+//VRAM_TILE_DIRTY. the 2d engines keep things derived from tiles, each of which has its own bit and
+//stays valid for as long as that bit is clear.
+//the banks an engine can see are never mapped for the other one at the same time, so the two only
+//share tiles in the blank page. the sub engine uses its own copy of those, after the end (see
+//VRAM_TILE_INDEX), so that neither touches the other's bytes when they render in parallel.
+#define VRAM_TILE_SHIFT 5
+#define VRAM_TILE_COUNT ((0xA4000 + 0x4000) >> VRAM_TILE_SHIFT)
+#define VRAM_TILE_BLANK_FIRST (0xA4000 >> VRAM_TILE_SHIFT)
+#define VRAM_TILE_BLANK_COUNT (0x4000 >> VRAM_TILE_SHIFT)
+#define VRAM_TILE_ENGINE_COUNT (VRAM_TILE_COUNT + VRAM_TILE_BLANK_COUNT)
+#define VRAM_TILE_INDEX(engine, ofs) ( ((ofs) >> VRAM_TILE_SHIFT) + ((((ofs) >> VRAM_TILE_SHIFT) >= VRAM_TILE_BLANK_FIRST && (engine) != 0) ? VRAM_TILE_BLANK_COUNT : 0) )
+#define VRAM_TILE_DIRTY 0xFF
+#define VRAM_TILE_DIRTY_DECODED 0x01	//the decoded 4bpp tile
+#define VRAM_TILE_DIRTY_COVERAGE 0x02	//which of the tile's pixels are transparent
+extern u8 vram_tile_dirty[VRAM_TILE_ENGINE_COUNT];
+
+#define VRAM_PAGE_COUNT (VRAM_TILE_COUNT >> (14 - VRAM_TILE_SHIFT))
+#define VRAM_BLOCK_SHIFT 10
+#define VRAM_BLOCK_COUNT (VRAM_TILE_COUNT >> (VRAM_BLOCK_SHIFT - VRAM_TILE_SHIFT))
+#define VMEM_BLOCK_SHIFT 5
+#define VMEM_BLOCK_COUNT (0x800 >> VMEM_BLOCK_SHIFT)
+
+//tracks writes to video memory, for whoever keeps something derived from it.
+//every write stamps the block it lands in (1KB of vram, 32 bytes of palette or oam) and the
+//coarser region around it (the 16KB vram page, the engine's half of palette or oam) with the
+//current generation. a consumer takes a generation when it looks at the memory, and can later
+//tell in O(1) per region whether anything was written since by comparing the stamps against it.
+struct VideoWriteTracking
+{
+	volatile u64 now;	//only through atomic_*, both 2d engines take generations while they render
+	u64 vramMap;
+	u64 vramPage[VRAM_PAGE_COUNT];
+	u64 vramBlock[VRAM_BLOCK_COUNT];
+	u64 vmemEngine[2];
+	u64 vmemBlock[VMEM_BLOCK_COUNT];
+	u64 oamEngine[2];
+	u64 oamBlock[VMEM_BLOCK_COUNT];
+
+	VideoWriteTracking() : now(0) { touchAll(); }
+
+	//returns the generation to remember for what is being looked at now.
+	//everything written from now on is newer than it.
+	u64 look() { return atomic_add64(&now, 1); }
+
+	//the current generation, which writes stamp
+	FORCEINLINE u64 current() const { return atomic_load(&now); }
+
+	//stamps everything, as if all video memory had just been written
+	void touchAll()
+	{
+		const u64 stamp = atomic_add64(&now, 1) + 1;
+		vramMap = stamp;
+		for(int i = 0; i < VRAM_PAGE_COUNT; i++) vramPage[i] = stamp;
+		for(int i = 0; i < VRAM_BLOCK_COUNT; i++) vramBlock[i] = stamp;
+		for(int i = 0; i < VMEM_BLOCK_COUNT; i++) vmemBlock[i] = oamBlock[i] = stamp;
+		vmemEngine[0] = vmemEngine[1] = oamEngine[0] = oamEngine[1] = stamp;
+		memset(vram_tile_dirty, VRAM_TILE_DIRTY, sizeof(vram_tile_dirty));
+	}
+
+	//the vram offsets below are offsets into ARM9_LCD
+	FORCEINLINE void vramWritten(const u32 ofs)
+	{
+		const u64 stamp = current();
+		vram_tile_dirty[ofs >> VRAM_TILE_SHIFT] = VRAM_TILE_DIRTY;
+		vramBlock[ofs >> VRAM_BLOCK_SHIFT] = stamp;
+		vramPage[ofs >> 14] = stamp;
+	}
+
+	void vramWritten(const u32 ofs, const u32 size)
+	{
+		const u64 stamp = current();
+		const u32 last = ofs + size - 1;
+		for(u32 i = ofs >> VRAM_TILE_SHIFT; i <= (last >> VRAM_TILE_SHIFT); i++) vram_tile_dirty[i] = VRAM_TILE_DIRTY;
+		for(u32 i = ofs >> VRAM_BLOCK_SHIFT; i <= (last >> VRAM_BLOCK_SHIFT); i++) vramBlock[i] = stamp;
+		for(u32 i = ofs >> 14; i <= (last >> 14); i++) vramPage[i] = stamp;
+	}
+
+	//palette and oam offsets are taken modulo their 2KB, the upper half belonging to the sub engine
+	FORCEINLINE void vmemWritten(const u32 adr)
+	{
+		const u64 stamp = current();
+		vmemBlock[(adr & 0x7FF) >> VMEM_BLOCK_SHIFT] = stamp;
+		vmemEngine[(adr >> 10) & 1] = stamp;
+	}
+
+	FORCEINLINE void oamWritten(const u32 adr)
+	{
+		const u64 stamp = current();
+		oamBlock[(adr & 0x7FF) >> VMEM_BLOCK_SHIFT] = stamp;
+		oamEngine[(adr >> 10) & 1] = stamp;
+	}
+
+	void vramRemapped() { vramMap = current(); }
+
+	bool vramRemappedSince(const u64 generation) const { return vramMap > generation; }
+	bool vramPageChangedSince(const u32 page, const u64 generation) const { return vramPage[page] > generation; }
+	bool vmemChangedSince(const int engine, const u64 generation) const { return vmemEngine[engine] > generation; }
+	bool oamChangedSince(const int engine, const u64 generation) const { return oamEngine[engine] > generation; }
+
+	bool vramChangedSince(const u32 ofs, const u32 size, const u64 generation) const
+	{
+		const u32 last = ofs + size - 1;
+		for(u32 page = ofs >> 14; page <= (last >> 14); page++)
+		{
+			if(vramPage[page] <= generation) continue;
+			const u32 first = std::max(ofs, page << 14) >> VRAM_BLOCK_SHIFT;
+			const u32 end = std::min(last, (page << 14) + 0x3FFF) >> VRAM_BLOCK_SHIFT;
+			for(u32 i = first; i <= end; i++)
+				if(vramBlock[i] > generation) return true;
+		}
+		return false;
+	}
+
+	bool vmemChangedSince(const u32 ofs, const u32 size, const u64 generation) const
+	{
+		for(u32 i = ofs >> VMEM_BLOCK_SHIFT; i <= ((ofs + size - 1) >> VMEM_BLOCK_SHIFT); i++)
+			if(vmemBlock[i] > generation) return true;
+		return false;
+	}
+
+	bool oamChangedSince(const u32 ofs, const u32 size, const u64 generation) const
+	{
+		for(u32 i = ofs >> VMEM_BLOCK_SHIFT; i <= ((ofs + size - 1) >> VMEM_BLOCK_SHIFT); i++)
+			if(oamBlock[i] > generation) return true;
+		return false;
+	}
+};
+
+extern VideoWriteTracking videoWriteTracking;
+
 FORCEINLINE void* MMU_gpu_map(const u32 vram_addr)
 {
 	//this is supposed to map a single gpu vram address to emulator host memory
@@ -68,6 +68,12 @@ static FORCEINLINE bool USE_TIMING(void)
 #endif
 }
 
+// approximate timing only takes over when advanced timing is off
+static FORCEINLINE bool USE_APPROXIMATE_TIMING(void)
+{
+	return !USE_TIMING() && CommonSettings.approximate_timing;
+}
+
 enum MMU_ACCESS_DIRECTION
 {
 	MMU_AD_READ = 0,
@@ -377,11 +383,27 @@ FORCEINLINE u32 MMU_memAccessCycles(u32 addr)
    return MMU_timing.armDataFetch<PROCNUM>().template Fetch<READSIZE,DIRECTION,false>((addr)&(~((READSIZE>>3)-1)));
 }
 
+// fixed cycle cost of a single memory access for the approximate timing mode.
+// every access is charged as a main memory access, so neither the region
+// lookup nor the sequential access tracking of FetchAccessUnit is performed.
+template<int PROCNUM, int READSIZE>
+FORCEINLINE u32 MMU_approxAccessCycles()
+{
+	static const u32 cycles[2][3] = {
+		// 8bit, 16bit, 32bit
+		{ 2, 2, 4 }, // ARM9
+		{ 1, 1, 2 }, // ARM7
+	};
+	return cycles[PROCNUM][(READSIZE>>4)];
+}
+
 template<int PROCNUM, int READSIZE, MMU_ACCESS_DIRECTION DIRECTION>
 FORCEINLINE u32 MMU_memAccessCycles(u32 addr)
 {
 	if(USE_TIMING())
 		return MMU_memAccessCycles<PROCNUM,READSIZE,DIRECTION,true>(addr);
+	if(USE_APPROXIMATE_TIMING())
+		return MMU_approxAccessCycles<PROCNUM,READSIZE>();
    return MMU_memAccessCycles<PROCNUM,READSIZE,DIRECTION,false>(addr);
 }
 
@@ -393,6 +415,8 @@ FORCEINLINE u32 MMU_codeFetchCycles(u32 addr)
 {
 	if(USE_TIMING())
 		return MMU_timing.armCodeFetch<PROCNUM>().template Fetch<READSIZE,MMU_AD_READ,true>((addr)&(~((READSIZE>>3)-1)));
+	if(USE_APPROXIMATE_TIMING())
+		return 1;
    return MMU_timing.armCodeFetch<PROCNUM>().template Fetch<READSIZE,MMU_AD_READ,false>((addr)&(~((READSIZE>>3)-1)));
 }
 
@@ -428,6 +452,8 @@ FORCEINLINE u32 MMU_aluMemAccessCycles(u32 aluCycles, u32 addr)
 	u32 memCycles;
 	if(USE_TIMING())
 		memCycles = MMU_memAccessCycles<PROCNUM,READSIZE,DIRECTION,true>(addr);
+	else if(USE_APPROXIMATE_TIMING())
+		memCycles = MMU_approxAccessCycles<PROCNUM,READSIZE>();
 	else memCycles = MMU_memAccessCycles<PROCNUM,READSIZE,DIRECTION,false>(addr);
 	return MMU_aluMemCycles<PROCNUM>(aluCycles, memCycles);
 }
@@ -85,6 +85,9 @@ BaseDriver* driver = &_stub_driver;
 static BOOL LidClosed = FALSE;
 static u8	countLid = 0;
 
+static Task arm7Task;
+static bool arm7TaskRunning = false;
+
 GameInfo gameInfo;
 NDSSystem nds;
 CFIRMWARE	*firmware = NULL;
@@ -191,6 +194,13 @@ void NDS_DeInit(void)
 	delete cheats;
 	cheats = NULL;
 	
+	if(arm7TaskRunning)
+	{
+		arm7Task.finish();
+		arm7Task.shutdown();
+		arm7TaskRunning = false;
+	}
+
 #ifdef HAVE_JIT
 	arm_jit_close();
 #endif
@@ -1468,7 +1478,7 @@ void NDS_Reschedule()
 #ifndef NDEBUG
 	IF_DEVELOPER(if(!sequencer.reschedule) DEBUG_statistics.sequencerExecutionCounters[0]++;);
 #endif
-	sequencer.reschedule = true;
+	atomic_store(&sequencer.reschedule, true);
 }
 
 FORCEINLINE u32 _fast_min32(u32 a, u32 b, u32 c, u32 d)
@@ -1734,7 +1744,7 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 	const u64 nds_timer_base, const s32 s32next, s32 arm9, s32 arm7)
 {
 	s32 timer = minarmtime<doarm9,doarm7>(arm9,arm7);
-	while(timer < s32next && !sequencer.reschedule && execute)
+	while(timer < s32next && !atomic_load(&sequencer.reschedule) && atomic_load(&execute))
 	{
 		if(doarm9 && (!doarm7 || arm9 <= timer))
 		{
@@ -1760,7 +1770,7 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 				s32 temp = arm9;
 				arm9 = min(s32next, arm9 + kIrqWait);
 				nds.idleCycles[0] += arm9-temp;
-				if (gxFIFO.size < 255) nds.freezeBus &= ~1;
+				if (gxFIFO.size < 255) atomic_store(&nds.freezeBus, nds.freezeBus & ~1);
 			}
 		}
 		if(doarm7 && (!doarm9 || arm7 <= timer))
@@ -1797,9 +1807,93 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 		}
 
 		timer = minarmtime<doarm9,doarm7>(arm9,arm7);
+		//while the ARM7 runs on its own thread, the hardware time stays at the start
+		//of the slice, so that neither core sees how far along the other one is
+		if(doarm7 || !MMU_arm7Threaded)
+			nds_timer = nds_timer_base + timer;
+	}
+
+	return std::make_pair(arm9, arm7);
+}
+
+//ARM7 side of the threaded cpu loop (CommonSettings.arm7_thread).
+//the ARM7 runs on arm7Task while the ARM9 runs on the emulation thread; both stop
+//at the end of a slice, or as soon as something (an irq, the ipc registers,
+//the wram mapping) requests a reschedule, and rejoin before the next one.
+//where in its slice each core sees the other's reschedule request depends on the
+//host scheduling, which is why this mode isn't deterministic. a late look at the
+//flag only makes the slice run longer; arm7Task.finish() syncs all of it again.
+//the flags either core reads while the other may write them (sequencer.reschedule,
+//execute, nds.freezeBus, the ARM7's waitIRQ) go through atomic loads and stores.
+//the IO registers are behind the shared lock (MMU_SharedAccess), whose lock and unlock
+//also order the wram and main memory writes a game hands over through them (ipcsync,
+//the ipc fifo) against the other core's reads.
+//the mode is interpreter only: the jit's code cache isn't safe to invalidate from
+//one core while the other may be running out of it.
+struct TARM7Slice
+{
+	s32 arm7;
+	s32 target;
+};
+
+static TARM7Slice arm7Slice;
+
+static void* arm7SliceProc(void *param)
+{
+	TARM7Slice *slice = (TARM7Slice*)param;
+	s32 arm7 = slice->arm7;
+
+	while(arm7 < slice->target && !atomic_load(&sequencer.reschedule) && atomic_load(&execute))
+	{
+		if(!atomic_load(&NDS_ARM7.waitIRQ)&&!atomic_load(&nds.freezeBus))
+		{
+			arm7 += (armcpu_exec<ARMCPU_ARM7>()<<1);
+		}
+		else
+		{
+			s32 temp = arm7;
+			arm7 = min(slice->target, arm7 + kIrqWait);
+			nds.idleCycles[1] += arm7-temp;
+		}
+	}
+
+	slice->arm7 = arm7;
+	return NULL;
+}
+
+static std::pair<s32,s32> armThreadedLoop(
+	const u64 nds_timer_base, const s32 s32next, s32 arm9, s32 arm7)
+{
+	if(!arm7TaskRunning)
+	{
+		arm7Task.start();
+		arm7TaskRunning = true;
+	}
+
+	MMU_arm7Threaded = true;
+
+	s32 timer = min(arm9,arm7);
+	while(timer < s32next && !atomic_load(&sequencer.reschedule) && atomic_load(&execute))
+	{
+		const s32 target = min(s32next, timer + (s32)CommonSettings.arm7_max_skew);
+
+		arm7Slice.arm7 = arm7;
+		arm7Slice.target = target;
+		arm7Task.execute(&arm7SliceProc, &arm7Slice);
+#ifdef HAVE_JIT
+		arm9 = armInnerLoop<true,false,false>(nds_timer_base, target, arm9, arm7).first;
+#else
+		arm9 = armInnerLoop<true,false>(nds_timer_base, target, arm9, arm7).first;
+#endif
+		arm7Task.finish();
+		arm7 = arm7Slice.arm7;
+
+		timer = min(arm9,arm7);
 		nds_timer = nds_timer_base + timer;
 	}
 
+	MMU_arm7Threaded = false;
+
 	return std::make_pair(arm9, arm7);
 }
 
@@ -1896,13 +1990,21 @@ void NDS_exec(s32 nb)
 				}
 			#endif
 
+			std::pair<s32,s32> arm9arm7;
+			if(CommonSettings.arm7_thread && !CommonSettings.use_jit && !CommonSettings.single_core())
+			{
+				arm9arm7 = armThreadedLoop(nds_timer_base,s32next,arm9,arm7);
+			}
+			else
+			{
 #ifdef HAVE_JIT
-			std::pair<s32,s32> arm9arm7 = CommonSettings.use_jit
-				? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
-				: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
+				arm9arm7 = CommonSettings.use_jit
+					? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
+					: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
 #else
-				std::pair<s32,s32> arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
+				arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
 #endif
+			}
 
 			#ifdef DEVELOPER
 				if(singleStep)
@@ -2731,7 +2833,7 @@ void NDS_swapScreen()
 void emu_halt()
 {
 	//printf("halting emu: ARM9 PC=%08X/%08X, ARM7 PC=%08X/%08X\n", NDS_ARM9.R[15], NDS_ARM9.instruct_adr, NDS_ARM7.R[15], NDS_ARM7.instruct_adr);
-	execute = false;
+	atomic_store(&execute, 0);
 #ifdef LOG_ARM9
 	if (fp_dis9)
 	{
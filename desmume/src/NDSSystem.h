@@ -24,6 +24,7 @@
 #include <string>
 
 #include "types.h"
+#include "utils/atomic.h"
 
 class BaseDriver;
 class CFIRMWARE;
@@ -69,7 +70,7 @@ extern BOOL click;
 #if defined(LOG_ARM9) || defined(LOG_ARM7)
 void emu_halt();
 #else
-#define emu_halt() (execute = 0)
+#define emu_halt() atomic_store(&execute, 0)
 #endif
 /*
  * The firmware language values
@@ -505,6 +506,14 @@ extern struct TCommonSettings {
 		, cheatsDisable(false)
 		, rigorous_timing(false)
 		, advanced_timing(true)
+		, approximate_timing(false)
+		, arm7_thread(false)
+		, arm7_max_skew(4096)
+		, deferred_2d(false)
+		, parallel_2d(false)
+		, reuse_2d_lines(false)
+		, skip_hidden_bg(false)
+		, output_xrgb8888(false)
 		, micMode(InternalNoise)
 		, manualBackupType(0)
 		, autodetectBackupMethod(0)
@@ -576,6 +585,34 @@ extern struct TCommonSettings {
 	bool dispLayers[2][5];
 	
 	FAST_ALIGN bool advanced_timing;
+	//when advanced_timing is off, charges each instruction a fixed cost for its
+	//class, and each memory access a fixed cost instead of the bus timing of the
+	//accessed region. the code fetch timing is skipped.
+	FAST_ALIGN bool approximate_timing;
+
+	//runs the ARM7 on its own host thread. the cores rejoin at every hardware event
+	//and never run more than arm7_max_skew (ARM9) cycles apart. the interleaving of
+	//the cores then depends on the host, so savestates and input recordings don't
+	//replay the same way. off by default, and ignored while the jit is on.
+	bool arm7_thread;
+	u32 arm7_max_skew;
+
+	//renders the 2d engines on a worker thread, some scanlines behind the emulation.
+	//the emulation waits for it to catch up before changing anything the engines read.
+	bool deferred_2d;
+
+	//renders the scanlines of the sub 2d engine on a worker thread, alongside the main engine.
+	bool parallel_2d;
+
+	//leaves a 2d engine's scanline as it was in the previous frame when nothing it is rendered from changed.
+	bool reuse_2d_lines;
+
+	//doesn't render the tiled bg layers whose tiles are all transparent, or which lie under an opaque one.
+	bool skip_hidden_bg;
+
+	//the gpu also outputs the displays as XRGB8888, for frontends that take 32-bit frames.
+	//read when the gpu is created.
+	bool output_xrgb8888;
 
 	bool use_jit;
 	u32	jit_max_block_size;
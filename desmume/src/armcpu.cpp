@@ -32,12 +32,14 @@
 #endif
 #include "NDSSystem.h"
 #include "MMU_timing.h"
+#include "instruction_attributes.h"
 #include "utils/bits.h"
 #ifdef HAVE_JIT
 #include "arm_jit.h"
 #endif
 
 template<u32> static u32 armcpu_prefetch();
+static void armcpu_initApproxCycles();
 
 FORCEINLINE u32 armcpu_prefetch(armcpu_t *armcpu) { 
 	if(armcpu->proc_ID==0) return armcpu_prefetch<0>();
@@ -146,6 +148,8 @@ int armcpu_new( armcpu_t *armcpu, u32 id)
 	
 	armcpu_init(armcpu, 0);
 
+	armcpu_initApproxCycles();
+
 	return 0;
 }
 
@@ -376,7 +380,8 @@ u32 armcpu_Wait4IRQ(armcpu_t *cpu)
 	return 1;
 }
 
-template<u32 PROCNUM>
+//FETCH_CYCLES = false skips the code fetch timing, for the approximate timing mode
+template<u32 PROCNUM, bool FETCH_CYCLES>
 FORCEINLINE static u32 armcpu_prefetch()
 {
 	armcpu_t* const armcpu = &ARMPROC;
@@ -392,6 +397,7 @@ FORCEINLINE static u32 armcpu_prefetch()
 		armcpu->R[15] = curInstruction + 8;
 		armcpu->instruction = _MMU_read32<PROCNUM, MMU_AT_CODE>(curInstruction);
 
+		if(!FETCH_CYCLES) return 0;
 		return MMU_codeFetchCycles<PROCNUM,32>(curInstruction);
 	}
 
@@ -403,6 +409,8 @@ FORCEINLINE static u32 armcpu_prefetch()
 	armcpu->R[15] = curInstruction + 4;
 	armcpu->instruction = _MMU_read16<PROCNUM, MMU_AT_CODE>(curInstruction);
 
+	if(!FETCH_CYCLES) return 0;
+
 	if(PROCNUM==0)
 	{
 		// arm9 fetches 2 instructions at a time in thumb mode
@@ -415,6 +423,12 @@ FORCEINLINE static u32 armcpu_prefetch()
 	return MMU_codeFetchCycles<PROCNUM,16>(curInstruction);
 }
 
+template<u32 PROCNUM>
+FORCEINLINE static u32 armcpu_prefetch()
+{
+	return armcpu_prefetch<PROCNUM,true>();
+}
+
 #if 0 /* not used */
 static BOOL FASTCALL test_EQ(Status_Reg CPSR) { return ( CPSR.bits.Z); }
 static BOOL FASTCALL test_NE(Status_Reg CPSR) { return (!CPSR.bits.Z); }
@@ -520,9 +534,111 @@ u32 TRAPUNDEF(armcpu_t* cpu)
 	}
 }
 
+//approximate timing (CommonSettings.approximate_timing): instructions with a constant
+//cost in the opcode tables are charged that, without running the handler's own count.
+//0 means the cost depends on the operands or the access (multiplies, loads and stores,
+//block transfers, swi), and what the handler returns is used instead. single loads and
+//stores get their fixed access cost there, from the size MMU_aluMemAccessCycles is
+//instantiated with (see MMU_approxAccessCycles).
+static u8 approxCyclesARM[4096];
+static u8 approxCyclesThumb[1024];
+
+static u32 armcpu_approxClassCycles(u32 attributes)
+{
+	if((attributes & INSTR_CYCLES_MASK) == INSTR_CYCLES_VARIABLE)
+		return 0;
+	return attributes & INSTR_CYCLES_MASK;
+}
+
+static void armcpu_initApproxCycles()
+{
+	for(int i = 0; i < 4096; i++)
+		approxCyclesARM[i] = armcpu_approxClassCycles(instruction_attributes[i]);
+	for(int i = 0; i < 1024; i++)
+		approxCyclesThumb[i] = armcpu_approxClassCycles(thumb_attributes[i]);
+}
+
+//whether the instruction about to run was reached by a branch. the sdk routines are
+//always entered with a bl or bx, so they're only looked for there.
+static bool armcpu_atBranchTarget[2];
+
+//called after an instruction has run and before the next one is fetched
+template<int PROCNUM, u32 ISIZE>
+static FORCEINLINE void armcpu_noteBranch()
+{
+	armcpu_atBranchTarget[PROCNUM] = (ARMPROC.next_instruction != ARMPROC.instruct_adr + ISIZE);
+}
+
+//runs the sdk routine starting at the current instruction natively, if it is one
+//bios_findSdkRoutine knows. the jit does the same when it compiles a block.
+template<int PROCNUM, bool FETCH_CYCLES>
+static FORCEINLINE bool armcpu_execSdkRoutine(u32 &cycles)
+{
+	if(!armcpu_atBranchTarget[PROCNUM] || ARMPROC.CPSR.bits.T || !bios_maybeSdkRoutine(ARMPROC.instruction))
+		return false;
+
+	ArmOpCompiled f = bios_findSdkRoutine<PROCNUM>(ARMPROC.instruct_adr, false);
+	if(!f) return false;
+
+	const u32 cExecute = f();
+	armcpu_atBranchTarget[PROCNUM] = true; //it returned to lr
+	const u32 cFetch = armcpu_prefetch<PROCNUM,FETCH_CYCLES>();
+	cycles = FETCH_CYCLES ? MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch) : cExecute;
+	return true;
+}
+
+//armcpu_exec for the approximate timing mode. the code fetch timing is compiled out,
+//and the memory accesses made by the handlers are charged a fixed cost (see
+//MMU_approxAccessCycles) without looking up the accessed region.
+template<int PROCNUM>
+static u32 armcpu_execApproximate()
+{
+	u32 sdkCycles;
+	if(armcpu_execSdkRoutine<PROCNUM,false>(sdkCycles))
+		return sdkCycles;
+
+	if(ARMPROC.CPSR.bits.T == 0)
+	{
+		const u32 index = INSTRUCTION_INDEX(ARMPROC.instruction);
+		u32 cycles = 1; // If condition=false: 1S cycle
+
+		if(
+			CONDITION(ARMPROC.instruction) == 0x0E  //fast path for unconditional instructions
+			|| (TEST_COND(CONDITION(ARMPROC.instruction), CODE(ARMPROC.instruction), ARMPROC.CPSR)) //handles any condition
+			)
+		{
+			#ifdef DEVELOPER
+			DEBUG_statistics.instructionHits[PROCNUM].arm[index]++;
+			#endif
+			cycles = arm_instructions_set[PROCNUM][index](ARMPROC.instruction);
+			if(approxCyclesARM[index])
+				cycles = approxCyclesARM[index];
+		}
+
+		armcpu_noteBranch<PROCNUM,4>();
+		armcpu_prefetch<PROCNUM,false>();
+		return cycles;
+	}
+
+	const u32 index = ARMPROC.instruction>>6;
+	#ifdef DEVELOPER
+	DEBUG_statistics.instructionHits[PROCNUM].thumb[index]++;
+	#endif
+	u32 cycles = thumb_instructions_set[PROCNUM][index](ARMPROC.instruction);
+	if(approxCyclesThumb[index])
+		cycles = approxCyclesThumb[index];
+
+	armcpu_noteBranch<PROCNUM,2>();
+	armcpu_prefetch<PROCNUM,false>();
+	return cycles;
+}
+
 template<int PROCNUM>
 u32 armcpu_exec()
 {
+	if(USE_APPROXIMATE_TIMING())
+		return armcpu_execApproximate<PROCNUM>();
+
 	// Usually, fetching and executing are processed parallelly.
 	// So this function stores the cycles of each process to
 	// the variables below, and returns appropriate cycle count.
@@ -574,6 +690,10 @@ u32 armcpu_exec()
 
 	//printf("%d: %08X\n",PROCNUM,ARMPROC.instruct_adr);
 
+	u32 sdkCycles;
+	if(armcpu_execSdkRoutine<PROCNUM,true>(sdkCycles))
+		return sdkCycles;
+
 	if(ARMPROC.CPSR.bits.T == 0)
 	{
 		if(
@@ -588,6 +708,7 @@ u32 armcpu_exec()
 		}
 		else
 			cExecute = 1; // If condition=false: 1S cycle
+		armcpu_noteBranch<PROCNUM,4>();
 		cFetch = armcpu_prefetch<PROCNUM>();
 		return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
 	}
@@ -597,6 +718,7 @@ u32 armcpu_exec()
 	#endif
 	cExecute = thumb_instructions_set[PROCNUM][ARMPROC.instruction>>6](ARMPROC.instruction);
 
+	armcpu_noteBranch<PROCNUM,2>();
 	cFetch = armcpu_prefetch<PROCNUM>();
 	return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
 }
@@ -621,7 +743,16 @@ u32 armcpu_exec()
 	{
 		ARMPROC.instruct_adr &= ARMPROC.CPSR.bits.T?0xFFFFFFFE:0xFFFFFFFC;
 		ArmOpCompiled f = (ArmOpCompiled)JIT_COMPILED_FUNC(ARMPROC.instruct_adr, PROCNUM);
-		return f ? f() : arm_jit_compile<PROCNUM>();
+		if (f) return f();
+
+		f = bios_findSdkRoutine<PROCNUM>(ARMPROC.instruct_adr, ARMPROC.CPSR.bits.T);
+		if (f)
+		{
+			JIT_COMPILED_FUNC(ARMPROC.instruct_adr, PROCNUM) = (uintptr_t)f;
+			return f();
+		}
+
+		return arm_jit_compile<PROCNUM>();
 	}
 
 	return armcpu_exec<PROCNUM>();
@@ -24,11 +24,16 @@
 #include "cp15.h"
 #include <math.h>
 #include "MMU.h"
+#include "MMU_timing.h"
 #include "debug.h"
 #include "registers.h"
 #include "NDSSystem.h"
 #include "utils/bits.h"
 
+#ifdef ENABLE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define cpu (&ARMPROC)
 #define TEMPLATE template<int PROCNUM>
 
@@ -43,6 +48,70 @@ private:
 	u32 value;
 };
 
+//the memory a decompression routine reads from or writes to. whatever part of it
+//MMU_hostRange can resolve is accessed directly on the host; the rest (io, tcm,
+//unmapped vram, ...) goes through the regular MMU accessors, so the results are
+//identical either way.
+template<int PROCNUM>
+class BiosRange
+{
+public:
+	BiosRange(u32 addr, u32 size, bool write = false, bool byteWrites = false)
+		: start(addr)
+		, size(size)
+	{
+		host = MMU_hostRange<PROCNUM>(addr, this->size, write, byteWrites);
+		if(!host) this->size = 0;
+	}
+
+	FORCEINLINE bool has(u32 addr, u32 bytes) const
+	{
+		const u32 ofs = addr - start;
+		return ofs < size && bytes <= size - ofs;
+	}
+	FORCEINLINE u8* ptr(u32 addr) const { return host + (addr - start); }
+
+	FORCEINLINE u8 read08(u32 addr) const
+	{
+		if(has(addr,1)) return *ptr(addr);
+		return _MMU_read08<PROCNUM>(addr);
+	}
+	FORCEINLINE u16 read16(u32 addr) const
+	{
+		addr &= ~1;
+		if(has(addr,2)) return T1ReadWord(ptr(addr), 0);
+		return _MMU_read16<PROCNUM>(addr);
+	}
+	FORCEINLINE u32 read32(u32 addr) const
+	{
+		addr &= ~3;
+		if(has(addr,4)) return T1ReadLong(ptr(addr), 0);
+		return _MMU_read32<PROCNUM>(addr);
+	}
+	FORCEINLINE void write08(u32 addr, u8 val) const
+	{
+		if(has(addr,1)) *ptr(addr) = val;
+		else _MMU_write08<PROCNUM>(addr, val);
+	}
+	FORCEINLINE void write16(u32 addr, u16 val) const
+	{
+		addr &= ~1;
+		if(has(addr,2)) T1WriteWord(ptr(addr), 0, val);
+		else _MMU_write16<PROCNUM>(addr, val);
+	}
+	FORCEINLINE void write32(u32 addr, u32 val) const
+	{
+		addr &= ~3;
+		if(has(addr,4)) T1WriteLong(ptr(addr), 0, val);
+		else _MMU_write32<PROCNUM>(addr, val);
+	}
+
+private:
+	const u32 start;
+	u32 size;
+	u8 *host;
+};
+
 static const u16 getsinetbl[] = {
 0x0000, 0x0324, 0x0648, 0x096A, 0x0C8C, 0x0FAB, 0x12C8, 0x15E2, 
 0x18F9, 0x1C0B, 0x1F1A, 0x2223, 0x2528, 0x2826, 0x2B1F, 0x2E11, 
@@ -490,8 +559,12 @@ TEMPLATE static u32 LZ77UnCompVram()
 
   len = header >> 8;
 
+  //a literal costs a byte plus a bit of the flag byte, a match at least as much
+  BiosRange<PROCNUM> src(source, len + len/8 + 2);
+  BiosRange<PROCNUM> dst(dest, len, true);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = src.read08(source++);
 
     if(d) {
       for(i1 = 0; i1 < 8; i1++) {
@@ -499,18 +572,18 @@ TEMPLATE static u32 LZ77UnCompVram()
           int length;
           int offset;
           u32 windowOffset;
-          u16 data = _MMU_read08<PROCNUM>(source++) << 8;
-          data |= _MMU_read08<PROCNUM>(source++);
+          u16 data = src.read08(source++) << 8;
+          data |= src.read08(source++);
           length = (data >> 12) + 3;
           offset = (data & 0x0FFF);
           windowOffset = dest + byteCount - offset - 1;
           for(i2 = 0; i2 < length; i2++) {
-            writeValue |= (_MMU_read08<PROCNUM>(windowOffset++) << byteShift);
+            writeValue |= (dst.read08(windowOffset++) << byteShift);
             byteShift += 8;
             byteCount++;
 
             if(byteCount == 2) {
-              _MMU_write16<PROCNUM>(dest, writeValue);
+              dst.write16(dest, writeValue);
               dest += 2;
               byteCount = 0;
               byteShift = 0;
@@ -521,11 +594,11 @@ TEMPLATE static u32 LZ77UnCompVram()
               return 0;
           }
         } else {
-          writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+          writeValue |= (src.read08(source++) << byteShift);
           byteShift += 8;
           byteCount++;
           if(byteCount == 2) {
-            _MMU_write16<PROCNUM>(dest, writeValue);
+            dst.write16(dest, writeValue);
             dest += 2;
             byteCount = 0;
             byteShift = 0;
@@ -539,11 +612,11 @@ TEMPLATE static u32 LZ77UnCompVram()
       }
     } else {
       for(i1 = 0; i1 < 8; i1++) {
-        writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+        writeValue |= (src.read08(source++) << byteShift);
         byteShift += 8;
         byteCount++;
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
+          dst.write16(dest, writeValue);
           dest += 2;      
           byteShift = 0;
           byteCount = 0;
@@ -576,8 +649,11 @@ TEMPLATE static u32 LZ77UnCompWram()
   
   len = header >> 8;
 
+  BiosRange<PROCNUM> src(source, len + len/8 + 2);
+  BiosRange<PROCNUM> dst(dest, len, true, true);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = src.read08(source++);
 
     if(d) {
       for(i1 = 0; i1 < 8; i1++) {
@@ -585,19 +661,31 @@ TEMPLATE static u32 LZ77UnCompWram()
           int length;
           int offset;
           u32 windowOffset;
-          u16 data = _MMU_read08<PROCNUM>(source++) << 8;
-          data |= _MMU_read08<PROCNUM>(source++);
+          u16 data = src.read08(source++) << 8;
+          data |= src.read08(source++);
           length = (data >> 12) + 3;
           offset = (data & 0x0FFF);
           windowOffset = dest - offset - 1;
-          for(i2 = 0; i2 < length; i2++) {
-            _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(windowOffset++));
+          //when the window is at least a word behind, copying a word at a
+          //time gives the same result as copying byte by byte
+          if(offset >= 3 && length < len && dst.has(windowOffset, length) && dst.has(dest, length)) {
+            u8 *from = dst.ptr(windowOffset);
+            u8 *to = dst.ptr(dest);
+            for(i2 = 0; i2 + 4 <= length; i2 += 4)
+              memcpy(to + i2, from + i2, 4);
+            for(; i2 < length; i2++)
+              to[i2] = from[i2];
+            dest += length;
+            len -= length;
+          }
+          else for(i2 = 0; i2 < length; i2++) {
+            dst.write08(dest++, dst.read08(windowOffset++));
             len--;
             if(len == 0)
               return 0;
           }
         } else {
-          _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(source++));
+          dst.write08(dest++, src.read08(source++));
           len--;
           if(len == 0)
             return 0;
@@ -606,7 +694,7 @@ TEMPLATE static u32 LZ77UnCompWram()
       }
     } else {
       for(i1 = 0; i1 < 8; i1++) {
-        _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(source++));
+        dst.write08(dest++, src.read08(source++));
         len--;
         if(len == 0)
           return 0;
@@ -636,15 +724,18 @@ TEMPLATE static u32 RLUnCompVram()
     return 0;  
   
   len = header >> 8;
+
+  BiosRange<PROCNUM> src(source, 2*len + 2);
+  BiosRange<PROCNUM> dst(dest, len, true);
   byteCount = 0;
   byteShift = 0;
   writeValue = 0;
 
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = src.read08(source++);
     int l = d & 0x7F;
     if(d & 0x80) {
-      u8 data = _MMU_read08<PROCNUM>(source++);
+      u8 data = src.read08(source++);
       l += 3;
       for(i = 0;i < l; i++) {
         writeValue |= (data << byteShift);
@@ -652,7 +743,7 @@ TEMPLATE static u32 RLUnCompVram()
         byteCount++;
 
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
+          dst.write16(dest, writeValue);
           dest += 2;
           byteCount = 0;
           byteShift = 0;
@@ -665,11 +756,11 @@ TEMPLATE static u32 RLUnCompVram()
     } else {
       l++;
       for(i = 0; i < l; i++) {
-        writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+        writeValue |= (src.read08(source++) << byteShift);
         byteShift += 8;
         byteCount++;
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
+          dst.write16(dest, writeValue);
           dest += 2;
           byteCount = 0;
           byteShift = 0;
@@ -706,14 +797,17 @@ TEMPLATE static u32 RLUnCompWram()
   
   len = header >> 8;
 
+  BiosRange<PROCNUM> src(source, 2*len + 2);
+  BiosRange<PROCNUM> dst(dest, len, true, true);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = src.read08(source++);
     int l = d & 0x7F;
     if(d & 0x80) {
-      u8 data = _MMU_read08<PROCNUM>(source++);
+      u8 data = src.read08(source++);
       l += 3;
       for(i = 0;i < l; i++) {
-        _MMU_write08<PROCNUM>(dest++, data);
+        dst.write08(dest++, data);
         len--;
         if(len == 0)
           return 0;
@@ -721,7 +815,7 @@ TEMPLATE static u32 RLUnCompWram()
     } else {
       l++;
       for(i = 0; i < l; i++) {
-        _MMU_write08<PROCNUM>(dest++,  _MMU_read08<PROCNUM>(source++));
+        dst.write08(dest++, src.read08(source++));
         len--;
         if(len == 0)
           return 0;
@@ -753,20 +847,24 @@ TEMPLATE static u32 UnCompHuffman()
      ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
     return 0;  
   
-  treeSize = _MMU_read08<PROCNUM>(source++);
+  len = header >> 8;
+
+  //the size of the bitstream isn't known up front; anything past this guess goes through the MMU
+  BiosRange<PROCNUM> src(source, 0x200 + len*8);
+  BiosRange<PROCNUM> dst(dest, len, true);
+
+  treeSize = src.read08(source++);
 
   treeStart = source;
 
   source += ((treeSize+1)<<1)-1; // minus because we already skipped one byte
-  
-  len = header >> 8;
 
   mask = 0x80000000;
-  data = _MMU_read32<PROCNUM>(source);
+  data = src.read32(source);
   source += 4;
 
   pos = 0;
-  rootNode = _MMU_read08<PROCNUM>(treeStart);
+  rootNode = src.read08(treeStart);
   currentNode = rootNode;
   writeData = 0;
   byteShift = 0;
@@ -785,12 +883,12 @@ TEMPLATE static u32 UnCompHuffman()
         // right
         if(currentNode & 0x40)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos+1);
+        currentNode = src.read08(treeStart+pos+1);
       } else {
         // left
         if(currentNode & 0x80)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos);
+        currentNode = src.read08(treeStart+pos);
       }
       
       if(writeData) {
@@ -805,7 +903,7 @@ TEMPLATE static u32 UnCompHuffman()
         if(byteCount == 4) {
           byteCount = 0;
           byteShift = 0;
-          _MMU_write32<PROCNUM>(dest, writeValue);
+          dst.write32(dest, writeValue);
           writeValue = 0;
           dest += 4;
           len -= 4;
@@ -814,7 +912,7 @@ TEMPLATE static u32 UnCompHuffman()
       mask >>= 1;
       if(mask == 0) {
         mask = 0x80000000;
-        data = _MMU_read32<PROCNUM>(source);
+        data = src.read32(source);
         source += 4;
       }
     }
@@ -832,12 +930,12 @@ TEMPLATE static u32 UnCompHuffman()
         // right
         if(currentNode & 0x40)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos+1);
+        currentNode = src.read08(treeStart+pos+1);
       } else {
         // left
         if(currentNode & 0x80)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos);
+        currentNode = src.read08(treeStart+pos);
       }
       
       if(writeData) {
@@ -858,7 +956,7 @@ TEMPLATE static u32 UnCompHuffman()
           if(byteCount == 4) {
             byteCount = 0;
             byteShift = 0;
-            _MMU_write32<PROCNUM>(dest, writeValue);
+            dst.write32(dest, writeValue);
             dest += 4;
             writeValue = 0;
             len -= 4;
@@ -871,13 +969,110 @@ TEMPLATE static u32 UnCompHuffman()
       mask >>= 1;
       if(mask == 0) {
         mask = 0x80000000;
-        data = _MMU_read32<PROCNUM>(source);
+        data = src.read32(source);
         source += 4;
       }
     }    
   }
   return 1;
 }
+//expands the whole BitUnPack source at once, through a table holding the output
+//bits of every possible source byte. the table is built with the same per-field
+//arithmetic as the generic loop in BitUnPack (including the base carrying into
+//the next field), so the output is identical.
+static void BitUnPackTable(const u8 *src, u8 *dst, int len, int bits, int dataSize, u32 base, int addBase)
+{
+	const u32 fields = 8 / bits;
+	const u32 outBits = fields * dataSize;
+	const u32 fieldMask = 0xFF >> (8 - bits);
+	//words produced by one source byte, or source bytes making up one word
+	const u32 wordsPerByte = outBits >= 32 ? outBits / 32 : 1;
+	const u32 bytesPerWord = outBits >= 32 ? 1 : 32 / outBits;
+	u32 table[256*8];
+
+	for(u32 b = 0; b < 256; b++)
+	{
+		u32 *entry = &table[b * wordsPerByte];
+		memset(entry, 0, wordsPerByte * sizeof(u32));
+		u32 bitpos = 0;
+		for(u32 i = 0; i < fields; i++)
+		{
+			u32 temp = (b >> (i * bits)) & fieldMask;
+			if(temp || addBase)
+				temp += base;
+			entry[bitpos / 32] |= temp << (bitpos & 31);
+			bitpos += dataSize;
+		}
+	}
+
+	if(bytesPerWord == 1)
+	{
+		for(int i = 0; i < len; i++)
+		{
+			const u32 *entry = &table[src[i] * wordsPerByte];
+			for(u32 w = 0; w < wordsPerByte; w++, dst += 4)
+				T1WriteLong(dst, 0, entry[w]);
+		}
+		return;
+	}
+
+	for(int i = 0; i + (int)bytesPerWord <= len; i += bytesPerWord, dst += 4)
+	{
+		u32 word = 0;
+		for(u32 j = 0; j < bytesPerWord; j++)
+			word |= table[src[i+j]] << (j * outBits);
+		T1WriteLong(dst, 0, word);
+	}
+}
+
+#ifdef ENABLE_SSE2
+//expands four output words at a time, one per lane, when each word is built from whole
+//source bytes (fields no wider than the output size, and one, two or four bytes per word).
+//every lane pulls its fields out of its own source bytes and does the same add and or
+//as the generic loop, so the output is identical. returns the number of source bytes used;
+//the rest is left to BitUnPackTable, which is also faster when a source byte expands to
+//whole words, since its table entries are then just copied out.
+static int BitUnPackSSE2(const u8 *src, u8 *dst, int len, int bits, int dataSize, u32 base, int addBase)
+{
+	const u32 fields = 32 / dataSize;
+	const u32 bytesPerWord = (fields * bits) / 8;
+	if(bits > dataSize || bytesPerWord == 0)
+		return 0;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i fieldMask = _mm_set1_epi32(0xFF >> (8 - bits));
+	const __m128i baseVec = _mm_set1_epi32(base);
+	//all ones when the base is added to zero fields too
+	const __m128i addBaseMask = _mm_set1_epi32(addBase ? -1 : 0);
+	const int step = bytesPerWord * 4;
+	int i = 0;
+
+	for(; i + step <= len; i += step, dst += 16)
+	{
+		//the source bytes of each word, in its own lane
+		__m128i in;
+		if(bytesPerWord == 4)
+			in = _mm_loadu_si128((const __m128i *)(src + i));
+		else if(bytesPerWord == 2)
+			in = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(src + i)), zero);
+		else
+			in = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(T1ReadLong((u8 *)src, i)), zero), zero);
+
+		__m128i out = zero;
+		for(u32 f = 0; f < fields; f++)
+		{
+			const __m128i temp = _mm_and_si128(_mm_srl_epi32(in, _mm_cvtsi32_si128(f * bits)), fieldMask);
+			const __m128i skipBase = _mm_andnot_si128(addBaseMask, _mm_cmpeq_epi32(temp, zero));
+			const __m128i value = _mm_add_epi32(temp, _mm_andnot_si128(skipBase, baseVec));
+			out = _mm_or_si128(out, _mm_sll_epi32(value, _mm_cvtsi32_si128(f * dataSize)));
+		}
+		_mm_storeu_si128((__m128i *)dst, out);
+	}
+
+	return i;
+}
+#endif
+
 TEMPLATE static u32 BitUnPack()
 {
 	u32 source,dest,header,base,temp;
@@ -921,6 +1116,28 @@ TEMPLATE static u32 BitUnPack()
 
 	//INFO("SWI10: bitunpack src 0x%08X dst 0x%08X hdr 0x%08X (src len %05i src bits %02i dst bits %02i)\n\n", source, dest, header, len, bits, dataSize);
 
+	//each source byte expands to a fixed number of output bits
+	const u32 outBits = (8 / bits) * dataSize;
+	const u32 outSize = (u32)(((u64)len * outBits) / 32) * 4;
+	//the output is written a word at a time, each to the word holding dest
+	//(see write32), so the host side only ever sees aligned words too
+	dest &= ~3;
+	BiosRange<PROCNUM> src(source, len);
+	BiosRange<PROCNUM> dst(dest, outSize, true);
+
+	if(len >= 64 && src.has(source, len) && dst.has(dest, outSize))
+	{
+		const u8 *in = src.ptr(source);
+		u8 *out = dst.ptr(dest);
+		int done = 0;
+#ifdef ENABLE_SSE2
+		done = BitUnPackSSE2(in, out, len, bits, dataSize, base, addBase);
+#endif
+		if(done < len)
+			BitUnPackTable(in + done, out + (u32)(((u64)done * outBits) / 8), len - done, bits, dataSize, base, addBase);
+		return 1;
+	}
+
 	data = 0; 
 	bitwritecount = 0; 
 	while(1) {
@@ -928,7 +1145,7 @@ TEMPLATE static u32 BitUnPack()
 		if(len < 0)
 			break;
 		mask = 0xff >> revbits; 
-		b = _MMU_read08<PROCNUM>(source); 
+		b = src.read08(source); 
 		source++;
 		bitcount = 0;
 		while(1) {
@@ -948,7 +1165,7 @@ TEMPLATE static u32 BitUnPack()
 			data |= temp << bitwritecount;
 			bitwritecount += dataSize;
 			if(bitwritecount >= 32) {
-				_MMU_write32<PROCNUM>(dest, data);
+				dst.write32(dest, data);
 				dest += 4;
 				data = 0;
 				bitwritecount = 0;
@@ -1001,17 +1218,20 @@ TEMPLATE static u32 Diff16bitUnFilter()
 	if(header.Type() != 8) printf("WARNING: incorrect header passed to Diff16bitUnFilter\n");
 	u32 len = header.DecompressedSize();
 
-	u16 data = _MMU_read16<PROCNUM>(source);
+	BiosRange<PROCNUM> src(source, len);
+	BiosRange<PROCNUM> dst(dest, len, true);
+
+	u16 data = src.read16(source);
 	source += 2;
-	_MMU_write16<PROCNUM>(dest, data);
+	dst.write16(dest, data);
 	dest += 2;
 	len -= 2;
 
 	while(len >= 2) {
-		u16 diff = _MMU_read16<PROCNUM>(source);
+		u16 diff = src.read16(source);
 		source += 2;
 		data += diff;
-		_MMU_write16<PROCNUM>(dest, data);
+		dst.write16(dest, data);
 		dest += 2;
 		len -= 2;
 	}
@@ -1337,3 +1557,209 @@ const char* ARM_swi_names[2][32] = {
 	}
 };
 #undef BIOS_NOP
+
+//HLE for the memory routines of the nintendo sdk, which games link into their own code.
+//the jit looks a routine up by its exact code when it is about to compile a block at
+//its entry point, and the interpreter when it is about to execute one's first
+//instruction; both run the native version below instead. these have the same effect
+//on registers, flags and memory as the original loop, charge the cycles the loop would
+//have taken, and return to the caller the way its final bx lr does.
+//
+//only the MI_Cpu copy and fill loops are recognized. the sdk's software decompressors
+//(MI_UncompressLZ8 and friends) differ between sdk versions and compilers, so there is
+//no one code sequence to match them by; the bios decompressors they mirror, which games
+//reach through the SVC_ wrappers, are already HLEd as swis above.
+
+static FORCEINLINE void sdk_cmp(armcpu_t *armcpu, u32 a, u32 b)
+{
+	const u32 res = a - b;
+	armcpu->CPSR.bits.N = BIT31(res);
+	armcpu->CPSR.bits.Z = (res == 0);
+	armcpu->CPSR.bits.C = !BorrowFrom(a, b);
+	armcpu->CPSR.bits.V = OverflowFromSUB(res, a, b);
+}
+
+//the LT condition of cmp a, b
+static FORCEINLINE bool sdk_lt(u32 a, u32 b) { return (s32)a < (s32)b; }
+
+TEMPLATE static FORCEINLINE u32 sdk_return()
+{
+	u32 tmp = cpu->R[14];
+	cpu->CPSR.bits.T = BIT0(tmp);
+	cpu->R[15] = tmp & (0xFFFFFFFC|(cpu->CPSR.bits.T<<1));
+	cpu->next_instruction = cpu->R[15];
+	cpu->instruct_adr = cpu->next_instruction;
+	return 3;
+}
+
+//MI_CpuCopy32(src, dest, size)
+//	add     r12, r1, r2
+//	cmp     r1, r12
+//	ldmltia r0!, {r2}
+//	stmltia r1!, {r2}
+//	blt     @1
+//	bx      lr
+TEMPLATE static u32 FASTCALL sdk_MI_CpuCopy32()
+{
+	u32 src = cpu->R[0];
+	u32 dest = cpu->R[1];
+	const u32 end = dest + cpu->R[2];
+	const u32 loop = MMU_aluMemCycles<PROCNUM>(2, MMU_memAccessCycles<PROCNUM,32,MMU_AD_READ>(src))
+		+ MMU_aluMemCycles<PROCNUM>(1, MMU_memAccessCycles<PROCNUM,32,MMU_AD_WRITE>(dest)) + 4;
+
+	BiosRange<PROCNUM> srcRange(src & ~3, cpu->R[2]);
+	BiosRange<PROCNUM> destRange(dest & ~3, cpu->R[2], true);
+
+	u32 cycles = 1;
+	while(sdk_lt(dest, end))
+	{
+		cpu->R[2] = srcRange.read32(src);
+		destRange.write32(dest, cpu->R[2]);
+		src += 4;
+		dest += 4;
+		cycles += loop;
+	}
+
+	cpu->R[0] = src;
+	cpu->R[1] = dest;
+	cpu->R[12] = end;
+	sdk_cmp(cpu, dest, end);
+	return cycles + 4 + sdk_return<PROCNUM>();
+}
+
+//MI_CpuFill32(data, dest, size)
+//	add     r12, r1, r2
+//	cmp     r1, r12
+//	stmltia r1!, {r0}
+//	blt     @1
+//	bx      lr
+TEMPLATE static u32 FASTCALL sdk_MI_CpuFill32()
+{
+	const u32 data = cpu->R[0];
+	u32 dest = cpu->R[1];
+	const u32 end = dest + cpu->R[2];
+	const u32 loop = MMU_aluMemCycles<PROCNUM>(1, MMU_memAccessCycles<PROCNUM,32,MMU_AD_WRITE>(dest)) + 4;
+
+	BiosRange<PROCNUM> destRange(dest & ~3, cpu->R[2], true);
+
+	u32 cycles = 1;
+	while(sdk_lt(dest, end))
+	{
+		destRange.write32(dest, data);
+		dest += 4;
+		cycles += loop;
+	}
+
+	cpu->R[1] = dest;
+	cpu->R[12] = end;
+	sdk_cmp(cpu, dest, end);
+	return cycles + 3 + sdk_return<PROCNUM>();
+}
+
+//MI_CpuCopy16(src, dest, size)
+//	mov     r12, #0
+//	cmp     r12, r2
+//	ldrlth  r3, [r0, r12]
+//	strlth  r3, [r1, r12]
+//	addlt   r12, r12, #2
+//	blt     @1
+//	bx      lr
+TEMPLATE static u32 FASTCALL sdk_MI_CpuCopy16()
+{
+	const u32 src = cpu->R[0];
+	const u32 dest = cpu->R[1];
+	const u32 size = cpu->R[2];
+	const u32 loop = MMU_aluMemCycles<PROCNUM>(3, MMU_memAccessCycles<PROCNUM,16,MMU_AD_READ>(src))
+		+ MMU_aluMemCycles<PROCNUM>(2, MMU_memAccessCycles<PROCNUM,16,MMU_AD_WRITE>(dest)) + 5;
+
+	BiosRange<PROCNUM> srcRange(src & ~1, size);
+	BiosRange<PROCNUM> destRange(dest & ~1, size, true);
+
+	u32 ofs = 0;
+	u32 cycles = 1;
+	while(sdk_lt(ofs, size))
+	{
+		cpu->R[3] = srcRange.read16(src + ofs);
+		destRange.write16(dest + ofs, cpu->R[3]);
+		ofs += 2;
+		cycles += loop;
+	}
+
+	cpu->R[12] = ofs;
+	sdk_cmp(cpu, ofs, size);
+	return cycles + 5 + sdk_return<PROCNUM>();
+}
+
+//MI_CpuFill16(data, dest, size)
+//	mov     r3, #0
+//	cmp     r3, r2
+//	strlth  r0, [r1, r3]
+//	addlt   r3, r3, #2
+//	blt     @1
+//	bx      lr
+TEMPLATE static u32 FASTCALL sdk_MI_CpuFill16()
+{
+	const u16 data = (u16)cpu->R[0];
+	const u32 dest = cpu->R[1];
+	const u32 size = cpu->R[2];
+	const u32 loop = MMU_aluMemCycles<PROCNUM>(2, MMU_memAccessCycles<PROCNUM,16,MMU_AD_WRITE>(dest)) + 5;
+
+	BiosRange<PROCNUM> destRange(dest & ~1, size, true);
+
+	u32 ofs = 0;
+	u32 cycles = 1;
+	while(sdk_lt(ofs, size))
+	{
+		destRange.write16(dest + ofs, data);
+		ofs += 2;
+		cycles += loop;
+	}
+
+	cpu->R[3] = ofs;
+	sdk_cmp(cpu, ofs, size);
+	return cycles + 4 + sdk_return<PROCNUM>();
+}
+
+struct SdkRoutine
+{
+	const char *name;
+	u32 count;
+	u32 code[8];
+	ArmOpCompiled hle[2];
+};
+
+static const SdkRoutine sdk_routines[] = {
+	{ "MI_CpuCopy32", 6, { 0xE081C002, 0xE151000C, 0xB8B00004, 0xB8A10004, 0xBAFFFFFB, 0xE12FFF1E },
+		{ sdk_MI_CpuCopy32<ARMCPU_ARM9>, sdk_MI_CpuCopy32<ARMCPU_ARM7> } },
+	{ "MI_CpuFill32", 5, { 0xE081C002, 0xE151000C, 0xB8A10001, 0xBAFFFFFC, 0xE12FFF1E },
+		{ sdk_MI_CpuFill32<ARMCPU_ARM9>, sdk_MI_CpuFill32<ARMCPU_ARM7> } },
+	{ "MI_CpuCopy16", 7, { 0xE3A0C000, 0xE15C0002, 0xB19030BC, 0xB18130BC, 0xB28CC002, 0xBAFFFFFA, 0xE12FFF1E },
+		{ sdk_MI_CpuCopy16<ARMCPU_ARM9>, sdk_MI_CpuCopy16<ARMCPU_ARM7> } },
+	{ "MI_CpuFill16", 6, { 0xE3A03000, 0xE1530002, 0xB18100B3, 0xB2833002, 0xBAFFFFFB, 0xE12FFF1E },
+		{ sdk_MI_CpuFill16<ARMCPU_ARM9>, sdk_MI_CpuFill16<ARMCPU_ARM7> } },
+};
+
+template<int PROCNUM>
+ArmOpCompiled bios_findSdkRoutine(u32 adr, bool thumb)
+{
+	if(thumb) return NULL;
+
+	const u32 first = _MMU_read32<PROCNUM,MMU_AT_DEBUG>(adr);
+	for(u32 i = 0; i < sizeof(sdk_routines)/sizeof(sdk_routines[0]); i++)
+	{
+		const SdkRoutine &routine = sdk_routines[i];
+		assert(bios_maybeSdkRoutine(routine.code[0]));
+		if(routine.code[0] != first) continue;
+
+		u32 j = 1;
+		while(j < routine.count && _MMU_read32<PROCNUM,MMU_AT_DEBUG>(adr + 4*j) == routine.code[j])
+			j++;
+		if(j == routine.count)
+			return routine.hle[PROCNUM];
+	}
+
+	return NULL;
+}
+
+template ArmOpCompiled bios_findSdkRoutine<ARMCPU_ARM9>(u32 adr, bool thumb);
+template ArmOpCompiled bios_findSdkRoutine<ARMCPU_ARM7>(u32 adr, bool thumb);
@@ -20,9 +20,22 @@
 #define BIOS_H
 
 #include "types.h"
+#include "arm_jit.h"
 
 extern u32 (* ARM_swi_tab[2][32])();
 extern const char* ARM_swi_names[2][32];
 
+//returns a native replacement for the nintendo sdk routine whose code starts at adr, if any
+template<int PROCNUM> ArmOpCompiled bios_findSdkRoutine(u32 adr, bool thumb);
+
+//whether an arm instruction is the first one of a routine bios_findSdkRoutine knows.
+//the interpreter checks branch targets against this before looking anything up.
+FORCEINLINE bool bios_maybeSdkRoutine(u32 instruction)
+{
+	return instruction == 0xE081C002	//add r12, r1, r2 (MI_CpuCopy32, MI_CpuFill32)
+		|| instruction == 0xE3A0C000	//mov r12, #0 (MI_CpuCopy16)
+		|| instruction == 0xE3A03000;	//mov r3, #0 (MI_CpuFill16)
+}
+
 #endif
  
@@ -44,6 +44,8 @@
 #include "emufile.h"
 #include "matrix.h"
 #include "GPU.h"
+#include "lighting.h"
+#include "ysort.h"
 #include "MMU.h"
 #include "render3D.h"
 #include "mem.h"
@@ -336,6 +338,13 @@ static CACHE_ALIGN s32 mtxCurrent[4][16];
 static CACHE_ALIGN s32 mtxTemporal[16];
 static MatrixMode mode = MATRIXMODE_PROJECTION;
 
+// The clip matrix (projection * position), and float copies of both for the box and position tests.
+// These are only rebuilt when they're needed after the projection or position matrix has changed.
+static CACHE_ALIGN s32 mtxClip[16];
+static CACHE_ALIGN float mtxProjectionFloat[16];
+static CACHE_ALIGN float mtxPositionFloat[16];
+static bool mtxClipDirty = true;
+
 // Indexes for matrix loading/multiplication
 static u8 ML4x4ind = 0;
 static u8 ML4x3ind = 0;
@@ -397,6 +406,7 @@ static u32 lightMask=0;
 static int texCoordinateTransform = 0;
 static CACHE_ALIGN s32 cacheLightDirection[4][4];
 static CACHE_ALIGN s32 cacheHalfVector[4][4];
+static LightingCache lightingCache;
 //------------------
 
 #define RENDER_FRONT_SURFACE 0x80
@@ -408,6 +418,8 @@ POLYLIST* polylists = NULL;
 POLYLIST* polylist = NULL;
 VERTLIST* vertlists = NULL;
 VERTLIST* vertlist = NULL;
+VERTSTORE vertstores[2];
+VERTSTORE* vertstore = NULL;
 int			polygonListCompleted = 0;
 
 int listTwiddle = 1;
@@ -430,8 +442,10 @@ static void twiddleLists(void)
 	listTwiddle &= 1;
 	polylist = &polylists[listTwiddle];
 	vertlist = &vertlists[listTwiddle];
+	vertstore = &vertstores[listTwiddle];
 	polylist->count = 0;
 	vertlist->count = 0;
+	vertstore->count = 0;
 }
 
 static BOOL flushPending = FALSE;
@@ -516,6 +530,62 @@ void VERT::load(EMUFILE* is)
 	OSREAD(fcolor[0]); OSREAD(fcolor[1]); OSREAD(fcolor[2]);
 }
 
+//most frames use a few hundred verts, so start small and grow by doubling
+#define VERTSTORE_INITIAL_SIZE 1024
+
+void VERTSTORE::init()
+{
+	this->coord = NULL;
+	this->texcoord = NULL;
+	this->color = NULL;
+	this->count = 0;
+	this->capacity = 0;
+	this->reserve(VERTSTORE_INITIAL_SIZE);
+}
+
+void VERTSTORE::deinit()
+{
+	memalign_free(this->coord);
+	memalign_free(this->texcoord);
+	memalign_free(this->color);
+	this->coord = NULL;
+	this->texcoord = NULL;
+	this->color = NULL;
+	this->count = 0;
+	this->capacity = 0;
+}
+
+void VERTSTORE::reserve(size_t size)
+{
+	if (size <= this->capacity)
+		return;
+
+	size_t newCapacity = (this->capacity != 0) ? this->capacity : VERTSTORE_INITIAL_SIZE;
+	while (newCapacity < size)
+		newCapacity *= 2;
+
+	float *newCoord = (float *)memalign_alloc(16, newCapacity * 4 * sizeof(float));
+	float *newTexcoord = (float *)memalign_alloc(16, newCapacity * 2 * sizeof(float));
+	u8 *newColor = (u8 *)memalign_alloc(16, newCapacity * 4 * sizeof(u8));
+
+	//verts past the count may already have been written by a strip that isn't finished yet
+	if (this->capacity != 0)
+	{
+		memcpy(newCoord, this->coord, this->capacity * 4 * sizeof(float));
+		memcpy(newTexcoord, this->texcoord, this->capacity * 2 * sizeof(float));
+		memcpy(newColor, this->color, this->capacity * 4 * sizeof(u8));
+	}
+
+	memalign_free(this->coord);
+	memalign_free(this->texcoord);
+	memalign_free(this->color);
+
+	this->coord = newCoord;
+	this->texcoord = newTexcoord;
+	this->color = newColor;
+	this->capacity = newCapacity;
+}
+
 void gfx3d_init()
 {
 	gxf_hardware.reset();
@@ -552,6 +622,13 @@ void gfx3d_init()
 		vertlist = &vertlists[0];
 	}
 	
+	if(vertstore == NULL)
+	{
+		vertstores[0].init();
+		vertstores[1].init();
+		vertstore = &vertstores[0];
+	}
+	
 #ifdef NEW
 	gfx3d.state.savedDISP3DCNT.value = 0;
 	gfx3d.state.fogDensityTable = MMU.ARM9_REG+0x0360;
@@ -577,6 +654,13 @@ void gfx3d_deinit()
 	free(vertlists);
 	vertlists = NULL;
 	vertlist = NULL;
+	
+	vertstores[0].deinit();
+	vertstores[1].deinit();
+	vertstore = NULL;
+
+	delete viewer3d_state;
+	viewer3d_state = NULL;
 }
 
 void gfx3d_reset()
@@ -584,21 +668,26 @@ void gfx3d_reset()
 	CurrentRenderer->RenderFinish();
 	
 	reconstruct(&gfx3d);
+
+	//the viewer's copy of the lists is several megabytes, so it's only made once the viewer is actually used
 	delete viewer3d_state;
-	viewer3d_state = new Viewer3d_State();
+	viewer3d_state = NULL;
 	
 	gxf_hardware.reset();
 
 	control = 0;
 	drawPending = FALSE;
 	flushPending = FALSE;
-	memset(polylists, 0, sizeof(POLYLIST)*2);
-	memset(vertlists, 0, sizeof(VERTLIST)*2);
+	//nothing past the counts is ever read, so there's no need to touch the rest of the lists
+	polylists[0].count = polylists[1].count = 0;
+	vertlists[0].count = vertlists[1].count = 0;
+	vertstores[0].count = vertstores[1].count = 0;
 	gfx3d.state.invalidateToon = true;
 	listTwiddle = 1;
 	twiddleLists();
 	gfx3d.polylist = polylist;
 	gfx3d.vertlist = vertlist;
+	gfx3d.vertstore = vertstore;
 
 	polyAttr = 0;
 	textureFormat = 0;
@@ -623,6 +712,9 @@ void gfx3d_reset()
 	MatrixInit (mtxCurrent[2]);
 	MatrixInit (mtxCurrent[3]);
 	MatrixInit (mtxTemporal);
+	mtxClipDirty = true;
+
+	lightingCache.reset();
 
 	MatrixStackInit(&mtxStack[0]);
 	MatrixStackInit(&mtxStack[1]);
@@ -673,15 +765,6 @@ inline float vec3dot(float* a, float* b)
 	return (((a[0]) * (b[0])) + ((a[1]) * (b[1])) + ((a[2]) * (b[2])));
 }
 
-FORCEINLINE s32 mul_fixed32(s32 a, s32 b)
-{
-	return fx32_shiftdown(fx32_mul(a,b));
-}
-
-FORCEINLINE s32 vec3dot_fixed32(const s32* a, const s32* b) {
-	return fx32_shiftdown(fx32_mul(a[0],b[0]) + fx32_mul(a[1],b[1]) + fx32_mul(a[2],b[2]));
-}
-
 #define SUBMITVERTEX(ii, nn) polylist->list[polylist->count].vertIndexes[ii] = tempVertInfo.map[nn];
 //Submit a vertex to the GE
 static void SetVertex()
@@ -763,6 +846,7 @@ static void SetVertex()
 	vert.color[1]    = GFX3D_5TO6(colorRGB[1]);
 	vert.color[2]    = GFX3D_5TO6(colorRGB[2]);
 	vert.color_to_float();
+	vertstore->set(vertIndex, vert);
 	tempVertInfo.map[tempVertInfo.count] = vertlist->count + tempVertInfo.count - continuation;
 	tempVertInfo.count++;
 
@@ -915,6 +999,7 @@ static void gfx3d_glLightDirection_cache(const size_t index)
 	cacheLightDirection[index][1] = y;
 	cacheLightDirection[index][2] = z;
 	cacheLightDirection[index][3] = 0;
+	lightingCache.invalidate();
 
 	/* Multiply the vector by the directional matrix */
 	MatrixMultVec3x3_fixed(mtxCurrent[2], cacheLightDirection[index]);
@@ -944,6 +1029,23 @@ static void gfx3d_glLightDirection_cache(const size_t index)
 
 
 //===============================================================================
+static void gfx3d_UpdateClipMatrix()
+{
+	if (!mtxClipDirty)
+		return;
+
+	MatrixCopy(mtxClip, mtxCurrent[MATRIXMODE_PROJECTION]);
+	MatrixMultiply(mtxClip, mtxCurrent[MATRIXMODE_POSITION]);
+
+	for (size_t i = 0; i < 16; i++)
+	{
+		mtxProjectionFloat[i] = mtxCurrent[MATRIXMODE_PROJECTION][i] / 4096.0f;
+		mtxPositionFloat[i] = mtxCurrent[MATRIXMODE_POSITION][i] / 4096.0f;
+	}
+
+	mtxClipDirty = false;
+}
+
 static void gfx3d_glMatrixMode(u32 v)
 {
 	mode = (MatrixMode)(v & 0x03);
@@ -983,6 +1085,7 @@ static void gfx3d_glPopMatrix(s32 i)
 	//please note that our ability to skip treating this as signed is dependent on the modular addressing later. if that ever changes, we need to change this back.
 
 	MatrixStackPopMatrix(mtxCurrent[mymode], &mtxStack[mymode], i);
+	mtxClipDirty = true;
 
 	GFX_DELAY(36);
 
@@ -1038,6 +1141,7 @@ static void gfx3d_glRestoreMatrix(u32 v)
 
 
 	MatrixCopy(mtxCurrent[mymode], MatrixStackGetPos(&mtxStack[mymode], v));
+	mtxClipDirty = true;
 
 	GFX_DELAY(36);
 
@@ -1048,6 +1152,7 @@ static void gfx3d_glRestoreMatrix(u32 v)
 static void gfx3d_glLoadIdentity()
 {
 	MatrixIdentity(mtxCurrent[mode]);
+	mtxClipDirty = true;
 
 	GFX_DELAY(19);
 
@@ -1057,15 +1162,19 @@ static void gfx3d_glLoadIdentity()
 	//printf("identity: %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
 }
 
-static BOOL gfx3d_glLoadMatrix4x4(s32 v)
+//reads the parameters of a whole matrix command into a 4x4 matrix.
+//4x3 and 3x3 matrices leave the last column (and row) alone, the same as the one-word-at-a-time handlers do.
+template<size_t ROWS, size_t COLS>
+static FORCEINLINE void gfx3d_readMatrixParams(s32 *mtx, const u32 *params)
 {
-	mtxCurrent[mode][ML4x4ind] = v;
-
-	++ML4x4ind;
-	if(ML4x4ind<16)
-      return FALSE;
-	ML4x4ind = 0;
+	for (size_t r = 0; r < ROWS; r++)
+		for (size_t c = 0; c < COLS; c++)
+			mtx[(r * 4) + c] = (s32)params[(r * COLS) + c];
+}
 
+static void gfx3d_glLoadMatrix4x4_apply()
+{
+	mtxClipDirty = true;
 	GFX_DELAY(19);
 
 	//vector_fix2float<4>(mtxCurrent[mode], 4096.f);
@@ -1074,48 +1183,62 @@ static BOOL gfx3d_glLoadMatrix4x4(s32 v)
 		MatrixCopy(mtxCurrent[1], mtxCurrent[2]);
 
 	//printf("load4x4: matrix %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
-	return TRUE;
 }
 
-static BOOL gfx3d_glLoadMatrix4x3(s32 v)
+static BOOL gfx3d_glLoadMatrix4x4(s32 v)
 {
-	mtxCurrent[mode][ML4x3ind] = v;
+	mtxCurrent[mode][ML4x4ind] = v;
+	mtxClipDirty = true;
 
-	ML4x3ind++;
-	if((ML4x3ind & 0x03) == 3)
-      ML4x3ind++;
-	if(ML4x3ind<16)
+	++ML4x4ind;
+	if(ML4x4ind<16)
       return FALSE;
-	ML4x3ind = 0;
+	ML4x4ind = 0;
+
+	gfx3d_glLoadMatrix4x4_apply();
+	return TRUE;
+}
 
+static void gfx3d_glLoadMatrix4x3_apply()
+{
 	//vector_fix2float<4>(mtxCurrent[mode], 4096.f);
 
 	//fill in the unusued matrix values
 	mtxCurrent[mode][3] = mtxCurrent[mode][7] = mtxCurrent[mode][11] = 0;
 	mtxCurrent[mode][15] = (1<<12);
+	mtxClipDirty = true;
 
 	GFX_DELAY(30);
 
 	if (mode == MATRIXMODE_POSITION_VECTOR)
 		MatrixCopy(mtxCurrent[1], mtxCurrent[2]);
 	//printf("load4x3: matrix %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
-	return TRUE;
 }
 
-static BOOL gfx3d_glMultMatrix4x4(s32 v)
+static BOOL gfx3d_glLoadMatrix4x3(s32 v)
 {
-	mtxTemporal[MM4x4ind] = v;
+	mtxCurrent[mode][ML4x3ind] = v;
+	mtxClipDirty = true;
 
-	MM4x4ind++;
-	if(MM4x4ind<16)
+	ML4x3ind++;
+	if((ML4x3ind & 0x03) == 3)
+      ML4x3ind++;
+	if(ML4x3ind<16)
       return FALSE;
-	MM4x4ind = 0;
+	ML4x3ind = 0;
 
+	gfx3d_glLoadMatrix4x3_apply();
+	return TRUE;
+}
+
+static void gfx3d_glMultMatrix4x4_apply()
+{
 	GFX_DELAY(35);
 
 	//vector_fix2float<4>(mtxTemporal, 4096.f);
 
 	MatrixMultiply(mtxCurrent[mode], mtxTemporal);
+	mtxClipDirty = true;
 
 	if (mode == MATRIXMODE_POSITION_VECTOR)
 	{
@@ -1126,20 +1249,23 @@ static BOOL gfx3d_glMultMatrix4x4(s32 v)
 	//printf("mult4x4: matrix %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
 
 	MatrixIdentity(mtxTemporal);
-	return TRUE;
 }
 
-static BOOL gfx3d_glMultMatrix4x3(s32 v)
+static BOOL gfx3d_glMultMatrix4x4(s32 v)
 {
-	mtxTemporal[MM4x3ind] = v;
+	mtxTemporal[MM4x4ind] = v;
 
-	MM4x3ind++;
-	if ((MM4x3ind & 0x03) == 3)
-      MM4x3ind++;
-	if (MM4x3ind < 16)
+	MM4x4ind++;
+	if(MM4x4ind<16)
       return FALSE;
-	MM4x3ind = 0;
+	MM4x4ind = 0;
 
+	gfx3d_glMultMatrix4x4_apply();
+	return TRUE;
+}
+
+static void gfx3d_glMultMatrix4x3_apply()
+{
 	GFX_DELAY(31);
 
 	//vector_fix2float<4>(mtxTemporal, 4096.f);
@@ -1149,6 +1275,7 @@ static BOOL gfx3d_glMultMatrix4x3(s32 v)
 	mtxTemporal[15] = 1 << 12;
 
 	MatrixMultiply (mtxCurrent[mode], mtxTemporal);
+	mtxClipDirty = true;
 
 	if (mode == MATRIXMODE_POSITION_VECTOR)
 	{
@@ -1160,20 +1287,25 @@ static BOOL gfx3d_glMultMatrix4x3(s32 v)
 
 	//does this really need to be done?
 	MatrixIdentity(mtxTemporal);
-	return TRUE;
 }
 
-static BOOL gfx3d_glMultMatrix3x3(s32 v)
+static BOOL gfx3d_glMultMatrix4x3(s32 v)
 {
-	mtxTemporal[MM3x3ind] = v;
-	
-	MM3x3ind++;
-	if ((MM3x3ind & 0x03) == 3)
-      MM3x3ind++;
-	if (MM3x3ind<12)
+	mtxTemporal[MM4x3ind] = v;
+
+	MM4x3ind++;
+	if ((MM4x3ind & 0x03) == 3)
+      MM4x3ind++;
+	if (MM4x3ind < 16)
       return FALSE;
-	MM3x3ind = 0;
+	MM4x3ind = 0;
 
+	gfx3d_glMultMatrix4x3_apply();
+	return TRUE;
+}
+
+static void gfx3d_glMultMatrix3x3_apply()
+{
 	GFX_DELAY(28);
 
 	//vector_fix2float<3>(mtxTemporal, 4096.f);
@@ -1184,6 +1316,7 @@ static BOOL gfx3d_glMultMatrix3x3(s32 v)
 	mtxTemporal[12] = mtxTemporal[13] = mtxTemporal[14] = 0;
 
 	MatrixMultiply(mtxCurrent[mode], mtxTemporal);
+	mtxClipDirty = true;
 
 	if (mode == MATRIXMODE_POSITION_VECTOR)
 	{
@@ -1196,20 +1329,27 @@ static BOOL gfx3d_glMultMatrix3x3(s32 v)
 
 	//does this really need to be done?
 	MatrixIdentity(mtxTemporal);
-	return TRUE;
 }
 
-static BOOL gfx3d_glScale(s32 v)
+static BOOL gfx3d_glMultMatrix3x3(s32 v)
 {
-	scale[scaleind] = v;
-
-	++scaleind;
-
-	if (scaleind < 3)
+	mtxTemporal[MM3x3ind] = v;
+	
+	MM3x3ind++;
+	if ((MM3x3ind & 0x03) == 3)
+      MM3x3ind++;
+	if (MM3x3ind<12)
       return FALSE;
-	scaleind = 0;
+	MM3x3ind = 0;
+
+	gfx3d_glMultMatrix3x3_apply();
+	return TRUE;
+}
 
+static void gfx3d_glScale_apply()
+{
 	MatrixScale(mtxCurrent[(mode == MATRIXMODE_POSITION_VECTOR ? MATRIXMODE_POSITION : mode)], scale);
+	mtxClipDirty = true;
 	//printf("scale: matrix %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
 
 	GFX_DELAY(22);
@@ -1219,20 +1359,26 @@ static BOOL gfx3d_glScale(s32 v)
 	//so, I am leaving this commented out as an example of what not to do.
 	//if (mode == 2)
 	//	MatrixScale (mtxCurrent[1], scale);
-	return TRUE;
 }
 
-static BOOL gfx3d_glTranslate(s32 v)
+static BOOL gfx3d_glScale(s32 v)
 {
-	trans[transind] = v;
+	scale[scaleind] = v;
 
-	++transind;
+	++scaleind;
 
-	if (transind < 3)
+	if (scaleind < 3)
       return FALSE;
-	transind = 0;
+	scaleind = 0;
+
+	gfx3d_glScale_apply();
+	return TRUE;
+}
 
+static void gfx3d_glTranslate_apply()
+{
 	MatrixTranslate(mtxCurrent[mode], trans);
+	mtxClipDirty = true;
 
 	GFX_DELAY(22);
 
@@ -1243,7 +1389,19 @@ static BOOL gfx3d_glTranslate(s32 v)
 	}
 
 	//printf("translate: matrix %d to: \n",mode); MatrixPrint(mtxCurrent[1]);
+}
+
+static BOOL gfx3d_glTranslate(s32 v)
+{
+	trans[transind] = v;
+
+	++transind;
+
+	if (transind < 3)
+      return FALSE;
+	transind = 0;
 
+	gfx3d_glTranslate_apply();
 	return TRUE;
 }
 
@@ -1257,8 +1415,6 @@ static void gfx3d_glColor3b(u32 v)
 
 static void gfx3d_glNormal(s32 v)
 {
-   size_t i;
-   size_t c;
 	s16 nx = ((v<<22)>>22)<<3;
 	s16 ny = ((v<<12)>>22)<<3;
 	s16 nz = ((v<<2)>>22)<<3;
@@ -1275,82 +1431,13 @@ static void gfx3d_glNormal(s32 v)
 
 	MatrixMultVec3x3_fixed(mtxCurrent[2],normal);
 
-	//apply lighting model
-	u8 diffuse[3] = {
-		(u8)( dsDiffuse        & 0x1F),
-		(u8)((dsDiffuse >>  5) & 0x1F),
-		(u8)((dsDiffuse >> 10) & 0x1F) };
-
-	u8 ambient[3] = {
-		(u8)( dsAmbient        & 0x1F),
-		(u8)((dsAmbient >>  5) & 0x1F),
-		(u8)((dsAmbient >> 10) & 0x1F) };
-
-	u8 emission[3] = {
-		(u8)( dsEmission        & 0x1F),
-		(u8)((dsEmission >>  5) & 0x1F),
-		(u8)((dsEmission >> 10) & 0x1F) };
-
-	u8 specular[3] = {
-		(u8)( dsSpecular        & 0x1F),
-		(u8)((dsSpecular >>  5) & 0x1F),
-		(u8)((dsSpecular >> 10) & 0x1F) };
-
-	int vertexColor[3] = { emission[0], emission[1], emission[2] };
-
-	for (i = 0; i < 4; i++)
+	const u16 material[4] = { dsDiffuse, dsAmbient, dsSpecular, dsEmission };
+	if (!lightingCache.lookup(normal, lightMask, material, colorRGB))
 	{
-		if (!((lightMask>>i)&1))
-         continue;
-
-		u8 _lightColor[3] = {
-			(u8)( lightColor[i]        & 0x1F),
-			(u8)((lightColor[i] >> 5)  & 0x1F),
-			(u8)((lightColor[i] >> 10) & 0x1F) };
-
-		//This formula is the one used by the DS
-		//Reference : http://nocash.emubase.de/gbatek.htm#ds3dpolygonlightparameters
-		s32 fixed_diffuse = std::max(0,-vec3dot_fixed32(cacheLightDirection[i],normal));
-		
-		//todo - this could be cached in this form
-		s32 fixedTempNegativeHalf[] = {-cacheHalfVector[i][0],-cacheHalfVector[i][1],-cacheHalfVector[i][2],-cacheHalfVector[i][3]};
-		s32 dot = vec3dot_fixed32(fixedTempNegativeHalf, normal);
-
-		s32 fixedshininess = 0;
-		if (dot > 0) //prevent shininess on opposite side
-		{
-			//we have cos(a). it seems that we need cos(2a). trig identity is a fast way to get it.
-			//cos^2(a)=(1/2)(1+cos(2a))
-			//2*cos^2(a)-1=cos(2a)
-			fixedshininess = 2*mul_fixed32(dot,dot)-4096;
-			//gbatek is almost right but not quite!
-		}
-
-		//this seems to need to be saturated, or else the table will overflow.
-		//even without a table, failure to saturate is bad news
-		fixedshininess = std::min(fixedshininess,4095);
-		fixedshininess = std::max(fixedshininess,0);
-		
-		if (dsSpecular & 0x8000)
-		{
-			//shininess is 20.12 fixed point, so >>5 gives us .7 which is 128 entries
-			//the entries are 8bits each so <<4 gives us .12 again, compatible with the lighting formulas below
-			//(according to other normal nds procedures, we might should fill the bottom bits with 1 or 0 according to rules...)
-			fixedshininess = gfx3d.state.shininessTable[fixedshininess>>5]<<4;
-		}
-
-		for (c = 0; c < 3; c++)
-		{
-			s32 specComp    = ((specular[c] * _lightColor[c] * fixedshininess)>>17);  //5 bits for color*color and 12 bits for the shininess
-			s32 diffComp    = ((diffuse[c] * _lightColor[c] * fixed_diffuse)>>17); //5bits for the color*color and 12 its for the diffuse
-			s32 ambComp     = ((ambient[c] * _lightColor[c])>>5); //5bits for color*color
-			vertexColor[c] += specComp + diffComp + ambComp;
-		}
+		LightingApply(normal, lightMask, material, lightColor, cacheLightDirection, cacheHalfVector, gfx3d.state.shininessTable, colorRGB);
+		lightingCache.store(normal, lightMask, material, colorRGB);
 	}
 
-	for (c = 0; c < 3; c++)
-		colorRGB[c] = std::min(31,vertexColor[c]);
-
 	GFX_DELAY(9);
 	GFX_DELAY_M2((lightMask) & 0x01);
 	GFX_DELAY_M2((lightMask>>1) & 0x01);
@@ -1397,6 +1484,17 @@ static BOOL gfx3d_glVertex16b(s32 v)
 	return TRUE;
 }
 
+static void gfx3d_glVertex16b_all(const u32 *params)
+{
+	s16coord[0] = ((s32)params[0]<<16)>>16;
+	s16coord[1] = ((s32)params[0]>>16)&0xFFFF;
+	s16coord[2] = ((s32)params[1]<<16)>>16;
+
+	SetVertex ();
+
+	GFX_DELAY(9);
+}
+
 static void gfx3d_glVertex10b(s32 v)
 {
 	//TODO TODO TODO - contemplate the sign extension - shift in zeroes or ones? zeroes is certainly more normal..
@@ -1509,6 +1607,7 @@ static void gfx3d_glLightColor(u32 v)
 {
 	const size_t index = v >> 30;
 	lightColor[index]  = v;
+	lightingCache.invalidate();
 	GFX_DELAY(1);
 }
 
@@ -1518,6 +1617,7 @@ static BOOL gfx3d_glShininess(u32 val)
 	gfx3d.state.shininessTable[shininessInd++] = (((val >>  8) & 0xFF));
 	gfx3d.state.shininessTable[shininessInd++] = (((val >> 16) & 0xFF));
 	gfx3d.state.shininessTable[shininessInd++] = (((val >> 24) & 0xFF));
+	lightingCache.invalidate();
 
 	if (shininessInd < 128)
       return FALSE;
@@ -1638,19 +1738,17 @@ static BOOL gfx3d_glBoxTest(u32 v)
 	////---------------------
 
 	//transform all coords
+	gfx3d_UpdateClipMatrix();
 	for (size_t i = 0; i < 8; i++)
 	{
 		//this cant work. its left as a reminder that we could (and probably should) do the boxtest in all fixed point values
 		//MatrixMultVec4x4_M2(mtxCurrent[0], verts[i].coord);
 
 		//but change it all to floating point and do it that way instead
-		CACHE_ALIGN float temp1[16] = {mtxCurrent[1][0]/4096.0f,mtxCurrent[1][1]/4096.0f,mtxCurrent[1][2]/4096.0f,mtxCurrent[1][3]/4096.0f,mtxCurrent[1][4]/4096.0f,mtxCurrent[1][5]/4096.0f,mtxCurrent[1][6]/4096.0f,mtxCurrent[1][7]/4096.0f,mtxCurrent[1][8]/4096.0f,mtxCurrent[1][9]/4096.0f,mtxCurrent[1][10]/4096.0f,mtxCurrent[1][11]/4096.0f,mtxCurrent[1][12]/4096.0f,mtxCurrent[1][13]/4096.0f,mtxCurrent[1][14]/4096.0f,mtxCurrent[1][15]/4096.0f};
-		CACHE_ALIGN float temp0[16] = {mtxCurrent[0][0]/4096.0f,mtxCurrent[0][1]/4096.0f,mtxCurrent[0][2]/4096.0f,mtxCurrent[0][3]/4096.0f,mtxCurrent[0][4]/4096.0f,mtxCurrent[0][5]/4096.0f,mtxCurrent[0][6]/4096.0f,mtxCurrent[0][7]/4096.0f,mtxCurrent[0][8]/4096.0f,mtxCurrent[0][9]/4096.0f,mtxCurrent[0][10]/4096.0f,mtxCurrent[0][11]/4096.0f,mtxCurrent[0][12]/4096.0f,mtxCurrent[0][13]/4096.0f,mtxCurrent[0][14]/4096.0f,mtxCurrent[0][15]/4096.0f};
-
 		DS_ALIGN(16) VERT_POS4f vert = { verts[i].x, verts[i].y, verts[i].z, verts[i].w };
 
-		_NOSSE_MatrixMultVec4x4(temp1,verts[i].coord);
-		_NOSSE_MatrixMultVec4x4(temp0,verts[i].coord);
+		_NOSSE_MatrixMultVec4x4(mtxPositionFloat,verts[i].coord);
+		_NOSSE_MatrixMultVec4x4(mtxProjectionFloat,verts[i].coord);
 	}
 
 	//clip each poly
@@ -1701,11 +1799,9 @@ static BOOL gfx3d_glPosTest(u32 v)
 	
 	PTcoords[3] = 1.0f;
 
-	CACHE_ALIGN float temp1[16] = {mtxCurrent[1][0]/4096.0f,mtxCurrent[1][1]/4096.0f,mtxCurrent[1][2]/4096.0f,mtxCurrent[1][3]/4096.0f,mtxCurrent[1][4]/4096.0f,mtxCurrent[1][5]/4096.0f,mtxCurrent[1][6]/4096.0f,mtxCurrent[1][7]/4096.0f,mtxCurrent[1][8]/4096.0f,mtxCurrent[1][9]/4096.0f,mtxCurrent[1][10]/4096.0f,mtxCurrent[1][11]/4096.0f,mtxCurrent[1][12]/4096.0f,mtxCurrent[1][13]/4096.0f,mtxCurrent[1][14]/4096.0f,mtxCurrent[1][15]/4096.0f};
-	CACHE_ALIGN float temp0[16] = {mtxCurrent[0][0]/4096.0f,mtxCurrent[0][1]/4096.0f,mtxCurrent[0][2]/4096.0f,mtxCurrent[0][3]/4096.0f,mtxCurrent[0][4]/4096.0f,mtxCurrent[0][5]/4096.0f,mtxCurrent[0][6]/4096.0f,mtxCurrent[0][7]/4096.0f,mtxCurrent[0][8]/4096.0f,mtxCurrent[0][9]/4096.0f,mtxCurrent[0][10]/4096.0f,mtxCurrent[0][11]/4096.0f,mtxCurrent[0][12]/4096.0f,mtxCurrent[0][13]/4096.0f,mtxCurrent[0][14]/4096.0f,mtxCurrent[0][15]/4096.0f};
-
-	MatrixMultVec4x4(temp1, PTcoords);
-	MatrixMultVec4x4(temp0, PTcoords);
+	gfx3d_UpdateClipMatrix();
+	MatrixMultVec4x4(mtxPositionFloat, PTcoords);
+	MatrixMultVec4x4(mtxProjectionFloat, PTcoords);
 
 	MMU_new.gxstat.tb = 0;
 
@@ -1805,7 +1901,8 @@ void gfx3d_UpdateToonTable(u8 offset, u32 val)
 s32 gfx3d_GetClipMatrix(const u32 index)
 {
 	//printf("reading clip matrix: %d\n",index);
-	return (s32)MatrixGetMultipliedIndex(index, mtxCurrent[0], mtxCurrent[1]);
+	gfx3d_UpdateClipMatrix();
+	return mtxClip[index];
 }
 
 s32 gfx3d_GetDirectionalMatrix(const u32 index)
@@ -1947,11 +2044,76 @@ static void gfx3d_execute(u8 cmd, u32 param)
 	}
 }
 
+//the number of parameter words the command at the head of the fifo takes, if they can be handled
+//all at once. that's only possible when none of the command's parameters have been taken yet.
+static u32 gfx3d_batchParamCount(u8 cmd)
+{
+	switch (cmd)
+	{
+		case 0x16: return (ML4x4ind == 0) ? 16 : 0;
+		case 0x17: return (ML4x3ind == 0) ? 12 : 0;
+		case 0x18: return (MM4x4ind == 0) ? 16 : 0;
+		case 0x19: return (MM4x3ind == 0) ? 12 : 0;
+		case 0x1A: return (MM3x3ind == 0) ? 9 : 0;
+		case 0x1B: return (scaleind == 0) ? 3 : 0;
+		case 0x1C: return (transind == 0) ? 3 : 0;
+		case 0x23: return (coordind == 0) ? 2 : 0;
+		default: return 0;
+	}
+}
+
+//executes a whole command from all of its parameters, with the same results as sending them
+//to gfx3d_execute() one at a time
+static void gfx3d_executeBatch(u8 cmd, const u32 *params)
+{
+	switch (cmd)
+	{
+		case 0x16:		// MTX_LOAD_4x4
+			gfx3d_readMatrixParams<4,4>(mtxCurrent[mode], params);
+			gfx3d_glLoadMatrix4x4_apply();
+		break;
+		case 0x17:		// MTX_LOAD_4x3
+			gfx3d_readMatrixParams<4,3>(mtxCurrent[mode], params);
+			gfx3d_glLoadMatrix4x3_apply();
+		break;
+		case 0x18:		// MTX_MULT_4x4
+			gfx3d_readMatrixParams<4,4>(mtxTemporal, params);
+			gfx3d_glMultMatrix4x4_apply();
+		break;
+		case 0x19:		// MTX_MULT_4x3
+			gfx3d_readMatrixParams<4,3>(mtxTemporal, params);
+			gfx3d_glMultMatrix4x3_apply();
+		break;
+		case 0x1A:		// MTX_MULT_3x3
+			gfx3d_readMatrixParams<3,3>(mtxTemporal, params);
+			gfx3d_glMultMatrix3x3_apply();
+		break;
+		case 0x1B:		// MTX_SCALE
+			scale[0] = params[0];
+			scale[1] = params[1];
+			scale[2] = params[2];
+			gfx3d_glScale_apply();
+		break;
+		case 0x1C:		// MTX_TRANS
+			trans[0] = params[0];
+			trans[1] = params[1];
+			trans[2] = params[2];
+			gfx3d_glTranslate_apply();
+		break;
+		case 0x23:		// VTX_16
+			gfx3d_glVertex16b_all(params);
+		break;
+		default:
+		break;
+	}
+}
+
 void gfx3d_execute3D()
 {
    size_t i;
 	u8	cmd      = 0;
 	u32	param = 0;
+	u32	params[16];
 
 #ifndef FLUSHMODE_HACK
 	if (isSwapBuffers)
@@ -1965,6 +2127,19 @@ void gfx3d_execute3D()
 
 	for (i = 0; i < HACK_FIFO_BATCH_SIZE; i++)
    {
+      //a multi-word command that's all in the fifo is taken off it and run in one go.
+      //it costs the same as its words would one by one, and still has to fit in this batch.
+      const u8 nextCmd = gxFIFO.cmd[gxFIFO.head];
+      const u32 paramCount = (gxFIFO.size > 1) ? gfx3d_batchParamCount(nextCmd) : 0;
+      if (paramCount != 0 && (i + paramCount) <= HACK_FIFO_BATCH_SIZE && GFX_PIPErecvCommand(nextCmd, params, paramCount))
+      {
+         NDS_RescheduleGXFIFO(paramCount);
+         gfx3d_executeBatch(nextCmd, params);
+         MMU.gfx3dCycles = nds_timer+1;
+         i += paramCount - 1;
+         continue;
+      }
+
       if (!GFX_PIPErecv(&cmd, &param))
          break;
 
@@ -2016,51 +2191,44 @@ void gfx3d_glFlush(u32 v)
 	GFX_DELAY(1);
 }
 
-static inline bool gfx3d_ysort_compare_orig(int num1, int num2)
-{
-	const POLY &poly1 = polylist->list[num1];
-	const POLY &poly2 = polylist->list[num2];
+//the projected y of each vertex, for working out the poly y-bounds in gfx3d_doFlush
+static CACHE_ALIGN float vertProjectedY[VERTLIST_SIZE];
 
-	if (poly1.maxy != poly2.maxy)
-		return poly1.maxy < poly2.maxy; 
-	if (poly1.miny != poly2.miny)
-		return poly1.miny < poly2.miny; 
-
-	return num1 < num2;
-}
-
-static inline bool gfx3d_ysort_compare_kalven(int num1, int num2)
+static void gfx3d_ProjectVertsY(const VERTVIEW &verts, float *projectedY)
 {
-	const POLY &poly1 = polylist->list[num1];
-	const POLY &poly2 = polylist->list[num2];
+	const size_t count = verts.count;
+	size_t i = 0;
 
-	//this may be verified by checking the game create menus in harvest moon island of happiness
-	//also the buttons in the knights in the nightmare frontend depend on this and the perspective division
-	if (poly1.maxy < poly2.maxy)
-      return true;
-	if (poly1.maxy > poly2.maxy)
-      return false;
-	if (poly1.miny < poly2.miny)
-      return true;
-	if (poly1.miny > poly2.miny)
-      return false;
-	//notably, the main shop interface in harvest moon will not have a correct RTN button
-	//i think this is due to a math error rounding its position to one pixel too high and it popping behind
-	//the bar that it sits on.
-	//everything else in all the other menus that I could find looks right..
+	// TODO: Possible divide by zero with the w-coordinate.
+	// Is the vertex being read correctly? Is 0 a valid value for w?
+	// If both of these questions answer to yes, then how does the NDS handle a NaN?
+	// For now, simply prevent w from being zero.
+#ifdef ENABLE_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 tinyW = _mm_set1_ps(0.00000001f);
 
-	//make sure we respect the game's ordering in cases of complete ties
-	//this makes it a stable sort.
-	//this must be a stable sort or else advance wars DOR will flicker in the main map mode
-	return (num1 < num2);
-}
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 v0 = _mm_load_ps(verts.getCoord(i+0));
+		__m128 v1 = _mm_load_ps(verts.getCoord(i+1));
+		__m128 v2 = _mm_load_ps(verts.getCoord(i+2));
+		__m128 v3 = _mm_load_ps(verts.getCoord(i+3));
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+		const __m128 wIsZero = _mm_cmpeq_ps(v3, zero);
+		const __m128 w = _mm_or_ps(_mm_andnot_ps(wIsZero, v3), _mm_and_ps(wIsZero, tinyW));
+		_mm_store_ps(projectedY + i, _mm_sub_ps(one, _mm_div_ps(_mm_add_ps(v1, w), _mm_mul_ps(two, w))));
+	}
+#endif
 
-static bool gfx3d_ysort_compare(int num1, int num2)
-{
-	bool original = gfx3d_ysort_compare_orig(num1,num2);
-	bool kalven   = gfx3d_ysort_compare_kalven(num1,num2);
-	assert(original == kalven);
-	return original;
+	for (; i < count; i++)
+	{
+		const float *coord = verts.getCoord(i);
+		const float vertw = (coord[3] != 0.0f) ? coord[3] : 0.00000001f;
+		projectedY[i] = 1.0f-(coord[1]+vertw)/(2*vertw);
+	}
 }
 
 static void gfx3d_doFlush(void)
@@ -2072,6 +2240,8 @@ static void gfx3d_doFlush(void)
 	//the renderer will get the lists we just built
 	gfx3d.polylist = polylist;
 	gfx3d.vertlist = vertlist;
+	gfx3d.vertstore = vertstore;
+	vertstore->count = vertlist->count;
 
 	//and also our current render state
 
@@ -2118,23 +2288,17 @@ static void gfx3d_doFlush(void)
 	//the w-division here is just an approximation to fix the shop in harvest moon island of happiness
 	//also the buttons in the knights in the nightmare frontend depend on this
    
+	gfx3d_ProjectVertsY(VERTVIEW(*vertstore), vertProjectedY);
+
 	for (i = 0; i < polycount; i++)
 	{
-		// TODO: Possible divide by zero with the w-coordinate.
-		// Is the vertex being read correctly? Is 0 a valid value for w?
-		// If both of these questions answer to yes, then how does the NDS handle a NaN?
-		// For now, simply prevent w from being zero.
 		POLY &poly = polylist->list[i];
-		float verty = vertlist->list[poly.vertIndexes[0]].y;
-		float vertw = (vertlist->list[poly.vertIndexes[0]].w != 0.0f) ? vertlist->list[poly.vertIndexes[0]].w : 0.00000001f;
-		verty = 1.0f-(verty+vertw)/(2*vertw);
+		float verty = vertProjectedY[poly.vertIndexes[0]];
 		poly.miny = poly.maxy = verty;
 
 		for (size_t j = 1; j < poly.type; j++)
 		{
-			verty = vertlist->list[poly.vertIndexes[j]].y;
-			vertw = (vertlist->list[poly.vertIndexes[j]].w != 0.0f) ? vertlist->list[poly.vertIndexes[j]].w : 0.00000001f;
-			verty = 1.0f-(verty+vertw)/(2*vertw);
+			verty = vertProjectedY[poly.vertIndexes[j]];
 			poly.miny = min(poly.miny, verty);
 			poly.maxy = max(poly.maxy, verty);
 		}
@@ -2161,33 +2325,41 @@ static void gfx3d_doFlush(void)
 			gfx3d.indexlist.list[ctr++] = i;
 	}
 	
-	//NOTE: the use of the stable_sort below must be here as a workaround for some compilers on osx and linux.
-	//we're hazy on the exact behaviour of the resulting bug, all thats known is the list gets mangled somehow.
-	//it should not in principle be relevant since the predicate results in no ties.
-	//perhaps the compiler is buggy. perhaps the predicate is wrong.
-
 	//now we have to sort the opaque polys by y-value.
 	//(test case: harvest moon island of happiness character cretor UI)
 	//should this be done after clipping??
-	std::stable_sort(gfx3d.indexlist.list, gfx3d.indexlist.list + opaqueCount, gfx3d_ysort_compare);
+	YSortPolys(gfx3d.indexlist.list, opaqueCount, polylist->list);
 	
 	if (!gfx3d.state.sortmode)
 	{
 		//if we are autosorting translucent polys, we need to do this also
 		//TODO - this is unverified behavior. need a test case
-		std::stable_sort(gfx3d.indexlist.list + opaqueCount, gfx3d.indexlist.list + polycount, gfx3d_ysort_compare);
+		YSortPolys(gfx3d.indexlist.list + opaqueCount, polycount - opaqueCount, polylist->list);
 	}
 
+	//the render of the last frame may still be running on the rasterizer threads, and the lists
+	//it's reading from are about to be reused for the next frame's geometry
+	CurrentRenderer->RenderFinish();
+
 	//switch to the new lists
 	twiddleLists();
 
 	if (driver->view3d->IsRunning())
 	{
+		if (viewer3d_state == NULL)
+			viewer3d_state = new Viewer3d_State;
+
+		//only copy the part of the lists this frame used
+		const size_t viewerPolyCount = gfx3d.polylist->count;
+		const size_t viewerVertCount = gfx3d.vertlist->count;
+
 		viewer3d_state->frameNumber = currFrameCounter;
 		viewer3d_state->state = gfx3d.state;
-		viewer3d_state->polylist = *gfx3d.polylist;
-		viewer3d_state->vertlist = *gfx3d.vertlist;
-		viewer3d_state->indexlist = gfx3d.indexlist;
+		viewer3d_state->polylist.count = viewerPolyCount;
+		memcpy(viewer3d_state->polylist.list, gfx3d.polylist->list, viewerPolyCount * sizeof(POLY));
+		viewer3d_state->vertlist.count = viewerVertCount;
+		memcpy(viewer3d_state->vertlist.list, gfx3d.vertlist->list, viewerVertCount * sizeof(VERT));
+		memcpy(viewer3d_state->indexlist.list, gfx3d.indexlist.list, viewerPolyCount * sizeof(int));
 		driver->view3d->NewFrame();
 	}
 
@@ -2486,6 +2658,11 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 	if (read32le(&version,is) != 1) return false;
 	if (size == 8) version = 0;
 
+	//the lists are about to be replaced, so the renderer can't still be reading them
+	CurrentRenderer->RenderFinish();
+
+	//the clip matrix isn't saved; it's rebuilt from the loaded matrices when it's next needed
+	mtxClipDirty = true;
 
 	gfx3d_glPolygonAttrib_cache();
 	gfx3d_glTexImage_cache();
@@ -2498,12 +2675,17 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 	listTwiddle = 0;
 	polylist = &polylists[listTwiddle];
 	vertlist = &vertlists[listTwiddle];
+	vertstore = &vertstores[listTwiddle];
+	vertstore->count = 0;
 
 	if (version >= 1)
 	{
 		OSREAD(vertlist->count);
 		for (size_t i = 0; i < vertlist->count; i++)
+		{
 			vertlist->list[i].load(is);
+			vertstore->set(i, vertlist->list[i]);
+		}
 		OSREAD(polylist->count);
 		for (size_t i = 0; i < polylist->count; i++)
 			polylist->list[i].load(is);
@@ -2526,8 +2708,10 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 
 	gfx3d.polylist = &polylists[listTwiddle^1];
 	gfx3d.vertlist = &vertlists[listTwiddle^1];
+	gfx3d.vertstore = &vertstores[listTwiddle^1];
 	gfx3d.polylist->count=0;
 	gfx3d.vertlist->count=0;
+	gfx3d.vertstore->count=0;
 
 	if (version >= 4)
 	{
@@ -2535,6 +2719,8 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 		OSREAD(cacheHalfVector);
 	}
 
+	lightingCache.invalidate();
+
 	return true;
 }
 
@@ -2752,12 +2938,123 @@ typedef ClipperPlane<1,-1,Stage4> Stage3;        static Stage3 clipper3 (clipper
 typedef ClipperPlane<0, 1,Stage3> Stage2;        static Stage2 clipper2 (clipper3); // right plane
 typedef ClipperPlane<0,-1,Stage2> Stage1;        static Stage1 clipper  (clipper2); // left plane
 
+//outcode bits, one per clip plane, in the same order as the clipper stages
+enum
+{
+	CLIPCODE_LEFT   = 0x01,
+	CLIPCODE_BOTTOM = 0x02,
+	CLIPCODE_FRONT  = 0x04,
+	CLIPCODE_RIGHT  = 0x08,
+	CLIPCODE_TOP    = 0x10,
+	CLIPCODE_BACK   = 0x20
+};
+
+//which planes a vertex is outside of. these are the same tests the clipper stages make.
+static FORCEINLINE u32 gfx3d_ClipCode(const float *coord)
+{
+#ifdef ENABLE_SSE2
+	const __m128 v = _mm_loadu_ps(coord);
+	const __m128 w = _mm_shuffle_ps(v, v, 0xFF);
+	const __m128 negW = _mm_xor_ps(w, _mm_set1_ps(-0.0f));
+	return (_mm_movemask_ps(_mm_cmplt_ps(v, negW)) & 0x07) | ((_mm_movemask_ps(_mm_cmpgt_ps(v, w)) & 0x07) << 3);
+#else
+	return ((coord[0] < -coord[3]) ? CLIPCODE_LEFT   : 0) |
+	       ((coord[1] < -coord[3]) ? CLIPCODE_BOTTOM : 0) |
+	       ((coord[2] < -coord[3]) ? CLIPCODE_FRONT  : 0) |
+	       ((coord[0] >  coord[3]) ? CLIPCODE_RIGHT  : 0) |
+	       ((coord[1] >  coord[3]) ? CLIPCODE_TOP    : 0) |
+	       ((coord[2] >  coord[3]) ? CLIPCODE_BACK   : 0);
+#endif
+}
+
 template<bool useHiResInterpolate>
 void GFX3D_Clipper::clipPoly(const POLY &poly, const VERT **verts)
 {
 	CLIPLOG("==Begin poly==\n");
 
 	const PolygonType type = poly.type;
+
+	//most polys are entirely inside or entirely outside of the clip volume, so check that first
+	u32 clipCodeAny = 0;
+	u32 clipCodeAll = 0x3F;
+	for (size_t i = 0; i < type; i++)
+	{
+		const u32 clipCode = gfx3d_ClipCode(verts[i]->coord);
+		clipCodeAny |= clipCode;
+		clipCodeAll &= clipCode;
+	}
+
+	//all the verts are outside of the same plane, so that stage would leave nothing
+	if (clipCodeAll != 0)
+		return;
+
+	//nothing to clip. each of the six stages passes the verts through starting from the second one,
+	//so the output comes out rotated by six places.
+	if (clipCodeAny == 0)
+	{
+		VERT *outVerts = clippedPolys[clippedPolyCounter].clipVerts;
+		for (size_t i = 0; i < type; i++)
+			outVerts[i] = *verts[(i + 6) % type];
+
+		clippedPolys[clippedPolyCounter].type = type;
+		clippedPolys[clippedPolyCounter].poly = (POLY *)&poly;
+		clippedPolyCounter++;
+		return;
+	}
+
+	this->clipPolyVsPlanes<useHiResInterpolate>(poly, verts);
+}
+
+//the same as above, reading the verts through a view. only the positions are needed to find
+//the polys that are entirely inside or outside, which is most of them.
+template<bool useHiResInterpolate>
+void GFX3D_Clipper::clipPoly(const POLY &poly, const VERTVIEW &verts)
+{
+	CLIPLOG("==Begin poly==\n");
+
+	const PolygonType type = poly.type;
+
+	u32 clipCodeAny = 0;
+	u32 clipCodeAll = 0x3F;
+	for (size_t i = 0; i < type; i++)
+	{
+		const u32 clipCode = gfx3d_ClipCode(verts.getCoord(poly.vertIndexes[i]));
+		clipCodeAny |= clipCode;
+		clipCodeAll &= clipCode;
+	}
+
+	if (clipCodeAll != 0)
+		return;
+
+	if (clipCodeAny == 0)
+	{
+		VERT *outVerts = clippedPolys[clippedPolyCounter].clipVerts;
+		for (size_t i = 0; i < type; i++)
+			verts.get(poly.vertIndexes[(i + 6) % type], outVerts[i]);
+
+		clippedPolys[clippedPolyCounter].type = type;
+		clippedPolys[clippedPolyCounter].poly = (POLY *)&poly;
+		clippedPolyCounter++;
+		return;
+	}
+
+	VERT polyVerts[4];
+	const VERT *polyVertPtrs[4];
+	for (size_t i = 0; i < type; i++)
+	{
+		verts.get(poly.vertIndexes[i], polyVerts[i]);
+		polyVertPtrs[i] = &polyVerts[i];
+	}
+
+	this->clipPolyVsPlanes<useHiResInterpolate>(poly, polyVertPtrs);
+}
+
+//runs a poly that crosses the clip volume through the clipper stages
+template<bool useHiResInterpolate>
+void GFX3D_Clipper::clipPolyVsPlanes(const POLY &poly, const VERT **verts)
+{
+	const PolygonType type = poly.type;
+
 	numScratchClipVerts = 0;
 
 	clipper.init(clippedPolys[clippedPolyCounter].clipVerts);
@@ -2782,6 +3079,8 @@ void GFX3D_Clipper::clipPoly(const POLY &poly, const VERT **verts)
 //these templates needed to be instantiated manually
 template void GFX3D_Clipper::clipPoly<true>(const POLY &poly, const VERT **verts);
 template void GFX3D_Clipper::clipPoly<false>(const POLY &poly, const VERT **verts);
+template void GFX3D_Clipper::clipPoly<true>(const POLY &poly, const VERTVIEW &verts);
+template void GFX3D_Clipper::clipPoly<false>(const POLY &poly, const VERTVIEW &verts);
 
 void GFX3D_Clipper::clipSegmentVsPlane(VERT** verts, const int coord, int which)
 {
@@ -22,6 +22,7 @@
 #include <iosfwd>
 #include <ostream>
 #include <istream>
+#include <string.h>
 
 #include "types.h"
 #include "GPU.h"
@@ -591,7 +592,67 @@ struct VERTLIST {
 	int count;
 };
 
-#define INDEXLIST_SIZE (POLYLIST_SIZE * 4)
+//the fields of each vertex that the clipper and rasterizer read, in separate arrays.
+//a VERT is padded out to several cache lines, so walking the positions of a VERTLIST
+//(which is most of what clipping does) drags everything else through the cache with them.
+//the arrays grow with the number of verts a frame actually submits.
+struct VERTSTORE
+{
+	float *coord;		// x,y,z,w of each vertex
+	float *texcoord;	// u,v of each vertex
+	u8 *color;			// r,g,b,(unused) of each vertex
+	size_t count;
+	size_t capacity;
+
+	void init();
+	void deinit();
+	void reserve(size_t size);
+
+	FORCEINLINE void set(const size_t index, const VERT &vert)
+	{
+		if (index >= this->capacity)
+			this->reserve(index + 1);
+
+		memcpy(this->coord + (index * 4), vert.coord, sizeof(vert.coord));
+		memcpy(this->texcoord + (index * 2), vert.texcoord, sizeof(vert.texcoord));
+		this->color[(index * 4) + 0] = vert.color[0];
+		this->color[(index * 4) + 1] = vert.color[1];
+		this->color[(index * 4) + 2] = vert.color[2];
+	}
+};
+
+//read-only access to the verts of a VERTSTORE, for the renderers
+struct VERTVIEW
+{
+	VERTVIEW(const VERTSTORE &store)
+		: coord(store.coord)
+		, texcoord(store.texcoord)
+		, color(store.color)
+		, count(store.count)
+	{
+	}
+
+	const float *coord;
+	const float *texcoord;
+	const u8 *color;
+	size_t count;
+
+	FORCEINLINE const float* getCoord(const size_t index) const { return this->coord + (index * 4); }
+
+	//puts a vertex back together as a VERT, for the parts of the pipeline that still work on them
+	FORCEINLINE void get(const size_t index, VERT &vert) const
+	{
+		memcpy(vert.coord, this->coord + (index * 4), sizeof(vert.coord));
+		memcpy(vert.texcoord, this->texcoord + (index * 2), sizeof(vert.texcoord));
+		vert.color[0] = this->color[(index * 4) + 0];
+		vert.color[1] = this->color[(index * 4) + 1];
+		vert.color[2] = this->color[(index * 4) + 2];
+		vert.color_to_float();
+	}
+};
+
+//one entry per poly
+#define INDEXLIST_SIZE POLYLIST_SIZE
 struct INDEXLIST {
 	int list[INDEXLIST_SIZE];
 };
@@ -621,6 +682,7 @@ public:
 
 	//the entry point for poly clipping
 	template<bool hirez> void clipPoly(const POLY &poly, const VERT **verts);
+	template<bool hirez> void clipPoly(const POLY &poly, const VERTVIEW &verts);
 
 	//the output of clipping operations goes into here.
 	//be sure you init it before clipping!
@@ -631,6 +693,7 @@ public:
 private:
 	TClippedPoly tempClippedPoly;
 	TClippedPoly outClippedPoly;
+	template<bool hirez> void clipPolyVsPlanes(const POLY &poly, const VERT **verts);
 	FORCEINLINE void clipSegmentVsPlane(VERT** verts, const int coord, int which);
 	FORCEINLINE void clipPolyVsPlane(const int coord, int which);
 };
@@ -717,6 +780,7 @@ struct GFX3D
 	GFX3D()
 		: polylist(0)
 		, vertlist(0)
+		, vertstore(0)
 		, frameCtr(0)
 		, frameCtrRaw(0) {
 	}
@@ -729,6 +793,7 @@ struct GFX3D
 
 	POLYLIST* polylist;
 	VERTLIST* vertlist;
+	VERTSTORE* vertstore;
 	INDEXLIST indexlist;
 
 	//ticks every time flush() is called
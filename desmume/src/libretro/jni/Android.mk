@@ -5,12 +5,18 @@ CORE_DIR := $(LOCAL_PATH)/../..
 JIT             :=
 DESMUME_JIT     := 0
 DESMUME_JIT_ARM := 0
+DESMUME_JIT_ARM64 := 0
 
 ifeq ($(TARGET_ARCH),arm)
   DESMUME_JIT_ARM := 1
   JIT             := -DHAVE_JIT
 endif
 
+ifeq ($(TARGET_ARCH),arm64)
+  DESMUME_JIT_ARM64 := 1
+  JIT               := -DHAVE_JIT
+endif
+
 ifneq (,$(filter $(TARGET_ARCH),x86 x86_64))
   DESMUME_JIT := 1
   JIT         := -DHAVE_JIT
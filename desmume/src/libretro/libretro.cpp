@@ -46,8 +46,9 @@ static int hybrid_layout_scale = 1;
 static bool hybrid_layout_showbothscreens = true;
 static bool hybrid_cursor_always_smallscreen = true;
 static uint16_t pointer_colour = 0xFFFF;
+static uint32_t pointer_colour32 = 0xFFFFFF;
 
-static uint16_t *screen_buf;
+static void *screen_buf;
 
 extern GPUSubsystem *GPU;
 
@@ -63,8 +64,8 @@ int current_layout = LAYOUT_TOP_BOTTOM;
 
 struct LayoutData
 {
-   uint16_t *dst;
-   uint16_t *dst2;
+   void *dst;
+   void *dst2;
    uint32_t touch_x;
    uint32_t touch_y;
    uint32_t width;
@@ -104,19 +105,22 @@ static int32_t TouchY;
 static const uint32_t FramesWithPointerBase = 60 * 10;
 static int32_t FramesWithPointer;
 
-static void DrawPointerLine(uint16_t* aOut, uint32_t aPitchInPix)
+template<typename T>
+static void DrawPointerLine(T* aOut, uint32_t aPitchInPix)
 {
    for(int i = 0; i < (5 * scale) ; i ++)
-      aOut[aPitchInPix * i] = pointer_colour;
+      aOut[aPitchInPix * i] = (T)((sizeof(T) == sizeof(uint32_t)) ? pointer_colour32 : pointer_colour);
 }
 
-static void DrawPointerLineSmall(uint16_t* aOut, uint32_t aPitchInPix, int factor)
+template<typename T>
+static void DrawPointerLineSmall(T* aOut, uint32_t aPitchInPix, int factor)
 {
    for(int i = 0; i < (factor * scale) ; i ++)
-      aOut[aPitchInPix * i] = pointer_colour;
+      aOut[aPitchInPix * i] = (T)((sizeof(T) == sizeof(uint32_t)) ? pointer_colour32 : pointer_colour);
 }
 
-static void DrawPointer(uint16_t* aOut, uint32_t aPitchInPix)
+template<typename T>
+static void DrawPointer(T* aOut, uint32_t aPitchInPix)
 {
    if(FramesWithPointer-- < 0)
       return;
@@ -130,7 +134,8 @@ static void DrawPointer(uint16_t* aOut, uint32_t aPitchInPix)
    if(TouchY < (GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT-(5 * scale) )) DrawPointerLine(&aOut[(TouchY + 1) * aPitchInPix + TouchX], aPitchInPix);
 }
 
-static void DrawPointerHybrid(uint16_t* aOut, uint32_t aPitchInPix, bool large)
+template<typename T>
+static void DrawPointerHybrid(T* aOut, uint32_t aPitchInPix, bool large)
 {
    if(FramesWithPointer-- < 0)
       return;
@@ -185,7 +190,12 @@ static uint32_t frameIndex;
 
 #define CONVERT_COLOR(color) (((color & 0x001f) << 11) | ((color & 0x03e0) << 1) | ((color & 0x0200) >> 4) | ((color & 0x7c00) >> 10))
 
-bool Resample_Screen(int w1, int h1, bool shrink, const uint16_t *old, uint16_t *ret)
+// RGB565 frames are converted from the core's RGB555 output, XRGB8888 frames come out of the core ready to use
+static INLINE uint16_t output_pixel(uint16_t color) { return CONVERT_COLOR(color); }
+static INLINE uint32_t output_pixel(uint32_t color) { return color; }
+
+template<typename T>
+bool Resample_Screen(int w1, int h1, bool shrink, const T *old, T *ret)
     {
 		int w2, h2, x2, y2 ;
 		if(shrink)
@@ -217,24 +227,26 @@ bool Resample_Screen(int w1, int h1, bool shrink, const uint16_t *old, uint16_t
         return true;
     }
 
-static void BlankScreenSmallSection(uint16_t *pt1, const uint16_t *pt2){
+template<typename T>
+static void BlankScreenSmallSection(T *pt1, const T *pt2){
 	//Ensures above the hybrid screens is blank - If someone changes screen layout, stuff will be leftover otherwise
 	unsigned i;
 	pt1 += hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
 	while( pt1 < pt2)
 	{
 		int awidth = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3;
-		memset(pt1, 0, hybrid_layout_scale*awidth*sizeof(uint16_t));
+		memset(pt1, 0, hybrid_layout_scale*awidth*sizeof(T));
 		pt1 += hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3 + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH);
 	}
 }
 
-static void BlankScreenGap(uint16_t *screen1, uint16_t *screen2, uint32_t pitch) {
+template<typename T>
+static void BlankScreenGap(T *screen1, T *screen2, uint32_t pitch) {
 	if (nds_screen_gap == 0)
 		return;
 
 	bool vertical;
-	uint16_t *screen;
+	T *screen;
 
 	switch (current_layout) {
 		case LAYOUT_TOP_BOTTOM:
@@ -262,18 +274,19 @@ static void BlankScreenGap(uint16_t *screen1, uint16_t *screen2, uint32_t pitch)
 	}
 
 	if (vertical) {
-		memset(screen + GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT * pitch, 0, nds_screen_gap * pitch * sizeof(uint16_t));
+		memset(screen + GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT * pitch, 0, nds_screen_gap * pitch * sizeof(T));
 	}
 	else {
 		unsigned i;
 		for (i = 0; i < GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT; i++) {
-			memset (screen + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH, 0, nds_screen_gap * sizeof(uint16_t));
+			memset (screen + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH, 0, nds_screen_gap * sizeof(T));
 			screen += pitch;
 		}
 	}
 }
 
-static void SwapScreen(uint16_t *dst, const uint16_t *src, uint32_t pitch)
+template<typename T>
+static void SwapScreen(T *dst, const T *src, uint32_t pitch)
 {
    unsigned i, j;
    uint32_t skip = pitch - GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
@@ -282,14 +295,15 @@ static void SwapScreen(uint16_t *dst, const uint16_t *src, uint32_t pitch)
    {
       for(j = 0; j < GPU_LR_FRAMEBUFFER_NATIVE_WIDTH; j ++)
       {
-         uint16_t col = *src++;
-         *dst++ = CONVERT_COLOR(col);
+         T col = *src++;
+         *dst++ = output_pixel(col);
       }
       dst += skip;
    }
 }
 
-static void SwapScreenLarge(uint16_t *dst, const uint16_t *src, uint32_t pitch)
+template<typename T>
+static void SwapScreenLarge(T *dst, const T *src, uint32_t pitch)
 {
 	/*
 	This method uses Nearest Neighbour to resize the primary screen to 3 times its original width and 3 times its original height.
@@ -305,15 +319,16 @@ static void SwapScreenLarge(uint16_t *dst, const uint16_t *src, uint32_t pitch)
 		  src -= GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
       for(j = 0; j < GPU_LR_FRAMEBUFFER_NATIVE_WIDTH; j ++)
       {
-		 uint16_t col = *src++;
+		 T col = *src++;
 		 for(k = 0; k < hybrid_layout_scale; ++k)
-			*dst++ = CONVERT_COLOR(col);
+			*dst++ = output_pixel(col);
       }
       dst += skip;
    }
 }
 
-static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch, bool first, bool draw)
+template<typename T>
+static void SwapScreenSmall(T *dst, const T *src, uint32_t pitch, bool first, bool draw)
 {
    unsigned i, j;
 	int addgap;
@@ -328,7 +343,7 @@ static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch,
 		//Make Sure The Screen Gap is Empty
 		for(i=0; i< addgap; ++i)
 		{
-			memset(dst, 0, hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(uint16_t));
+			memset(dst, 0, hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(T));
 			dst += hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3 + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH);
 		}
 	}
@@ -336,8 +351,8 @@ static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch,
 	if(hybrid_layout_scale != 3)
 	{
 		//Shrink to 1/3 the width and 1/3 the height
-		uint16_t *resampl;
-		resampl = (uint16_t*)malloc(GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/9*sizeof(uint16_t));
+		T *resampl;
+		resampl = (T*)malloc(GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/9*sizeof(T));
 		Resample_Screen(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH, GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT, true, src, resampl);
 		
 		for(i=0; i<GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/3; ++i)
@@ -345,11 +360,11 @@ static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch,
 			if(draw)
 			{
 				for(j=0; j<GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3; ++j)
-					*dst++ = CONVERT_COLOR(resampl[i*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)+j]);
+					*dst++ = output_pixel(resampl[i*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)+j]);
 			}
 			else
 			{
-				memset(dst, 0, GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(uint16_t));
+				memset(dst, 0, GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(T));
 				dst += GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3;
 			}
 			dst += GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
@@ -365,13 +380,13 @@ static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch,
 			{
 				for(j=0; j<GPU_LR_FRAMEBUFFER_NATIVE_WIDTH-1; ++j)
 				{	
-					uint16_t col = *src++;
-					*dst++ = CONVERT_COLOR(col);
+					T col = *src++;
+					*dst++ = output_pixel(col);
 				}
 			}
 			else
 			{
-				memset(dst, 0, (GPU_LR_FRAMEBUFFER_NATIVE_WIDTH-1)*sizeof(uint16_t));
+				memset(dst, 0, (GPU_LR_FRAMEBUFFER_NATIVE_WIDTH-1)*sizeof(T));
 				dst += GPU_LR_FRAMEBUFFER_NATIVE_WIDTH-1;
 			}
 			//Cuts off last pixel in width, because 3 does not divide native_width evenly. This prevents overwriting some of the main screen
@@ -383,7 +398,7 @@ static void SwapScreenSmall(uint16_t *dst, const uint16_t *src, uint32_t pitch,
 	if(!first){
 		int endheight = hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/3 - addgap;
 		for(i=0; i<endheight; ++i){
-			memset(dst, 0, hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(uint16_t));
+			memset(dst, 0, hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3*sizeof(T));
 			dst += hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3 + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH);
 		}
 	}
@@ -407,7 +422,8 @@ void retro_get_system_info(struct retro_system_info *info)
    info->block_extract = false;
 }
 
-static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
+template<typename T>
+static void get_layout_params(unsigned id, T *src, LayoutData *layout)
 {
    if (!layout)
       return;
@@ -418,7 +434,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
          if (src)
          {
             layout->dst    = src;
-            layout->dst2   = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + nds_screen_gap));
+            layout->dst2   = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + nds_screen_gap));
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
          layout->height = GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT * 2 + nds_screen_gap;
@@ -432,7 +448,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
       case LAYOUT_BOTTOM_TOP:
          if (src)
          {
-            layout->dst   = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + nds_screen_gap));
+            layout->dst   = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + nds_screen_gap));
             layout->dst2  = src;
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
@@ -448,7 +464,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
          if (src)
          {
             layout->dst    = src;
-            layout->dst2   = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + nds_screen_gap);
+            layout->dst2   = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + nds_screen_gap);
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * 2 + nds_screen_gap;
          layout->height = GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
@@ -462,7 +478,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
       case LAYOUT_RIGHT_LEFT:
          if (src)
          {
-            layout->dst   = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + nds_screen_gap);
+            layout->dst   = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + nds_screen_gap);
             layout->dst2  = src;
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * 2 + nds_screen_gap;
@@ -485,7 +501,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
 				addgap = hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/3-1;
 			else
 				addgap = nds_screen_gap;
-			layout->dst2   = (uint16_t*)(src + hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)*( hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/6 - addgap/2) - hybrid_layout_scale*awidth);
+			layout->dst2   = (src + hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)*( hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/6 - addgap/2) - hybrid_layout_scale*awidth);
          }
          layout->width  = hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + awidth);
          layout->height = hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
@@ -508,7 +524,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
 				addgap = GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/3-1;
 			else
 				addgap = nds_screen_gap;
-            layout->dst   = (uint16_t*)(src + hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)*( hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/6 - addgap/2) - hybrid_layout_scale*awidth);
+            layout->dst   = (src + hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH/3)*( hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT/6 - addgap/2) - hybrid_layout_scale*awidth);
 			layout->dst2  = src;
          }
          layout->width  = hybrid_layout_scale*(GPU_LR_FRAMEBUFFER_NATIVE_WIDTH + awidth);
@@ -526,7 +542,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
          if (src)
          {
             layout->dst    = src;
-            layout->dst2   = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
+            layout->dst2   = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
          layout->height = GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
@@ -539,7 +555,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
       case LAYOUT_BOTTOM_ONLY:
          if (src)
          {
-            layout->dst    = (uint16_t*)(src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
+            layout->dst    = (src + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
             layout->dst2   = src;
          }
          layout->width  = GPU_LR_FRAMEBUFFER_NATIVE_WIDTH;
@@ -556,7 +572,7 @@ static void get_layout_params(unsigned id, uint16_t *src, LayoutData *layout)
 void retro_get_system_av_info(struct retro_system_av_info *info)
 {
    struct LayoutData layout;
-   get_layout_params(current_layout, NULL, &layout);
+   get_layout_params(current_layout, (uint16_t *)NULL, &layout);
 
    info->geometry.base_width   = layout.width;
    info->geometry.base_height  = layout.height;
@@ -644,6 +660,14 @@ static void check_variables(bool first_boot)
                hybrid_layout_scale = 1;
          }
       }
+
+      //Also first boot only, it picks the pixel format and whether the gpu allocates its 32-bit buffers
+      var.key = "desmume_color_depth";
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+         CommonSettings.output_xrgb8888 = !strcmp(var.value, "32-bit");
+      else
+         CommonSettings.output_xrgb8888 = false;
    }
 
    var.key = "desmume_num_cores";
@@ -936,6 +960,78 @@ static void check_variables(bool first_boot)
    }
    else
       CommonSettings.advanced_timing = true;
+
+   var.key = "desmume_approximate_timing";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.approximate_timing = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.approximate_timing = false;
+   }
+   else
+      CommonSettings.approximate_timing = false;
+
+   var.key = "desmume_arm7_thread";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.arm7_thread = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.arm7_thread = false;
+   }
+   else
+      CommonSettings.arm7_thread = false;
+
+   var.key = "desmume_deferred_2d";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.deferred_2d = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.deferred_2d = false;
+   }
+   else
+      CommonSettings.deferred_2d = false;
+
+   var.key = "desmume_parallel_2d";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.parallel_2d = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.parallel_2d = false;
+   }
+   else
+      CommonSettings.parallel_2d = false;
+
+   var.key = "desmume_reuse_2d_lines";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.reuse_2d_lines = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.reuse_2d_lines = false;
+   }
+   else
+      CommonSettings.reuse_2d_lines = false;
+
+   var.key = "desmume_skip_hidden_bg";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         CommonSettings.skip_hidden_bg = true;
+      else if (!strcmp(var.value, "disabled"))
+         CommonSettings.skip_hidden_bg = false;
+   }
+   else
+      CommonSettings.skip_hidden_bg = false;
    
    var.key = "desmume_screens_gap";
    
@@ -975,23 +1071,32 @@ static void check_variables(bool first_boot)
   
    var.key = "desmume_pointer_colour";
 
+   pointer_colour = 0xFFFF;
+   pointer_colour32 = 0xFFFFFF;
+
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
    {
-      if(!strcmp(var.value, "white"))
-         pointer_colour = 0xFFFF;
-      else if (!strcmp(var.value, "black"))
+      if (!strcmp(var.value, "black"))
+      {
          pointer_colour = 0x0000;
+         pointer_colour32 = 0x000000;
+      }
       else if(!strcmp(var.value, "red"))
+      {
          pointer_colour = 0xF800;
+         pointer_colour32 = 0xFF0000;
+      }
       else if(!strcmp(var.value, "yellow"))
+      {
          pointer_colour = 0xFFE0;
+         pointer_colour32 = 0xFFFF00;
+      }
       else if(!strcmp(var.value, "blue"))
+      {
          pointer_colour = 0x001F;
-      else
-         pointer_colour = 0xFFFF;
+         pointer_colour32 = 0x0000FF;
+      }
    }
-   else
-      pointer_colour = 0xFFFF;
 }
 
 #ifndef GPU3D_NULL
@@ -1045,6 +1150,7 @@ void retro_set_environment(retro_environment_t cb)
 #endif
       { "desmume_screens_layout", "Screen layout; top/bottom|bottom/top|left/right|right/left|top only|bottom only|quick switch|hybrid/top|hybrid/bottom" },
       { "desmume_hybrid_layout_scale", "Hybrid layout scale (restart); 1|3"},
+      { "desmume_color_depth", "Color depth (restart); 16-bit|32-bit"},
       { "desmume_hybrid_showboth_screens", "Hybrid layout show both screens; enabled|disabled"},
       { "desmume_hybrid_cursor_always_smallscreen", "Hybrid layout cursor always on small screen; enabled|disabled"},
       { "desmume_pointer_mouse", "Enable mouse/pointer; enabled|disabled" },
@@ -1059,6 +1165,12 @@ void retro_set_environment(retro_environment_t cb)
       { "desmume_pointer_stylus_jitter", "Enable emulated stylus jitter; disabled|enabled"},
       { "desmume_load_to_memory", "Load Game into Memory (restart); disabled|enabled" },
       { "desmume_advanced_timing", "Enable Advanced Bus-Level Timing; enabled|disabled" },
+      { "desmume_approximate_timing", "Approximate Memory Timing (no advanced timing); disabled|enabled" },
+      { "desmume_arm7_thread", "Run ARM7 on its own thread (CPU cores > 1, no JIT, not deterministic); disabled|enabled" },
+      { "desmume_deferred_2d", "Render 2D on its own thread (CPU cores > 1); disabled|enabled" },
+      { "desmume_parallel_2d", "Render both 2D engines in parallel (CPU cores > 1); disabled|enabled" },
+      { "desmume_reuse_2d_lines", "Reuse unchanged 2D scanlines; disabled|enabled" },
+      { "desmume_skip_hidden_bg", "Skip hidden 2D BG layers; disabled|enabled" },
       { "desmume_firmware_language", "Firmware language; Auto|English|Japanese|French|German|Italian|Spanish" },
       { "desmume_frameskip", "Frameskip; 0|1|2|3|4|5|6|7|8|9" },
       { "desmume_screens_gap", "Screen Gap; 0|5|64|90|0|1|2|3|4|5|6|7|8|9|10|11|12|13|14|15|16|17|18|19|20|21|22|23|24|25|26|27|28|29|30|31|32|33|34|35|36|37|38|39|40|41|42|43|44|45|46|47|48|49|50|51|52|53|54|55|56|57|58|59|60|61|62|63|64|65|66|67|68|69|70|71|72|73|74|75|76|77|78|79|80|81|82|83|84|85|86|87|88|89|90|91|92|93|94|95|96|97|98|99|100" },
@@ -1190,12 +1302,18 @@ void retro_init (void)
    else
       log_cb = NULL;
 
-    colorMode = RETRO_PIXEL_FORMAT_RGB565;
-    if(!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &colorMode))
-       return;
-
     check_variables(true);
 
+    colorMode = (CommonSettings.output_xrgb8888) ? RETRO_PIXEL_FORMAT_XRGB8888 : RETRO_PIXEL_FORMAT_RGB565;
+    if(!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &colorMode))
+    {
+       //fall back to 16-bit frames if the frontend can't take 32-bit ones
+       colorMode = RETRO_PIXEL_FORMAT_RGB565;
+       CommonSettings.output_xrgb8888 = false;
+       if(!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &colorMode))
+          return;
+    }
+
     // Init DeSmuME
     struct NDS_fw_config_data fw_config;
     NDS_FillDefaultFirmwareConfigData(&fw_config);
@@ -1229,6 +1347,65 @@ void retro_reset (void)
     NDS_Reset();
 }
 
+template<typename T>
+static void RenderScreens(const LayoutData &layout, const T *framebuffer)
+{
+   T *dst  = (T *)layout.dst;
+   T *dst2 = (T *)layout.dst2;
+
+	  if (current_layout == LAYOUT_HYBRID_TOP_ONLY || current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
+	  {
+		const T *screen = framebuffer;
+		if (current_layout == LAYOUT_HYBRID_TOP_ONLY)
+		{
+			if(hybrid_layout_scale == 3)
+				SwapScreenLarge(dst,  screen, layout.pitch);
+			else
+				SwapScreen (dst,  screen, layout.pitch);
+			BlankScreenSmallSection(dst, dst2);
+			SwapScreenSmall(dst2, screen, layout.pitch, true, hybrid_layout_showbothscreens);
+		}
+		else if (current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
+			SwapScreenSmall(dst, screen, layout.pitch, true, true);
+	 
+		screen = framebuffer + (GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
+		if (current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
+		{
+			if(hybrid_layout_scale == 3)
+				SwapScreenLarge(dst2,  screen, layout.pitch);
+			else
+				SwapScreen (dst2,  screen, layout.pitch);
+			BlankScreenSmallSection(dst2, dst);
+			SwapScreenSmall (dst, screen, layout.pitch, false , hybrid_layout_showbothscreens);
+			//Keep the Touch Cursor on the Small Screen, even if the bottom is the primary screen? Make this configurable by user? (Needs work to get working with hybrid_layout_scale==3 and layout_hybrid_bottom_only)
+			if(hybrid_cursor_always_smallscreen && hybrid_layout_showbothscreens)
+				DrawPointerHybrid (dst, layout.pitch, false);
+			else
+				DrawPointerHybrid (dst2, layout.pitch, true);
+		}
+		else
+		{
+			SwapScreenSmall (dst2, screen, layout.pitch, false, true);
+			DrawPointerHybrid (dst2, layout.pitch, false);
+		}
+	  }
+	  //This is for every layout except Hybrid - same as before
+	  else
+	  {
+		const T *screen = framebuffer;
+		if (layout.draw_screen1)
+			SwapScreen (dst,  screen, layout.pitch);
+		if (layout.draw_screen2)
+		{
+			screen = framebuffer + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
+			SwapScreen (dst2, screen, layout.pitch);
+			DrawPointer(dst2, layout.pitch);
+		}
+
+		BlankScreenGap(dst, dst2, layout.pitch);
+	  }
+}
+
 void retro_run (void)
 {
    struct LayoutData layout;
@@ -1245,7 +1422,10 @@ void retro_run (void)
    }
 
    poll_cb();
-   get_layout_params(current_layout, screen_buf, &layout);
+   if (colorMode == RETRO_PIXEL_FORMAT_XRGB8888)
+      get_layout_params(current_layout, (uint32_t *)screen_buf, &layout);
+   else
+      get_layout_params(current_layout, (uint16_t *)screen_buf, &layout);
 
    if(pointer_device_l != 0 || pointer_device_r != 0)  // 1=emulated pointer, 2=absolute pointer, 3=absolute pointer constantly pressed
    {
@@ -1566,7 +1746,7 @@ void retro_run (void)
 			current_layout = LAYOUT_HYBRID_BOTTOM_ONLY;
 			{
 				//Need to swap around DST variables
-				uint16_t*swap = layout.dst;
+				void *swap = layout.dst;
 				layout.dst = layout.dst2;
 				layout.dst2 = swap;
 				//Need to reset Touch position to 0 with these conditions or it causes problems with mouse
@@ -1580,7 +1760,7 @@ void retro_run (void)
 		case LAYOUT_HYBRID_BOTTOM_ONLY:
 			current_layout = LAYOUT_HYBRID_TOP_ONLY;
 			{
-				uint16_t*swap = layout.dst;
+				void *swap = layout.dst;
 				layout.dst = layout.dst2;
 				layout.dst2 = swap;
 				//Need to reset Touch position to 0 with these conditions are it causes problems with mouse
@@ -1617,59 +1797,12 @@ void retro_run (void)
 
    if (!skipped)
    {
-	  if (current_layout == LAYOUT_HYBRID_TOP_ONLY || current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
-	  {
-		u16 *screen = GPU->GetCustomFramebuffer();
-		if (current_layout == LAYOUT_HYBRID_TOP_ONLY)
-		{
-			if(hybrid_layout_scale == 3)
-				SwapScreenLarge(layout.dst,  screen, layout.pitch);
-			else
-				SwapScreen (layout.dst,  screen, layout.pitch);
-			BlankScreenSmallSection(layout.dst, layout.dst2);
-			SwapScreenSmall(layout.dst2, screen, layout.pitch, true, hybrid_layout_showbothscreens);
-		}
-		else if (current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
-			SwapScreenSmall(layout.dst, screen, layout.pitch, true, true);
-	 
-		screen = GPU->GetCustomFramebuffer() + (GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT);
-		if (current_layout == LAYOUT_HYBRID_BOTTOM_ONLY)
-		{
-			if(hybrid_layout_scale == 3)
-				SwapScreenLarge(layout.dst2,  screen, layout.pitch);
-			else
-				SwapScreen (layout.dst2,  screen, layout.pitch);
-			BlankScreenSmallSection(layout.dst2, layout.dst);
-			SwapScreenSmall (layout.dst, screen, layout.pitch, false , hybrid_layout_showbothscreens);
-			//Keep the Touch Cursor on the Small Screen, even if the bottom is the primary screen? Make this configurable by user? (Needs work to get working with hybrid_layout_scale==3 and layout_hybrid_bottom_only)
-			if(hybrid_cursor_always_smallscreen && hybrid_layout_showbothscreens)
-				DrawPointerHybrid (layout.dst, layout.pitch, false);
-			else
-				DrawPointerHybrid (layout.dst2, layout.pitch, true);
-		}
-		else
-		{
-			SwapScreenSmall (layout.dst2, screen, layout.pitch, false, true);
-			DrawPointerHybrid (layout.dst2, layout.pitch, false);
-		}
-	  }
-	  //This is for every layout except Hybrid - same as before
-	  else
-	  {
-		u16 *screen = GPU->GetCustomFramebuffer();
-		if (layout.draw_screen1)
-			SwapScreen (layout.dst,  screen, layout.pitch);
-		if (layout.draw_screen2)
-		{
-			screen = GPU->GetCustomFramebuffer() + GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT;
-			SwapScreen (layout.dst2, screen, layout.pitch);
-			DrawPointer(layout.dst2, layout.pitch);
-		}
-
-		BlankScreenGap(layout.dst, layout.dst2, layout.pitch);
-	  }
+      if (colorMode == RETRO_PIXEL_FORMAT_XRGB8888)
+         RenderScreens(layout, GPU->GetCustomFramebuffer32());
+      else
+         RenderScreens(layout, GPU->GetCustomFramebuffer());
    }
-   video_cb(skipped ? 0 : screen_buf, layout.width, layout.height, layout.pitch * 2);
+   video_cb(skipped ? 0 : screen_buf, layout.width, layout.height, layout.pitch * ((colorMode == RETRO_PIXEL_FORMAT_XRGB8888) ? 4 : 2));
    frameIndex = skipped ? frameIndex : 0;
 }
 
@@ -1701,7 +1834,7 @@ bool retro_unserialize(const void * data, size_t size)
 
 bool retro_load_game(const struct retro_game_info *game)
 {
-   if (!game || colorMode != RETRO_PIXEL_FORMAT_RGB565)
+   if (!game || (colorMode != RETRO_PIXEL_FORMAT_RGB565 && colorMode != RETRO_PIXEL_FORMAT_XRGB8888))
       return false;
 
    struct retro_input_descriptor desc[] = {
@@ -1732,7 +1865,7 @@ bool retro_load_game(const struct retro_game_info *game)
    if (execute == -1)
       return false;
 
-   screen_buf = (uint16_t*)malloc(hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + NDS_MAX_SCREEN_GAP) * 2 * sizeof(uint16_t));
+   screen_buf = malloc(hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_WIDTH * (hybrid_layout_scale*GPU_LR_FRAMEBUFFER_NATIVE_HEIGHT + NDS_MAX_SCREEN_GAP) * 2 * ((colorMode == RETRO_PIXEL_FORMAT_XRGB8888) ? sizeof(uint32_t) : sizeof(uint16_t)));
 
    return true;
 }
@@ -0,0 +1,233 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lighting.h"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef ENABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef ENABLE_SSE4_1
+#include <smmintrin.h>
+#endif
+
+#ifdef ENABLE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(ENABLE_SSE2)
+//the low 32 bits of a 32x32 multiply, same as the C code gets from int multiplies
+static FORCEINLINE __m128i lighting_mullo_epi32(const __m128i a, const __m128i b)
+{
+#ifdef ENABLE_SSE4_1
+	return _mm_mullo_epi32(a, b);
+#else
+	const __m128i even = _mm_mul_epu32(a, b);
+	const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, 0x08), _mm_shuffle_epi32(odd, 0x08));
+#endif
+}
+#endif
+
+void LightingApply(const s32 *normal, const u32 lightMask, const u16 *material,
+	const u32 *lightColor, const s32 (*lightDirection)[4], const s32 (*halfVector)[4],
+	const u8 *shininessTable, u8 *color)
+{
+   size_t i;
+   size_t c;
+
+	const u16 dsDiffuse = material[0];
+	const u16 dsAmbient = material[1];
+	const u16 dsSpecular = material[2];
+	const u16 dsEmission = material[3];
+
+	u8 diffuse[3] = {
+		(u8)( dsDiffuse        & 0x1F),
+		(u8)((dsDiffuse >>  5) & 0x1F),
+		(u8)((dsDiffuse >> 10) & 0x1F) };
+
+	u8 ambient[3] = {
+		(u8)( dsAmbient        & 0x1F),
+		(u8)((dsAmbient >>  5) & 0x1F),
+		(u8)((dsAmbient >> 10) & 0x1F) };
+
+	u8 emission[3] = {
+		(u8)( dsEmission        & 0x1F),
+		(u8)((dsEmission >>  5) & 0x1F),
+		(u8)((dsEmission >> 10) & 0x1F) };
+
+	u8 specular[3] = {
+		(u8)( dsSpecular        & 0x1F),
+		(u8)((dsSpecular >>  5) & 0x1F),
+		(u8)((dsSpecular >> 10) & 0x1F) };
+
+	int vertexColor[3] = { emission[0], emission[1], emission[2] };
+
+	//the diffuse and shininess factors of each light. these need 64-bit dot products, so they stay scalar.
+	CACHE_ALIGN s32 lightDiffuse[4] = { 0, 0, 0, 0 };
+	CACHE_ALIGN s32 lightShininess[4] = { 0, 0, 0, 0 };
+	CACHE_ALIGN s32 lightEnable[4] = { 0, 0, 0, 0 };
+
+	for (i = 0; i < 4; i++)
+	{
+		if (!((lightMask>>i)&1))
+         continue;
+
+		lightEnable[i] = -1;
+
+		//This formula is the one used by the DS
+		//Reference : http://nocash.emubase.de/gbatek.htm#ds3dpolygonlightparameters
+		s32 fixed_diffuse = std::max(0,-vec3dot_fixed32(lightDirection[i],normal));
+
+		//todo - this could be cached in this form
+		s32 fixedTempNegativeHalf[] = {-halfVector[i][0],-halfVector[i][1],-halfVector[i][2],-halfVector[i][3]};
+		s32 dot = vec3dot_fixed32(fixedTempNegativeHalf, normal);
+
+		s32 fixedshininess = 0;
+		if (dot > 0) //prevent shininess on opposite side
+		{
+			//we have cos(a). it seems that we need cos(2a). trig identity is a fast way to get it.
+			//cos^2(a)=(1/2)(1+cos(2a))
+			//2*cos^2(a)-1=cos(2a)
+			fixedshininess = 2*mul_fixed32(dot,dot)-4096;
+			//gbatek is almost right but not quite!
+		}
+
+		//this seems to need to be saturated, or else the table will overflow.
+		//even without a table, failure to saturate is bad news
+		fixedshininess = std::min(fixedshininess,4095);
+		fixedshininess = std::max(fixedshininess,0);
+
+		if (dsSpecular & 0x8000)
+		{
+			//shininess is 20.12 fixed point, so >>5 gives us .7 which is 128 entries
+			//the entries are 8bits each so <<4 gives us .12 again, compatible with the lighting formulas below
+			//(according to other normal nds procedures, we might should fill the bottom bits with 1 or 0 according to rules...)
+			fixedshininess = shininessTable[fixedshininess>>5]<<4;
+		}
+
+		lightDiffuse[i] = fixed_diffuse;
+		lightShininess[i] = fixedshininess;
+	}
+
+	//the color terms are summed for all four lights at once, one light per lane.
+	//they're the same int multiplies and shifts as the plain version, so the results match exactly.
+	for (c = 0; c < 3; c++)
+	{
+		const size_t shift = c * 5;
+
+#if defined(ENABLE_SSE2)
+		const __m128i enable = _mm_load_si128((const __m128i *)lightEnable);
+		const __m128i lightComp = _mm_set_epi32((lightColor[3] >> shift) & 0x1F, (lightColor[2] >> shift) & 0x1F, (lightColor[1] >> shift) & 0x1F, (lightColor[0] >> shift) & 0x1F);
+
+		//5 bits for color*color and 12 bits for the shininess
+		const __m128i specComp = _mm_srai_epi32(lighting_mullo_epi32(_mm_madd_epi16(lightComp, _mm_set1_epi32(specular[c])), _mm_load_si128((const __m128i *)lightShininess)), 17);
+		//5bits for the color*color and 12 its for the diffuse
+		const __m128i diffComp = _mm_srai_epi32(lighting_mullo_epi32(_mm_madd_epi16(lightComp, _mm_set1_epi32(diffuse[c])), _mm_load_si128((const __m128i *)lightDiffuse)), 17);
+		//5bits for color*color
+		const __m128i ambComp  = _mm_srai_epi32(_mm_madd_epi16(lightComp, _mm_set1_epi32(ambient[c])), 5);
+
+		__m128i sum = _mm_and_si128(_mm_add_epi32(_mm_add_epi32(specComp, diffComp), ambComp), enable);
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		vertexColor[c] += _mm_cvtsi128_si32(sum);
+#elif defined(ENABLE_NEON)
+		const int32x4_t enable = vld1q_s32(lightEnable);
+		const s32 lightCompValues[4] = { (s32)((lightColor[0] >> shift) & 0x1F), (s32)((lightColor[1] >> shift) & 0x1F), (s32)((lightColor[2] >> shift) & 0x1F), (s32)((lightColor[3] >> shift) & 0x1F) };
+		const int32x4_t lightComp = vld1q_s32(lightCompValues);
+
+		const int32x4_t specComp = vshrq_n_s32(vmulq_s32(vmulq_n_s32(lightComp, specular[c]), vld1q_s32(lightShininess)), 17);
+		const int32x4_t diffComp = vshrq_n_s32(vmulq_s32(vmulq_n_s32(lightComp, diffuse[c]), vld1q_s32(lightDiffuse)), 17);
+		const int32x4_t ambComp  = vshrq_n_s32(vmulq_n_s32(lightComp, ambient[c]), 5);
+
+		const int32x4_t sum = vandq_s32(vaddq_s32(vaddq_s32(specComp, diffComp), ambComp), enable);
+		const int32x2_t sum2 = vpadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+		vertexColor[c] += vget_lane_s32(vpadd_s32(sum2, sum2), 0);
+#else
+		for (i = 0; i < 4; i++)
+		{
+			if (!lightEnable[i])
+				continue;
+
+			const s32 lightComp = (lightColor[i] >> shift) & 0x1F;
+			s32 specComp    = ((specular[c] * lightComp * lightShininess[i])>>17);  //5 bits for color*color and 12 bits for the shininess
+			s32 diffComp    = ((diffuse[c] * lightComp * lightDiffuse[i])>>17); //5bits for the color*color and 12 its for the diffuse
+			s32 ambComp     = ((ambient[c] * lightComp)>>5); //5bits for color*color
+			vertexColor[c] += specComp + diffComp + ambComp;
+		}
+#endif
+	}
+
+	for (c = 0; c < 3; c++)
+		color[c] = std::min(31,vertexColor[c]);
+}
+
+size_t LightingCache::index(const s32 *normal)
+{
+	u32 hash = ((u32)normal[0] * 73856093) ^ ((u32)normal[1] * 19349663) ^ ((u32)normal[2] * 83492791);
+	hash ^= hash >> 16;
+	return hash & (SIZE - 1);
+}
+
+void LightingCache::reset()
+{
+	memset(entries, 0, sizeof(entries));
+	generation = 1;
+}
+
+void LightingCache::invalidate()
+{
+	generation++;
+
+	//entries are only ever matched against the current generation, so wipe them all if it wraps around
+	if (generation == 0)
+		reset();
+}
+
+bool LightingCache::lookup(const s32 *normal, const u32 lightMask, const u16 *material, u8 *color) const
+{
+	const Entry &cached = entries[index(normal)];
+
+	if (cached.generation != generation || cached.lightMask != lightMask ||
+	    cached.normal[0] != normal[0] || cached.normal[1] != normal[1] || cached.normal[2] != normal[2] ||
+	    memcmp(cached.material, material, sizeof(cached.material)) != 0)
+		return false;
+
+	color[0] = cached.color[0];
+	color[1] = cached.color[1];
+	color[2] = cached.color[2];
+	return true;
+}
+
+void LightingCache::store(const s32 *normal, const u32 lightMask, const u16 *material, const u8 *color)
+{
+	Entry &cached = entries[index(normal)];
+
+	cached.normal[0] = normal[0];
+	cached.normal[1] = normal[1];
+	cached.normal[2] = normal[2];
+	cached.generation = generation;
+	cached.lightMask = lightMask;
+	memcpy(cached.material, material, sizeof(cached.material));
+	cached.color[0] = color[0];
+	cached.color[1] = color[1];
+	cached.color[2] = color[2];
+}
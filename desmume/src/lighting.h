@@ -0,0 +1,77 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <math/fxp.h>
+
+#include "types.h"
+
+FORCEINLINE s32 mul_fixed32(s32 a, s32 b)
+{
+	return fx32_shiftdown(fx32_mul(a,b));
+}
+
+FORCEINLINE s32 vec3dot_fixed32(const s32* a, const s32* b) {
+	return fx32_shiftdown(fx32_mul(a[0],b[0]) + fx32_mul(a[1],b[1]) + fx32_mul(a[2],b[2]));
+}
+
+//lights a transformed normal the way the geometry engine does.
+//lightMask is the low 4 bits of the polygon attributes, material is the diffuse, ambient, specular and emission
+//colors (15 bit, the specular one with its shininess table enable bit), and the light vectors are the ones
+//precomputed when the light directions were set. the color comes out as three 5 bit values.
+void LightingApply(const s32 *normal, const u32 lightMask, const u16 *material,
+	const u32 *lightColor, const s32 (*lightDirection)[4], const s32 (*halfVector)[4],
+	const u8 *shininessTable, u8 *color);
+
+//lighting results for recently transformed normals. lit models reuse the same normals every frame,
+//and a normal lights the same way for as long as the lights, the light mask and the material don't change.
+//invalidate() has to be called whenever the lights or the shininess table change.
+class LightingCache
+{
+public:
+	LightingCache() { reset(); }
+
+	void reset();
+	void invalidate();
+
+	//fills in color and returns true if this normal was lit with the same light mask and material
+	//since the last invalidate()
+	bool lookup(const s32 *normal, const u32 lightMask, const u16 *material, u8 *color) const;
+	void store(const s32 *normal, const u32 lightMask, const u16 *material, const u8 *color);
+
+private:
+	struct Entry
+	{
+		s32 normal[3];
+		u32 generation;
+		u32 lightMask;
+		u16 material[4];
+		u8 color[3];
+	};
+
+	enum { SIZE = 256 };
+
+	static size_t index(const s32 *normal);
+
+	Entry entries[SIZE];
+	u32 generation;
+};
+
+#endif
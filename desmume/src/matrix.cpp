@@ -27,6 +27,30 @@
 #include <math/fxp.h>
 #include <gfx/math/vector_3.h>
 
+#if defined(ENABLE_SSE2)
+//the SSE4.1 kernel is built even when the compiler isn't told to target SSE4.1,
+//and is picked at startup from cpuid (see _fx32_MatrixUseSSE41)
+#if defined(ENABLE_SSE4_1)
+	#define FX32_HAVE_SSE41
+	#define FX32_SSE41_TARGET
+#elif defined(_MSC_VER)
+	#define FX32_HAVE_SSE41
+	#define FX32_SSE41_TARGET
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+	#define FX32_HAVE_SSE41
+	#define FX32_SSE41_TARGET __attribute__((target("sse4.1")))
+#endif
+#endif
+
+#ifdef FX32_HAVE_SSE41
+#include <smmintrin.h>
+#include <features/features_cpu.h>
+#endif
+
+#ifdef ENABLE_NEON
+#include <arm_neon.h>
+#endif
+
 void _NOSSE_MatrixMultVec4x4 (const float *matrix, float *vecPtr)
 {
 	float x = vecPtr[0];
@@ -40,7 +64,10 @@ void _NOSSE_MatrixMultVec4x4 (const float *matrix, float *vecPtr)
 	vecPtr[3] = x * matrix[3] + y * matrix[7] + z * matrix[11] + w * matrix[15];
 }
 
-void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
+//-------------------------
+//plain C fixed point matrix functions. these are the reference the SIMD versions
+//below have to match bit for bit, and are used as they are when there is no SIMD.
+void _NOSIMD_MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
 {
 	const s32 x = vecPtr[0];
 	const s32 y = vecPtr[1];
@@ -53,7 +80,7 @@ void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
 	vecPtr[3] = fx32_shiftdown(fx32_mul(x,matrix[3]) + fx32_mul(y,matrix[7]) + fx32_mul(z,matrix[11]) + fx32_mul(w,matrix[15]));
 }
 
-void MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
+void _NOSIMD_MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
 {
 	const s32 x = vecPtr[0];
 	const s32 y = vecPtr[1];
@@ -64,6 +91,249 @@ void MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
 	vecPtr[2] = fx32_shiftdown(fx32_mul(x,matrix[2]) + fx32_mul(y,matrix[6]) + fx32_mul(z,matrix[10]));
 }
 
+void _NOSIMD_MatrixMultiply (s32 *matrix, const s32 *rightMatrix)
+{
+	s32 tmpMatrix[16];
+
+	tmpMatrix[0]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[0])+fx32_mul(matrix[4],rightMatrix[1])+fx32_mul(matrix[8],rightMatrix[2])+fx32_mul(matrix[12],rightMatrix[3]));
+	tmpMatrix[1]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[0])+fx32_mul(matrix[5],rightMatrix[1])+fx32_mul(matrix[9],rightMatrix[2])+fx32_mul(matrix[13],rightMatrix[3]));
+	tmpMatrix[2]  = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[0])+fx32_mul(matrix[6],rightMatrix[1])+fx32_mul(matrix[10],rightMatrix[2])+fx32_mul(matrix[14],rightMatrix[3]));
+	tmpMatrix[3]  = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[0])+fx32_mul(matrix[7],rightMatrix[1])+fx32_mul(matrix[11],rightMatrix[2])+fx32_mul(matrix[15],rightMatrix[3]));
+
+	tmpMatrix[4]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[4])+fx32_mul(matrix[4],rightMatrix[5])+fx32_mul(matrix[8],rightMatrix[6])+fx32_mul(matrix[12],rightMatrix[7]));
+	tmpMatrix[5]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[4])+fx32_mul(matrix[5],rightMatrix[5])+fx32_mul(matrix[9],rightMatrix[6])+fx32_mul(matrix[13],rightMatrix[7]));
+	tmpMatrix[6]  = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[4])+fx32_mul(matrix[6],rightMatrix[5])+fx32_mul(matrix[10],rightMatrix[6])+fx32_mul(matrix[14],rightMatrix[7]));
+	tmpMatrix[7]  = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[4])+fx32_mul(matrix[7],rightMatrix[5])+fx32_mul(matrix[11],rightMatrix[6])+fx32_mul(matrix[15],rightMatrix[7]));
+
+	tmpMatrix[8]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[8])+fx32_mul(matrix[4],rightMatrix[9])+fx32_mul(matrix[8],rightMatrix[10])+fx32_mul(matrix[12],rightMatrix[11]));
+	tmpMatrix[9]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[8])+fx32_mul(matrix[5],rightMatrix[9])+fx32_mul(matrix[9],rightMatrix[10])+fx32_mul(matrix[13],rightMatrix[11]));
+	tmpMatrix[10] = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[8])+fx32_mul(matrix[6],rightMatrix[9])+fx32_mul(matrix[10],rightMatrix[10])+fx32_mul(matrix[14],rightMatrix[11]));
+	tmpMatrix[11] = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[8])+fx32_mul(matrix[7],rightMatrix[9])+fx32_mul(matrix[11],rightMatrix[10])+fx32_mul(matrix[15],rightMatrix[11]));
+
+	tmpMatrix[12] = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[12])+fx32_mul(matrix[4],rightMatrix[13])+fx32_mul(matrix[8],rightMatrix[14])+fx32_mul(matrix[12],rightMatrix[15]));
+	tmpMatrix[13] = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[12])+fx32_mul(matrix[5],rightMatrix[13])+fx32_mul(matrix[9],rightMatrix[14])+fx32_mul(matrix[13],rightMatrix[15]));
+	tmpMatrix[14] = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[12])+fx32_mul(matrix[6],rightMatrix[13])+fx32_mul(matrix[10],rightMatrix[14])+fx32_mul(matrix[14],rightMatrix[15]));
+	tmpMatrix[15] = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[12])+fx32_mul(matrix[7],rightMatrix[13])+fx32_mul(matrix[11],rightMatrix[14])+fx32_mul(matrix[15],rightMatrix[15]));
+
+	memcpy(matrix,tmpMatrix,sizeof(s32)*16);
+}
+
+//-------------------------
+//fixed point matrix * vector, for ROWS of the matrix.
+//the products are summed at 64 bits and shifted down by 12 like fx32_mul/fx32_shiftdown,
+//so these give exactly the same results as the plain C versions.
+#if defined(ENABLE_SSE2)
+
+//SSE2 only multiplies unsigned. the terms that make the products signed again
+//all land in the upper 32 bits, so they can be gathered per lane and taken off once.
+template<size_t ROWS>
+static FORCEINLINE __m128i _fx32_MatrixMultVec_SSE2(const s32 *matrix, const s32 *vecPtr)
+{
+	__m128i sumEven = _mm_setzero_si128();
+	__m128i sumOdd = _mm_setzero_si128();
+	__m128i signFix = _mm_setzero_si128();
+
+	for (size_t i = 0; i < ROWS; i++)
+	{
+		const __m128i row = _mm_loadu_si128((const __m128i *)(matrix + (i * 4)));
+		const __m128i v = _mm_set1_epi32(vecPtr[i]);
+		sumEven = _mm_add_epi64(sumEven, _mm_mul_epu32(row, v));
+		sumOdd = _mm_add_epi64(sumOdd, _mm_mul_epu32(_mm_srli_epi64(row, 32), v));
+		signFix = _mm_add_epi32(signFix, _mm_and_si128(_mm_srai_epi32(row, 31), v));
+		signFix = _mm_add_epi32(signFix, _mm_and_si128(_mm_srai_epi32(v, 31), row));
+	}
+
+	sumEven = _mm_sub_epi64(sumEven, _mm_slli_epi64(signFix, 32));
+	sumOdd = _mm_sub_epi64(sumOdd, _mm_and_si128(signFix, _mm_set_epi32(0xFFFFFFFF, 0, 0xFFFFFFFF, 0)));
+
+	//only bits 12-43 of the sums are kept, so a logical shift does the same as the arithmetic one
+	sumEven = _mm_and_si128(_mm_srli_epi64(sumEven, 12), _mm_set_epi32(0, 0xFFFFFFFF, 0, 0xFFFFFFFF));
+	sumOdd = _mm_slli_epi64(_mm_srli_epi64(sumOdd, 12), 32);
+	return _mm_or_si128(sumEven, sumOdd);
+}
+
+static void _fx32_MatrixMultVec4x4_SSE2(const s32 *matrix, s32 *vecPtr)
+{
+	_mm_storeu_si128((__m128i *)vecPtr, _fx32_MatrixMultVec_SSE2<4>(matrix, vecPtr));
+}
+
+static void _fx32_MatrixMultVec3x3_SSE2(const s32 *matrix, s32 *vecPtr)
+{
+	const __m128i result = _fx32_MatrixMultVec_SSE2<3>(matrix, vecPtr);
+	_mm_storel_epi64((__m128i *)vecPtr, result);
+	vecPtr[2] = _mm_cvtsi128_si32(_mm_srli_si128(result, 8));
+}
+
+static void _fx32_MatrixMultiply_SSE2(s32 *matrix, const s32 *rightMatrix)
+{
+	const __m128i col0 = _fx32_MatrixMultVec_SSE2<4>(matrix, rightMatrix);
+	const __m128i col1 = _fx32_MatrixMultVec_SSE2<4>(matrix, rightMatrix + 4);
+	const __m128i col2 = _fx32_MatrixMultVec_SSE2<4>(matrix, rightMatrix + 8);
+	const __m128i col3 = _fx32_MatrixMultVec_SSE2<4>(matrix, rightMatrix + 12);
+
+	_mm_storeu_si128((__m128i *)matrix, col0);
+	_mm_storeu_si128((__m128i *)(matrix + 4), col1);
+	_mm_storeu_si128((__m128i *)(matrix + 8), col2);
+	_mm_storeu_si128((__m128i *)(matrix + 12), col3);
+}
+
+#ifdef FX32_HAVE_SSE41
+
+//same as the SSE2 kernel, with the signed multiply doing the sign fixup.
+//the callers carry the target attribute too, so that this can be inlined into them.
+template<size_t ROWS>
+static FORCEINLINE FX32_SSE41_TARGET __m128i _fx32_MatrixMultVec_SSE41(const s32 *matrix, const s32 *vecPtr)
+{
+	__m128i sumEven = _mm_setzero_si128();
+	__m128i sumOdd = _mm_setzero_si128();
+
+	for (size_t i = 0; i < ROWS; i++)
+	{
+		const __m128i row = _mm_loadu_si128((const __m128i *)(matrix + (i * 4)));
+		const __m128i v = _mm_set1_epi32(vecPtr[i]);
+		sumEven = _mm_add_epi64(sumEven, _mm_mul_epi32(row, v));
+		sumOdd = _mm_add_epi64(sumOdd, _mm_mul_epi32(_mm_srli_epi64(row, 32), v));
+	}
+
+	sumEven = _mm_srli_epi64(sumEven, 12);
+	sumOdd = _mm_slli_epi64(_mm_srli_epi64(sumOdd, 12), 32);
+	return _mm_blend_epi16(sumEven, sumOdd, 0xCC);
+}
+
+static FX32_SSE41_TARGET void _fx32_MatrixMultVec4x4_SSE41(const s32 *matrix, s32 *vecPtr)
+{
+	_mm_storeu_si128((__m128i *)vecPtr, _fx32_MatrixMultVec_SSE41<4>(matrix, vecPtr));
+}
+
+static FX32_SSE41_TARGET void _fx32_MatrixMultVec3x3_SSE41(const s32 *matrix, s32 *vecPtr)
+{
+	const __m128i result = _fx32_MatrixMultVec_SSE41<3>(matrix, vecPtr);
+	_mm_storel_epi64((__m128i *)vecPtr, result);
+	vecPtr[2] = _mm_extract_epi32(result, 2);
+}
+
+static FX32_SSE41_TARGET void _fx32_MatrixMultiply_SSE41(s32 *matrix, const s32 *rightMatrix)
+{
+	const __m128i col0 = _fx32_MatrixMultVec_SSE41<4>(matrix, rightMatrix);
+	const __m128i col1 = _fx32_MatrixMultVec_SSE41<4>(matrix, rightMatrix + 4);
+	const __m128i col2 = _fx32_MatrixMultVec_SSE41<4>(matrix, rightMatrix + 8);
+	const __m128i col3 = _fx32_MatrixMultVec_SSE41<4>(matrix, rightMatrix + 12);
+
+	_mm_storeu_si128((__m128i *)matrix, col0);
+	_mm_storeu_si128((__m128i *)(matrix + 4), col1);
+	_mm_storeu_si128((__m128i *)(matrix + 8), col2);
+	_mm_storeu_si128((__m128i *)(matrix + 12), col3);
+}
+
+#if defined(ENABLE_SSE4_1)
+bool _fx32_MatrixUseSSE41 = true;
+#else
+bool _fx32_MatrixUseSSE41 = (cpu_features_get() & RETRO_SIMD_SSE4) != 0;
+#endif
+
+#else
+bool _fx32_MatrixUseSSE41 = false;
+#endif //FX32_HAVE_SSE41
+
+void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
+{
+#ifdef FX32_HAVE_SSE41
+	if (_fx32_MatrixUseSSE41)
+	{
+		_fx32_MatrixMultVec4x4_SSE41(matrix, vecPtr);
+		return;
+	}
+#endif
+	_fx32_MatrixMultVec4x4_SSE2(matrix, vecPtr);
+}
+
+void MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
+{
+#ifdef FX32_HAVE_SSE41
+	if (_fx32_MatrixUseSSE41)
+	{
+		_fx32_MatrixMultVec3x3_SSE41(matrix, vecPtr);
+		return;
+	}
+#endif
+	_fx32_MatrixMultVec3x3_SSE2(matrix, vecPtr);
+}
+
+void MatrixMultiply (s32 *matrix, const s32 *rightMatrix)
+{
+#ifdef FX32_HAVE_SSE41
+	if (_fx32_MatrixUseSSE41)
+	{
+		_fx32_MatrixMultiply_SSE41(matrix, rightMatrix);
+		return;
+	}
+#endif
+	_fx32_MatrixMultiply_SSE2(matrix, rightMatrix);
+}
+
+#elif defined(ENABLE_NEON)
+
+template<size_t ROWS>
+static FORCEINLINE int32x4_t _fx32_MatrixMultVec(const s32 *matrix, const s32 *vecPtr)
+{
+	int64x2_t sumLo = vdupq_n_s64(0);
+	int64x2_t sumHi = vdupq_n_s64(0);
+
+	for (size_t i = 0; i < ROWS; i++)
+	{
+		const int32x4_t row = vld1q_s32(matrix + (i * 4));
+		const int32x2_t v = vdup_n_s32(vecPtr[i]);
+		sumLo = vmlal_s32(sumLo, vget_low_s32(row), v);
+		sumHi = vmlal_s32(sumHi, vget_high_s32(row), v);
+	}
+
+	return vcombine_s32(vshrn_n_s64(sumLo, 12), vshrn_n_s64(sumHi, 12));
+}
+
+void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
+{
+	vst1q_s32(vecPtr, _fx32_MatrixMultVec<4>(matrix, vecPtr));
+}
+
+void MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
+{
+	const int32x4_t result = _fx32_MatrixMultVec<3>(matrix, vecPtr);
+	vst1_s32(vecPtr, vget_low_s32(result));
+	vecPtr[2] = vgetq_lane_s32(result, 2);
+}
+
+void MatrixMultiply (s32 *matrix, const s32 *rightMatrix)
+{
+	const int32x4_t col0 = _fx32_MatrixMultVec<4>(matrix, rightMatrix);
+	const int32x4_t col1 = _fx32_MatrixMultVec<4>(matrix, rightMatrix + 4);
+	const int32x4_t col2 = _fx32_MatrixMultVec<4>(matrix, rightMatrix + 8);
+	const int32x4_t col3 = _fx32_MatrixMultVec<4>(matrix, rightMatrix + 12);
+
+	vst1q_s32(matrix, col0);
+	vst1q_s32(matrix + 4, col1);
+	vst1q_s32(matrix + 8, col2);
+	vst1q_s32(matrix + 12, col3);
+}
+
+#else
+
+void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr)
+{
+	_NOSIMD_MatrixMultVec4x4(matrix, vecPtr);
+}
+
+void MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr)
+{
+	_NOSIMD_MatrixMultVec3x3_fixed(matrix, vecPtr);
+}
+
+void MatrixMultiply (s32 *matrix, const s32 *rightMatrix)
+{
+	_NOSIMD_MatrixMultiply(matrix, rightMatrix);
+}
+
+#endif //fixed point matrix * vector
+
 //-------------------------
 //switched SSE functions: implementations for no SSE
 #ifndef ENABLE_SSE
@@ -266,33 +536,6 @@ void MatrixStackLoadMatrix (MatrixStack *stack, const size_t pos, const s32 *ptr
    MatrixCopy(&stack->matrix[pos*16], ptr);
 }
 
-void MatrixMultiply (s32 *matrix, const s32 *rightMatrix)
-{
-	s32 tmpMatrix[16];
-
-	tmpMatrix[0]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[0])+fx32_mul(matrix[4],rightMatrix[1])+fx32_mul(matrix[8],rightMatrix[2])+fx32_mul(matrix[12],rightMatrix[3]));
-	tmpMatrix[1]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[0])+fx32_mul(matrix[5],rightMatrix[1])+fx32_mul(matrix[9],rightMatrix[2])+fx32_mul(matrix[13],rightMatrix[3]));
-	tmpMatrix[2]  = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[0])+fx32_mul(matrix[6],rightMatrix[1])+fx32_mul(matrix[10],rightMatrix[2])+fx32_mul(matrix[14],rightMatrix[3]));
-	tmpMatrix[3]  = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[0])+fx32_mul(matrix[7],rightMatrix[1])+fx32_mul(matrix[11],rightMatrix[2])+fx32_mul(matrix[15],rightMatrix[3]));
-
-	tmpMatrix[4]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[4])+fx32_mul(matrix[4],rightMatrix[5])+fx32_mul(matrix[8],rightMatrix[6])+fx32_mul(matrix[12],rightMatrix[7]));
-	tmpMatrix[5]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[4])+fx32_mul(matrix[5],rightMatrix[5])+fx32_mul(matrix[9],rightMatrix[6])+fx32_mul(matrix[13],rightMatrix[7]));
-	tmpMatrix[6]  = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[4])+fx32_mul(matrix[6],rightMatrix[5])+fx32_mul(matrix[10],rightMatrix[6])+fx32_mul(matrix[14],rightMatrix[7]));
-	tmpMatrix[7]  = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[4])+fx32_mul(matrix[7],rightMatrix[5])+fx32_mul(matrix[11],rightMatrix[6])+fx32_mul(matrix[15],rightMatrix[7]));
-
-	tmpMatrix[8]  = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[8])+fx32_mul(matrix[4],rightMatrix[9])+fx32_mul(matrix[8],rightMatrix[10])+fx32_mul(matrix[12],rightMatrix[11]));
-	tmpMatrix[9]  = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[8])+fx32_mul(matrix[5],rightMatrix[9])+fx32_mul(matrix[9],rightMatrix[10])+fx32_mul(matrix[13],rightMatrix[11]));
-	tmpMatrix[10] = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[8])+fx32_mul(matrix[6],rightMatrix[9])+fx32_mul(matrix[10],rightMatrix[10])+fx32_mul(matrix[14],rightMatrix[11]));
-	tmpMatrix[11] = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[8])+fx32_mul(matrix[7],rightMatrix[9])+fx32_mul(matrix[11],rightMatrix[10])+fx32_mul(matrix[15],rightMatrix[11]));
-
-	tmpMatrix[12] = fx32_shiftdown(fx32_mul(matrix[0],rightMatrix[12])+fx32_mul(matrix[4],rightMatrix[13])+fx32_mul(matrix[8],rightMatrix[14])+fx32_mul(matrix[12],rightMatrix[15]));
-	tmpMatrix[13] = fx32_shiftdown(fx32_mul(matrix[1],rightMatrix[12])+fx32_mul(matrix[5],rightMatrix[13])+fx32_mul(matrix[9],rightMatrix[14])+fx32_mul(matrix[13],rightMatrix[15]));
-	tmpMatrix[14] = fx32_shiftdown(fx32_mul(matrix[2],rightMatrix[12])+fx32_mul(matrix[6],rightMatrix[13])+fx32_mul(matrix[10],rightMatrix[14])+fx32_mul(matrix[14],rightMatrix[15]));
-	tmpMatrix[15] = fx32_shiftdown(fx32_mul(matrix[3],rightMatrix[12])+fx32_mul(matrix[7],rightMatrix[13])+fx32_mul(matrix[11],rightMatrix[14])+fx32_mul(matrix[15],rightMatrix[15]));
-
-	memcpy(matrix,tmpMatrix,sizeof(s32)*16);
-}
-
 void MatrixScale(s32 *matrix, const s32 *ptr)
 {
 	//zero 21-sep-2010 - verified unrolling seems faster on my cpu
@@ -350,6 +350,16 @@ FORCEINLINE void vector_fix2float(float* matrix, const float divisor)
 
 void MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr);
 
+//plain C versions of the fixed point functions, which the SIMD ones have to match
+void _NOSIMD_MatrixMultVec4x4 (const s32 *matrix, s32 *vecPtr);
+void _NOSIMD_MatrixMultVec3x3_fixed(const s32 *matrix, s32 *vecPtr);
+void _NOSIMD_MatrixMultiply (s32 *matrix, const s32 *rightMatrix);
+
+#ifdef ENABLE_SSE2
+//whether the fixed point functions use the SSE4.1 kernel. set from cpuid at startup
+extern bool _fx32_MatrixUseSSE41;
+#endif
+
 void MatrixMultVec4x4_M2(const s32 *matrix, s32 *vecPtr);
 
 void MatrixMultiply(s32* matrix, const s32* rightMatrix);
@@ -1215,23 +1215,14 @@ Render3DError SoftRasterizerRenderer::InitTables()
 }
 
 template<bool useHiResInterpolate>
-size_t SoftRasterizerRenderer::performClipping(const VERTLIST *vertList, const POLYLIST *polyList, const INDEXLIST *indexList)
+size_t SoftRasterizerRenderer::performClipping(const VERTVIEW &verts, const POLYLIST *polyList, const INDEXLIST *indexList)
 {
 	//submit all polys to clipper
 	clipper.reset();
 	for (size_t i = 0; i < polyList->count; i++)
 	{
 		const POLY &poly = polyList->list[indexList->list[i]];
-		const VERT *clipVerts[4] = {
-			&vertList->list[poly.vertIndexes[0]],
-			&vertList->list[poly.vertIndexes[1]],
-			&vertList->list[poly.vertIndexes[2]],
-			poly.type==POLYGON_TYPE_QUAD
-			?&vertList->list[poly.vertIndexes[3]]
-			:NULL
-		};
-		
-		clipper.clipPoly<useHiResInterpolate>(poly, clipVerts);
+		clipper.clipPoly<useHiResInterpolate>(poly, verts);
 	}
 	
 	return clipper.clippedPolyCounter;
@@ -1422,13 +1413,15 @@ Render3DError SoftRasterizerRenderer::BeginRender(const GFX3D &engine)
 			rasterizerUnitTask[i].finish();
 	}
 	
-	// Keep the current render states for later use
-	this->currentRenderState = (GFX3D_State *)&engine.renderState;
+	// Keep a copy of the current render states for later use. The rasterizer threads may still
+	// be using them after the next flush has replaced the engine's render states.
+	this->_renderState = engine.renderState;
+	this->currentRenderState = &this->_renderState;
 	
 	if (CommonSettings.GFX3D_HighResolutionInterpolateColor)
-		this->_clippedPolyCount = this->performClipping<true>(engine.vertlist, engine.polylist, &engine.indexlist);
+		this->_clippedPolyCount = this->performClipping<true>(VERTVIEW(*engine.vertstore), engine.polylist, &engine.indexlist);
 	else
-		this->_clippedPolyCount = this->performClipping<false>(engine.vertlist, engine.polylist, &engine.indexlist);
+		this->_clippedPolyCount = this->performClipping<false>(VERTVIEW(*engine.vertstore), engine.polylist, &engine.indexlist);
 	
 	if (rasterizerCores >= 4)
 	{
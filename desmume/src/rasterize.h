@@ -59,7 +59,7 @@ protected:
 	// SoftRasterizer-specific methods
 	virtual Render3DError InitTables();
 	
-	template<bool useHiResInterpolate> size_t performClipping(const VERTLIST *vertList, const POLYLIST *polyList, const INDEXLIST *indexList);
+	template<bool useHiResInterpolate> size_t performClipping(const VERTVIEW &verts, const POLYLIST *polyList, const INDEXLIST *indexList);
 	
 	// Base rendering methods
 	virtual Render3DError BeginRender(const GFX3D &engine);
@@ -81,6 +81,7 @@ public:
 	bool polyVisible[POLYLIST_SIZE];
 	bool polyBackfacing[POLYLIST_SIZE];
 	GFX3D_State *currentRenderState;
+	GFX3D_State _renderState;
 	SoftRasterizerPostProcessParams *postprocessParam;
 	
 	SoftRasterizerRenderer();
@@ -1006,6 +1006,9 @@ static void loadstate()
 
 	SetupMMU(nds.Is_DebugConsole(),nds.Is_DSI());
 
+	// video memory was replaced wholesale, so everything derived from it is stale
+	videoWriteTracking.touchAll();
+
 	execute = !driver->EMU_IsEmulationPaused();
 }
 
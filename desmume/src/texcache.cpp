@@ -77,6 +77,19 @@ public:
 		return 0;
 	}
 
+	//returns whether any vram covered by this MemSpan was written since the specified generation.
+	//unmapped slots point at blank memory, which is never written.
+	bool changedSince(u64 generation) const
+	{
+		for(int i=0;i<numItems;i++)
+		{
+			const Item &item = items[i];
+			if(item.ptr < MMU.ARM9_LCD || item.ptr >= MMU.ARM9_LCD + sizeof(MMU.ARM9_LCD)) continue;
+			if(videoWriteTracking.vramChangedSince(item.ptr - MMU.ARM9_LCD, item.len, generation)) return true;
+		}
+		return false;
+	}
+
 	//TODO - get rid of duplication between these two methods.
 
 	//dumps the memspan to the specified buffer
@@ -205,8 +218,10 @@ class TexCache
 public:
 	TexCache()
 		: cache_size(0)
+		, paletteDumpGeneration(0)
 	{
 		memset(paletteDump,0,sizeof(paletteDump));
+		memset(paletteDumpSlot,0,sizeof(paletteDumpSlot));
 	}
 
 	TTexCacheItemMultimap index;
@@ -334,13 +349,22 @@ public:
 			//so they go through a different system
 			if(mspal.size != 0 && memcmp(curr->dump.palette,pal,mspal.size)) goto REJECT;
 
-			//when the texture data doesn't match
-			if(ms.memcmp(&curr->dump.texture[0],curr->dump.textureSize)) goto REJECT;
-
-			//if the texture is 4x4 then the index data must match
-			if(textureMode == TEXMODE_4X4)
+			//the texture and index data can only differ from the dump if the slots were remapped or written since it was verified
+			if(memcmp(curr->verifiedSlotAddr,MMU.texInfo.textureSlotAddr,sizeof(curr->verifiedSlotAddr))
+				|| ms.changedSince(curr->verifiedGeneration)
+				|| (textureMode == TEXMODE_4X4 && msIndex.changedSince(curr->verifiedGeneration)))
 			{
-				if(msIndex.memcmp(curr->dump.texture + curr->dump.textureSize,curr->dump.indexSize)) goto REJECT; 
+				//when the texture data doesn't match
+				if(ms.memcmp(&curr->dump.texture[0],curr->dump.textureSize)) goto REJECT;
+
+				//if the texture is 4x4 then the index data must match
+				if(textureMode == TEXMODE_4X4)
+				{
+					if(msIndex.memcmp(curr->dump.texture + curr->dump.textureSize,curr->dump.indexSize)) goto REJECT; 
+				}
+
+				curr->verifiedGeneration = videoWriteTracking.look();
+				memcpy(curr->verifiedSlotAddr,MMU.texInfo.textureSlotAddr,sizeof(curr->verifiedSlotAddr));
 			}
 
 			//we found a match. just return it
@@ -387,6 +411,8 @@ public:
 		const int texsize = newitem->dump.textureSize = ms.size;
 		const int indexsize = newitem->dump.indexSize = msIndex.size;
 		newitem->dump.texture = new u8[texsize+indexsize];
+		newitem->verifiedGeneration = videoWriteTracking.look();
+		memcpy(newitem->verifiedSlotAddr,MMU.texInfo.textureSlotAddr,sizeof(newitem->verifiedSlotAddr));
 		ms.dump(&newitem->dump.texture[0],newitem->dump.maxTextureSize); //dump texture
 		if(textureMode == TEXMODE_4X4)
 			msIndex.dump(newitem->dump.texture+newitem->dump.textureSize,newitem->dump.indexSize); //dump 4x4
@@ -676,17 +702,24 @@ public:
 
 	static const int PALETTE_DUMP_SIZE = (64+16+16)*1024;
 	u8 paletteDump[PALETTE_DUMP_SIZE];
+	u8* paletteDumpSlot[6];
+	u64 paletteDumpGeneration;
 
 	void invalidate()
 	{
-		//check whether the palette memory changed
-		//TODO - we should handle this instead by setting dirty flags in the vram memory mapping and noting whether palette memory was dirty.
-		//but this will work for now
+		//check whether the palette memory changed.
+		//if the same vram is still mapped to the palette slots and none of it was written since the dump, it cant have.
 		MemSpan mspal = MemSpan_TexPalette(0,PALETTE_DUMP_SIZE,true);
-		bool paletteDirty = mspal.memcmp(paletteDump);
-		if(paletteDirty)
+		bool paletteDirty = false;
+		if(memcmp(paletteDumpSlot,MMU.texInfo.texPalSlot,sizeof(paletteDumpSlot)) || mspal.changedSince(paletteDumpGeneration))
 		{
-			mspal.dump(paletteDump);
+			paletteDirty = mspal.memcmp(paletteDump) != 0;
+			if(paletteDirty)
+			{
+				mspal.dump(paletteDump);
+			}
+			paletteDumpGeneration = videoWriteTracking.look();
+			memcpy(paletteDumpSlot,MMU.texInfo.texPalSlot,sizeof(paletteDumpSlot));
 		}
 
 		for(TTexCacheItemMultimap::iterator it(index.begin()); it != index.end(); ++it)
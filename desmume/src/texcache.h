@@ -49,6 +49,7 @@ public:
 		, decoded(NULL)
 		, suspectedInvalid(false)
 		, assumedInvalid(false)
+		, verifiedGeneration(0)
 		, _deleteCallback(NULL)
 		, _deleteCallbackParam1(NULL)
 		, _deleteCallbackParam2(NULL)
@@ -67,6 +68,11 @@ public:
 	bool assumedInvalid;
 	TTexCacheItemMultimap::iterator iterator;
 
+	//the video write generation when the texture and index data were last known to match the dump,
+	//and the texture slot mapping at that time. if neither changed since, the data doesnt need comparing.
+	u64 verifiedGeneration;
+	u8* verifiedSlotAddr[4];
+
 	int getTextureMode() const { return (int)((texformat>>26)&0x07); }
 
 	u32 texformat, texpal;
@@ -59,6 +59,14 @@
 	#ifdef __SSSE3__
 		#define ENABLE_SSSE3
 	#endif
+
+	#ifdef __SSE4_1__
+		#define ENABLE_SSE4_1
+	#endif
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#define ENABLE_NEON
 #endif
 
 #ifdef _MSC_VER 
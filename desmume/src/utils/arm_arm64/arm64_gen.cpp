@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "arm64_gen.h"
+
+#if defined(__MACH__)
+#include <libkern/OSCacheControl.h>
+static void flush_icache(void *start, void *end)
+{
+   size_t len = (char *)end - (char *)start;
+   sys_dcache_flush(start, len);
+   sys_icache_invalidate(start, len);
+}
+#else
+static void flush_icache(void *start, void *end)
+{
+   __builtin___clear_cache((char *)start, (char *)end);
+}
+#endif
+
+namespace arm64_gen
+{
+
+code_pool::code_pool(uint32_t icount) :
+   instruction_count(icount),
+   instructions(0),
+   next_instruction(0),
+   flush_start(0)
+{
+   memset(labels, 0, sizeof(labels));
+   memset(branches, 0, sizeof(branches));
+
+   if (posix_memalign((void**)&instructions, 4096, instruction_count * 4))
+   {
+      fprintf(stderr, "posix_memalign failed\n");
+      abort();
+   }
+
+   if (mprotect(instructions, instruction_count * 4, PROT_READ | PROT_WRITE | PROT_EXEC))
+   {
+      fprintf(stderr, "mprotect failed\n");
+      abort();
+   }
+}
+
+code_pool::~code_pool()
+{
+   mprotect(instructions, instruction_count * 4, PROT_READ | PROT_WRITE);
+   free(instructions);
+}
+
+void* code_pool::fn_pointer()
+{
+   void* result = &instructions[flush_start];
+
+   flush_icache(&instructions[flush_start], &instructions[next_instruction]);
+   flush_start = next_instruction;
+
+   return result;
+}
+
+void code_pool::set_label(const char* name)
+{
+   for (uint32_t i = 0; i < TARGET_COUNT; i ++)
+   {
+      if (labels[i].name == name)
+      {
+         fprintf(stderr, "Duplicate label\n");
+         abort();
+      }
+   }
+
+   for (uint32_t i = 0; i < TARGET_COUNT; i ++)
+   {
+      if (labels[i].name == 0)
+      {
+         labels[i].name = name;
+         labels[i].position = next_instruction;
+         return;
+      }
+   }
+
+   fprintf(stderr, "Label overflow\n");
+   abort();
+}
+
+void code_pool::resolve_label(const char* name)
+{
+   for (uint32_t i = 0; i < TARGET_COUNT; i ++)
+   {
+      if (labels[i].name != name)
+      {
+         continue;
+      }
+
+      for (uint32_t j = 0; j < TARGET_COUNT; j ++)
+      {
+         if (branches[j].name != name)
+         {
+            continue;
+         }
+
+         const uint32_t source = branches[j].position;
+         const uint32_t target = labels[i].position;
+         const int32_t offset = (int32_t)(target - source);
+
+         // B.cond carries a 19-bit offset, B a 26-bit one
+         if ((instructions[source] & 0xFF000010) == 0x54000000)
+         {
+            instructions[source] |= (offset & 0x7FFFF) << 5;
+         }
+         else
+         {
+            instructions[source] |= offset & 0x3FFFFFF;
+         }
+
+         branches[j].name = 0;
+      }
+
+      labels[i].name = 0;
+      break;
+   }
+}
+
+// Code Gen: Generic
+void code_pool::insert_raw_instruction(uint32_t op)
+{
+   if (next_instruction >= instruction_count)
+   {
+      fprintf(stderr, "code_pool overflow\n");
+      abort();
+   }
+
+   instructions[next_instruction ++] = op;
+}
+
+void code_pool::push_frame()
+{
+   insert_raw_instruction( 0xA9BA7BFD ); // stp x29, x30, [sp, #-96]!
+   insert_raw_instruction( 0x910003FD ); // mov x29, sp
+   insert_raw_instruction( 0xA90153F3 ); // stp x19, x20, [sp, #16]
+   insert_raw_instruction( 0xA9025BF5 ); // stp x21, x22, [sp, #32]
+   insert_raw_instruction( 0xA90363F7 ); // stp x23, x24, [sp, #48]
+   insert_raw_instruction( 0xA9046BF9 ); // stp x25, x26, [sp, #64]
+   insert_raw_instruction( 0xA90573FB ); // stp x27, x28, [sp, #80]
+}
+
+void code_pool::pop_frame()
+{
+   insert_raw_instruction( 0xA94573FB ); // ldp x27, x28, [sp, #80]
+   insert_raw_instruction( 0xA9446BF9 ); // ldp x25, x26, [sp, #64]
+   insert_raw_instruction( 0xA94363F7 ); // ldp x23, x24, [sp, #48]
+   insert_raw_instruction( 0xA9425BF5 ); // ldp x21, x22, [sp, #32]
+   insert_raw_instruction( 0xA94153F3 ); // ldp x19, x20, [sp, #16]
+   insert_raw_instruction( 0xA8C67BFD ); // ldp x29, x30, [sp], #96
+}
+
+void code_pool::b(const char* target, AG_COND cond)
+{
+   assert(target);
+
+   for (uint32_t i = 0; i < TARGET_COUNT; i ++)
+   {
+      if (branches[i].name == 0)
+      {
+         branches[i].name = target;
+         branches[i].position = next_instruction;
+         insert_raw_instruction( (cond == AL) ? 0x14000000 : (0x54000000 | cond) );
+         return;
+      }
+   }
+
+   assert(false);
+}
+
+void code_pool::load_constant(reg_t target_reg, uint32_t constant)
+{
+   insert_raw_instruction( 0x52800000 | ((constant & 0xFFFF) << 5) | target_reg );
+
+   // If the upper 16-bits are zero the movk op is not needed
+   if (constant >> 16)
+   {
+      insert_raw_instruction( 0x72A00000 | ((constant >> 16) << 5) | target_reg );
+   }
+}
+
+void code_pool::load_constant64(reg_t target_reg, uint64_t constant)
+{
+   insert_raw_instruction( 0xD2800000 | ((constant & 0xFFFF) << 5) | target_reg );
+
+   for (uint32_t hw = 1; hw < 4; hw ++)
+   {
+      const uint32_t part = (constant >> (16 * hw)) & 0xFFFF;
+      if (part)
+      {
+         insert_raw_instruction( 0xF2800000 | (hw << 21) | (part << 5) | target_reg );
+      }
+   }
+}
+
+} // namespace arm64_gen
@@ -0,0 +1,199 @@
+#ifndef ARM64_GEN_H_LR
+#define ARM64_GEN_H_LR
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+
+namespace arm64_gen
+{
+
+template<uint32_t MAX>
+struct Constraint
+{
+   public:
+      Constraint(uint32_t val) : value(val) { assert(val < MAX); }
+      operator uint32_t() const { return value; }
+
+   private:
+      const uint32_t value;
+};
+
+// NOTE: Register 31 is either the zero register or SP depending on the
+//       instruction, the helpers below only ever use it as the zero register.
+struct reg_t : public Constraint<32>
+{
+   public:
+      reg_t(uint32_t num) : Constraint<32>(num) { }
+};
+
+static const uint32_t ZR = 31;
+
+// Do NOT reorder these enums, the values match both the guest (ARMv5) and the
+// host (AArch64) condition encodings.
+enum AG_COND
+{
+   EQ, NE, CS, CC, MI, PL, VS, VC,
+   HI, LS, GE, LT, GT, LE, AL, EGG,
+   CONDINVALID
+};
+
+enum AG_ALU_SHIFT
+{
+   LSL, LSR, ASR, ROR, SHIFTINVALID
+};
+
+static inline AG_COND invert(AG_COND cond) { return (AG_COND)(cond ^ 1); }
+
+// 80 Columns be damned
+class code_pool
+{
+   public:
+      code_pool(uint32_t instruction_count);
+      ~code_pool();
+
+      uint32_t instructions_remaining() const { return instruction_count - next_instruction; }
+
+      void* fn_pointer();
+
+      // Relocs
+      void set_label(const char* name);
+      void resolve_label(const char* name);
+
+      // Code Gen: Generic
+      void insert_raw_instruction(uint32_t op);
+
+      // Code Gen: ALU (32-bit, shifted register; ROR is only valid for the logical ops)
+      void add (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { addsub_reg(0x0B000000, rd, rn, rm, st, imm); }
+      void adds(reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { addsub_reg(0x2B000000, rd, rn, rm, st, imm); }
+      void sub (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { addsub_reg(0x4B000000, rd, rn, rm, st, imm); }
+      void subs(reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { addsub_reg(0x6B000000, rd, rn, rm, st, imm); }
+      void cmp (          reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { subs(ZR, rn, rm, st, imm); }
+      void cmn (          reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { adds(ZR, rn, rm, st, imm); }
+
+      void and_(reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x0A000000, rd, rn, rm, st, imm); }
+      void ands(reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x6A000000, rd, rn, rm, st, imm); }
+      void bic (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x0A200000, rd, rn, rm, st, imm); }
+      void orr (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x2A000000, rd, rn, rm, st, imm); }
+      void orn (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x2A200000, rd, rn, rm, st, imm); }
+      void eor (reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { logic_reg(0x4A000000, rd, rn, rm, st, imm); }
+      void tst (          reg_t rn, reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { ands(ZR, rn, rm, st, imm); }
+      void mov (reg_t rd,           reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { orr(rd, ZR, rm, st, imm); }
+      void mvn (reg_t rd,           reg_t rm, AG_ALU_SHIFT st = LSL, uint32_t imm = 0) { orn(rd, ZR, rm, st, imm); }
+
+      void adc (reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x1A000000 | (rm << 16) | (rn << 5) | rd ); }
+      void adcs(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x3A000000 | (rm << 16) | (rn << 5) | rd ); }
+      void sbc (reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x5A000000 | (rm << 16) | (rn << 5) | rd ); }
+      void sbcs(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x7A000000 | (rm << 16) | (rn << 5) | rd ); }
+
+      // Code Gen: ALU (32-bit, 12-bit unsigned immediate)
+      void add_imm (reg_t rd, reg_t rn, uint32_t imm) { addsub_imm(0x11000000, rd, rn, imm); }
+      void adds_imm(reg_t rd, reg_t rn, uint32_t imm) { addsub_imm(0x31000000, rd, rn, imm); }
+      void sub_imm (reg_t rd, reg_t rn, uint32_t imm) { addsub_imm(0x51000000, rd, rn, imm); }
+      void subs_imm(reg_t rd, reg_t rn, uint32_t imm) { addsub_imm(0x71000000, rd, rn, imm); }
+      void cmp_imm (          reg_t rn, uint32_t imm) { subs_imm(ZR, rn, imm); }
+      void cmn_imm (          reg_t rn, uint32_t imm) { adds_imm(ZR, rn, imm); }
+
+      // Code Gen: Variable shifts
+      void lslv(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x1AC02000 | (rm << 16) | (rn << 5) | rd ); }
+      void lsrv(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x1AC02400 | (rm << 16) | (rn << 5) | rd ); }
+      void asrv(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x1AC02800 | (rm << 16) | (rn << 5) | rd ); }
+      void rorv(reg_t rd, reg_t rn, reg_t rm) { insert_raw_instruction( 0x1AC02C00 | (rm << 16) | (rn << 5) | rd ); }
+
+      // Code Gen: Bitfield
+      void ubfm(reg_t rd, reg_t rn, uint32_t immr, uint32_t imms) { insert_raw_instruction( 0x53000000 | (immr << 16) | (imms << 10) | (rn << 5) | rd ); }
+      void sbfm(reg_t rd, reg_t rn, uint32_t immr, uint32_t imms) { insert_raw_instruction( 0x13000000 | (immr << 16) | (imms << 10) | (rn << 5) | rd ); }
+      void bfm (reg_t rd, reg_t rn, uint32_t immr, uint32_t imms) { insert_raw_instruction( 0x33000000 | (immr << 16) | (imms << 10) | (rn << 5) | rd ); }
+
+      void lsl (reg_t rd, reg_t rn, uint32_t imm)                 { ubfm(rd, rn, (32 - imm) & 0x1F, 31 - imm); }
+      void lsr (reg_t rd, reg_t rn, uint32_t imm)                 { ubfm(rd, rn, imm, 31); }
+      void asr (reg_t rd, reg_t rn, uint32_t imm)                 { sbfm(rd, rn, imm, 31); }
+      void ror (reg_t rd, reg_t rn, uint32_t imm)                 { insert_raw_instruction( 0x13800000 | (rn << 16) | (imm << 10) | (rn << 5) | rd ); }
+      void ubfx(reg_t rd, reg_t rn, uint32_t lsb, uint32_t width) { ubfm(rd, rn, lsb, lsb + width - 1); }
+      void bfi (reg_t rd, reg_t rn, uint32_t lsb, uint32_t width) { bfm(rd, rn, (32 - lsb) & 0x1F, width - 1); }
+
+      // Code Gen: Sign Extend
+      void sxtb(reg_t rd, reg_t rm)                               { sbfm(rd, rm, 0, 7); }
+      void sxth(reg_t rd, reg_t rm)                               { sbfm(rd, rm, 0, 15); }
+      void uxtb(reg_t rd, reg_t rm)                               { ubfm(rd, rm, 0, 7); }
+      void uxth(reg_t rd, reg_t rm)                               { ubfm(rd, rm, 0, 15); }
+
+      // Code Gen: Multiply
+      void madd(reg_t rd, reg_t rn, reg_t rm, reg_t ra)           { insert_raw_instruction( 0x1B000000 | (rm << 16) | (ra << 10) | (rn << 5) | rd ); }
+      void mul (reg_t rd, reg_t rn, reg_t rm)                     { madd(rd, rn, rm, ZR); }
+      void umull(reg_t xd, reg_t wn, reg_t wm)                    { insert_raw_instruction( 0x9BA07C00 | (wm << 16) | (wn << 5) | xd ); }
+      void smull(reg_t xd, reg_t wn, reg_t wm)                    { insert_raw_instruction( 0x9B207C00 | (wm << 16) | (wn << 5) | xd ); }
+      void lsr64(reg_t xd, reg_t xn, uint32_t imm)                { insert_raw_instruction( 0xD340FC00 | (imm << 16) | (xn << 5) | xd ); }
+      void clz (reg_t rd, reg_t rn)                               { insert_raw_instruction( 0x5AC01000 | (rn << 5) | rd ); }
+
+      // Code Gen: Memory (unsigned, scaled immediate offset)
+      void ldr  (reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0xB9400000, rt, base, offset, 2); }
+      void str  (reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0xB9000000, rt, base, offset, 2); }
+      void ldrb (reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0x39400000, rt, base, offset, 0); }
+      void strb (reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0x39000000, rt, base, offset, 0); }
+      void ldr64(reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0xF9400000, rt, base, offset, 3); }
+      void str64(reg_t rt, reg_t base, uint32_t offset = 0) { mem_imm(0xF9000000, rt, base, offset, 3); }
+
+      // Code Gen: Other
+      void set_status(reg_t source_reg)                     { insert_raw_instruction( 0xD51B4200 | source_reg ); }
+      void get_status(reg_t dest_reg)                       { insert_raw_instruction( 0xD53B4200 | dest_reg ); }
+      void blr(reg_t target_reg)                            { insert_raw_instruction( 0xD63F0000 | (target_reg << 5) ); }
+      void ret()                                            { insert_raw_instruction( 0xD65F03C0 ); }
+
+      // Saves/restores the frame record and the callee saved registers x19-x28.
+      void push_frame();
+      void pop_frame();
+
+      void b(const char* target, AG_COND cond = AL);
+
+      // Inserts a movz; movk pair to load the constant, omits movk if the constant fits in 16 bits.
+      void load_constant(reg_t target_reg, uint32_t constant);
+      void load_constant64(reg_t target_reg, uint64_t constant);
+
+      uint32_t get_next_instruction() { return next_instruction; };
+
+   private:
+      void addsub_reg(uint32_t op, reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st, uint32_t imm)
+      {
+         assert(st != ROR && imm < 32);
+         insert_raw_instruction( op | (st << 22) | (rm << 16) | (imm << 10) | (rn << 5) | rd );
+      }
+
+      void logic_reg(uint32_t op, reg_t rd, reg_t rn, reg_t rm, AG_ALU_SHIFT st, uint32_t imm)
+      {
+         assert(st < SHIFTINVALID && imm < 32);
+         insert_raw_instruction( op | (st << 22) | (rm << 16) | (imm << 10) | (rn << 5) | rd );
+      }
+
+      void addsub_imm(uint32_t op, reg_t rd, reg_t rn, uint32_t imm)
+      {
+         assert(imm < 4096 && rn != ZR);
+         insert_raw_instruction( op | (imm << 10) | (rn << 5) | rd );
+      }
+
+      void mem_imm(uint32_t op, reg_t rt, reg_t base, uint32_t offset, uint32_t scale)
+      {
+         assert(((offset >> scale) << scale) == offset && (offset >> scale) < 4096);
+         insert_raw_instruction( op | ((offset >> scale) << 10) | (base << 5) | rt );
+      }
+
+      const uint32_t instruction_count;
+      uint32_t* instructions;
+
+      uint32_t next_instruction;
+      uint32_t flush_start;
+
+      static const uint32_t TARGET_COUNT = 16;
+
+      struct target
+      {
+         const char* name;
+         uint32_t position;
+      };
+
+      target labels[TARGET_COUNT];
+      target branches[TARGET_COUNT];
+};
+} // namespace arm64_gen
+
+#endif
@@ -0,0 +1,1743 @@
+/*	Copyright (C) 2006 yopyop
+	Copyright (C) 2011 Loren Merritt
+	Copyright (C) 2012 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "types.h"
+
+#ifdef HAVE_JIT
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arm64_gen.h"
+#include "reg_manager.h"
+using namespace arm64_gen;
+
+#include "instructions.h"
+#include "instruction_attributes.h"
+#include "MMU.h"
+#include "MMU_timing.h"
+#include "arm_jit.h"
+#include "bios.h"
+#include "armcpu.h"
+#include "../bits.h"
+
+u32 saveBlockSizeJIT = 0;
+
+// The block cache is the same flat table used by the other backends, so the
+// MMU write paths invalidate AArch64 blocks without knowing about them.
+#ifdef MAPPED_JIT_FUNCS
+#error "The AArch64 JIT only supports the flat compiled_funcs table"
+#endif
+DS_ALIGN(4096) uintptr_t compiled_funcs[1<<26] = {0};
+
+template<int PROCNUM, int thumb>
+static u32 FASTCALL OP_DECODE()
+{
+   u32 cycles;
+   u32 adr = ARMPROC.instruct_adr;
+   if(thumb)
+   {
+      ARMPROC.next_instruction = adr + 2;
+      ARMPROC.R[15] = adr + 4;
+      u32 opcode = _MMU_read16<PROCNUM, MMU_AT_CODE>(adr);
+      cycles = thumb_instructions_set[PROCNUM][opcode>>6](opcode);
+   }
+   else
+   {
+      ARMPROC.next_instruction = adr + 4;
+      ARMPROC.R[15] = adr + 8;
+      u32 opcode = _MMU_read32<PROCNUM, MMU_AT_CODE>(adr);
+      if(CONDITION(opcode) == 0xE || TEST_COND(CONDITION(opcode), CODE(opcode), ARMPROC.CPSR))
+         cycles = arm_instructions_set[PROCNUM][INSTRUCTION_INDEX(opcode)](opcode);
+      else
+         cycles = 1;
+   }
+   ARMPROC.instruct_adr = ARMPROC.next_instruction;
+   return cycles;
+}
+
+static const ArmOpCompiled op_decode[2][2] = { OP_DECODE<0,0>, OP_DECODE<0,1>, OP_DECODE<1,0>, OP_DECODE<1,1> };
+
+
+enum OP_RESULT { OPR_CONTINUE, OPR_INTERPRET, OPR_BRANCHED, OPR_RESULT_SIZE = 2147483647 };
+#define OPR_RESULT(result, cycles) (OP_RESULT)((result) | ((cycles) << 16));
+#define OPR_RESULT_CYCLES(result) ((result >> 16))
+#define OPR_RESULT_ACTION(result) ((result & 0xFF))
+
+typedef OP_RESULT (*ArmOpCompiler)(uint32_t pc, uint32_t opcode);
+
+static const uint32_t INSTRUCTION_COUNT = 0xC0000;
+static code_pool* block;
+static register_manager* regman;
+static u8 recompile_counts[(1<<26)/16];
+
+// NOTE: Host register usage
+// x0-x3   = Arguments to the memory handlers / scratch
+// x4-x8   = Guest R8-R12 (see register_manager)
+// x9-x13  = Scratch
+// x14-x16 = Guest R13-R15
+// x19     = Pointer to ARMPROC
+// x20     = Cycle counter
+// x21-x28 = Guest R0-R7
+const reg_t RCPU = 19;
+const reg_t RCYC = 20;
+static uint32_t block_procnum;
+
+///////
+// HELPERS
+///////
+static bool emu_status_dirty;
+
+static bool bit(uint32_t value, uint32_t bit)
+{
+   return value & (1 << bit);
+}
+
+static uint32_t bit(uint32_t value, uint32_t first, uint32_t count)
+{
+   return (value >> first) & ((1 << count) - 1);
+}
+
+// The guest N, Z, C and V flags sit in bits 28-31 of the CPSR, the same place
+// AArch64 keeps them in NZCV, so they can be moved over without any shuffling.
+static void load_status(reg_t scratch)
+{
+   block->ldr(scratch, RCPU, offsetof(armcpu_t, CPSR));
+   block->lsr(scratch, scratch, 28);
+   block->lsl(scratch, scratch, 28);
+   block->set_status(scratch);
+}
+
+static void write_status(reg_t scratch, reg_t scratch2)
+{
+   if (emu_status_dirty)
+   {
+      block->get_status(scratch);
+      block->ldr(scratch2, RCPU, offsetof(armcpu_t, CPSR));
+      block->lsr(scratch, scratch, 28);
+      block->bfi(scratch2, scratch, 28, 4);
+      block->str(scratch2, RCPU, offsetof(armcpu_t, CPSR));
+
+      emu_status_dirty = false;
+   }
+}
+
+static void mark_status_dirty()
+{
+   emu_status_dirty = true;
+}
+
+// AArch64 logical ops clear C and V, ARM ones only touch C when the shifter
+// produced a carry and never touch V. Rebuild NZCV from the result; carry is
+// either a register holding the new C in bit 0, or -1 to keep the old C.
+static void set_logical_flags(reg_t result, int32_t carry)
+{
+   block->get_status(11);
+   block->ubfx(11, 11, 28, (carry < 0) ? 2 : 1);
+   block->tst(result, result);
+   block->get_status(12);
+   block->orr(12, 12, 11, LSL, 28);
+   if (carry >= 0)
+   {
+      block->orr(12, 12, carry, LSL, 29);
+   }
+   block->set_status(12);
+
+   mark_status_dirty();
+}
+
+static void call(reg_t reg)
+{
+   write_status(9, 10);
+   regman->save_volatile();
+   block->blr(reg);
+   regman->restore_volatile();
+   load_status(9);
+}
+
+static void change_mode(bool thumb)
+{
+   block->ldr(0, RCPU, offsetof(armcpu_t, CPSR));
+   block->load_constant(1, 1 << 5);
+
+   if (!thumb)
+   {
+      block->bic(0, 0, 1);
+   }
+   else
+   {
+      block->orr(0, 0, 1);
+   }
+   block->str(0, RCPU, offsetof(armcpu_t, CPSR));
+}
+
+static void change_mode_reg(reg_t reg, reg_t scratch)
+{
+   block->ldr(scratch, RCPU, offsetof(armcpu_t, CPSR));
+   block->bfi(scratch, reg, 5, 1);
+   block->str(scratch, RCPU, offsetof(armcpu_t, CPSR));
+}
+
+template <int PROCNUM>
+static void arm_jit_prefetch(uint32_t pc, uint32_t opcode, bool thumb)
+{
+   const uint32_t imask = thumb ? 0xFFFFFFFE : 0xFFFFFFFC;
+   const uint32_t isize = thumb ? 2 : 4;
+
+   block->load_constant(0, pc & imask);
+   block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+
+   block->add_imm(0, 0, isize);
+   block->str(0, RCPU, offsetof(armcpu_t, next_instruction));
+
+   block->add_imm(0, 0, isize);
+   block->str(0, RCPU, offsetof(armcpu_t, R) + 4 * 15);
+
+   block->load_constant(0, opcode);
+   block->str(0, RCPU, offsetof(armcpu_t, instruction));
+}
+
+// Shift an operand into a plain register, for the ops that have no shifted
+// register form (or no ROR) on AArch64.
+static reg_t shifted_operand(reg_t dest, reg_t rm, AG_ALU_SHIFT st, uint32_t imm)
+{
+   if (imm == 0)
+   {
+      return rm;
+   }
+
+   switch (st)
+   {
+      case LSL: block->lsl(dest, rm, imm); break;
+      case LSR: block->lsr(dest, rm, imm); break;
+      case ASR: block->asr(dest, rm, imm); break;
+      case arm64_gen::ROR: block->ror(dest, rm, imm); break;
+      default: assert(false); break;
+   }
+
+   return dest;
+}
+
+/////////
+/// ARM
+/////////
+static OP_RESULT ARM_OP_ALU(uint32_t pc, uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const bool has_imm = bit(opcode, 25);
+   const uint32_t op = bit(opcode, 21, 4);
+   const bool S = bit(opcode, 20);
+   const uint32_t rn = bit(opcode, 16, 4);
+   const uint32_t rd = bit(opcode, 12, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+   const AG_ALU_SHIFT st = (AG_ALU_SHIFT)bit(opcode, 5, 2);
+   const uint32_t shift_imm = bit(opcode, 7, 5);
+
+   const bool has_rn = (op != 13) && (op != 15);
+   const bool has_rd = (op < 8) || (op > 11);
+   const bool is_logical = (op < 2) || (op == 8) || (op == 9) || (op >= 12);
+
+   if (cond == EGG)
+      return OPR_INTERPRET;
+
+   if ((has_rd && rd == 0xF) || (has_rn && rn == 0xF))
+      return OPR_INTERPRET;
+
+   // Register specified shifts, RRX and the #32 forms of LSR/ASR are interpreted
+   if (!has_imm && (bit(opcode, 4) || rm == 0xF || (shift_imm == 0 && st != LSL)))
+      return OPR_INTERPRET;
+
+   const uint32_t weak_tag = (cond == AL) ? 0x10 : 0;
+
+   int32_t regs[3];
+   regs[0] = has_rd ? (int32_t)(rd | weak_tag) : -1;
+   regs[1] = has_rn ? (int32_t)rn : -1;
+   regs[2] = has_imm ? -1 : (int32_t)rm;
+   regman->get(3, regs);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   const reg_t nrd = has_rd ? (reg_t)regs[0] : (reg_t)((op == 8 || op == 9) ? 10 : ZR);
+   const reg_t nrn = has_rn ? (reg_t)regs[1] : (reg_t)ZR;
+
+   // Operand 2 as (register, shift, amount)
+   uint32_t imm_val = 0;
+   uint32_t m = 9;
+   AG_ALU_SHIFT mst = LSL;
+   uint32_t mimm = 0;
+   int32_t carry = -1;
+
+   if (has_imm)
+   {
+      const uint32_t rot = bit(opcode, 8, 4) * 2;
+      imm_val = ::ROR(opcode & 0xFF, rot);
+
+      if (S && is_logical && rot)
+      {
+         block->load_constant(13, imm_val >> 31);
+         carry = 13;
+      }
+   }
+   else
+   {
+      m = regs[2];
+      mst = st;
+      mimm = shift_imm;
+
+      // The shifter carry must be read before rd (which may alias rm) is written
+      if (S && is_logical && shift_imm)
+      {
+         block->ubfx(13, m, (st == LSL) ? (32 - shift_imm) : (shift_imm - 1), 1);
+         carry = 13;
+      }
+   }
+
+   const bool small_imm = has_imm && (imm_val < 4096);
+
+   switch (op)
+   {
+      case 2: // SUB
+      case 4: // ADD
+      case 10: // CMP
+      case 11: // CMN
+      {
+         const bool is_sub = (op == 2) || (op == 10);
+
+         if (small_imm)
+         {
+            if (is_sub) S ? block->subs_imm(nrd, nrn, imm_val) : block->sub_imm(nrd, nrn, imm_val);
+            else        S ? block->adds_imm(nrd, nrn, imm_val) : block->add_imm(nrd, nrn, imm_val);
+         }
+         else
+         {
+            if (has_imm)
+            {
+               block->load_constant(9, imm_val);
+            }
+            else if (mst == arm64_gen::ROR)
+            {
+               m = shifted_operand(9, m, mst, mimm);
+               mst = LSL;
+               mimm = 0;
+            }
+
+            if (is_sub) S ? block->subs(nrd, nrn, m, mst, mimm) : block->sub(nrd, nrn, m, mst, mimm);
+            else        S ? block->adds(nrd, nrn, m, mst, mimm) : block->add(nrd, nrn, m, mst, mimm);
+         }
+         break;
+      }
+
+      case 3: // RSB
+      case 5: // ADC
+      case 6: // SBC
+      case 7: // RSC
+      {
+         if (has_imm)
+         {
+            block->load_constant(9, imm_val);
+         }
+         else
+         {
+            m = shifted_operand(9, m, mst, mimm);
+         }
+
+         switch (op)
+         {
+            case 3: S ? block->subs(nrd, m, nrn) : block->sub(nrd, m, nrn); break;
+            case 5: S ? block->adcs(nrd, nrn, m) : block->adc(nrd, nrn, m); break;
+            case 6: S ? block->sbcs(nrd, nrn, m) : block->sbc(nrd, nrn, m); break;
+            case 7: S ? block->sbcs(nrd, m, nrn) : block->sbc(nrd, m, nrn); break;
+         }
+         break;
+      }
+
+      case 13: // MOV
+      case 15: // MVN
+      {
+         if (has_imm)
+         {
+            block->load_constant(nrd, (op == 13) ? imm_val : ~imm_val);
+         }
+         else if (op == 13)
+         {
+            block->mov(nrd, m, mst, mimm);
+         }
+         else
+         {
+            block->mvn(nrd, m, mst, mimm);
+         }
+         break;
+      }
+
+      default: // AND, EOR, TST, TEQ, ORR, BIC
+      {
+         if (has_imm)
+         {
+            block->load_constant(9, imm_val);
+         }
+
+         switch (op)
+         {
+            case 0: case 8: block->and_(nrd, nrn, m, mst, mimm); break;
+            case 1: case 9: block->eor (nrd, nrn, m, mst, mimm); break;
+            case 12:        block->orr (nrd, nrn, m, mst, mimm); break;
+            case 14:        block->bic (nrd, nrn, m, mst, mimm); break;
+         }
+         break;
+      }
+   }
+
+   if (S)
+   {
+      if (is_logical)
+      {
+         set_logical_flags(nrd, carry);
+      }
+      else
+      {
+         mark_status_dirty();
+      }
+   }
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   if (has_rd)
+   {
+      regman->mark_dirty(regs[0]);
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+#define ARM_ALU_OP_DEF(T) \
+   static const ArmOpCompiler ARM_OP_##T##_LSL_IMM = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_LSL_REG = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_LSR_IMM = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_LSR_REG = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_ASR_IMM = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_ASR_REG = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_ROR_IMM = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_ROR_REG = ARM_OP_ALU; \
+   static const ArmOpCompiler ARM_OP_##T##_IMM_VAL = ARM_OP_ALU
+
+ARM_ALU_OP_DEF(AND  );
+ARM_ALU_OP_DEF(AND_S);
+ARM_ALU_OP_DEF(EOR  );
+ARM_ALU_OP_DEF(EOR_S);
+ARM_ALU_OP_DEF(SUB  );
+ARM_ALU_OP_DEF(SUB_S);
+ARM_ALU_OP_DEF(RSB  );
+ARM_ALU_OP_DEF(RSB_S);
+ARM_ALU_OP_DEF(ADD  );
+ARM_ALU_OP_DEF(ADD_S);
+ARM_ALU_OP_DEF(ADC  );
+ARM_ALU_OP_DEF(ADC_S);
+ARM_ALU_OP_DEF(SBC  );
+ARM_ALU_OP_DEF(SBC_S);
+ARM_ALU_OP_DEF(RSC  );
+ARM_ALU_OP_DEF(RSC_S);
+ARM_ALU_OP_DEF(TST  );
+ARM_ALU_OP_DEF(TEQ  );
+ARM_ALU_OP_DEF(CMP  );
+ARM_ALU_OP_DEF(CMN  );
+ARM_ALU_OP_DEF(ORR  );
+ARM_ALU_OP_DEF(ORR_S);
+ARM_ALU_OP_DEF(MOV  );
+ARM_ALU_OP_DEF(MOV_S);
+ARM_ALU_OP_DEF(BIC  );
+ARM_ALU_OP_DEF(BIC_S);
+ARM_ALU_OP_DEF(MVN  );
+ARM_ALU_OP_DEF(MVN_S);
+
+// HACK: multiply cycles are wrong
+static OP_RESULT ARM_OP_MUL_DELEGATE(uint32_t pc, uint32_t opcode, bool ACCUM, uint32_t CYC)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const uint32_t rd = bit(opcode, 16, 4);
+   const uint32_t rn = bit(opcode, 12, 4);
+   const uint32_t rs = bit(opcode, 8, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+
+   if (cond == EGG || rd == 0xF || rs == 0xF || rm == 0xF || (ACCUM && rn == 0xF))
+      return OPR_INTERPRET;
+
+   int32_t regs[4] = { (int32_t)(rd | ((cond == AL) ? 0x10 : 0)), (int32_t)rm, (int32_t)rs, ACCUM ? (int32_t)rn : -1 };
+   regman->get(4, regs);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   if (ACCUM) block->madd(regs[0], regs[1], regs[2], regs[3]);
+   else       block->mul(regs[0], regs[1], regs[2]);
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   regman->mark_dirty(regs[0]);
+
+   return OPR_RESULT(OPR_CONTINUE, CYC);
+}
+
+static OP_RESULT ARM_OP_MULL_DELEGATE(uint32_t pc, uint32_t opcode, bool SIGNED, uint32_t CYC)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const uint32_t rdhi = bit(opcode, 16, 4);
+   const uint32_t rdlo = bit(opcode, 12, 4);
+   const uint32_t rs = bit(opcode, 8, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+
+   if (cond == EGG || rdhi == 0xF || rdlo == 0xF || rs == 0xF || rm == 0xF || rdhi == rdlo)
+      return OPR_INTERPRET;
+
+   const uint32_t weak_tag = (cond == AL) ? 0x10 : 0;
+   int32_t regs[4] = { (int32_t)(rdhi | weak_tag), (int32_t)(rdlo | weak_tag), (int32_t)rs, (int32_t)rm };
+   regman->get(4, regs);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   if (SIGNED) block->smull(9, regs[3], regs[2]);
+   else        block->umull(9, regs[3], regs[2]);
+
+   block->mov(regs[1], 9);
+   block->lsr64(9, 9, 32);
+   block->mov(regs[0], 9);
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   regman->mark_dirty(regs[0]);
+   regman->mark_dirty(regs[1]);
+
+   return OPR_RESULT(OPR_CONTINUE, CYC);
+}
+
+template <bool ACCUM, uint32_t CYC>
+static OP_RESULT ARM_OP_MUL_T(uint32_t pc, uint32_t opcode)
+{
+   return ARM_OP_MUL_DELEGATE(pc, opcode, ACCUM, CYC);
+}
+
+template <bool SIGNED, uint32_t CYC>
+static OP_RESULT ARM_OP_MULL_T(uint32_t pc, uint32_t opcode)
+{
+   return ARM_OP_MULL_DELEGATE(pc, opcode, SIGNED, CYC);
+}
+
+static OP_RESULT ARM_OP_CLZ(uint32_t pc, uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const uint32_t rd = bit(opcode, 12, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+
+   if (cond == EGG || rd == 0xF || rm == 0xF)
+      return OPR_INTERPRET;
+
+   int32_t regs[2] = { (int32_t)(rd | ((cond == AL) ? 0x10 : 0)), (int32_t)rm };
+   regman->get(2, regs);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   block->clz(regs[0], regs[1]);
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   regman->mark_dirty(regs[0]);
+
+   return OPR_RESULT(OPR_CONTINUE, 2);
+}
+
+#define ARM_OP_MUL         ARM_OP_MUL_T<false, 3>
+#define ARM_OP_MUL_S       0
+#define ARM_OP_MLA         ARM_OP_MUL_T<true, 4>
+#define ARM_OP_MLA_S       0
+#define ARM_OP_UMULL       ARM_OP_MULL_T<false, 4>
+#define ARM_OP_UMULL_S     0
+#define ARM_OP_UMLAL       0
+#define ARM_OP_UMLAL_S     0
+#define ARM_OP_SMULL       ARM_OP_MULL_T<true, 4>
+#define ARM_OP_SMULL_S     0
+#define ARM_OP_SMLAL       0
+#define ARM_OP_SMLAL_S     0
+
+#define ARM_OP_SMUL_B_B    0
+#define ARM_OP_SMUL_T_B    0
+#define ARM_OP_SMUL_B_T    0
+#define ARM_OP_SMUL_T_T    0
+
+#define ARM_OP_SMLA_B_B    0
+#define ARM_OP_SMLA_T_B    0
+#define ARM_OP_SMLA_B_T    0
+#define ARM_OP_SMLA_T_T    0
+
+#define ARM_OP_SMULW_B     0
+#define ARM_OP_SMULW_T     0
+#define ARM_OP_SMLAW_B     0
+#define ARM_OP_SMLAW_T     0
+
+#define ARM_OP_SMLAL_B_B   0
+#define ARM_OP_SMLAL_T_B   0
+#define ARM_OP_SMLAL_B_T   0
+#define ARM_OP_SMLAL_T_T   0
+
+#define ARM_OP_QADD        0
+#define ARM_OP_QSUB        0
+#define ARM_OP_QDADD       0
+#define ARM_OP_QDSUB       0
+
+////////
+// The memory handlers also work out the access time, the same way the
+// interpreter does. Loads return the value in the low word and the cycles in
+// the high word, stores return the cycles. One cycle of every access is part of
+// the op's constant cost, which is all a skipped conditional op is charged.
+#define MEM_CYCLES(SIZE, DIR, ALU) ((u64)(MMU_aluMemAccessCycles<PROCNUM,SIZE,DIR>(ALU, addr) - 1))
+
+template<int PROCNUM> static u64 jit_read08(u32 addr)
+{
+   const u32 val = _MMU_read08<PROCNUM>(addr);
+   return val | (MEM_CYCLES(8, MMU_AD_READ, 3) << 32);
+}
+
+template<int PROCNUM> static u64 jit_read16(u32 addr)
+{
+   const u32 val = _MMU_read16<PROCNUM>(addr & 0xFFFFFFFE);
+   return val | (MEM_CYCLES(16, MMU_AD_READ, 3) << 32);
+}
+
+template<int PROCNUM> static u64 jit_read32(u32 addr)
+{
+   const u32 val = ::ROR(_MMU_read32<PROCNUM>(addr & 0xFFFFFFFC), 8 * (addr & 3));
+   return val | (MEM_CYCLES(32, MMU_AD_READ, 3) << 32);
+}
+
+template<int PROCNUM> static u32 jit_write08(u32 addr, u8 val)
+{
+   _MMU_write08<PROCNUM>(addr, val);
+   return MEM_CYCLES(8, MMU_AD_WRITE, 2);
+}
+
+template<int PROCNUM> static u32 jit_write16(u32 addr, u16 val)
+{
+   _MMU_write16<PROCNUM>(addr & 0xFFFFFFFE, val);
+   return MEM_CYCLES(16, MMU_AD_WRITE, 2);
+}
+
+template<int PROCNUM> static u32 jit_write32(u32 addr, u32 val)
+{
+   _MMU_write32<PROCNUM>(addr & 0xFFFFFFFC, val);
+   return MEM_CYCLES(32, MMU_AD_WRITE, 2);
+}
+
+#undef MEM_CYCLES
+
+static const uintptr_t mem_funcs[12] =
+{
+   (uintptr_t)jit_read08<0>,  (uintptr_t)jit_read08<1>,
+   (uintptr_t)jit_write08<0>, (uintptr_t)jit_write08<1>,
+   (uintptr_t)jit_read16<0>,  (uintptr_t)jit_read16<1>,
+   (uintptr_t)jit_write16<0>, (uintptr_t)jit_write16<1>,
+   (uintptr_t)jit_read32<0>,  (uintptr_t)jit_read32<1>,
+   (uintptr_t)jit_write32<0>, (uintptr_t)jit_write32<1>
+};
+
+// Adds the access time returned by a memory handler to the cycle counter
+static void add_mem_cycles(bool load)
+{
+   if (load)
+   {
+      block->lsr64(9, 0, 32);
+      block->add(RCYC, RCYC, 9);
+   }
+   else
+   {
+      block->add(RCYC, RCYC, 0);
+   }
+}
+
+
+static OP_RESULT ARM_OP_MEM(uint32_t pc, const uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const bool has_reg_offset = bit(opcode, 25);
+   const bool has_pre_index = bit(opcode, 24);
+   const bool has_up_bit = bit(opcode, 23);
+   const bool has_byte_bit = bit(opcode, 22);
+   const bool has_write_back = bit(opcode, 21);
+   const bool has_load = bit(opcode, 20);
+   const uint32_t rn = bit(opcode, 16, 4);
+   const uint32_t rd = bit(opcode, 12, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+   const AG_ALU_SHIFT st = (AG_ALU_SHIFT)bit(opcode, 5, 2);
+   const uint32_t imm = bit(opcode, 7, 5);
+
+   if (cond == EGG || rn == 0xF || rd == 0xF || (has_reg_offset && (rm == 0xF)))
+      return OPR_INTERPRET;
+
+   if (has_reg_offset && imm == 0 && st != LSL)
+      return OPR_INTERPRET;
+
+   int32_t regs[3] = { (int32_t)(rd | (((cond == AL) && has_load) ? 0x10 : 0)), (int32_t)rn, has_reg_offset ? (int32_t)rm : -1 };
+   regman->get(3, regs);
+
+   const reg_t dest = regs[0];
+   const reg_t base = regs[1];
+
+   // HACK: This needs to done manually here as we can't branch over the generated code
+   write_status(9, 10);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   // Put the indexed address in W3
+   if (has_reg_offset)
+   {
+      const reg_t offs = shifted_operand(3, regs[2], st, (st == arm64_gen::ROR) ? imm : 0);
+      const uint32_t offs_imm = (st == arm64_gen::ROR) ? 0 : imm;
+
+      if (has_up_bit) block->add(3, base, offs, (st == arm64_gen::ROR) ? LSL : st, offs_imm);
+      else            block->sub(3, base, offs, (st == arm64_gen::ROR) ? LSL : st, offs_imm);
+   }
+   else
+   {
+      if (has_up_bit) block->add_imm(3, base, opcode & 0xFFF);
+      else            block->sub_imm(3, base, opcode & 0xFFF);
+   }
+
+   // Load EA
+   block->mov(0, (has_pre_index ? (reg_t)3 : base));
+
+   // Store value, taken before writeback in case rd == rn
+   if (!has_load)
+   {
+      if (has_byte_bit)
+      {
+         block->uxtb(1, dest);
+      }
+      else
+      {
+         block->mov(1, dest);
+      }
+   }
+
+   // Do Writeback
+   if ((!has_pre_index) || has_write_back)
+   {
+      block->mov(base, 3);
+      regman->mark_dirty(base);
+   }
+
+   uint32_t func_idx = block_procnum | (has_load ? 0 : 2) | (has_byte_bit ? 0 : 8);
+   block->load_constant64(2, mem_funcs[func_idx]);
+   call(2);
+   add_mem_cycles(has_load);
+
+   if (has_load)
+   {
+      if (has_byte_bit)
+      {
+         block->uxtb(dest, 0);
+      }
+      else
+      {
+         block->mov(dest, 0);
+      }
+
+      regman->mark_dirty(dest);
+   }
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+#define ARM_MEM_OP_DEF2(T, Q) \
+   static const ArmOpCompiler ARM_OP_##T##_M_LSL_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_P_LSL_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_M_LSR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_P_LSR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_M_ASR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_P_ASR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_M_ROR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_P_ROR_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_M_##Q = ARM_OP_MEM; \
+   static const ArmOpCompiler ARM_OP_##T##_P_##Q = ARM_OP_MEM
+
+#define ARM_MEM_OP_DEF(T) \
+   ARM_MEM_OP_DEF2(T, IMM_OFF_PREIND); \
+   ARM_MEM_OP_DEF2(T, IMM_OFF); \
+   ARM_MEM_OP_DEF2(T, IMM_OFF_POSTIND)
+
+ARM_MEM_OP_DEF(STR);
+ARM_MEM_OP_DEF(LDR);
+ARM_MEM_OP_DEF(STRB);
+ARM_MEM_OP_DEF(LDRB);
+
+//
+static OP_RESULT ARM_OP_MEM_HALF(uint32_t pc, uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const bool has_pre_index = bit(opcode, 24);
+   const bool has_up_bit = bit(opcode, 23);
+   const bool has_imm_offset = bit(opcode, 22);
+   const bool has_write_back = bit(opcode, 21);
+   const bool has_load = bit(opcode, 20);
+   const uint32_t op = bit(opcode, 5, 2);
+   const uint32_t rn = bit(opcode, 16, 4);
+   const uint32_t rd = bit(opcode, 12, 4);
+   const uint32_t rm = bit(opcode, 0, 4);
+
+   if (cond == EGG || rn == 0xF || rd == 0xF || (!has_imm_offset && (rm == 0xF)))
+      return OPR_INTERPRET;
+
+   // Signed stores are LDRD/STRD, which are left to the interpreter
+   if (!has_load && op != 1)
+      return OPR_INTERPRET;
+
+   int32_t regs[3] = { (int32_t)(rd | (((cond == AL) && has_load) ? 0x10 : 0)), (int32_t)rn, (!has_imm_offset) ? (int32_t)rm : -1 };
+   regman->get(3, regs);
+
+   const reg_t dest = regs[0];
+   const reg_t base = regs[1];
+
+   // HACK: This needs to done manually here as we can't branch over the generated code
+   write_status(9, 10);
+
+   if (cond != AL)
+   {
+      block->b("skip", invert(cond));
+   }
+
+   // Put the indexed address in W3
+   if (!has_imm_offset)
+   {
+      if (has_up_bit) block->add(3, base, regs[2]);
+      else            block->sub(3, base, regs[2]);
+   }
+   else
+   {
+      const uint32_t offs = (opcode & 0xF) | ((opcode >> 4) & 0xF0);
+
+      if (has_up_bit) block->add_imm(3, base, offs);
+      else            block->sub_imm(3, base, offs);
+   }
+
+   // Load EA
+   block->mov(0, (has_pre_index ? (reg_t)3 : base));
+
+   // Store value, taken before writeback in case rd == rn
+   if (!has_load)
+   {
+      block->uxth(1, dest);
+   }
+
+   // Do Writeback
+   if ((!has_pre_index) || has_write_back)
+   {
+      block->mov(base, 3);
+      regman->mark_dirty(base);
+   }
+
+   uint32_t func_idx = block_procnum | (has_load ? 0 : 2) | ((op == 2) ? 0 : 4);
+   block->load_constant64(2, mem_funcs[func_idx]);
+   call(2);
+   add_mem_cycles(has_load);
+
+   if (has_load)
+   {
+      switch (op)
+      {
+         case 1: block->uxth(dest, 0); break;
+         case 2: block->sxtb(dest, 0); break;
+         case 3: block->sxth(dest, 0); break;
+      }
+
+      regman->mark_dirty(dest);
+   }
+
+   if (cond != AL)
+   {
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+#define ARM_MEM_HALF_OP_DEF2(T, P) \
+   static const ArmOpCompiler ARM_OP_##T##_##P##M_REG_OFF = ARM_OP_MEM_HALF; \
+   static const ArmOpCompiler ARM_OP_##T##_##P##P_REG_OFF = ARM_OP_MEM_HALF; \
+   static const ArmOpCompiler ARM_OP_##T##_##P##M_IMM_OFF = ARM_OP_MEM_HALF; \
+   static const ArmOpCompiler ARM_OP_##T##_##P##P_IMM_OFF = ARM_OP_MEM_HALF
+
+#define ARM_MEM_HALF_OP_DEF(T) \
+   ARM_MEM_HALF_OP_DEF2(T, POS_INDE_); \
+   ARM_MEM_HALF_OP_DEF2(T, ); \
+   ARM_MEM_HALF_OP_DEF2(T, PRE_INDE_)
+
+ARM_MEM_HALF_OP_DEF(STRH);
+ARM_MEM_HALF_OP_DEF(LDRH);
+ARM_MEM_HALF_OP_DEF(STRSB);
+ARM_MEM_HALF_OP_DEF(LDRSB);
+ARM_MEM_HALF_OP_DEF(STRSH);
+ARM_MEM_HALF_OP_DEF(LDRSH);
+
+//
+#define SIGNEXTEND_24(i) (((s32)i<<8)>>8)
+static OP_RESULT ARM_OP_B_BL(uint32_t pc, uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 28, 4);
+   const bool has_link = bit(opcode, 24);
+
+   const bool unconditional = (cond == AL || cond == EGG);
+   int32_t regs[1] = { (has_link || cond == EGG) ? 14 : -1 };
+   regman->get(1, regs);
+
+   uint32_t dest = (pc + 8 + (SIGNEXTEND_24(bit(opcode, 0, 24)) << 2));
+
+   if (!unconditional)
+   {
+      block->load_constant(0, pc + 4);
+      block->b("skip", invert(cond));
+   }
+
+   if (cond == EGG)
+   {
+      change_mode(true);
+
+      if (has_link)
+      {
+         dest += 2;
+      }
+   }
+
+   if (has_link || cond == EGG)
+   {
+      block->load_constant(regs[0], pc + 4);
+      regman->mark_dirty(regs[0]);
+   }
+
+   block->load_constant(0, dest);
+
+   // A branch that isn't taken only costs a cycle
+   if (!unconditional)
+   {
+      block->add_imm(RCYC, RCYC, 2);
+      block->set_label("skip");
+      block->resolve_label("skip");
+   }
+
+   block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+
+   return OPR_RESULT(OPR_BRANCHED, unconditional ? 3 : 1);
+}
+
+#define ARM_OP_B  ARM_OP_B_BL
+#define ARM_OP_BL ARM_OP_B_BL
+
+////
+
+#define ARM_OP_LDRD_STRD_POST_INDEX 0
+#define ARM_OP_LDRD_STRD_OFFSET_PRE_INDEX 0
+#define ARM_OP_MRS_CPSR 0
+#define ARM_OP_SWP 0
+#define ARM_OP_MSR_CPSR 0
+#define ARM_OP_BX 0
+#define ARM_OP_BLX_REG 0
+#define ARM_OP_BKPT 0
+#define ARM_OP_MRS_SPSR 0
+#define ARM_OP_SWPB 0
+#define ARM_OP_MSR_SPSR 0
+#define ARM_OP_STREX 0
+#define ARM_OP_LDREX 0
+#define ARM_OP_MSR_CPSR_IMM_VAL 0
+#define ARM_OP_MSR_SPSR_IMM_VAL 0
+#define ARM_OP_STMDA 0
+#define ARM_OP_LDMDA 0
+#define ARM_OP_STMDA_W 0
+#define ARM_OP_LDMDA_W 0
+#define ARM_OP_STMDA2 0
+#define ARM_OP_LDMDA2 0
+#define ARM_OP_STMDA2_W 0
+#define ARM_OP_LDMDA2_W 0
+#define ARM_OP_STMIA 0
+#define ARM_OP_LDMIA 0
+#define ARM_OP_STMIA_W 0
+#define ARM_OP_LDMIA_W 0
+#define ARM_OP_STMIA2 0
+#define ARM_OP_LDMIA2 0
+#define ARM_OP_STMIA2_W 0
+#define ARM_OP_LDMIA2_W 0
+#define ARM_OP_STMDB 0
+#define ARM_OP_LDMDB 0
+#define ARM_OP_STMDB_W 0
+#define ARM_OP_LDMDB_W 0
+#define ARM_OP_STMDB2 0
+#define ARM_OP_LDMDB2 0
+#define ARM_OP_STMDB2_W 0
+#define ARM_OP_LDMDB2_W 0
+#define ARM_OP_STMIB 0
+#define ARM_OP_LDMIB 0
+#define ARM_OP_STMIB_W 0
+#define ARM_OP_LDMIB_W 0
+#define ARM_OP_STMIB2 0
+#define ARM_OP_LDMIB2 0
+#define ARM_OP_STMIB2_W 0
+#define ARM_OP_LDMIB2_W 0
+#define ARM_OP_STC_OPTION 0
+#define ARM_OP_LDC_OPTION 0
+#define ARM_OP_STC_M_POSTIND 0
+#define ARM_OP_LDC_M_POSTIND 0
+#define ARM_OP_STC_P_POSTIND 0
+#define ARM_OP_LDC_P_POSTIND 0
+#define ARM_OP_STC_M_IMM_OFF 0
+#define ARM_OP_LDC_M_IMM_OFF 0
+#define ARM_OP_STC_M_PREIND 0
+#define ARM_OP_LDC_M_PREIND 0
+#define ARM_OP_STC_P_IMM_OFF 0
+#define ARM_OP_LDC_P_IMM_OFF 0
+#define ARM_OP_STC_P_PREIND 0
+#define ARM_OP_LDC_P_PREIND 0
+#define ARM_OP_CDP 0
+#define ARM_OP_MCR 0
+#define ARM_OP_MRC 0
+#define ARM_OP_SWI 0
+#define ARM_OP_UND 0
+static const ArmOpCompiler arm_instruction_compilers[4096] = {
+#define TABDECL(x) ARM_##x
+#include "instruction_tabdef.inc"
+#undef TABDECL
+};
+
+////////
+// THUMB
+////////
+static OP_RESULT THUMB_OP_SHIFT(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rd = bit(opcode, 0, 3);
+   const uint32_t rs = bit(opcode, 3, 3);
+   const uint32_t imm = bit(opcode, 6, 5);
+   const AG_ALU_SHIFT op = (AG_ALU_SHIFT)bit(opcode, 11, 2);
+
+   // LSR #32 and ASR #32
+   if (imm == 0 && op != LSL)
+      return OPR_INTERPRET;
+
+   int32_t regs[2] = { (int32_t)(rd | 0x10), (int32_t)rs };
+   regman->get(2, regs);
+
+   const reg_t nrd = regs[0];
+   const reg_t nrs = regs[1];
+
+   int32_t carry = -1;
+   if (imm)
+   {
+      block->ubfx(13, nrs, (op == LSL) ? (32 - imm) : (imm - 1), 1);
+      carry = 13;
+   }
+
+   block->mov(nrd, nrs, op, imm);
+   set_logical_flags(nrd, carry);
+
+   regman->mark_dirty(nrd);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_ADDSUB_REGIMM(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rd = bit(opcode, 0, 3);
+   const uint32_t rs = bit(opcode, 3, 3);
+   const bool is_sub = bit(opcode, 9);
+   const bool arg_type = bit(opcode, 10);
+   const uint32_t arg = bit(opcode, 6, 3);
+
+   int32_t regs[3] = { (int32_t)(rd | 0x10), (int32_t)rs, (!arg_type) ? (int32_t)arg : -1 };
+   regman->get(3, regs);
+
+   const reg_t nrd = regs[0];
+   const reg_t nrs = regs[1];
+
+   if (arg_type) // Immediate
+   {
+      if (is_sub) block->subs_imm(nrd, nrs, arg);
+      else        block->adds_imm(nrd, nrs, arg);
+   }
+   else
+   {
+      if (is_sub) block->subs(nrd, nrs, regs[2]);
+      else        block->adds(nrd, nrs, regs[2]);
+   }
+
+   mark_status_dirty();
+   regman->mark_dirty(nrd);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_MCAS_IMM8(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rd = bit(opcode, 8, 3);
+   const uint32_t op = bit(opcode, 11, 2);
+   const uint32_t imm = bit(opcode, 0, 8);
+
+   int32_t regs[1] = { (int32_t)(rd | ((op == 0) ? 0x10 : 0)) };
+   regman->get(1, regs);
+   const reg_t nrd = regs[0];
+
+   switch (op)
+   {
+      case 0:
+         block->load_constant(nrd, imm);
+         set_logical_flags(nrd, -1);
+         break;
+      case 1: block->cmp_imm (nrd, imm); break;
+      case 2: block->adds_imm(nrd, nrd, imm); break;
+      case 3: block->subs_imm(nrd, nrd, imm); break;
+   }
+
+   mark_status_dirty();
+
+   if (op != 1) // Don't keep the result of a CMP instruction
+   {
+      regman->mark_dirty(nrd);
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_ALU(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rd = bit(opcode, 0, 3);
+   const uint32_t rs = bit(opcode, 3, 3);
+   const uint32_t op = bit(opcode, 6, 4);
+
+   // The register specified shifts need the amount range checked for the result
+   // and carry, and MUL has a data dependent cycle count, so these are left to
+   // the interpreter
+   if (op == 2 || op == 3 || op == 4 || op == 7 || op == 13)
+   {
+      return OPR_INTERPRET;
+   }
+
+   int32_t regs[2] = { (int32_t)rd, (int32_t)rs };
+   regman->get(2, regs);
+
+   const reg_t nrd = regs[0];
+   const reg_t nrs = regs[1];
+
+   switch (op)
+   {
+      case  0: block->and_(nrd, nrd, nrs); set_logical_flags(nrd, -1); break;
+      case  1: block->eor (nrd, nrd, nrs); set_logical_flags(nrd, -1); break;
+      case  5: block->adcs(nrd, nrd, nrs); break;
+      case  6: block->sbcs(nrd, nrd, nrs); break;
+      case  8: block->and_(10,  nrd, nrs); set_logical_flags(10,  -1); break;
+      case  9: block->subs(nrd, ZR, nrs); break;
+      case 10: block->cmp (nrd, nrs); break;
+      case 11: block->cmn (nrd, nrs); break;
+      case 12: block->orr (nrd, nrd, nrs); set_logical_flags(nrd, -1); break;
+      case 14: block->bic (nrd, nrd, nrs); set_logical_flags(nrd, -1); break;
+      case 15: block->mvn (nrd, nrs);      set_logical_flags(nrd, -1); break;
+   }
+
+   mark_status_dirty();
+
+   static const bool op_wb[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1 };
+   if (op_wb[op])
+   {
+      regman->mark_dirty(nrd);
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_SPE(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rd = bit(opcode, 0, 3) + (bit(opcode, 7) ? 8 : 0);
+   const uint32_t rs = bit(opcode, 3, 4);
+   const uint32_t op = bit(opcode, 8, 2);
+
+   if (rd == 0xF || rs == 0xF)
+   {
+      return OPR_INTERPRET;
+   }
+
+   int32_t regs[2] = { (int32_t)rd, (int32_t)rs };
+   regman->get(2, regs);
+
+   const reg_t nrd = regs[0];
+   const reg_t nrs = regs[1];
+
+   switch (op)
+   {
+      case 0: block->add(nrd, nrd, nrs); break;
+      case 1: block->cmp(nrd, nrs); break;
+      case 2: block->mov(nrd, nrs); break;
+   }
+
+   if (op != 1)
+   {
+      regman->mark_dirty(nrd);
+   }
+   else
+   {
+      mark_status_dirty();
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_MEMORY_DELEGATE(uint32_t pc, uint32_t opcode, bool LOAD, uint32_t SIZE, uint32_t EXTEND, bool REG_OFFSET)
+{
+   const uint32_t rd = bit(opcode, 0, 3);
+   const uint32_t rb = bit(opcode, 3, 3);
+   const uint32_t ro = bit(opcode, 6, 3);
+   const uint32_t off = bit(opcode, 6, 5);
+
+   int32_t regs[3] = { (int32_t)(rd | (LOAD ? 0x10 : 0)), (int32_t)rb, REG_OFFSET ? (int32_t)ro : -1 };
+   regman->get(3, regs);
+
+   const reg_t dest = regs[0];
+   const reg_t base = regs[1];
+
+   // Calc EA
+   if (REG_OFFSET)
+   {
+      block->add(0, base, regs[2]);
+   }
+   else
+   {
+      block->add_imm(0, base, off << SIZE);
+   }
+
+   // Load access function
+   block->load_constant64(2, mem_funcs[(SIZE << 2) + (LOAD ? 0 : 2) + block_procnum]);
+
+   if (!LOAD)
+   {
+      switch (SIZE)
+      {
+         case 0: block->uxtb(1, dest); break;
+         case 1: block->uxth(1, dest); break;
+         case 2: block->mov(1, dest); break;
+      }
+   }
+
+   call(2);
+   add_mem_cycles(LOAD);
+
+   // Only the low word of the return value is the loaded value, and the bits
+   // above a u8 or u16 are undefined anyway
+   if (LOAD)
+   {
+      switch (SIZE | (EXTEND ? 4 : 0))
+      {
+         case 0: block->uxtb(dest, 0); break;
+         case 1: block->uxth(dest, 0); break;
+         case 2: block->mov(dest, 0); break;
+         case 4: block->sxtb(dest, 0); break;
+         case 5: block->sxth(dest, 0); break;
+      }
+
+      regman->mark_dirty(dest);
+   }
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+// SIZE: 0=8, 1=16, 2=32
+template <bool LOAD, uint32_t SIZE, uint32_t EXTEND, bool REG_OFFSET>
+static OP_RESULT THUMB_OP_MEMORY(uint32_t pc, uint32_t opcode)
+{
+   return THUMB_OP_MEMORY_DELEGATE(pc, opcode, LOAD, SIZE, EXTEND, REG_OFFSET);
+}
+
+static OP_RESULT THUMB_OP_LDR_PCREL(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offset = bit(opcode, 0, 8);
+   const uint32_t rd = bit(opcode, 8, 3);
+
+   int32_t regs[1] = { (int32_t)(rd | 0x10) };
+   regman->get(1, regs);
+
+   const reg_t dest = regs[0];
+
+   block->load_constant(0, ((pc + 4) & ~2) + (offset << 2));
+   block->load_constant64(2, mem_funcs[8 + block_procnum]);
+   call(2);
+   add_mem_cycles(true);
+   block->mov(dest, 0);
+
+   regman->mark_dirty(dest);
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_STR_SPREL(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offset = bit(opcode, 0, 8);
+   const uint32_t rd = bit(opcode, 8, 3);
+
+   int32_t regs[2] = { (int32_t)rd, 13 };
+   regman->get(2, regs);
+
+   const reg_t src = regs[0];
+   const reg_t base = regs[1];
+
+   block->add_imm(0, base, offset << 2);
+   block->mov(1, src);
+   block->load_constant64(2, mem_funcs[10 + block_procnum]);
+   call(2);
+   add_mem_cycles(false);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_LDR_SPREL(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offset = bit(opcode, 0, 8);
+   const uint32_t rd = bit(opcode, 8, 3);
+
+   int32_t regs[2] = { (int32_t)(rd | 0x10), 13 };
+   regman->get(2, regs);
+
+   const reg_t dest = regs[0];
+   const reg_t base = regs[1];
+
+   block->add_imm(0, base, offset << 2);
+   block->load_constant64(2, mem_funcs[8 + block_procnum]);
+   call(2);
+   add_mem_cycles(true);
+   block->mov(dest, 0);
+
+   regman->mark_dirty(dest);
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_B_COND(uint32_t pc, uint32_t opcode)
+{
+   const AG_COND cond = (AG_COND)bit(opcode, 8, 4);
+
+   if (cond >= AL)
+      return OPR_INTERPRET;
+
+   block->load_constant(0, pc + 2);
+   block->b("skip", invert(cond));
+   block->load_constant(0, (pc + 4) + ((u32)((s8)(opcode&0xFF))<<1));
+   block->add_imm(RCYC, RCYC, 2);
+   block->set_label("skip");
+   block->resolve_label("skip");
+
+   block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+
+   return OPR_RESULT(OPR_BRANCHED, 1);
+}
+
+static OP_RESULT THUMB_OP_B_UNCOND(uint32_t pc, uint32_t opcode)
+{
+   int32_t offs = (opcode & 0x7FF) | (bit(opcode, 10) ? 0xFFFFF800 : 0);
+   block->load_constant(0, pc + 4 + (offs << 1));
+
+   block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+
+   return OPR_RESULT(OPR_BRANCHED, 3);
+}
+
+static OP_RESULT THUMB_OP_ADJUST_SP(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offs = bit(opcode, 0, 7);
+
+   int32_t regs[1] = { 13 };
+   regman->get(1, regs);
+
+   const reg_t sp = regs[0];
+
+   if (bit(opcode, 7)) block->sub_imm(sp, sp, offs << 2);
+   else                block->add_imm(sp, sp, offs << 2);
+
+   regman->mark_dirty(sp);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_ADD_2PC(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offset = bit(opcode, 0, 8);
+   const uint32_t rd = bit(opcode, 8, 3);
+
+   int32_t regs[1] = { (int32_t)(rd | 0x10) };
+   regman->get(1, regs);
+
+   const reg_t dest = regs[0];
+
+   block->load_constant(dest, ((pc + 4) & 0xFFFFFFFC) + (offset << 2));
+   regman->mark_dirty(dest);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_ADD_2SP(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t offset = bit(opcode, 0, 8);
+   const uint32_t rd = bit(opcode, 8, 3);
+
+   int32_t regs[2] = { 13, (int32_t)(rd | 0x10) };
+   regman->get(2, regs);
+
+   const reg_t sp = regs[0];
+   const reg_t dest = regs[1];
+
+   block->add_imm(dest, sp, offset << 2);
+   regman->mark_dirty(dest);
+
+   return OPR_RESULT(OPR_CONTINUE, 1);
+}
+
+static OP_RESULT THUMB_OP_BX_BLX_THUMB(uint32_t pc, uint32_t opcode)
+{
+   const uint32_t rm = bit(opcode, 3, 4);
+   const bool link = bit(opcode, 7);
+
+   if (rm == 15)
+      return OPR_INTERPRET;
+
+   block->load_constant(0, pc + 4);
+
+   int32_t regs[2] = { link ? 14 : -1, (int32_t)rm };
+   regman->get(2, regs);
+
+   reg_t target = regs[1];
+
+   // Read the target before LR is written, BLX LR is valid
+   block->mov(3, target);
+
+   if (link)
+   {
+      const reg_t lr = regs[0];
+      block->sub_imm(lr, 0, 1);
+      regman->mark_dirty(lr);
+   }
+
+   change_mode_reg(3, 2);
+
+   // Bit 0 is the new Thumb bit, an ARM target is also word aligned
+   block->load_constant(2, 2);
+   block->bic(1, 2, 3, LSL, 1);
+   block->bic(0, 3, 1);
+   block->load_constant(1, 1);
+   block->bic(0, 0, 1);
+   block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+
+   return OPR_RESULT(OPR_BRANCHED, link ? 4 : 3);
+}
+
+#define THUMB_OP_BL_LONG 0
+
+#define THUMB_OP_INTERPRET       0
+#define THUMB_OP_UND_THUMB       THUMB_OP_INTERPRET
+
+#define THUMB_OP_LSL             THUMB_OP_SHIFT
+#define THUMB_OP_LSL_0           THUMB_OP_SHIFT
+#define THUMB_OP_LSR             THUMB_OP_SHIFT
+#define THUMB_OP_LSR_0           THUMB_OP_SHIFT
+#define THUMB_OP_ASR             THUMB_OP_SHIFT
+#define THUMB_OP_ASR_0           THUMB_OP_SHIFT
+
+#define THUMB_OP_ADD_REG         THUMB_OP_ADDSUB_REGIMM
+#define THUMB_OP_SUB_REG         THUMB_OP_ADDSUB_REGIMM
+#define THUMB_OP_ADD_IMM3        THUMB_OP_ADDSUB_REGIMM
+#define THUMB_OP_SUB_IMM3        THUMB_OP_ADDSUB_REGIMM
+
+#define THUMB_OP_MOV_IMM8        THUMB_OP_MCAS_IMM8
+#define THUMB_OP_CMP_IMM8        THUMB_OP_MCAS_IMM8
+#define THUMB_OP_ADD_IMM8        THUMB_OP_MCAS_IMM8
+#define THUMB_OP_SUB_IMM8        THUMB_OP_MCAS_IMM8
+
+#define THUMB_OP_AND             THUMB_OP_ALU
+#define THUMB_OP_EOR             THUMB_OP_ALU
+#define THUMB_OP_LSL_REG         THUMB_OP_ALU
+#define THUMB_OP_LSR_REG         THUMB_OP_ALU
+#define THUMB_OP_ASR_REG         THUMB_OP_ALU
+#define THUMB_OP_ADC_REG         THUMB_OP_ALU
+#define THUMB_OP_SBC_REG         THUMB_OP_ALU
+#define THUMB_OP_ROR_REG         THUMB_OP_ALU
+#define THUMB_OP_TST             THUMB_OP_ALU
+#define THUMB_OP_NEG             THUMB_OP_ALU
+#define THUMB_OP_CMP             THUMB_OP_ALU
+#define THUMB_OP_CMN             THUMB_OP_ALU
+#define THUMB_OP_ORR             THUMB_OP_ALU
+#define THUMB_OP_MUL_REG         THUMB_OP_INTERPRET
+#define THUMB_OP_BIC             THUMB_OP_ALU
+#define THUMB_OP_MVN             THUMB_OP_ALU
+
+#define THUMB_OP_ADD_SPE         THUMB_OP_SPE
+#define THUMB_OP_CMP_SPE         THUMB_OP_SPE
+#define THUMB_OP_MOV_SPE         THUMB_OP_SPE
+
+#define THUMB_OP_ADJUST_P_SP     THUMB_OP_ADJUST_SP
+#define THUMB_OP_ADJUST_M_SP     THUMB_OP_ADJUST_SP
+
+#define THUMB_OP_LDRB_REG_OFF    THUMB_OP_MEMORY<true , 0, 0, true>
+#define THUMB_OP_LDRH_REG_OFF    THUMB_OP_MEMORY<true , 1, 0, true>
+#define THUMB_OP_LDR_REG_OFF     THUMB_OP_MEMORY<true , 2, 0, true>
+
+#define THUMB_OP_STRB_REG_OFF    THUMB_OP_MEMORY<false, 0, 0, true>
+#define THUMB_OP_STRH_REG_OFF    THUMB_OP_MEMORY<false, 1, 0, true>
+#define THUMB_OP_STR_REG_OFF     THUMB_OP_MEMORY<false, 2, 0, true>
+
+#define THUMB_OP_LDRB_IMM_OFF    THUMB_OP_MEMORY<true , 0, 0, false>
+#define THUMB_OP_LDRH_IMM_OFF    THUMB_OP_MEMORY<true , 1, 0, false>
+#define THUMB_OP_LDR_IMM_OFF     THUMB_OP_MEMORY<true , 2, 0, false>
+
+#define THUMB_OP_STRB_IMM_OFF    THUMB_OP_MEMORY<false, 0, 0, false>
+#define THUMB_OP_STRH_IMM_OFF    THUMB_OP_MEMORY<false, 1, 0, false>
+#define THUMB_OP_STR_IMM_OFF     THUMB_OP_MEMORY<false, 2, 0, false>
+
+#define THUMB_OP_LDRSB_REG_OFF   THUMB_OP_MEMORY<true , 0, 1, true>
+#define THUMB_OP_LDRSH_REG_OFF   THUMB_OP_MEMORY<true , 1, 1, true>
+
+#define THUMB_OP_BX_THUMB        THUMB_OP_BX_BLX_THUMB
+#define THUMB_OP_BLX_THUMB       THUMB_OP_BX_BLX_THUMB
+#define THUMB_OP_BL_10           THUMB_OP_BL_LONG
+#define THUMB_OP_BL_11           THUMB_OP_BL_LONG
+#define THUMB_OP_BLX             THUMB_OP_BL_LONG
+
+
+// UNDEFINED OPS
+#define THUMB_OP_PUSH            THUMB_OP_INTERPRET
+#define THUMB_OP_PUSH_LR         THUMB_OP_INTERPRET
+#define THUMB_OP_POP             THUMB_OP_INTERPRET
+#define THUMB_OP_POP_PC          THUMB_OP_INTERPRET
+#define THUMB_OP_BKPT_THUMB      THUMB_OP_INTERPRET
+#define THUMB_OP_STMIA_THUMB     THUMB_OP_INTERPRET
+#define THUMB_OP_LDMIA_THUMB     THUMB_OP_INTERPRET
+#define THUMB_OP_SWI_THUMB       THUMB_OP_INTERPRET
+
+static const ArmOpCompiler thumb_instruction_compilers[1024] = {
+#define TABDECL(x) THUMB_##x
+#include "thumb_tabdef.inc"
+#undef TABDECL
+};
+
+//-----------------------------------------------------------------------------
+//   Compiler
+//-----------------------------------------------------------------------------
+
+static u32 instr_attributes(bool thumb, u32 opcode)
+{
+   return thumb ? thumb_attributes[opcode>>6]
+                : instruction_attributes[INSTRUCTION_INDEX(opcode)];
+}
+
+static bool instr_is_branch(bool thumb, u32 opcode)
+{
+   u32 x = instr_attributes(thumb, opcode);
+   if(thumb)
+      return (x & BRANCH_ALWAYS)
+          || ((x & BRANCH_POS0) && ((opcode&7) | ((opcode>>4)&8)) == 15)
+          || (x & BRANCH_SWI)
+          || (x & JIT_BYPASS);
+   else
+      return (x & BRANCH_ALWAYS)
+          || ((x & BRANCH_POS12) && REG_POS(opcode,12) == 15)
+          || ((x & BRANCH_LDM) && BIT15(opcode))
+          || (x & BRANCH_SWI)
+          || (x & JIT_BYPASS);
+}
+
+template<int PROCNUM>
+static ArmOpCompiled compile_basicblock()
+{
+   block_procnum = PROCNUM;
+
+   const bool thumb = ARMPROC.CPSR.bits.T == 1;
+   const u32 base = ARMPROC.instruct_adr;
+   const u32 isize = thumb ? 2 : 4;
+
+   uint32_t pc = base;
+   bool compiled_op = true;
+   bool has_ended = false;
+   uint32_t constant_cycles = 0;
+
+   regman->reset();
+   emu_status_dirty = false;
+   block->push_frame();
+
+   block->load_constant64(RCPU, (uintptr_t)&ARMPROC);
+   block->load_constant(RCYC, 0);
+
+   load_status(9);
+
+   for (uint32_t i = 0; i < CommonSettings.jit_max_block_size && !has_ended; i ++, pc += isize)
+   {
+      uint32_t opcode = thumb ? _MMU_read16<PROCNUM, MMU_AT_CODE>(pc) : _MMU_read32<PROCNUM, MMU_AT_CODE>(pc);
+
+      ArmOpCompiler compiler = thumb ? thumb_instruction_compilers[opcode >> 6]
+                                     : arm_instruction_compilers[INSTRUCTION_INDEX(opcode)];
+
+      int result = compiler ? compiler(pc, opcode) : OPR_INTERPRET;
+
+      constant_cycles += OPR_RESULT_CYCLES(result);
+      switch (OPR_RESULT_ACTION(result))
+      {
+         case OPR_INTERPRET:
+         {
+            if (compiled_op)
+            {
+               arm_jit_prefetch<PROCNUM>(pc, opcode, thumb);
+               compiled_op = false;
+            }
+
+            regman->flush_all();
+            regman->reset();
+
+            block->load_constant64(0, (uintptr_t)&armcpu_exec<PROCNUM>);
+            call(0);
+            block->add(RCYC, RCYC, 0);
+
+            has_ended = has_ended || instr_is_branch(thumb, opcode);
+
+            break;
+         }
+
+         case OPR_BRANCHED:
+         {
+            has_ended = true;
+            compiled_op = false;
+            break;
+         }
+
+         case OPR_CONTINUE:
+         {
+            compiled_op = true;
+            break;
+         }
+      }
+   }
+
+   if (compiled_op)
+   {
+      block->load_constant(0, pc);
+      block->str(0, RCPU, offsetof(armcpu_t, instruct_adr));
+   }
+
+   write_status(9, 10);
+
+   regman->flush_all();
+   regman->reset();
+
+   block->load_constant(1, constant_cycles);
+   block->add(0, 1, RCYC);
+
+   block->pop_frame();
+   block->ret();
+
+   void* fn_ptr = block->fn_pointer();
+   JIT_COMPILED_FUNC(base, PROCNUM) = (uintptr_t)fn_ptr;
+   return (ArmOpCompiled)fn_ptr;
+}
+
+
+template<int PROCNUM> u32 arm_jit_compile()
+{
+   u32 adr = ARMPROC.instruct_adr;
+   u32 mask_adr = (adr & 0x07FFFFFE) >> 4;
+   if(((recompile_counts[mask_adr >> 1] >> 4*(mask_adr & 1)) & 0xF) > 8)
+   {
+      ArmOpCompiled f = op_decode[PROCNUM][ARMPROC.CPSR.bits.T];
+      JIT_COMPILED_FUNC(adr, PROCNUM) = (uintptr_t)f;
+      return f();
+   }
+
+   recompile_counts[mask_adr >> 1] += 1 << 4*(mask_adr & 1);
+
+   if (block->instructions_remaining() < 1000)
+   {
+      arm_jit_reset(true);
+   }
+
+   return compile_basicblock<PROCNUM>()();
+}
+
+template u32 arm_jit_compile<0>();
+template u32 arm_jit_compile<1>();
+
+void arm_jit_reset(bool enable, bool suppress_msg)
+{
+   if (!suppress_msg)
+	   printf("CPU mode: %s\n", enable?"JIT":"Interpreter");
+
+   saveBlockSizeJIT = CommonSettings.jit_max_block_size;
+
+   if (enable)
+   {
+      printf("JIT: max block size %d instruction(s)\n", CommonSettings.jit_max_block_size);
+
+      for(size_t i=0; i<sizeof(recompile_counts)/8; i++)
+         if(((u64*)recompile_counts)[i])
+         {
+            ((u64*)recompile_counts)[i] = 0;
+            memset(compiled_funcs+128*i, 0, 128*sizeof(*compiled_funcs));
+         }
+
+      delete block;
+      block = new code_pool(INSTRUCTION_COUNT);
+
+      delete regman;
+      regman = new register_manager(block);
+   }
+}
+
+void arm_jit_close()
+{
+   delete block;
+   block = 0;
+
+   delete regman;
+   regman = 0;
+}
+#endif // HAVE_JIT
@@ -0,0 +1,161 @@
+#ifndef ARM64_JIT_REG_MANAGER_H
+#define ARM64_JIT_REG_MANAGER_H
+
+#include <string.h>
+#include "arm64_gen.h"
+#include "armcpu.h"
+
+extern const arm64_gen::reg_t RCPU;
+
+// Every guest register has its own host register for the whole block, so
+// nothing is ever evicted. R0-R7, which Thumb code works on almost exclusively,
+// live in the callee saved x21-x28 and survive the calls into the memory
+// handlers untouched. R8-R15 live in caller saved registers, which are written
+// back before those calls and reloaded after them. The guest NZCV flags stay in
+// the host NZCV (see load_status/write_status in arm64_jit.cpp).
+//
+// A register is loaded the first time it's used and written back at the end of
+// the block, or before an op that has to be interpreted.
+class register_manager
+{
+   public:
+      register_manager(arm64_gen::code_pool* apool) : pool(apool)
+      {
+         reset();
+      }
+
+      void reset()
+      {
+         memset(loaded, 0, sizeof(loaded));
+         memset(dirty, 0, sizeof(dirty));
+         memset(weak, 0, sizeof(weak));
+      }
+
+      static arm64_gen::reg_t native_reg(uint32_t emu_reg_id)
+      {
+         static const uint8_t PIN_MAP[16] =
+         {
+            21, 22, 23, 24, 25, 26, 27, 28, // R0-R7   (callee saved)
+             4,  5,  6,  7,  8, 14, 15, 16  // R8-R15  (caller saved)
+         };
+
+         return PIN_MAP[emu_reg_id & 0xF];
+      }
+
+   private:
+      static uint32_t emu_reg(uint32_t native)
+      {
+         for (uint32_t i = 0; i != 16; i ++)
+         {
+            if (native_reg(i) == native)
+            {
+               return i;
+            }
+         }
+
+         assert(false);
+         return 0;
+      }
+
+   public:
+      // Bit 4 of an id means the op only writes the register, so its old value
+      // doesn't have to be loaded. The ids are replaced by the host registers.
+      void get(uint32_t reg_count, int32_t* emu_reg_ids)
+      {
+         assert(reg_count < 5);
+
+         for (uint32_t i = 0; i < reg_count; i ++)
+         {
+            if (emu_reg_ids[i] < 0)
+            {
+               continue;
+            }
+
+            const uint32_t emu = emu_reg_ids[i] & 0xF;
+            const bool no_read = (emu_reg_ids[i] & 0x10) ? true : false;
+
+            if (!loaded[emu])
+            {
+               if (!no_read)
+               {
+                  read_emu(native_reg(emu), emu);
+               }
+
+               loaded[emu] = true;
+               weak[emu] = no_read;
+            }
+            else if (weak[emu] && !no_read)
+            {
+               read_emu(native_reg(emu), emu);
+               weak[emu] = false;
+            }
+
+            emu_reg_ids[i] = native_reg(emu);
+         }
+      }
+
+      void mark_dirty(uint32_t native)
+      {
+         const uint32_t emu = emu_reg(native);
+         assert(loaded[emu]);
+
+         dirty[emu] = true;
+         weak[emu] = false;
+      }
+
+      void flush_all()
+      {
+         for (uint32_t i = 0; i != 16; i ++)
+         {
+            if (dirty[i] && !weak[i])
+            {
+               write_emu(native_reg(i), i);
+               dirty[i] = false;
+            }
+         }
+      }
+
+      // Around a call into C code. The dirty and loaded state is left as it is,
+      // as the call may sit behind a condition that skips it at run time.
+      void save_volatile()
+      {
+         for (uint32_t i = 8; i != 16; i ++)
+         {
+            if (dirty[i] && !weak[i])
+            {
+               write_emu(native_reg(i), i);
+            }
+         }
+      }
+
+      void restore_volatile()
+      {
+         for (uint32_t i = 8; i != 16; i ++)
+         {
+            if (loaded[i] && !weak[i])
+            {
+               read_emu(native_reg(i), i);
+            }
+         }
+      }
+
+   private:
+      void read_emu(arm64_gen::reg_t native, uint32_t emu)
+      {
+         pool->ldr(native, RCPU, offsetof(armcpu_t, R) + 4 * emu);
+      }
+
+      void write_emu(arm64_gen::reg_t native, uint32_t emu)
+      {
+         pool->str(native, RCPU, offsetof(armcpu_t, R) + 4 * emu);
+      }
+
+   private:
+      arm64_gen::code_pool* pool;
+
+      bool loaded[16];
+      bool dirty[16];
+      bool weak[16];
+};
+
+#endif
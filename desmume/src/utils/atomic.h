@@ -0,0 +1,56 @@
+/*
+	Copyright (C) 2009-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+#include "../types.h"
+
+//the few atomic operations needed for state shared with the helper threads (the 2d sub engine
+//task, the arm7 thread). loads acquire and stores release, so whatever was written before a
+//flag was set is visible to the thread that sees the flag. 64 bit values don't tear on 32 bit hosts.
+//plain loads and stores of types up to the host's word size only.
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+//volatile accesses are acquire and release with msvc's default /volatile:ms
+template<typename T> FORCEINLINE T atomic_load(volatile const T *p) { const T v = *p; _ReadWriteBarrier(); return v; }
+template<typename T> FORCEINLINE void atomic_store(volatile T *p, const T v) { _ReadWriteBarrier(); *p = v; }
+
+FORCEINLINE u64 atomic_load(volatile const u64 *p) { return (u64)_InterlockedCompareExchange64((volatile __int64 *)p, 0, 0); }
+FORCEINLINE u64 atomic_add64(volatile u64 *p, const u64 v)
+{
+	u64 old = atomic_load(p);
+	for (;;)
+	{
+		const u64 seen = (u64)_InterlockedCompareExchange64((volatile __int64 *)p, (__int64)(old + v), (__int64)old);
+		if (seen == old) return old;
+		old = seen;
+	}
+}
+
+#else
+
+template<typename T> FORCEINLINE T atomic_load(volatile const T *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+template<typename T> FORCEINLINE void atomic_store(volatile T *p, const T v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+FORCEINLINE u64 atomic_add64(volatile u64 *p, const u64 v) { return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL); }
+
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ysort.h"
+
+#include <string.h>
+#include <algorithm>
+
+//sort keys and scratch space for YSortPolys
+static CACHE_ALIGN u64 ysortKeys[2][POLYLIST_SIZE];
+static CACHE_ALIGN int ysortIndexes[POLYLIST_SIZE];
+
+//maps a float to a key whose unsigned order is the same as the float's order
+static FORCEINLINE u32 ysortFloatKey(const float f)
+{
+	u32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	//-0 and 0 have to compare equal
+	if (bits == 0x80000000)
+		bits = 0;
+
+	return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+//sorts a range of the index list by maxy, then miny.
+//this may be verified by checking the game create menus in harvest moon island of happiness
+//also the buttons in the knights in the nightmare frontend depend on this and the perspective division
+//notably, the main shop interface in harvest moon will not have a correct RTN button
+//i think this is due to a math error rounding its position to one pixel too high and it popping behind
+//the bar that it sits on.
+//
+//the game's ordering has to be respected in cases of complete ties, so this must be a stable sort
+//or else advance wars DOR will flicker in the main map mode. an LSD radix sort is stable, and the
+//indexes come in ascending order, so ties keep their order.
+void YSortPolys(int *indexes, const size_t count, const POLY *polys)
+{
+	size_t i;
+	size_t histogram[8][256];
+	u64 *keys = ysortKeys[0];
+	u64 *keysTemp = ysortKeys[1];
+	int *indexesIn = indexes;
+	int *indexesTemp = ysortIndexes;
+
+	if (count < 2)
+		return;
+
+	memset(histogram, 0, sizeof(histogram));
+
+	for (i = 0; i < count; i++)
+	{
+		const POLY &poly = polys[indexes[i]];
+		const u64 key = ((u64)ysortFloatKey(poly.maxy) << 32) | (u64)ysortFloatKey(poly.miny);
+		keys[i] = key;
+
+		for (size_t pass = 0; pass < 8; pass++)
+			histogram[pass][(key >> (pass * 8)) & 0xFF]++;
+	}
+
+	for (size_t pass = 0; pass < 8; pass++)
+	{
+		const size_t shift = pass * 8;
+		const size_t *passHistogram = histogram[pass];
+
+		//every key has the same digit here, so this pass wouldn't move anything
+		if (passHistogram[(keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset[256];
+		size_t total = 0;
+		for (size_t d = 0; d < 256; d++)
+		{
+			offset[d] = total;
+			total += passHistogram[d];
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			const size_t pos = offset[(keys[i] >> shift) & 0xFF]++;
+			keysTemp[pos] = keys[i];
+			indexesTemp[pos] = indexesIn[i];
+		}
+
+		std::swap(keys, keysTemp);
+		std::swap(indexesIn, indexesTemp);
+	}
+
+	if (indexesIn != indexes)
+		memcpy(indexes, indexesIn, count * sizeof(int));
+}
@@ -0,0 +1,28 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef YSORT_H
+#define YSORT_H
+
+#include "types.h"
+#include "gfx3d.h"
+
+//sorts count indexes into polys (at most POLYLIST_SIZE) by maxy, then miny, keeping the order of ties
+void YSortPolys(int *indexes, const size_t count, const POLY *polys);
+
+#endif
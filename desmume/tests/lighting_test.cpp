@@ -0,0 +1,211 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//checks that normals lit through the lighting cache come out the same as lighting them directly, and
+//that LightingApply matches the plain per-light formula, while the lights, the shininess table, the
+//light mask and the material change the way a game changes them. run with `make test`.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "lighting.h"
+
+static u32 rngState = 0x12345678;
+
+static u32 rngNext()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+//a fixed point component of a unit-ish vector, the range the normal and light direction commands produce
+static s32 randomComponent()
+{
+	return (s32)(rngNext() % 8193) - 4096;
+}
+
+static u32 lightColor[4];
+static CACHE_ALIGN s32 lightDirection[4][4];
+static CACHE_ALIGN s32 halfVector[4][4];
+static u8 shininessTable[128];
+static u32 lightMask;
+static u16 material[4];
+
+static LightingCache lightingCache;
+
+//the lighting formula one light and one color at a time, as the geometry engine describes it
+static void referenceLighting(const s32 *normal, u8 *color)
+{
+	for (size_t c = 0; c < 3; c++)
+	{
+		const size_t shift = c * 5;
+		const s32 diffuse = (material[0] >> shift) & 0x1F;
+		const s32 ambient = (material[1] >> shift) & 0x1F;
+		const s32 specular = (material[2] >> shift) & 0x1F;
+		s32 vertexColor = (material[3] >> shift) & 0x1F;
+
+		for (size_t i = 0; i < 4; i++)
+		{
+			if (!((lightMask >> i) & 1))
+				continue;
+
+			const s32 fixedDiffuse = std::max(0, -vec3dot_fixed32(lightDirection[i], normal));
+
+			const s32 negativeHalf[4] = { -halfVector[i][0], -halfVector[i][1], -halfVector[i][2], -halfVector[i][3] };
+			const s32 dot = vec3dot_fixed32(negativeHalf, normal);
+			s32 fixedShininess = (dot > 0) ? 2*mul_fixed32(dot, dot) - 4096 : 0;
+			fixedShininess = std::max(std::min(fixedShininess, 4095), 0);
+			if (material[2] & 0x8000)
+				fixedShininess = shininessTable[fixedShininess >> 5] << 4;
+
+			const s32 lightComp = (lightColor[i] >> shift) & 0x1F;
+			vertexColor += ((specular * lightComp * fixedShininess) >> 17) +
+			               ((diffuse * lightComp * fixedDiffuse) >> 17) +
+			               ((ambient * lightComp) >> 5);
+		}
+
+		color[c] = (u8)std::min(31, vertexColor);
+	}
+}
+
+static size_t failures = 0;
+
+static void compare(const char *name, const s32 *normal, const u8 *expected, const u8 *got)
+{
+	if (memcmp(expected, got, 3) == 0)
+		return;
+
+	if (failures++ < 16)
+	{
+		printf("%s mismatch for normal (%d, %d, %d), mask %X, material %04X %04X %04X %04X:\n",
+			name, (int)normal[0], (int)normal[1], (int)normal[2], (unsigned)lightMask,
+			material[0], material[1], material[2], material[3]);
+		printf("  expected %d %d %d got %d %d %d\n", expected[0], expected[1], expected[2], got[0], got[1], got[2]);
+	}
+}
+
+static void randomLight(const size_t i)
+{
+	lightColor[i] = rngNext() & 0x7FFF;
+	for (size_t n = 0; n < 3; n++)
+	{
+		lightDirection[i][n] = randomComponent();
+		halfVector[i][n] = randomComponent();
+	}
+	lightDirection[i][3] = 0;
+	halfVector[i][3] = 0;
+}
+
+int main()
+{
+	//the normals a few models would use, so most of them are seen again before anything changes
+	s32 normals[64][4];
+	for (size_t n = 0; n < 64; n++)
+	{
+		for (size_t i = 0; i < 3; i++)
+			normals[n][i] = randomComponent();
+		normals[n][3] = 1 << 12;
+	}
+
+	for (size_t i = 0; i < 4; i++)
+		randomLight(i);
+	for (size_t i = 0; i < 128; i++)
+		shininessTable[i] = (u8)rngNext();
+	lightMask = 0xF;
+	material[0] = 0x7FFF; material[1] = 0x0421; material[2] = 0x8000 | 0x294A; material[3] = 0;
+
+	size_t hits = 0;
+
+	for (size_t step = 0; step < 2000000; step++)
+	{
+		const u32 r = rngNext() % 1000;
+
+		//the light color, light direction and shininess commands invalidate the cache
+		if (r < 10)
+		{
+			lightColor[rngNext() & 3] = rngNext() & 0x7FFF;
+			lightingCache.invalidate();
+		}
+		else if (r < 20)
+		{
+			randomLight(rngNext() & 3);
+			lightingCache.invalidate();
+		}
+		else if (r < 25)
+		{
+			shininessTable[rngNext() & 127] = (u8)rngNext();
+			lightingCache.invalidate();
+		}
+		//the light mask and material are part of the key, so changing them doesn't
+		else if (r < 45)
+			lightMask = rngNext() & 0xF;
+		else if (r < 65)
+			material[rngNext() & 3] = (u16)rngNext();
+		else if (r < 66)
+			lightingCache.reset();
+		else
+		{
+			CACHE_ALIGN s32 normal[4];
+			if (r < 950)
+				memcpy(normal, normals[rngNext() & 63], sizeof(normal));
+			else
+			{
+				for (size_t i = 0; i < 3; i++)
+					normal[i] = randomComponent();
+				normal[3] = 1 << 12;
+			}
+
+			u8 memo[3];
+			u8 direct[3];
+			u8 reference[3];
+
+			//the same steps gfx3d_glNormal takes
+			if (lightingCache.lookup(normal, lightMask, material, memo))
+				hits++;
+			else
+			{
+				LightingApply(normal, lightMask, material, lightColor, lightDirection, halfVector, shininessTable, memo);
+				lightingCache.store(normal, lightMask, material, memo);
+			}
+
+			LightingApply(normal, lightMask, material, lightColor, lightDirection, halfVector, shininessTable, direct);
+			referenceLighting(normal, reference);
+
+			compare("cached", normal, direct, memo);
+			compare("LightingApply", normal, reference, direct);
+		}
+	}
+
+	if (hits == 0)
+	{
+		printf("the lighting cache never hit, so it wasn't checked\n");
+		return 1;
+	}
+
+	if (failures)
+	{
+		printf("%d mismatches\n", (int)failures);
+		return 1;
+	}
+
+	printf("cached lighting matches lighting every normal directly\n");
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+	Copyright (C) 2006-2007 shash
+	Copyright (C) 2007-2012 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//checks the SIMD fixed point matrix functions against the plain C ones, bit for bit,
+//over random values and the edge cases of the 20.12 format. run with `make test`.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "matrix.h"
+
+//matrix.cpp flags matrix stack overflows in MMU_new, which none of this reaches.
+//it only needs something to link against.
+unsigned char MMU_new[1 << 16];
+
+static const s32 edgeValues[] =
+{
+	0, 1, -1, 2, -2, 0xFFF, -0xFFF, 0x1000, -0x1000, 0x1001, -0x1001,
+	0x7FFF, -0x8000, 0x8000, 0xFFFF, 0x10000, -0x10000, 0x7FFFF, -0x80000,
+	0x3FFFFFFF, -0x40000000, 0x7FFFFFFE, 0x7FFFFFFF, -0x7FFFFFFF, (s32)0x80000000,
+};
+static const size_t edgeCount = sizeof(edgeValues) / sizeof(edgeValues[0]);
+
+static u32 rngState = 0x12345678;
+
+static u32 rngNext()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+//mixes full range values, ones in the range geometry commands use, and edge values
+static s32 randomValue()
+{
+	const u32 r = rngNext();
+
+	switch (r & 3)
+	{
+		case 0: return (s32)rngNext();
+		case 1: return (s32)rngNext() >> 12;
+		case 2: return (s32)(rngNext() & 0x1FFF) - 0x1000;
+		default: return edgeValues[(r >> 2) % edgeCount];
+	}
+}
+
+static size_t failures = 0;
+
+static void compare(const char *name, const char *path, const s32 *expected, const s32 *got, const size_t count)
+{
+	if (memcmp(expected, got, count * sizeof(s32)) == 0)
+		return;
+
+	if (failures++ < 16)
+	{
+		printf("%s (%s) mismatch:\n", name, path);
+		for (size_t i = 0; i < count; i++)
+			printf("  [%2d] expected %08X got %08X\n", (int)i, (u32)expected[i], (u32)got[i]);
+	}
+}
+
+static void checkOne(const char *path, const s32 *mtx, const s32 *vec, const s32 *rightMtx)
+{
+	s32 expected[16];
+	s32 got[16];
+
+	memcpy(expected, vec, 4 * sizeof(s32));
+	memcpy(got, vec, 4 * sizeof(s32));
+	_NOSIMD_MatrixMultVec4x4(mtx, expected);
+	MatrixMultVec4x4(mtx, got);
+	compare("MatrixMultVec4x4", path, expected, got, 4);
+
+	memcpy(expected, vec, 4 * sizeof(s32));
+	memcpy(got, vec, 4 * sizeof(s32));
+	_NOSIMD_MatrixMultVec3x3_fixed(mtx, expected);
+	MatrixMultVec3x3_fixed(mtx, got);
+	compare("MatrixMultVec3x3_fixed", path, expected, got, 4);
+
+	memcpy(expected, mtx, 16 * sizeof(s32));
+	memcpy(got, mtx, 16 * sizeof(s32));
+	_NOSIMD_MatrixMultiply(expected, rightMtx);
+	MatrixMultiply(got, rightMtx);
+	compare("MatrixMultiply", path, expected, got, 16);
+}
+
+static void checkPath(const char *path)
+{
+	s32 mtx[16];
+	s32 vec[4];
+	s32 rightMtx[16];
+
+	//every edge value against every other, in every lane
+	for (size_t a = 0; a < edgeCount; a++)
+	{
+		for (size_t b = 0; b < edgeCount; b++)
+		{
+			for (size_t i = 0; i < 16; i++)
+			{
+				mtx[i] = edgeValues[(a + i) % edgeCount];
+				rightMtx[i] = edgeValues[(b + i * 7) % edgeCount];
+			}
+			for (size_t i = 0; i < 4; i++)
+				vec[i] = edgeValues[(b + i * 3) % edgeCount];
+
+			checkOne(path, mtx, vec, rightMtx);
+
+			//the same values everywhere, so the sums overflow as far as they can
+			for (size_t i = 0; i < 16; i++)
+			{
+				mtx[i] = edgeValues[a];
+				rightMtx[i] = edgeValues[b];
+			}
+			for (size_t i = 0; i < 4; i++)
+				vec[i] = edgeValues[b];
+
+			checkOne(path, mtx, vec, rightMtx);
+		}
+	}
+
+	for (size_t n = 0; n < 200000; n++)
+	{
+		for (size_t i = 0; i < 16; i++)
+		{
+			mtx[i] = randomValue();
+			rightMtx[i] = randomValue();
+		}
+		for (size_t i = 0; i < 4; i++)
+			vec[i] = randomValue();
+
+		checkOne(path, mtx, vec, rightMtx);
+	}
+}
+
+int main()
+{
+#ifdef ENABLE_SSE2
+	const bool hasSSE41 = _fx32_MatrixUseSSE41;
+
+	_fx32_MatrixUseSSE41 = false;
+	checkPath("SSE2");
+
+	if (hasSSE41)
+	{
+		_fx32_MatrixUseSSE41 = true;
+		checkPath("SSE4.1");
+	}
+	else
+		printf("SSE4.1 isn't available here, only the SSE2 path was checked\n");
+#else
+	checkPath("default");
+#endif
+
+	if (failures)
+	{
+		printf("%d mismatches\n", (int)failures);
+		return 1;
+	}
+
+	printf("matrix functions match the plain C versions\n");
+	return 0;
+}
@@ -0,0 +1,154 @@
+/*
+	Copyright (C) 2006 yopyop
+	Copyright (C) 2008-2015 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//checks the radix y-sort against the std::stable_sort gfx3d_doFlush used before it, over poly lists
+//full of ties, signed zeroes, negative and infinite bounds. run with `make test`.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "ysort.h"
+
+static u32 rngState = 0x12345678;
+
+static u32 rngNext()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+static POLY polys[POLYLIST_SIZE];
+
+//the comparison gfx3d_doFlush sorted with before
+static bool ysortCompare(int num1, int num2)
+{
+	const POLY &poly1 = polys[num1];
+	const POLY &poly2 = polys[num2];
+
+	if (poly1.maxy != poly2.maxy)
+		return poly1.maxy < poly2.maxy;
+	if (poly1.miny != poly2.miny)
+		return poly1.miny < poly2.miny;
+
+	return num1 < num2;
+}
+
+static const float edgeValues[] =
+{
+	0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1e-30f, -1e-30f, 1e30f, -1e30f,
+	1.0e-45f, -1.0e-45f, (float)HUGE_VAL, -(float)HUGE_VAL,
+};
+static const size_t edgeCount = sizeof(edgeValues) / sizeof(edgeValues[0]);
+
+//a y bound, drawn from one of a few distributions so some lists are mostly ties and some have none
+static float randomBound(const u32 kind)
+{
+	const u32 r = rngNext();
+
+	switch (kind)
+	{
+		//a handful of values, lots of complete ties
+		case 0: return (float)(r % 4) * 0.25f;
+		//projected y the way gfx3d_ProjectVertsY makes it, mostly within the screen
+		case 1: return (float)((s32)(r % 4096) - 1024) / 2048.0f;
+		//neighbouring floats, differing only in the low bits
+		case 2: return 0.75f + (float)(r % 64) * 1e-7f;
+		//any mix of the above and the edge values
+		default:
+			switch (r & 3)
+			{
+				case 0: return edgeValues[(r >> 2) % edgeCount];
+				case 1: return (float)((s32)(rngNext() % 4096) - 1024) / 2048.0f;
+				case 2: return (float)(s32)rngNext() * 1e-3f;
+				default: return (float)((r >> 2) & 7) - 4.0f;
+			}
+	}
+}
+
+static size_t failures = 0;
+
+static void checkOne(const size_t polyCount, const u32 kind)
+{
+	static int expected[POLYLIST_SIZE];
+	static int got[POLYLIST_SIZE];
+
+	for (size_t i = 0; i < polyCount; i++)
+	{
+		polys[i].miny = randomBound(kind);
+		//every maxy the same some of the time, so only the miny half of the key moves anything
+		polys[i].maxy = (kind == 0 && (polyCount & 1)) ? 1.0f : randomBound(kind);
+	}
+
+	//gfx3d_doFlush sorts the opaque and translucent polys separately, each an ascending subset of the list
+	size_t count = 0;
+	const u32 keep = rngNext() & 3;
+	for (size_t i = 0; i < polyCount; i++)
+	{
+		if (keep == 0 || (rngNext() & 3) != 0)
+			expected[count++] = (int)i;
+	}
+	memcpy(got, expected, count * sizeof(int));
+
+	std::stable_sort(expected, expected + count, ysortCompare);
+	YSortPolys(got, count, polys);
+
+	if (memcmp(expected, got, count * sizeof(int)) == 0)
+		return;
+
+	if (failures++ < 16)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (expected[i] == got[i])
+				continue;
+
+			printf("%d polys, kind %d: first mismatch at [%d], expected poly %d (maxy %g miny %g) got poly %d (maxy %g miny %g)\n",
+				(int)count, (int)kind, (int)i,
+				expected[i], polys[expected[i]].maxy, polys[expected[i]].miny,
+				got[i], polys[got[i]].maxy, polys[got[i]].miny);
+			break;
+		}
+	}
+}
+
+int main()
+{
+	for (u32 kind = 0; kind < 4; kind++)
+	{
+		for (size_t polyCount = 0; polyCount < 64; polyCount++)
+			checkOne(polyCount, kind);
+
+		for (size_t n = 0; n < 500; n++)
+			checkOne(rngNext() % 2048, kind);
+
+		checkOne(POLYLIST_SIZE, kind);
+	}
+
+	if (failures)
+	{
+		printf("%d mismatches\n", (int)failures);
+		return 1;
+	}
+
+	printf("radix y-sort matches the stable sort\n");
+	return 0;
+}